@@ -655,120 +655,6 @@ Device::propagatePlugInfo() {
     return true;
 }
 
-uint8_t
-Device::getConfigurationIdSampleRate()
-{
-    ExtendedStreamFormatCmd extStreamFormatCmd( get1394Service() );
-    UnitPlugAddress unitPlugAddress( UnitPlugAddress::ePT_PCR, 0 );
-    extStreamFormatCmd.setPlugAddress( PlugAddress( PlugAddress::ePD_Input,
-                                                    PlugAddress::ePAM_Unit,
-                                                    unitPlugAddress ) );
-
-    extStreamFormatCmd.setNodeId( getNodeId() );
-    extStreamFormatCmd.setCommandType( AVCCommand::eCT_Status );
-    extStreamFormatCmd.setVerbose( getDebugLevel() );
-
-    if ( !extStreamFormatCmd.fire() ) {
-        debugError( "Stream format command failed\n" );
-        return 0;
-    }
-
-    FormatInformation* formatInfo =
-        extStreamFormatCmd.getFormatInformation();
-    FormatInformationStreamsCompound* compoundStream
-        = dynamic_cast< FormatInformationStreamsCompound* > (
-            formatInfo->m_streams );
-    if ( compoundStream ) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "Sample rate 0x%02x\n",
-                    compoundStream->m_samplingFrequency );
-        return compoundStream->m_samplingFrequency;
-    }
-
-    debugError( "Could not retrieve sample rate\n" );
-    return 0;
-}
-
-uint8_t
-Device::getConfigurationIdNumberOfChannel( PlugAddress::EPlugDirection ePlugDirection )
-{
-    ExtendedPlugInfoCmd extPlugInfoCmd( get1394Service() );
-    UnitPlugAddress unitPlugAddress( UnitPlugAddress::ePT_PCR,
-                                     0 );
-    extPlugInfoCmd.setPlugAddress( PlugAddress( ePlugDirection,
-                                                PlugAddress::ePAM_Unit,
-                                                unitPlugAddress ) );
-    extPlugInfoCmd.setNodeId( getNodeId() );
-    extPlugInfoCmd.setCommandType( AVCCommand::eCT_Status );
-    extPlugInfoCmd.setVerbose( getDebugLevel() );
-    ExtendedPlugInfoInfoType extendedPlugInfoInfoType(
-        ExtendedPlugInfoInfoType::eIT_NoOfChannels );
-    extendedPlugInfoInfoType.initialize();
-    extPlugInfoCmd.setInfoType( extendedPlugInfoInfoType );
-
-    if ( !extPlugInfoCmd.fire() ) {
-        debugError( "Number of channels command failed\n" );
-        return 0;
-    }
-
-    ExtendedPlugInfoInfoType* infoType = extPlugInfoCmd.getInfoType();
-    if ( infoType
-         && infoType->m_plugNrOfChns )
-    {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "Number of channels 0x%02x\n",
-                    infoType->m_plugNrOfChns->m_nrOfChannels );
-        return infoType->m_plugNrOfChns->m_nrOfChannels;
-    }
-
-    debugError( "Could not retrieve number of channels\n" );
-    return 0;
-}
-
-uint16_t
-Device::getConfigurationIdSyncMode()
-{
-    SignalSourceCmd signalSourceCmd( get1394Service() );
-    SignalUnitAddress signalUnitAddr;
-    signalUnitAddr.m_plugId = 0x01;
-    signalSourceCmd.setSignalDestination( signalUnitAddr );
-    signalSourceCmd.setNodeId( getNodeId() );
-    signalSourceCmd.setSubunitType( eST_Unit  );
-    signalSourceCmd.setSubunitId( 0xff );
-    signalSourceCmd.setVerbose( getDebugLevel() );
-
-    signalSourceCmd.setCommandType( AVCCommand::eCT_Status );
-
-    if ( !signalSourceCmd.fire() ) {
-        debugError( "Signal source command failed\n" );
-        return 0;
-    }
-
-    SignalAddress* pSyncPlugSignalAddress = signalSourceCmd.getSignalSource();
-    SignalSubunitAddress* pSyncPlugSubunitAddress
-        = dynamic_cast<SignalSubunitAddress*>( pSyncPlugSignalAddress );
-    if ( pSyncPlugSubunitAddress ) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "Sync mode 0x%02x\n",
-                    ( pSyncPlugSubunitAddress->m_subunitType << 3
-                      | pSyncPlugSubunitAddress->m_subunitId ) << 8
-                    | pSyncPlugSubunitAddress->m_plugId );
-
-        return ( pSyncPlugSubunitAddress->m_subunitType << 3
-                 | pSyncPlugSubunitAddress->m_subunitId ) << 8
-            | pSyncPlugSubunitAddress->m_plugId;
-    }
-
-    SignalUnitAddress* pSyncPlugUnitAddress
-      = dynamic_cast<SignalUnitAddress*>( pSyncPlugSignalAddress );
-    if ( pSyncPlugUnitAddress ) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "Sync mode 0x%02x\n",
-                      0xff << 8 | pSyncPlugUnitAddress->m_plugId );
-
-        return ( 0xff << 8 | pSyncPlugUnitAddress->m_plugId );
-    }
-
-    debugError( "Could not retrieve sync mode\n" );
-    return 0;
-}
-
 bool
 Device::needsRediscovery()
 {
@@ -777,18 +663,6 @@ Device::needsRediscovery()
     return getConfigurationId() != m_last_discovery_config_id;
 }
 
-uint64_t
-Device::getConfigurationId()
-{
-    // create a unique configuration id.
-    uint64_t id = 0;
-    id = getConfigurationIdSampleRate();
-    id |= getConfigurationIdNumberOfChannel( PlugAddress::ePD_Input ) << 8;
-    id |= getConfigurationIdNumberOfChannel( PlugAddress::ePD_Output ) << 16;
-    id |= ((uint64_t)getConfigurationIdSyncMode()) << 24;
-    return id;
-}
-
 bool
 Device::serialize( std::string basePath,
                      Util::IOSerialize& ser ) const
@@ -807,121 +681,14 @@ Device::deserialize( std::string basePath,
     return result;
 }
 
-std::string
-Device::getCachePath()
-{
-    std::string cachePath;
-    char* pCachePath;
-
-    string path = CACHEDIR;
-    if ( path.size() && path[0] == '~' ) {
-        path.erase( 0, 1 ); // remove ~
-        path.insert( 0, getenv( "HOME" ) ); // prepend the home path
-    }
-
-    if ( asprintf( &pCachePath, "%s/cache/",  path.c_str() ) < 0 ) {
-        debugError( "Could not create path string for cache pool (trying '/var/cache/libffado' instead)\n" );
-        cachePath = "/var/cache/libffado/";
-    } else {
-        cachePath = pCachePath;
-        free( pCachePath );
-    }
-    return cachePath;
-}
-
 bool
 Device::loadFromCache()
 {
-    std::string sDevicePath = getCachePath() + getConfigRom().getGuidString();
-
-    char* configId;
-    asprintf(&configId, "%016"PRIx64"", getConfigurationId() );
-    if ( !configId ) {
-        debugError( "could not create id string\n" );
-        return false;
-    }
-
-    std::string sFileName = sDevicePath + "/" + configId + ".xml";
-    free( configId );
-    debugOutput( DEBUG_LEVEL_NORMAL, "filename %s\n", sFileName.c_str() );
-
-    struct stat buf;
-    if ( stat( sFileName.c_str(), &buf ) != 0 ) {
-        debugOutput( DEBUG_LEVEL_NORMAL,  "\"%s\" does not exist\n",  sFileName.c_str() );
-        return false;
-    } else {
-        if ( !S_ISREG( buf.st_mode ) ) {
-            debugOutput( DEBUG_LEVEL_NORMAL,  "\"%s\" is not a regular file\n",  sFileName.c_str() );
-            return false;
-        }
-    }
-
-    Util::XMLDeserialize deser( sFileName, getDebugLevel() );
-
-    if (!deser.isValid()) {
-        debugOutput( DEBUG_LEVEL_NORMAL, "cache not valid: %s\n",
-                     sFileName.c_str() );
-        return false;
-    }
-
-    bool result = deserialize( "", deser );
-    if ( result ) {
-        debugOutput( DEBUG_LEVEL_NORMAL, "could create valid bebob driver from %s\n",
-                     sFileName.c_str() );
-    }
-
-    if(result) {
-        buildMixer();
-    }
-
-    return result;
-}
-
-bool
-Device::saveCache()
-{
-    // the path looks like this:
-    // PATH_TO_CACHE + GUID + CONFIGURATION_ID
-    string tmp_path = getCachePath() + getConfigRom().getGuidString();
-
-    // the following piece should do something like
-    // 'mkdir -p some/path/with/some/dirs/which/do/not/exist'
-    vector<string> tokens;
-    tokenize( tmp_path, tokens, "/" );
-    string path;
-    for ( vector<string>::const_iterator it = tokens.begin();
-          it != tokens.end();
-          ++it )
-    {
-        path +=  "/" + *it;
-
-        struct stat buf;
-        if ( stat( path.c_str(), &buf ) == 0 ) {
-            if ( !S_ISDIR( buf.st_mode ) ) {
-                debugError( "\"%s\" is not a directory\n",  path.c_str() );
-                return false;
-            }
-        } else {
-            if (  mkdir( path.c_str(), S_IRWXU | S_IRWXG ) != 0 ) {
-                debugError( "Could not create \"%s\" directory\n", path.c_str() );
-                return false;
-            }
-        }
-    }
-
-    // come up with an unique file name for the current settings
-    char* configId;
-    asprintf(&configId, "%016"PRIx64"", BeBoB::Device::getConfigurationId() );
-    if ( !configId ) {
-        debugError( "Could not create id string\n" );
+    if ( !FFADODevice::loadFromCache() ) {
         return false;
     }
-    string filename = path + "/" + configId + ".xml";
-    free( configId );
-    debugOutput( DEBUG_LEVEL_NORMAL, "filename %s\n", filename.c_str() );
-
-    Util::XMLSerialize ser( filename );
-    return serialize( "", ser );
+    debugOutput( DEBUG_LEVEL_NORMAL, "could create valid bebob driver from cache\n" );
+    return buildMixer();
 }
 
 } // end of namespace
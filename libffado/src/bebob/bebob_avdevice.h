@@ -65,7 +65,6 @@ public:
 
     static bool probe( Util::Configuration&, ConfigRom& configRom, bool generic = false );
     virtual bool loadFromCache();
-    virtual bool saveCache();
     virtual bool discover();
 
     static FFADODevice * createDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ));
@@ -116,16 +115,9 @@ public:
     virtual bool serialize( std::string basePath, Util::IOSerialize& ser ) const;
     virtual bool deserialize( std::string basePath, Util::IODeserialize& deser );
 
-    virtual uint64_t getConfigurationId();
     virtual bool needsRediscovery();
 
-    std::string getCachePath();
-
 protected:
-    virtual uint8_t getConfigurationIdSampleRate();
-    virtual uint8_t getConfigurationIdNumberOfChannel( AVC::PlugAddress::EPlugDirection ePlugDirection );
-    virtual uint16_t getConfigurationIdSyncMode();
-
     std::vector<int> m_supported_frequencies;
     uint64_t         m_last_discovery_config_id;
 
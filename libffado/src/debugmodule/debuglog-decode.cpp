@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Decodes a binary debug log written with FFADO_DEBUG_BINLOG=<file>
+ */
+
+#include "debuglog.h"
+#include "config_debug.h"
+
+#include <argp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <map>
+#include <string>
+
+////////////////////////////////////////////////
+// arg parsing
+////////////////////////////////////////////////
+const char *argp_program_version = "ffado-debuglog-decode 0.1";
+const char *argp_program_bug_address = "<ffado-devel@lists.sf.net>";
+static char doc[] = "ffado-debuglog-decode -- formats a binary FFADO debug log.\n\n"
+                    "The log is written by any FFADO program that runs with the "
+                    "FFADO_DEBUG_BINLOG environment variable set to a file name.";
+static char args_doc[] = "FILE";
+static struct argp_option options[] = {
+    {"level",   'l', "level",   0,  "Only show messages up to this debug level" },
+    {"no-prefix", 'n', 0,       0,  "Don't print the timestamp and location prefix" },
+    { 0 }
+};
+
+struct arguments
+{
+    arguments()
+        : file( NULL )
+        , level( -1 )
+        , no_prefix( false )
+        {}
+
+    char* file;
+    long int level;
+    bool  no_prefix;
+} arguments;
+
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    struct arguments* arguments = ( struct arguments* ) state->input;
+
+    char* tail;
+    errno = 0;
+    switch (key) {
+    case 'l':
+        arguments->level = strtol( arg, &tail, 0 );
+        if ( errno ) {
+            fprintf( stderr,  "Could not parse 'level' argument\n" );
+            return ARGP_ERR_UNKNOWN;
+        }
+        break;
+    case 'n':
+        arguments->no_prefix = true;
+        break;
+    case ARGP_KEY_ARG:
+        if (arguments->file) {
+            argp_usage (state);
+        }
+        arguments->file = arg;
+        break;
+    case ARGP_KEY_END:
+        if (arguments->file == NULL) {
+            argp_usage (state);
+        }
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+// the text output without the color sequences
+static const char *levelNames[] = {
+    "", "Fatal", "Error", "Warning", "Debug",
+};
+
+typedef std::map<uint64_t, std::string> StringMap;
+
+static const char *
+lookup( StringMap &strings, uint64_t id )
+{
+    StringMap::iterator it = strings.find(id);
+    if (it == strings.end()) {
+        return NULL;
+    }
+    return it->second.c_str();
+}
+
+int
+main( int argc, char **argv )
+{
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        return -1;
+    }
+
+    FILE *f = fopen(arguments.file, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", arguments.file, strerror(errno));
+        return -1;
+    }
+
+    struct DebugLogFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+        || memcmp(hdr.magic, DEBUGLOG_FILE_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "%s is not a FFADO debug log\n", arguments.file);
+        fclose(f);
+        return -1;
+    }
+    if (hdr.version != DEBUGLOG_FILE_VERSION
+        || hdr.record_size != sizeof(struct DebugLogRecord)) {
+        fprintf(stderr, "%s: unsupported log version %u (record size %u)\n",
+                arguments.file, hdr.version, hdr.record_size);
+        fclose(f);
+        return -1;
+    }
+
+    StringMap strings;
+    unsigned int nb_records = 0;
+    unsigned int nb_dropped = 0;
+    char msg[DEBUG_MAX_MESSAGE_LENGTH];
+    uint32_t type;
+    int retval = 0;
+
+    while (fread(&type, sizeof(type), 1, f) == 1) {
+        if (type == eDLE_String) {
+            uint64_t id;
+            uint32_t len;
+            if (fread(&id, sizeof(id), 1, f) != 1
+                || fread(&len, sizeof(len), 1, f) != 1) {
+                break;
+            }
+            std::string s(len, 0);
+            if (len && fread(&s[0], len, 1, f) != 1) {
+                break;
+            }
+            strings[id] = s;
+        } else if (type == eDLE_Record) {
+            struct DebugLogRecord r;
+            if (fread(&r, sizeof(r), 1, f) != 1) {
+                break;
+            }
+            nb_records++;
+            if (arguments.level >= 0 && r.level > arguments.level) {
+                continue;
+            }
+            const char *format = lookup(strings, r.format);
+            if (format == NULL) {
+                fprintf(stderr, "record %u refers to an unknown format\n", nb_records);
+                continue;
+            }
+            if (!(r.flags & DEBUGLOG_FLAG_SHORT) && !arguments.no_prefix) {
+                const char *file = lookup(strings, r.file);
+                const char *function = lookup(strings, r.function);
+                const char *fname = (file ? strrchr(file, '/') : NULL);
+                fname = (fname ? fname + 1 : file);
+                int level = r.level;
+                if (level < 0 || level > 4) level = 4;
+                printf("%011" PRIu64 ": %s (%s)[%4u] %s: ", r.timestamp,
+                       levelNames[level], (fname ? fname : "?"),
+                       r.line, (function ? function : "?"));
+            }
+            debuglogFormat(msg, sizeof(msg), format, &r);
+            fputs(msg, stdout);
+        } else if (type == eDLE_Dropped) {
+            uint32_t entry[2];
+            if (fread(entry, sizeof(entry), 1, f) != 1) {
+                break;
+            }
+            nb_dropped += entry[1];
+            if (entry[0] == 0xFFFFFFFF) {
+                printf("WARNING: %u messages dropped, no free thread slot\n", entry[1]);
+            } else {
+                printf("WARNING: %u messages of thread slot %u dropped\n", entry[1], entry[0]);
+            }
+        } else {
+            fprintf(stderr, "Corrupt entry (type %u) at offset %ld\n",
+                    type, ftell(f) - (long)sizeof(type));
+            retval = -1;
+            break;
+        }
+    }
+
+    fclose(f);
+    fprintf(stderr, "%u records, %u messages dropped\n", nb_records, nb_dropped);
+    return retval;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "debuglog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define DEBUGLOG_NULL_STRING    0xFFFFFFFFFFFFFFFFULL
+
+enum eLength {
+    eL_None,
+    eL_hh,
+    eL_h,
+    eL_l,
+    eL_ll,
+    eL_L,
+    eL_j,
+    eL_z,
+    eL_t,
+};
+
+struct ConversionSpec {
+    const char *start;      // the '%'
+    const char *length;     // first character of the length modifier
+    const char *end;        // one past the conversion character
+    int         nb_stars;   // '*' width and precision
+    enum eLength length_type;
+    char        conversion;
+};
+
+/*
+ * Parses the conversion specification starting at p ('%')
+ */
+static bool
+parseSpec( const char *p, struct ConversionSpec *s )
+{
+    s->start = p++;
+    s->nb_stars = 0;
+    s->length_type = eL_None;
+
+    if (*p == '%') {
+        s->length = p;
+        s->conversion = '%';
+        s->end = p + 1;
+        return true;
+    }
+    while (*p && strchr("-+ #0'", *p)) p++;
+    if (*p == '*') {
+        s->nb_stars++;
+        p++;
+    } else {
+        while (isdigit(*p)) p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            s->nb_stars++;
+            p++;
+        } else {
+            while (isdigit(*p)) p++;
+        }
+    }
+
+    s->length = p;
+    switch (*p) {
+        case 'h':
+            if (p[1] == 'h') {s->length_type = eL_hh; p += 2;}
+            else {s->length_type = eL_h; p++;}
+            break;
+        case 'l':
+            if (p[1] == 'l') {s->length_type = eL_ll; p += 2;}
+            else {s->length_type = eL_l; p++;}
+            break;
+        case 'q': s->length_type = eL_ll; p++; break;
+        case 'L': s->length_type = eL_L; p++; break;
+        case 'j': s->length_type = eL_j; p++; break;
+        case 'z': s->length_type = eL_z; p++; break;
+        case 't': s->length_type = eL_t; p++; break;
+        default: break;
+    }
+    if (*p == 0) {
+        return false;
+    }
+    s->conversion = *p;
+    s->end = p + 1;
+    return true;
+}
+
+static uint64_t
+getSigned( enum eLength l, va_list *ap )
+{
+    // char and short arguments are promoted to int, printf converts
+    // them back before printing
+    switch (l) {
+        case eL_hh: return (int64_t)(signed char)va_arg(*ap, int);
+        case eL_h:  return (int64_t)(short)va_arg(*ap, int);
+        case eL_l:  return (int64_t)va_arg(*ap, long);
+        case eL_ll:
+        case eL_L:  return (int64_t)va_arg(*ap, long long);
+        case eL_j:  return (int64_t)va_arg(*ap, intmax_t);
+        case eL_z:  return (int64_t)va_arg(*ap, ssize_t);
+        case eL_t:  return (int64_t)va_arg(*ap, ptrdiff_t);
+        default:    return (int64_t)va_arg(*ap, int);
+    }
+}
+
+static uint64_t
+getUnsigned( enum eLength l, va_list *ap )
+{
+    switch (l) {
+        case eL_hh: return (unsigned char)va_arg(*ap, unsigned int);
+        case eL_h:  return (unsigned short)va_arg(*ap, unsigned int);
+        case eL_l:  return va_arg(*ap, unsigned long);
+        case eL_ll:
+        case eL_L:  return va_arg(*ap, unsigned long long);
+        case eL_j:  return va_arg(*ap, uintmax_t);
+        case eL_z:  return va_arg(*ap, size_t);
+        case eL_t:  return va_arg(*ap, ptrdiff_t);
+        default:    return va_arg(*ap, unsigned int);
+    }
+}
+
+void
+debuglogCapture( struct DebugLogRecord *r, const char *format, va_list arg )
+{
+    va_list ap;
+    va_copy(ap, arg);
+
+    unsigned int pool_used = 0;
+    r->nb_args = 0;
+
+    const char *p = format;
+    while ((p = strchr(p, '%'))) {
+        struct ConversionSpec s;
+        if (!parseSpec(p, &s)) {
+            break;
+        }
+        p = s.end;
+        if (s.conversion == '%') {
+            continue;
+        }
+        if (r->nb_args + s.nb_stars + 1 > DEBUGLOG_MAX_ARGS) {
+            r->flags |= DEBUGLOG_FLAG_TRUNCATED;
+            break;
+        }
+        for (int i = 0; i < s.nb_stars; i++) {
+            r->args[r->nb_args++] = (int64_t)va_arg(ap, int);
+        }
+
+        uint64_t v;
+        switch (s.conversion) {
+            case 'd': case 'i':
+                v = getSigned(s.length_type, &ap);
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                v = getUnsigned(s.length_type, &ap);
+                break;
+            case 'c':
+                v = va_arg(ap, int);
+                break;
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A': {
+                double d;
+                if (s.length_type == eL_L) {
+                    d = va_arg(ap, long double);
+                } else {
+                    d = va_arg(ap, double);
+                }
+                memcpy(&v, &d, sizeof(v));
+                break;
+            }
+            case 's': {
+                const char *str = va_arg(ap, const char *);
+                if (str == NULL) {
+                    v = DEBUGLOG_NULL_STRING;
+                    break;
+                }
+                // strings are copied, the caller's buffer might be gone
+                // by the time the record is formatted
+                unsigned int room = DEBUGLOG_STRING_POOL - pool_used;
+                unsigned int len = strnlen(str, room);
+                if (len == room) {
+                    r->flags |= DEBUGLOG_FLAG_TRUNCATED;
+                    if (room == 0) {
+                        v = DEBUGLOG_NULL_STRING;
+                        break;
+                    }
+                    len = room - 1;
+                }
+                memcpy(r->strings + pool_used, str, len);
+                r->strings[pool_used + len] = 0;
+                v = pool_used;
+                pool_used += len + 1;
+                break;
+            }
+            case 'p':
+                v = (uintptr_t)va_arg(ap, void *);
+                break;
+            case 'n':
+                // never write through the pointer, just skip it
+                va_arg(ap, void *);
+                continue;
+            default:
+                // not supported, the rest of the arguments is lost
+                r->flags |= DEBUGLOG_FLAG_TRUNCATED;
+                va_end(ap);
+                return;
+        }
+        r->args[r->nb_args++] = v;
+    }
+    va_end(ap);
+}
+
+template <typename T>
+static int
+formatOne( char *buff, size_t len, const char *spec,
+           int nb_stars, const uint64_t *stars, T value )
+{
+    switch (nb_stars) {
+        case 0:
+            return snprintf(buff, len, spec, value);
+        case 1:
+            return snprintf(buff, len, spec, (int)stars[0], value);
+        default:
+            return snprintf(buff, len, spec, (int)stars[0], (int)stars[1], value);
+    }
+}
+
+/*
+ * appends n characters to the output, keeping snprintf semantics
+ */
+static void
+append( char *buff, size_t len, size_t *pos, const char *s, size_t n )
+{
+    if (*pos < len) {
+        size_t room = len - *pos - 1;
+        memcpy(buff + *pos, s, (n < room ? n : room));
+    }
+    *pos += n;
+}
+
+int
+debuglogFormat( char *buff, size_t len, const char *format,
+                const struct DebugLogRecord *r )
+{
+    size_t pos = 0;
+    unsigned int argidx = 0;
+    bool args_done = false;
+    const char *p = format;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    while (*p) {
+        const char *next = strchr(p, '%');
+        if (next == NULL) {
+            append(buff, len, &pos, p, strlen(p));
+            break;
+        }
+        append(buff, len, &pos, p, next - p);
+
+        struct ConversionSpec s;
+        if (!parseSpec(next, &s)) {
+            append(buff, len, &pos, next, strlen(next));
+            break;
+        }
+        p = s.end;
+        if (s.conversion == '%') {
+            append(buff, len, &pos, "%", 1);
+            continue;
+        }
+        if (s.conversion == 'n') {
+            continue;
+        }
+        if (args_done || argidx + s.nb_stars + 1 > r->nb_args) {
+            // print what is left as is
+            args_done = true;
+            append(buff, len, &pos, s.start, s.end - s.start);
+            continue;
+        }
+
+        // rebuild the specification with a length modifier that
+        // matches the 64 bit argument storage
+        char spec[32];
+        size_t prefix = s.length - s.start;
+        if (prefix > sizeof(spec) - 4) {
+            args_done = true;
+            append(buff, len, &pos, s.start, s.end - s.start);
+            continue;
+        }
+        memcpy(spec, s.start, prefix);
+
+        const uint64_t *stars = r->args + argidx;
+        uint64_t v = r->args[argidx + s.nb_stars];
+        argidx += s.nb_stars + 1;
+
+        char tmp[256];
+        int n;
+        switch (s.conversion) {
+            case 'd': case 'i':
+            case 'u': case 'o': case 'x': case 'X':
+                spec[prefix] = 'l';
+                spec[prefix + 1] = 'l';
+                spec[prefix + 2] = s.conversion;
+                spec[prefix + 3] = 0;
+                if (s.conversion == 'd' || s.conversion == 'i') {
+                    n = formatOne(tmp, sizeof(tmp), spec, s.nb_stars, stars, (long long)v);
+                } else {
+                    n = formatOne(tmp, sizeof(tmp), spec, s.nb_stars, stars, (unsigned long long)v);
+                }
+                break;
+            case 'c':
+                spec[prefix] = 'c';
+                spec[prefix + 1] = 0;
+                n = formatOne(tmp, sizeof(tmp), spec, s.nb_stars, stars, (int)v);
+                break;
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A': {
+                double d;
+                memcpy(&d, &v, sizeof(d));
+                spec[prefix] = s.conversion;
+                spec[prefix + 1] = 0;
+                n = formatOne(tmp, sizeof(tmp), spec, s.nb_stars, stars, d);
+                break;
+            }
+            case 's': {
+                const char *str = "(null)";
+                if (v != DEBUGLOG_NULL_STRING && v < DEBUGLOG_STRING_POOL) {
+                    str = r->strings + v;
+                }
+                spec[prefix] = 's';
+                spec[prefix + 1] = 0;
+                n = formatOne(tmp, sizeof(tmp), spec, s.nb_stars, stars, str);
+                break;
+            }
+            case 'p':
+                spec[prefix] = 'p';
+                spec[prefix + 1] = 0;
+                n = formatOne(tmp, sizeof(tmp), spec, s.nb_stars, stars, (void *)(uintptr_t)v);
+                break;
+            default:
+                args_done = true;
+                append(buff, len, &pos, s.start, s.end - s.start);
+                continue;
+        }
+        if (n > 0) {
+            append(buff, len, &pos, tmp, ((size_t)n < sizeof(tmp) ? (size_t)n : sizeof(tmp) - 1));
+        }
+    }
+
+    if (r->flags & DEBUGLOG_FLAG_TRUNCATED) {
+        const char *warning = " [arguments truncated]\n";
+        append(buff, len, &pos, warning, strlen(warning));
+    }
+
+    buff[(pos < len ? pos : len - 1)] = 0;
+    return pos;
+}
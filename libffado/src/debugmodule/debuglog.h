@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DEBUGLOG_H
+#define DEBUGLOG_H
+
+/*
+ * Binary debug records
+ *
+ * Instead of formatting a message on the calling thread, the binary
+ * log mode stores the format string pointer, a timestamp and the raw
+ * arguments in a fixed size record. Formatting is done later, either
+ * by the low priority log thread or offline by ffado-debuglog-decode.
+ *
+ * The log file is a header followed by tagged entries, in host byte
+ * order. Strings (formats, file and function names) are written once,
+ * the first time they are referenced, and are identified by their
+ * address in the logging process.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEBUGLOG_FILE_MAGIC         "FFDBLOG1"
+#define DEBUGLOG_FILE_VERSION       1
+
+// max number of arguments stored per message
+#define DEBUGLOG_MAX_ARGS           12
+// bytes reserved for copies of the string arguments
+#define DEBUGLOG_STRING_POOL        120
+
+// record flags
+#define DEBUGLOG_FLAG_SHORT         0x01 // printShort(), no prefix
+#define DEBUGLOG_FLAG_TRUNCATED     0x02 // arguments did not fit
+
+enum eDebugLogEntryType {
+    eDLE_String     = 1, // uint64 id, uint32 length, characters
+    eDLE_Record     = 2, // a DebugLogRecord
+    eDLE_Dropped    = 3, // uint32 thread slot, uint32 messages dropped
+};
+
+struct DebugLogFileHeader {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    record_size;
+};
+
+struct DebugLogRecord {
+    uint64_t    timestamp;  // usecs, as in the text prefix
+    uint64_t    format;
+    uint64_t    file;
+    uint64_t    function;
+    uint32_t    line;
+    int16_t     level;
+    uint8_t     flags;
+    uint8_t     nb_args;
+    // integers, doubles (bit copied) and pool offsets for strings
+    uint64_t    args[DEBUGLOG_MAX_ARGS];
+    char        strings[DEBUGLOG_STRING_POOL];
+};
+
+/**
+ * Stores the arguments described by format in the record. Only walks
+ * the conversion specifications, does not format anything.
+ */
+void debuglogCapture( struct DebugLogRecord *r, const char *format, va_list arg );
+
+/**
+ * Formats the message of a record captured with debuglogCapture().
+ * @param format the format string the record was captured with
+ * @return the number of characters written, as snprintf
+ */
+int debuglogFormat( char *buff, size_t len, const char *format,
+                    const struct DebugLogRecord *r );
+
+#endif
@@ -34,6 +34,13 @@
 #include <string.h>
 #include <errno.h>
 
+#if DEBUG_BINLOG_SUPPORT
+    #include "debuglog.h"
+    #include "libutil/Atomic.h"
+    #include <stdlib.h>
+    #include <unistd.h>
+#endif
+
 #if DEBUG_BACKTRACE_SUPPORT
     #include <execinfo.h>
     #include <cxxabi.h>
@@ -111,6 +118,20 @@ DebugModule::printShort( debug_level_t level,
     }
 #endif
 
+#if DEBUG_BINLOG_SUPPORT
+    // the binary log defers the formatting, it does not feed the backlog
+    if ( DebugModuleManager::instance()->debuglogActive() ) {
+        if ( level <= m_level ) {
+            va_list arg;
+            va_start( arg, format );
+            DebugModuleManager::instance()->debuglog_record(
+                level, DEBUGLOG_FLAG_SHORT, NULL, NULL, 0, format, arg );
+            va_end( arg );
+        }
+        return;
+    }
+#endif
+
     const char *warning = "WARNING: message truncated!\n";
     const int warning_size = 32;
     va_list arg;
@@ -165,6 +186,19 @@ DebugModule::print( debug_level_t level,
     }
 #endif
 
+#if DEBUG_BINLOG_SUPPORT
+    if ( DebugModuleManager::instance()->debuglogActive() ) {
+        if ( level <= m_level ) {
+            va_list arg;
+            va_start( arg, format );
+            DebugModuleManager::instance()->debuglog_record(
+                level, 0, file, function, line, format, arg );
+            va_end( arg );
+        }
+        return;
+    }
+#endif
+
     const char *warning = "WARNING: message truncated!\n";
     const int warning_size = 32;
 
@@ -259,6 +293,15 @@ DebugModuleManager::DebugModuleManager()
 #if DEBUG_BACKLOG_SUPPORT
     , bl_mb_inbuffer(0)
 #endif
+#if DEBUG_BINLOG_SUPPORT
+    , dl_rings(NULL)
+    , dl_active(false)
+    , dl_running(false)
+    , dl_dropped_nothread(0)
+    , dl_dropped_nothread_seen(0)
+    , dl_dropped_total(0)
+    , dl_file(NULL)
+#endif
 {
 
 }
@@ -272,6 +315,10 @@ DebugModuleManager::~DebugModuleManager()
         unregisterModule(*mod);
     }
 
+#if DEBUG_BINLOG_SUPPORT
+    debuglog_stop();
+#endif
+
     if (!mb_initialized)
         return;
 
@@ -430,6 +477,14 @@ DebugModuleManager::init()
     #endif
 #endif
 
+#if DEBUG_BINLOG_SUPPORT
+    const char *binlog = getenv("FFADO_DEBUG_BINLOG");
+    if (binlog && *binlog) {
+        // not fatal, the text output still works
+        debuglog_init(binlog);
+    }
+#endif
+
     return true;
 }
 
@@ -517,6 +572,11 @@ DebugModuleManager::setMgrDebugLevel( std::string name, debug_level_t level )
 void
 DebugModuleManager::flush()
 {
+#if DEBUG_BINLOG_SUPPORT
+    if (dl_active) {
+        debuglog_drain();
+    }
+#endif
 #if DEBUG_USE_MESSAGE_BUFFER
     mb_flush();
 #else
@@ -673,6 +733,340 @@ DebugModuleManager::print(const char *msg)
 #endif
 }
 
+#if DEBUG_BINLOG_SUPPORT
+enum eDebugLogRingState {
+    eDLR_Free       = 0,
+    eDLR_Used       = 1,
+    eDLR_Released   = 2, // the owner thread has exited
+};
+
+/*
+ * One ring per logging thread. The owner thread only writes the head,
+ * the log thread only writes the tail, so no locks are needed.
+ */
+struct DebugModuleManager::DebugLogRing {
+    volatile int32_t    state;
+    volatile uint32_t   head;
+    volatile uint32_t   dropped;
+
+    volatile uint32_t   tail __attribute__((aligned(64)));
+    uint32_t            dropped_seen;
+
+    struct DebugLogRecord records[DEBUG_BINLOG_RECORDS] __attribute__((aligned(64)));
+};
+
+bool
+DebugModuleManager::debuglog_init(const char *target)
+{
+    if (strcmp(target, "-") != 0) {
+        dl_file = fopen(target, "wb");
+        if (dl_file == NULL) {
+            fprintf(stderr, "Cannot open debug log file %s: %s\n", target, strerror(errno));
+            return false;
+        }
+        struct DebugLogFileHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, DEBUGLOG_FILE_MAGIC, sizeof(hdr.magic));
+        hdr.version = DEBUGLOG_FILE_VERSION;
+        hdr.record_size = sizeof(struct DebugLogRecord);
+        fwrite(&hdr, sizeof(hdr), 1, dl_file);
+    }
+
+    void *rings;
+    size_t size = DEBUG_BINLOG_THREADS * sizeof(struct DebugLogRing);
+    if (posix_memalign(&rings, 64, size)) {
+        fprintf(stderr, "Cannot allocate debug log rings\n");
+        goto err_file;
+    }
+    memset(rings, 0, size);
+    dl_rings = (struct DebugLogRing *)rings;
+
+    int res;
+    if ((res = pthread_key_create(&dl_key, debuglog_thread_exit))) {
+        fprintf(stderr, "Cannot create debug log thread key: %s (%d)\n", strerror(res), res);
+        goto err_rings;
+    }
+    pthread_mutex_init(&dl_drain_lock, NULL);
+
+    // formatting and writing should not compete with the RT threads
+    pthread_attr_t attributes;
+    struct sched_param param;
+    pthread_attr_init(&attributes);
+    pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attributes, SCHED_OTHER);
+    memset(&param, 0, sizeof(param));
+    pthread_attr_setschedparam(&attributes, &param);
+
+    dl_running = true;
+    res = pthread_create(&dl_thread, &attributes, debuglog_thread_func, (void *)this);
+    pthread_attr_destroy(&attributes);
+    if (res) {
+        fprintf(stderr, "Cannot create debug log thread: %s (%d)\n", strerror(res), res);
+        dl_running = false;
+        pthread_mutex_destroy(&dl_drain_lock);
+        pthread_key_delete(dl_key);
+        goto err_rings;
+    }
+
+    // the manager is never deleted, empty the rings on exit
+    atexit(debuglog_atexit);
+    dl_active = true;
+    return true;
+
+err_rings:
+    free(dl_rings);
+    dl_rings = NULL;
+err_file:
+    if (dl_file) {
+        fclose(dl_file);
+        dl_file = NULL;
+    }
+    return false;
+}
+
+void
+DebugModuleManager::debuglog_stop()
+{
+    if (!dl_running) {
+        return;
+    }
+    // new messages go to the text output from here on
+    dl_active = false;
+    dl_running = false;
+    pthread_join(dl_thread, NULL);
+    debuglog_drain();
+
+    unsigned int dropped = getDroppedMessages();
+    if (dropped) {
+        fprintf(stderr, "WARNING: %u debug log messages dropped!\n", dropped);
+    }
+    if (dl_file) {
+        fclose(dl_file);
+        dl_file = NULL;
+    }
+    // the rings stay allocated, a thread might still be
+    // finishing a record
+}
+
+void
+DebugModuleManager::debuglog_atexit()
+{
+    if (m_instance) {
+        m_instance->debuglog_stop();
+    }
+}
+
+void *
+DebugModuleManager::debuglog_thread_func(void *arg)
+{
+    DebugModuleManager *m = static_cast<DebugModuleManager *>(arg);
+
+    while (m->dl_running) {
+        usleep(DEBUG_BINLOG_POLL_USEC);
+        m->debuglog_drain();
+    }
+    return NULL;
+}
+
+void
+DebugModuleManager::debuglog_thread_exit(void *arg)
+{
+    // the log thread frees the ring once it is empty
+    struct DebugLogRing *ring = static_cast<struct DebugLogRing *>(arg);
+    __sync_synchronize();
+    ring->state = eDLR_Released;
+}
+
+void
+DebugModuleManager::debuglog_record(debug_level_t level, unsigned int flags,
+                                    const char *file, const char *function,
+                                    unsigned int line, const char *format,
+                                    va_list arg)
+{
+    struct DebugLogRing *ring = (struct DebugLogRing *)pthread_getspecific(dl_key);
+    if (ring == NULL) {
+        // first message of this thread
+        for (int i = 0; i < DEBUG_BINLOG_THREADS; i++) {
+            if (CAS(eDLR_Free, eDLR_Used, &dl_rings[i].state)) {
+                ring = &dl_rings[i];
+                break;
+            }
+        }
+        if (ring == NULL) {
+            INC_ATOMIC(&dl_dropped_nothread);
+            return;
+        }
+        pthread_setspecific(dl_key, ring);
+    }
+
+    uint32_t head = ring->head;
+    if (head - ring->tail >= DEBUG_BINLOG_RECORDS) {
+        ring->dropped++;
+        return;
+    }
+
+    struct DebugLogRecord *r = &ring->records[head & (DEBUG_BINLOG_RECORDS - 1)];
+    struct timespec ts;
+    Util::SystemTimeSource::clockGettime(&ts);
+    r->timestamp = (uint64_t)(ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL);
+    r->format = (uintptr_t)format;
+    r->file = (uintptr_t)file;
+    r->function = (uintptr_t)function;
+    r->line = line;
+    r->level = level;
+    r->flags = flags;
+    debuglogCapture(r, format, arg);
+
+    // publish the record
+    __sync_synchronize();
+    ring->head = head + 1;
+}
+
+void
+DebugModuleManager::debuglog_write_string(uint64_t id, const char *s)
+{
+    if (dl_strings_seen.find(id) != dl_strings_seen.end()) {
+        return;
+    }
+    dl_strings_seen.insert(id);
+
+    uint32_t type = eDLE_String;
+    uint32_t len = (s ? strlen(s) : 0);
+    fwrite(&type, sizeof(type), 1, dl_file);
+    fwrite(&id, sizeof(id), 1, dl_file);
+    fwrite(&len, sizeof(len), 1, dl_file);
+    if (len) {
+        fwrite(s, len, 1, dl_file);
+    }
+}
+
+void
+DebugModuleManager::debuglog_output(const struct DebugLogRecord *r)
+{
+    const char *format = (const char *)(uintptr_t)r->format;
+    const char *file = (const char *)(uintptr_t)r->file;
+    const char *function = (const char *)(uintptr_t)r->function;
+
+    if (dl_file) {
+        uint32_t type = eDLE_Record;
+        debuglog_write_string(r->format, format);
+        if (!(r->flags & DEBUGLOG_FLAG_SHORT)) {
+            debuglog_write_string(r->file, file);
+            debuglog_write_string(r->function, function);
+        }
+        fwrite(&type, sizeof(type), 1, dl_file);
+        fwrite(r, sizeof(*r), 1, dl_file);
+        return;
+    }
+
+    // same layout as DebugModule::print()
+    char msg[MB_BUFFERSIZE];
+    int chars_written = 0;
+    int level = r->level;
+    if ( ( level > DebugModule::eDL_Normal ) || ( level < DebugModule::eDL_Message ) ) {
+        level = DebugModule::eDL_Normal;
+    }
+    if (!(r->flags & DEBUGLOG_FLAG_SHORT)) {
+        const char *f = file;
+        const char *fname = file;
+        while((f=strstr(f, "/"))) {
+            f++; // move away from delimiter
+            fname=f;
+        }
+        chars_written = snprintf(msg, MB_BUFFERSIZE, "%011"PRIu64": %s (%s)[%4u] %s: ",
+                                 r->timestamp, colorTable[level].preSequence,
+                                 fname, r->line, function);
+        if (chars_written < 0) chars_written = 0;
+        if (chars_written >= MB_BUFFERSIZE) chars_written = MB_BUFFERSIZE - 1;
+    }
+    chars_written += debuglogFormat(msg + chars_written, MB_BUFFERSIZE - chars_written,
+                                    format, r);
+    if (chars_written >= MB_BUFFERSIZE) chars_written = MB_BUFFERSIZE - 1;
+    if (!(r->flags & DEBUGLOG_FLAG_SHORT)) {
+        snprintf(msg + chars_written, MB_BUFFERSIZE - chars_written,
+                 "%s", colorTable[level].postSequence);
+    }
+    fputs(msg, stderr);
+}
+
+void
+DebugModuleManager::debuglog_drain()
+{
+    // both the log thread and flush() get here
+    pthread_mutex_lock(&dl_drain_lock);
+    for (int i = 0; i < DEBUG_BINLOG_THREADS; i++) {
+        struct DebugLogRing *ring = &dl_rings[i];
+        int32_t state = ring->state;
+        if (state == eDLR_Free) {
+            continue;
+        }
+
+        uint32_t head = ring->head;
+        // don't read the records before the index
+        __sync_synchronize();
+        while (ring->tail != head) {
+            debuglog_output(&ring->records[ring->tail & (DEBUG_BINLOG_RECORDS - 1)]);
+            __sync_synchronize();
+            ring->tail++;
+        }
+
+        uint32_t dropped = ring->dropped;
+        if (dropped != ring->dropped_seen) {
+            uint32_t n = dropped - ring->dropped_seen;
+            if (dl_file) {
+                uint32_t entry[3] = {eDLE_Dropped, (uint32_t)i, n};
+                fwrite(entry, sizeof(entry), 1, dl_file);
+            } else {
+                fprintf(stderr, "WARNING: %u debug messages of thread slot %d dropped\n", n, i);
+            }
+            ring->dropped_seen = dropped;
+            dl_dropped_total += n;
+        }
+
+        if (state == eDLR_Released && ring->tail == ring->head) {
+            ring->head = 0;
+            ring->tail = 0;
+            ring->dropped = 0;
+            ring->dropped_seen = 0;
+            __sync_synchronize();
+            ring->state = eDLR_Free;
+        }
+    }
+
+    uint32_t dropped = dl_dropped_nothread;
+    if (dropped != dl_dropped_nothread_seen) {
+        uint32_t n = dropped - dl_dropped_nothread_seen;
+        if (dl_file) {
+            uint32_t entry[3] = {eDLE_Dropped, 0xFFFFFFFF, n};
+            fwrite(entry, sizeof(entry), 1, dl_file);
+        } else {
+            fprintf(stderr, "WARNING: %u debug messages dropped, no free thread slot\n", n);
+        }
+        dl_dropped_nothread_seen = dropped;
+        dl_dropped_total += n;
+    }
+
+    fflush(dl_file ? dl_file : stderr);
+    pthread_mutex_unlock(&dl_drain_lock);
+}
+
+unsigned int
+DebugModuleManager::getDroppedMessages()
+{
+    if (dl_rings == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&dl_drain_lock);
+    unsigned int dropped = dl_dropped_total;
+    for (int i = 0; i < DEBUG_BINLOG_THREADS; i++) {
+        dropped += dl_rings[i].dropped - dl_rings[i].dropped_seen;
+    }
+    dropped += dl_dropped_nothread - dl_dropped_nothread_seen;
+    pthread_mutex_unlock(&dl_drain_lock);
+    return dropped;
+}
+#endif
+
 #if DEBUG_BACKTRACE_SUPPORT
 void
 DebugModuleManager::printBacktrace(int len)
@@ -36,6 +36,12 @@
 #include <stdint.h>
 #include <semaphore.h>
 
+#if DEBUG_BINLOG_SUPPORT
+#include <stdarg.h>
+#include <set>
+struct DebugLogRecord;
+#endif
+
 #define FFADO_ASSERT(x) { \
     if(!(x)) { \
         m_debugModule.print( DebugModule::eDL_Fatal,        \
@@ -362,6 +368,16 @@ public:
     void showBackLog(int nblines);
 #endif
 
+#if DEBUG_BINLOG_SUPPORT
+    // true if messages are recorded in binary form
+    // instead of being formatted by the calling thread
+    bool debuglogActive()
+        { return dl_active; }
+    // messages lost because a ring was full
+    // or because no ring was free for a thread
+    unsigned int getDroppedMessages();
+#endif
+
 #if DEBUG_BACKTRACE_SUPPORT
     void printBacktrace(int len);
     void *getBacktracePtr(int id);
@@ -380,6 +396,13 @@ protected:
     void backlog_print(const char *msg);
 #endif
 
+#if DEBUG_BINLOG_SUPPORT
+    void debuglog_record(debug_level_t level, unsigned int flags,
+                         const char *file, const char *function,
+                         unsigned int line, const char *format,
+                         va_list arg);
+#endif
+
 private:
     DebugModuleManager();
 
@@ -417,6 +440,32 @@ private:
     pthread_mutex_t bl_mb_write_lock;
 #endif
 
+#if DEBUG_BINLOG_SUPPORT
+    struct DebugLogRing;
+
+    bool debuglog_init(const char *target);
+    void debuglog_stop();
+    void debuglog_drain();
+    void debuglog_output(const struct DebugLogRecord *r);
+    void debuglog_write_string(uint64_t id, const char *s);
+    static void *debuglog_thread_func(void *arg);
+    static void debuglog_thread_exit(void *arg);
+    static void debuglog_atexit();
+
+    struct DebugLogRing *dl_rings;
+    volatile bool dl_active;
+    volatile bool dl_running;
+    volatile int32_t dl_dropped_nothread;
+    unsigned int dl_dropped_nothread_seen;
+    unsigned int dl_dropped_total;
+    FILE *dl_file;
+    pthread_t dl_thread;
+    pthread_key_t dl_key;
+    pthread_mutex_t dl_drain_lock;
+    // the strings already written to the log file
+    std::set<uint64_t> dl_strings_seen;
+#endif
+
     static DebugModuleManager* m_instance;
     DebugModuleVector          m_debugModules;
 };
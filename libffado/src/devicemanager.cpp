@@ -30,8 +30,10 @@
 #include "DeviceStringParser.h"
 
 #include "libieee1394/configrom.h"
+#include "libieee1394/ConfigRomCache.h"
 #include "libieee1394/ieee1394service.h"
 #include "libieee1394/IsoHandlerManager.h"
+#include "libieee1394/SimulatedBus.h"
 
 #include "libstreaming/generic/StreamProcessor.h"
 #include "libstreaming/StreamProcessorManager.h"
@@ -39,6 +41,7 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/PosixMutex.h"
+#include "libutil/Atomic.h"
 
 #ifdef ENABLE_BEBOB
 #include "bebob/bebob_avdevice.h"
@@ -82,6 +85,9 @@
 
 #include <algorithm>
 
+#include <pthread.h>
+#include <string.h>
+
 using namespace std;
 
 IMPL_DEBUG_MODULE( DeviceManager, DeviceManager, DEBUG_LEVEL_NORMAL );
@@ -178,7 +184,13 @@ DeviceManager::initialize()
     m_configuration->openFile( USER_CONFIG_FILE, Util::Configuration::eFM_ReadWrite );
     m_configuration->openFile( SYSTEM_CONFIG_FILE, Util::Configuration::eFM_ReadOnly );
 
-    int nb_detected_ports = Ieee1394Service::detectNbPorts();
+    int nb_detected_ports;
+    if (SimulatedBus::isRequested(m_configuration)) {
+        // one simulated port, no adapter needed
+        nb_detected_ports = 1;
+    } else {
+        nb_detected_ports = Ieee1394Service::detectNbPorts();
+    }
     if (nb_detected_ports < 0) {
         debugFatal("Failed to detect the number of 1394 adapters. Is the IEEE1394 stack loaded (raw1394)?\n");
         return false;
@@ -367,8 +379,9 @@ DeviceManager::discover( bool useCache, bool rediscover )
 
     // FIXME: it could be that a 1394service has disappeared (cardbus)
 
-    ConfigRomVector configRoms;
-    // build a list of configroms on the bus.
+    // build a list of configroms on the bus. The config roms are read
+    // in parallel, and reused to pick up the new devices below.
+    DiscoveryJobVector jobs;
     for ( Ieee1394ServiceVectorIterator it = m_1394Services.begin();
         it != m_1394Services.end();
         ++it )
@@ -378,30 +391,30 @@ DeviceManager::discover( bool useCache, bool rediscover )
             nodeId < portService->getNodeCount();
             ++nodeId )
         {
-            debugOutput( DEBUG_LEVEL_VERBOSE, "Probing node %d...\n", nodeId );
-
             if (nodeId == portService->getLocalNodeId()) {
                 debugOutput( DEBUG_LEVEL_VERBOSE, "Skipping local node (%d)...\n", nodeId );
                 continue;
             }
-
-            ConfigRom * configRom = new ConfigRom( *portService, nodeId );
-            if ( !configRom->initialize() ) {
-                // \todo If a PHY on the bus is in power safe mode then
-                // the config rom is missing. So this might be just
-                // such this case and we can safely skip it. But it might
-                // be there is a real software problem on our side.
-                // This should be handlede more carefuly.
-                debugOutput( DEBUG_LEVEL_NORMAL,
-                            "Could not read config rom from device (node id %d). "
-                            "Skip device discovering for this node\n",
-                            nodeId );
-                continue;
-            }
-            configRoms.push_back(configRom);
+            DiscoveryJob job;
+            job.service = portService;
+            job.nodeId = nodeId;
+            job.configRom = NULL;
+            job.device = NULL;
+            job.fromCache = false;
+            jobs.push_back(job);
         }
     }
+    runDiscoveryJobs(jobs, eDS_ReadConfigRom, useCache, snoopMode);
 
+    ConfigRomVector configRoms;
+    for ( DiscoveryJobVectorIterator it = jobs.begin();
+        it != jobs.end();
+        ++it )
+    {
+        if(it->configRom) {
+            configRoms.push_back(it->configRom);
+        }
+    }
 
     // notify that we are going to manipulate the list
     signalNotifiers(m_preUpdateNotifiers);
@@ -458,15 +471,6 @@ DeviceManager::discover( bool useCache, bool rediscover )
         m_avDevices.clear();
     }
 
-    // delete the config rom list entries
-    // FIXME: we should reuse it
-    for ( ConfigRomVectorIterator it = configRoms.begin();
-        it != configRoms.end();
-        ++it )
-    {
-        delete *it;
-    }
-
     assert(m_deviceStringParser);
     // show the spec strings we're going to use
     if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
@@ -544,118 +548,83 @@ DeviceManager::discover( bool useCache, bool rediscover )
         m_avDevices = to_keep;
 
         // pick up new devices
-        for ( Ieee1394ServiceVectorIterator it = m_1394Services.begin();
-            it != m_1394Services.end();
+        DiscoveryJobVector new_jobs;
+        for ( DiscoveryJobVectorIterator it = jobs.begin();
+            it != jobs.end();
             ++it )
         {
-            Ieee1394Service *portService = *it;
-            for ( fb_nodeid_t nodeId = 0;
-                nodeId < portService->getNodeCount();
-                ++nodeId )
-            {
-                debugOutput( DEBUG_LEVEL_VERBOSE, "Probing node %d...\n", nodeId );
-    
-                if (nodeId == portService->getLocalNodeId()) {
-                    debugOutput( DEBUG_LEVEL_VERBOSE, "Skipping local node (%d)...\n", nodeId );
-                    continue;
-                }
-    
-                ConfigRom *configRom = new ConfigRom( *portService, nodeId );
-                if ( !configRom->initialize() ) {
-                    // \todo If a PHY on the bus is in power safe mode then
-                    // the config rom is missing. So this might be just
-                    // such this case and we can safely skip it. But it might
-                    // be there is a real software problem on our side.
-                    // This should be handlede more carefuly.
-                    debugOutput( DEBUG_LEVEL_NORMAL,
-                                "Could not read config rom from device (node id %d). "
-                                "Skip device discovering for this node\n",
-                                nodeId );
-                    continue;
-                }
+            ConfigRom *configRom = it->configRom;
+            if ( !configRom ) {
+                continue;
+            }
 
-                bool already_in_vector = false;
-                for ( FFADODeviceVectorIterator it_dev = m_avDevices.begin();
-                    it_dev != m_avDevices.end();
-                    ++it_dev )
-                {
-                    if ((*it_dev)->getConfigRom().getGuid() == configRom->getGuid()) {
-                        already_in_vector = true;
-                        break;
-                    }
-                }
-                if(already_in_vector) {
-                    if(!rediscover) {
-                        debugWarning("Device with GUID %s already discovered on other port, skipping device...\n",
-                                    configRom->getGuidString().c_str());
-                    }
-                    continue;
+            // the device can already be known, or be present on more
+            // than one port. The first one in bus order wins.
+            bool already_in_vector = false;
+            for ( FFADODeviceVectorIterator it_dev = m_avDevices.begin();
+                it_dev != m_avDevices.end();
+                ++it_dev )
+            {
+                if ((*it_dev)->getConfigRom().getGuid() == configRom->getGuid()) {
+                    already_in_vector = true;
+                    break;
                 }
-
-                if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
-                    configRom->printConfigRomDebug();
+            }
+            for ( DiscoveryJobVectorIterator it_job = new_jobs.begin();
+                it_job != new_jobs.end();
+                ++it_job )
+            {
+                if (it_job->configRom->getGuid() == configRom->getGuid()) {
+                    already_in_vector = true;
+                    break;
                 }
-
-                // if spec strings are given, only add those devices
-                // that match the spec string(s).
-                // if no (valid) spec strings are present, grab all
-                // supported devices.
-                if(m_deviceStringParser->countDeviceStrings() &&
-                  !m_deviceStringParser->match(*configRom)) {
-                    debugOutput(DEBUG_LEVEL_VERBOSE, "Device doesn't match any of the spec strings. skipping...\n");
-                    continue;
+            }
+            if(already_in_vector) {
+                if(!rediscover) {
+                    debugWarning("Device with GUID %s already discovered on other port, skipping device...\n",
+                                configRom->getGuidString().c_str());
                 }
+                delete configRom;
+                continue;
+            }
 
-                // find a driver
-                FFADODevice* avDevice = getDriverForDevice( configRom,
-                                                            nodeId );
-
-                if ( avDevice ) {
-                    debugOutput( DEBUG_LEVEL_NORMAL,
-                                "driver found for device %d\n",
-                                nodeId );
-
-                    avDevice->setVerboseLevel( getDebugLevel() );
-                    bool isFromCache = false;
-                    if ( useCache && avDevice->loadFromCache() ) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE, "could load from cache\n" );
-                        isFromCache = true;
-                        // restore the debug level for everything that was loaded
-                        avDevice->setVerboseLevel( getDebugLevel() );
-                    } else if ( avDevice->discover() ) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE, "discovery successful\n" );
-                    } else {
-                        debugError( "could not discover device\n" );
-                        delete avDevice;
-                        continue;
-                    }
-
-                    if (snoopMode) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE,
-                                    "Enabling snoop mode on node %d...\n", nodeId );
+            if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
+                configRom->printConfigRomDebug();
+            }
 
-                        if(!avDevice->setOption("snoopMode", snoopMode)) {
-                            debugWarning("Could not set snoop mode for device on node %d\n", nodeId);
-                            delete avDevice;
-                            continue;
-                        }
-                    }
+            // if spec strings are given, only add those devices
+            // that match the spec string(s).
+            // if no (valid) spec strings are present, grab all
+            // supported devices.
+            if(m_deviceStringParser->countDeviceStrings() &&
+              !m_deviceStringParser->match(*configRom)) {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "Device doesn't match any of the spec strings. skipping...\n");
+                delete configRom;
+                continue;
+            }
+            new_jobs.push_back(*it);
+        }
 
-                    if ( !isFromCache && !avDevice->saveCache() ) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE, "No cached version of AVC model created\n" );
-                    }
-                    m_avDevices.push_back( avDevice );
+        // probe and discover the new devices in parallel
+        runDiscoveryJobs(new_jobs, eDS_Probe, useCache, snoopMode);
 
-                    if (!addElement(avDevice)) {
-                        debugWarning("failed to add Device to Control::Container\n");
-                    }
+        // add them in bus order
+        for ( DiscoveryJobVectorIterator it = new_jobs.begin();
+            it != new_jobs.end();
+            ++it )
+        {
+            FFADODevice* avDevice = it->device;
+            if ( !avDevice ) {
+                continue;
+            }
+            m_avDevices.push_back( avDevice );
 
-                    debugOutput( DEBUG_LEVEL_NORMAL, "discovery of node %d on port %d done...\n", nodeId, portService->getPort() );
-                } else {
-                    // we didn't get a device, hence we have to delete the configrom ptr manually
-                    delete configRom;
-                }
+            if (!addElement(avDevice)) {
+                debugWarning("failed to add Device to Control::Container\n");
             }
+
+            debugOutput( DEBUG_LEVEL_NORMAL, "discovery of node %d on port %d done...\n",
+                         it->nodeId, it->service->getPort() );
         }
 
         debugOutput( DEBUG_LEVEL_NORMAL, "Discovery finished...\n" );
@@ -703,6 +672,14 @@ DeviceManager::discover( bool useCache, bool rediscover )
         showDeviceInfo();
 
     } else { // slave mode
+        // the config roms of the other nodes are not needed
+        for ( ConfigRomVectorIterator it = configRoms.begin();
+            it != configRoms.end();
+            ++it )
+        {
+            delete *it;
+        }
+
         // notify any clients
         signalNotifiers(m_preUpdateNotifiers);
         Ieee1394Service *portService = m_1394Services.at(0);
@@ -769,6 +746,146 @@ DeviceManager::discover( bool useCache, bool rediscover )
     return true;
 }
 
+bool
+DeviceManager::runDiscoveryJobs( DiscoveryJobVector &jobs, enum eDiscoveryStage stage,
+                                 bool useCache, bool snoopMode )
+{
+    int nb_threads = DEVICEMANAGER_DISCOVERY_THREADS;
+    m_configuration->getValueForSetting("devicemanager.discovery_threads", nb_threads);
+    if (nb_threads > (int)jobs.size()) nb_threads = jobs.size();
+
+    DiscoveryPool pool;
+    pool.manager = this;
+    pool.jobs = &jobs;
+    pool.stage = stage;
+    pool.useCache = useCache;
+    pool.snoopMode = snoopMode;
+    pool.next_job = 0;
+
+    // the calling thread is a worker too
+    std::vector<pthread_t> threads;
+    for (int i = 1; i < nb_threads; i++) {
+        pthread_t thread;
+        int res = pthread_create(&thread, NULL, &discoveryWorker, (void *)&pool);
+        if (res) {
+            debugWarning("Could not create discovery thread: %s\n", strerror(res));
+            break;
+        }
+        threads.push_back(thread);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Running %zd discovery jobs (stage %d) on %zd threads...\n",
+                 jobs.size(), (int)stage, threads.size() + 1 );
+
+    discoveryWorker((void *)&pool);
+
+    for ( std::vector<pthread_t>::iterator it = threads.begin();
+          it != threads.end();
+          ++it )
+    {
+        pthread_join(*it, NULL);
+    }
+    return true;
+}
+
+void*
+DeviceManager::discoveryWorker( void *arg )
+{
+    DiscoveryPool *pool = (DiscoveryPool *)arg;
+    int32_t nb_jobs = pool->jobs->size();
+    int32_t idx;
+    while ((idx = INC_ATOMIC(&pool->next_job)) < nb_jobs) {
+        pool->manager->runDiscoveryJob(pool->jobs->at(idx), pool->stage,
+                                       pool->useCache, pool->snoopMode);
+    }
+    return NULL;
+}
+
+void
+DeviceManager::runDiscoveryJob( DiscoveryJob &job, enum eDiscoveryStage stage,
+                                bool useCache, bool snoopMode )
+{
+    fb_nodeid_t nodeId = job.nodeId;
+    switch (stage) {
+        case eDS_ReadConfigRom:
+        {
+            debugOutput( DEBUG_LEVEL_VERBOSE, "Probing node %d...\n", nodeId );
+            ConfigRom * configRom = new ConfigRom( *job.service, nodeId );
+            ConfigRomCache &romCache = job.service->getConfigRomCache();
+            if ( romCache.lookup( *configRom ) ) {
+                debugOutput( DEBUG_LEVEL_VERBOSE, "Using the cached config ROM of node %d\n", nodeId );
+                job.configRom = configRom;
+                return;
+            }
+            unsigned int generation = job.service->getGeneration();
+            if ( !configRom->initialize() ) {
+                // \todo If a PHY on the bus is in power safe mode then
+                // the config rom is missing. So this might be just
+                // such this case and we can safely skip it. But it might
+                // be there is a real software problem on our side.
+                // This should be handlede more carefuly.
+                debugOutput( DEBUG_LEVEL_NORMAL,
+                            "Could not read config rom from device (node id %d). "
+                            "Skip device discovering for this node\n",
+                            nodeId );
+                delete configRom;
+                return;
+            }
+            romCache.update( *configRom, generation );
+            job.configRom = configRom;
+            return;
+        }
+        case eDS_Probe:
+        {
+            // find a driver
+            FFADODevice* avDevice = getDriverForDevice( job.configRom,
+                                                        nodeId );
+            if ( !avDevice ) {
+                // we didn't get a device, hence we have to delete the configrom ptr manually
+                delete job.configRom;
+                job.configRom = NULL;
+                return;
+            }
+            // the device owns the config rom from now on
+            job.configRom = NULL;
+
+            debugOutput( DEBUG_LEVEL_NORMAL,
+                        "driver found for device %d\n",
+                        nodeId );
+
+            avDevice->setVerboseLevel( getDebugLevel() );
+            if ( useCache && avDevice->loadFromCache() ) {
+                debugOutput( DEBUG_LEVEL_VERBOSE, "could load from cache\n" );
+                job.fromCache = true;
+                // restore the debug level for everything that was loaded
+                avDevice->setVerboseLevel( getDebugLevel() );
+            } else if ( avDevice->discover() ) {
+                debugOutput( DEBUG_LEVEL_VERBOSE, "discovery successful\n" );
+            } else {
+                debugError( "could not discover device\n" );
+                delete avDevice;
+                return;
+            }
+
+            if (snoopMode) {
+                debugOutput( DEBUG_LEVEL_VERBOSE,
+                            "Enabling snoop mode on node %d...\n", nodeId );
+
+                if(!avDevice->setOption("snoopMode", snoopMode)) {
+                    debugWarning("Could not set snoop mode for device on node %d\n", nodeId);
+                    delete avDevice;
+                    return;
+                }
+            }
+
+            if ( !job.fromCache && !avDevice->saveCache() ) {
+                debugOutput( DEBUG_LEVEL_VERBOSE, "No cached version of AVC model created\n" );
+            }
+            job.device = avDevice;
+            return;
+        }
+    }
+}
+
 bool
 DeviceManager::initStreaming()
 {
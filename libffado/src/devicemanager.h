@@ -152,6 +152,37 @@ protected:
 
     void busresetHandler(Ieee1394Service &);
 
+    // parallel discovery: one job per node on the bus
+    struct DiscoveryJob {
+        Ieee1394Service *service;
+        fb_nodeid_t      nodeId;
+        ConfigRom       *configRom;
+        FFADODevice     *device;
+        bool             fromCache;
+    };
+    typedef std::vector< DiscoveryJob > DiscoveryJobVector;
+    typedef std::vector< DiscoveryJob >::iterator DiscoveryJobVectorIterator;
+
+    enum eDiscoveryStage {
+        eDS_ReadConfigRom,
+        eDS_Probe,
+    };
+
+    struct DiscoveryPool {
+        DeviceManager          *manager;
+        DiscoveryJobVector     *jobs;
+        enum eDiscoveryStage    stage;
+        bool                    useCache;
+        bool                    snoopMode;
+        volatile int32_t        next_job;
+    };
+
+    bool runDiscoveryJobs( DiscoveryJobVector &jobs, enum eDiscoveryStage stage,
+                           bool useCache, bool snoopMode );
+    void runDiscoveryJob( DiscoveryJob &job, enum eDiscoveryStage stage,
+                          bool useCache, bool snoopMode );
+    static void* discoveryWorker( void *arg );
+
 protected:
     // we have one service for each port
     // found on the system. We don't allow dynamic addition of ports (yet)
@@ -32,6 +32,7 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/ByteSwap.h"
+#include "libutil/serialize.h"
 #include <libraw1394/csr.h>
 
 #include <stdint.h>
@@ -77,6 +78,7 @@ Device::Device( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ))
     , m_tx_size (0xFFFFFFFFLU)
     , m_nb_rx (0xFFFFFFFFLU)
     , m_rx_size (0xFFFFFFFFLU)
+    , m_parameter_space_restored (false)
     , m_notifier (NULL)
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created Dice::Device (NodeID %d)\n",
@@ -211,6 +213,75 @@ Device::discover()
     return true;
 }
 
+uint64_t
+Device::getCacheId()
+{
+    // the channel layout depends on the rate mode, so key the cache on
+    // the sample rate and the clock source. This runs before discovery,
+    // hence the global space offset has to be read here.
+    fb_quadlet_t global_offset;
+    fb_quadlet_t clockreg;
+    if ( !readReg(DICE_REGISTER_GLOBAL_PAR_SPACE_OFF, &global_offset)
+         || !readReg(global_offset * 4 + DICE_REGISTER_GLOBAL_CLOCK_SELECT, &clockreg) ) {
+        debugWarning("Could not read CLOCK_SELECT register\n");
+        return 0xFFFFFFFFFFFFFFFFULL;
+    }
+    return ((uint64_t)DICE_GET_RATE(clockreg) << 8) | DICE_GET_CLOCKSOURCE(clockreg);
+}
+
+bool
+Device::serializeDiscovery( std::string basePath, Util::IOSerialize& ser ) const
+{
+    // only the parameter space layout is cached, the EAP and the names
+    // are read from the device by discover()
+    bool result;
+    result  = ser.write( basePath + "m_global_reg_offset", m_global_reg_offset );
+    result &= ser.write( basePath + "m_global_reg_size", m_global_reg_size );
+    result &= ser.write( basePath + "m_tx_reg_offset", m_tx_reg_offset );
+    result &= ser.write( basePath + "m_tx_reg_size", m_tx_reg_size );
+    result &= ser.write( basePath + "m_rx_reg_offset", m_rx_reg_offset );
+    result &= ser.write( basePath + "m_rx_reg_size", m_rx_reg_size );
+    result &= ser.write( basePath + "m_unused1_reg_offset", m_unused1_reg_offset );
+    result &= ser.write( basePath + "m_unused1_reg_size", m_unused1_reg_size );
+    result &= ser.write( basePath + "m_unused2_reg_offset", m_unused2_reg_offset );
+    result &= ser.write( basePath + "m_unused2_reg_size", m_unused2_reg_size );
+    result &= ser.write( basePath + "m_nb_tx", m_nb_tx );
+    result &= ser.write( basePath + "m_tx_size", m_tx_size );
+    result &= ser.write( basePath + "m_nb_rx", m_nb_rx );
+    result &= ser.write( basePath + "m_rx_size", m_rx_size );
+    return result;
+}
+
+bool
+Device::deserializeDiscovery( std::string basePath, Util::IODeserialize& deser )
+{
+    bool result;
+    result  = deser.read( basePath + "m_global_reg_offset", m_global_reg_offset );
+    result &= deser.read( basePath + "m_global_reg_size", m_global_reg_size );
+    result &= deser.read( basePath + "m_tx_reg_offset", m_tx_reg_offset );
+    result &= deser.read( basePath + "m_tx_reg_size", m_tx_reg_size );
+    result &= deser.read( basePath + "m_rx_reg_offset", m_rx_reg_offset );
+    result &= deser.read( basePath + "m_rx_reg_size", m_rx_reg_size );
+    result &= deser.read( basePath + "m_unused1_reg_offset", m_unused1_reg_offset );
+    result &= deser.read( basePath + "m_unused1_reg_size", m_unused1_reg_size );
+    result &= deser.read( basePath + "m_unused2_reg_offset", m_unused2_reg_offset );
+    result &= deser.read( basePath + "m_unused2_reg_size", m_unused2_reg_size );
+    result &= deser.read( basePath + "m_nb_tx", m_nb_tx );
+    result &= deser.read( basePath + "m_tx_size", m_tx_size );
+    result &= deser.read( basePath + "m_nb_rx", m_nb_rx );
+    result &= deser.read( basePath + "m_rx_size", m_rx_size );
+    if ( !result ) {
+        return false;
+    }
+
+    // run the rest of the (possibly overridden) discovery on top of the
+    // restored layout, such that e.g. the EAP is set up as usual
+    m_parameter_space_restored = true;
+    result = discover();
+    m_parameter_space_restored = false;
+    return result;
+}
+
 EAP*
 Device::createEAP() {
     return new EAP(*this);
@@ -1594,7 +1665,7 @@ Device::splitNameString(std::string in) {
 
 // I/O routines
 bool
-Device::initIoFunctions() {
+Device::readParameterSpace() {
 
     // offsets and sizes are returned in quadlets, but we use byte values
     if(!readReg(DICE_REGISTER_GLOBAL_PAR_SPACE_OFF, &m_global_reg_offset)) {
@@ -1699,6 +1770,16 @@ Device::initIoFunctions() {
                 break;
         }
     }
+    return true;
+}
+
+bool
+Device::initIoFunctions() {
+
+    // the layout was read before unless it was restored from the cache
+    if ( !m_parameter_space_restored && !readParameterSpace() ) {
+        return false;
+    }
 
 #if USE_OLD_DEFENSIVE_STREAMING_PROTECTION
     // FIXME: after a crash, the device might still be streaming. We
@@ -1796,6 +1877,10 @@ Device::readRegBlock(fb_nodeaddr_t offset, fb_quadlet_t *data, size_t length) {
     int quads_done = 0;
     // round to next full quadlet
     int length_quads = (length+3)/4;
+    // queue all chunks at once, such that the transaction engine can
+    // pipeline them
+    std::vector<AsyncTransactionEngine::Request> requests((length_quads + blocksize_quads - 1) / blocksize_quads);
+    unsigned int nb_requests = 0;
     while(quads_done < length_quads) {
         fb_nodeaddr_t curr_addr = addr + quads_done*4;
         fb_quadlet_t *curr_data = data + quads_done;
@@ -1812,13 +1897,34 @@ Device::readRegBlock(fb_nodeaddr_t offset, fb_quadlet_t *data, size_t length) {
         }
         #endif
 
-        if(!get1394Service().read( nodeId, curr_addr, quads_todo, curr_data ) ) {
-            debugError("Could not read %d quadlets from node 0x%04X addr 0x%012"PRIX64"\n", quads_todo, nodeId, curr_addr);
-            return false;
+        AsyncTransactionEngine::Request &r = requests.at(nb_requests++);
+        r.setRead( nodeId, curr_addr, quads_todo, curr_data );
+        if(!get1394Service().queueAsyncRequest( r )) {
+            // fall back to a blocking read
+            if(!get1394Service().read( nodeId, curr_addr, quads_todo, curr_data ) ) {
+                debugError("Could not read %d quadlets from node 0x%04X addr 0x%012"PRIX64"\n", quads_todo, nodeId, curr_addr);
+                nb_requests--;
+                for(unsigned int i = 0; i < nb_requests; i++) {
+                    get1394Service().waitForAsyncRequest( requests.at(i) );
+                }
+                return false;
+            }
+            nb_requests--;
         }
         quads_done += quads_todo;
     }
 
+    bool ok = true;
+    for(unsigned int i = 0; i < nb_requests; i++) {
+        if(!get1394Service().waitForAsyncRequest( requests.at(i) )) {
+            debugError("Could not read from node 0x%04X addr 0x%012"PRIX64"\n", nodeId, addr);
+            ok = false;
+        }
+    }
+    if(!ok) {
+        return false;
+    }
+
     byteSwapFromBus(data, length/4);
     return true;
 }
@@ -1856,7 +1962,7 @@ Device::writeRegBlock(fb_nodeaddr_t offset, fb_quadlet_t *data, size_t length) {
         }
         #endif
 
-        if(!get1394Service().write( nodeId, addr, quads_todo, curr_data ) ) {
+        if(!get1394Service().write( nodeId, curr_addr, quads_todo, curr_data ) ) {
             debugError("Could not write %d quadlets to node 0x%04X addr 0x%012"PRIX64"\n", quads_todo, nodeId, curr_addr);
             return false;
         }
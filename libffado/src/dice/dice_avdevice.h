@@ -78,6 +78,10 @@ public:
 
     static int getConfigurationId( );
 
+    virtual uint64_t getCacheId();
+    virtual bool serializeDiscovery( std::string basePath, Util::IOSerialize& ser ) const;
+    virtual bool deserializeDiscovery( std::string basePath, Util::IODeserialize& deser );
+
     virtual void showDevice();
     bool canChangeNickname() { return true; }
 
@@ -182,6 +186,7 @@ public:
     EAP* getEAP() {return m_eap;};
 
 private: // register I/O routines
+    bool readParameterSpace();
     bool initIoFunctions();
     // functions used for RX/TX abstraction
     bool startstopStreamByIndex(int i, const bool start);
@@ -228,6 +233,9 @@ private: // register I/O routines
     fb_quadlet_t m_nb_rx;
     fb_quadlet_t m_rx_size;
 
+    // set while deserializeDiscovery() runs discover()
+    bool m_parameter_space_restored;
+
     fb_quadlet_t audio_base_register;
     fb_quadlet_t midi_base_register;
     char dir[3];
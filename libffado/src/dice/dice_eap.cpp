@@ -1159,6 +1159,8 @@ EAP::Mixer::Mixer(EAP &p)
 : Control::MatrixMixer(&p.m_device, "MatrixMixer")
 , m_eap(p)
 , m_coeff(NULL)
+, m_dirty_first(-1)
+, m_dirty_last(-1)
 , m_debugModule(p.m_debugModule)
 {
 }
@@ -1190,6 +1192,9 @@ EAP::Mixer::init()
     int nb_outputs = m_eap.m_mixer_nb_rx;
 
     m_coeff = (fb_quadlet_t *)calloc(nb_outputs * nb_inputs, sizeof(fb_quadlet_t));
+    m_dirty.assign(nb_outputs * nb_inputs, false);
+    m_dirty_first = -1;
+    m_dirty_last = -1;
 
     // load initial values
     if(!loadCoefficients()) {
@@ -1209,13 +1214,85 @@ EAP::Mixer::loadCoefficients()
     }
     int nb_inputs = m_eap.m_mixer_nb_tx;
     int nb_outputs = m_eap.m_mixer_nb_rx;
-    if(!m_eap.readRegBlock(eRT_Mixer, 4, m_coeff, nb_inputs * nb_outputs * 4)) {
+    return loadCoefficientRange(0, nb_inputs * nb_outputs);
+}
+
+bool
+EAP::Mixer::loadCoefficientRange(int first, int count)
+{
+    if(count <= 0) {
+        return true;
+    }
+    // pending modifications have to reach the device first
+    if(m_dirty_first >= 0 && !flushCoefficients()) {
+        return false;
+    }
+    if(!m_eap.readRegBlock(eRT_Mixer, 4 + first * 4, m_coeff + first, count * 4)) {
         debugError("Failed to read coefficients\n");
         return false;
     }
     return true;
 }
 
+void
+EAP::Mixer::markDirty(int idx)
+{
+    m_dirty.at(idx) = true;
+    if(m_dirty_first < 0 || idx < m_dirty_first) {
+        m_dirty_first = idx;
+    }
+    if(idx > m_dirty_last) {
+        m_dirty_last = idx;
+    }
+}
+
+bool
+EAP::Mixer::flushCoefficients()
+{
+    if(m_dirty_first < 0) {
+        return true;
+    }
+    bool ok = true;
+    int nb_writes = 0;
+    int idx = m_dirty_first;
+    while(idx <= m_dirty_last) {
+        if(!m_dirty.at(idx)) {
+            idx++;
+            continue;
+        }
+        // extend the block over short runs of unmodified coefficients,
+        // rewriting them is cheaper than an extra transaction.
+        int first = idx;
+        int last = idx;
+        for(idx = first + 1; idx <= m_dirty_last && idx - last <= DICE_EAP_MIXER_COALESCE_GAP; idx++) {
+            if(m_dirty.at(idx)) {
+                last = idx;
+            }
+        }
+        int count = last - first + 1;
+        if(!m_eap.writeRegBlock(eRT_Mixer, 4 + first * 4, m_coeff + first, count * 4)) {
+            debugError("Failed to write coefficients %d to %d\n", first, last);
+            ok = false;
+        }
+        nb_writes++;
+        idx = last + 1;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Flushed coefficients %d to %d in %d block writes\n",
+                m_dirty_first, m_dirty_last, nb_writes);
+    // the cache is reloaded on failure, hence clear the dirty state anyway
+    for(idx = m_dirty_first; idx <= m_dirty_last; idx++) {
+        m_dirty.at(idx) = false;
+    }
+    m_dirty_first = -1;
+    m_dirty_last = -1;
+    if(!ok) {
+        int nb_inputs = m_eap.m_mixer_nb_tx;
+        int nb_outputs = m_eap.m_mixer_nb_rx;
+        loadCoefficientRange(0, nb_inputs * nb_outputs);
+    }
+    return ok;
+}
+
 bool
 EAP::Mixer::storeCoefficients()
 {
@@ -1230,9 +1307,14 @@ EAP::Mixer::storeCoefficients()
     int nb_inputs = m_eap.m_mixer_nb_tx;
     int nb_outputs = m_eap.m_mixer_nb_rx;
     if(!m_eap.writeRegBlock(eRT_Mixer, 4, m_coeff, nb_inputs * nb_outputs * 4)) {
-        debugError("Failed to read coefficients\n");
+        debugError("Failed to write coefficients\n");
         return false;
     }
+    for(int idx = m_dirty_first; m_dirty_first >= 0 && idx <= m_dirty_last; idx++) {
+        m_dirty.at(idx) = false;
+    }
+    m_dirty_first = -1;
+    m_dirty_last = -1;
     return true;
 }
 
@@ -1381,27 +1463,84 @@ EAP::Mixer::setValue( const int row, const int col, const double val)
         debugWarning("Mixer is read-only\n");
         return false;
     }
-    int nb_outputs = m_eap.m_mixer_nb_tx;
-    int addr = ((nb_outputs * col) + row) * 4;
-    quadlet_t tmp = (quadlet_t) val;
-    if(!m_eap.writeRegBlock(eRT_Mixer, 4+addr, &tmp, 4)) {
+    if(!canWrite(row, col) || m_coeff == NULL) {
+        debugError("Invalid coefficient (%d, %d)\n", row, col);
+        return 0;
+    }
+    int idx = coefficientIndex(row, col);
+    m_coeff[idx] = (quadlet_t) val;
+    markDirty(idx);
+    if(!flushCoefficients()) {
         debugError("Failed to write coefficient\n");
         return 0;
     }
-    return (double)(tmp);
+    return (double)(m_coeff[idx]);
 }
 
 double
 EAP::Mixer::getValue( const int row, const int col)
 {
-    int nb_outputs = m_eap.m_mixer_nb_tx;
-    int addr = ((nb_outputs * col) + row) * 4;
-    quadlet_t tmp;
-    if(!m_eap.readRegBlock(eRT_Mixer, 4+addr, &tmp, 4)) {
-        debugError("Failed to read coefficient\n");
+    if(row < 0 || row >= m_eap.m_mixer_nb_tx || col < 0 || col >= m_eap.m_mixer_nb_rx
+       || m_coeff == NULL) {
+        debugError("Invalid coefficient (%d, %d)\n", row, col);
         return 0;
     }
-    return (double)(tmp);
+    // all writes go through the cache, so it mirrors the device
+    return (double)(m_coeff[coefficientIndex(row, col)]);
+}
+
+bool
+EAP::Mixer::setValues( const int row, const int col,
+                       const int nb_rows, const int nb_cols,
+                       const std::vector<double>& values)
+{
+    if(m_eap.m_mixer_readonly) {
+        debugWarning("Mixer is read-only\n");
+        return false;
+    }
+    if(nb_rows <= 0 || nb_cols <= 0 || m_coeff == NULL
+       || !canWrite(row, col) || !canWrite(row + nb_rows - 1, col + nb_cols - 1)
+       || values.size() != (size_t)(nb_rows * nb_cols)) {
+        debugError("Invalid coefficient block (%d, %d) size %dx%d\n", row, col, nb_rows, nb_cols);
+        return false;
+    }
+    for(int i = 0; i < nb_rows; i++) {
+        for(int j = 0; j < nb_cols; j++) {
+            quadlet_t v = (quadlet_t) values.at(i * nb_cols + j);
+            int idx = coefficientIndex(row + i, col + j);
+            if(m_coeff[idx] != v) {
+                m_coeff[idx] = v;
+                markDirty(idx);
+            }
+        }
+    }
+    return flushCoefficients();
+}
+
+bool
+EAP::Mixer::getValues( const int row, const int col,
+                       const int nb_rows, const int nb_cols,
+                       std::vector<double>& values)
+{
+    if(nb_rows <= 0 || nb_cols <= 0 || m_coeff == NULL
+       || row < 0 || row + nb_rows > m_eap.m_mixer_nb_tx
+       || col < 0 || col + nb_cols > m_eap.m_mixer_nb_rx) {
+        debugError("Invalid coefficient block (%d, %d) size %dx%d\n", row, col, nb_rows, nb_cols);
+        return false;
+    }
+    // refresh the block from the device in one go
+    int first = coefficientIndex(row, col);
+    int last = coefficientIndex(row + nb_rows - 1, col + nb_cols - 1);
+    if(!loadCoefficientRange(first, last - first + 1)) {
+        return false;
+    }
+    values.resize(nb_rows * nb_cols);
+    for(int i = 0; i < nb_rows; i++) {
+        for(int j = 0; j < nb_cols; j++) {
+            values.at(i * nb_cols + j) = (double)(m_coeff[coefficientIndex(row + i, col + j)]);
+        }
+    }
+    return true;
 }
 
 int
@@ -101,6 +101,10 @@
 // MIXER registers
 // TODO
 
+// modified coefficients separated by less than this number of unmodified
+// ones are written in one block
+#define DICE_EAP_MIXER_COALESCE_GAP         16
+
 // PEAK registers
 // TODO
 
@@ -422,6 +426,12 @@ public:
         virtual int canWrite( const int, const int );
         virtual double setValue( const int, const int, const double );
         virtual double getValue( const int, const int );
+        virtual bool setValues( const int row, const int col,
+                                const int nb_rows, const int nb_cols,
+                                const std::vector<double>& values );
+        virtual bool getValues( const int row, const int col,
+                                const int nb_rows, const int nb_cols,
+                                std::vector<double>& values );
 
         //
         bool hasNames() const { return false; }
@@ -436,8 +446,28 @@ public:
         virtual bool storeCoefficientMap(int &);
 
     private:
+        int coefficientIndex( const int row, const int col )
+            {return m_eap.m_mixer_nb_tx * col + row;};
+        void markDirty( int idx );
+        /**
+         * writes the modified coefficients of the cache to the device,
+         * coalescing them into as few block writes as possible
+         * @return true if successful
+         */
+        bool flushCoefficients();
+        /**
+         * reads a range of coefficients from the device into the cache
+         * @return true if successful
+         */
+        bool loadCoefficientRange( int first, int count );
+
         EAP &         m_eap;
+        // shadow of the coefficients on the device
         fb_quadlet_t *m_coeff;
+        // the range of coefficients that differ from the device
+        std::vector<bool> m_dirty;
+        int           m_dirty_first;
+        int           m_dirty_last;
 
         //std::map<int, RouterConfig::Route> m_input_route_map;
         //std::map<int, RouterConfig::RouteVector> m_output_route_map;
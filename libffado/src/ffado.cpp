@@ -288,6 +288,30 @@ int ffado_streaming_transfer_buffers(ffado_device_t *dev) {
     return dev->m_deviceManager->getStreamProcessorManager().transfer();
 }
 
+int ffado_streaming_get_stats(ffado_device_t *dev, ffado_streaming_stat_t *stats,
+                              int nb_stats, int reset) {
+    if (stats == NULL || nb_stats < 0) {
+        return -1;
+    }
+    Util::LatencyStatistics &ls = dev->m_deviceManager->getStreamProcessorManager().getLatencyStatistics();
+    int n = (nb_stats < Util::LatencyStatistics::eS_Count ? nb_stats : Util::LatencyStatistics::eS_Count);
+    for (int i = 0; i < n; i++) {
+        Util::LatencyHistogram &h = ls.get((Util::LatencyStatistics::eStatistic)i);
+        stats[i].count = h.getCount();
+        stats[i].min = h.getMin();
+        stats[i].max = h.getMax();
+        stats[i].mean = h.getMean();
+        stats[i].p50 = h.getPercentile(0.5);
+        stats[i].p90 = h.getPercentile(0.9);
+        stats[i].p99 = h.getPercentile(0.99);
+        stats[i].p999 = h.getPercentile(0.999);
+    }
+    if (reset) {
+        ls.reset();
+    }
+    return n;
+}
+
 int ffado_streaming_get_nb_capture_streams(ffado_device_t *dev) {
     return dev->m_deviceManager->getStreamProcessorManager().getPortCount(Streaming::Port::E_Capture);
 }
@@ -22,6 +22,8 @@
  *
  */
 
+#include "config.h"
+
 #include "ffadodevice.h"
 #include "devicemanager.h"
 
@@ -32,9 +34,17 @@
 #include "libcontrol/ClockSelect.h"
 #include "libcontrol/Nickname.h"
 
+#include "libutil/serialize.h"
+#include "libutil/serialize_binary.h"
+
 #include <iostream>
 #include <sstream>
 #include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/stat.h>
 
 #include <assert.h>
 
@@ -136,18 +146,222 @@ FFADODevice::get1394Service()
     return getConfigRom().get1394Service();
 }
 
+std::string
+FFADODevice::getCachePath()
+{
+    std::string path = CACHEDIR;
+    if ( path.size() && path[0] == '~' ) {
+        const char *home = getenv( "HOME" );
+        if ( home == NULL ) {
+            debugError( "Could not expand cache path (trying '/var/cache/libffado' instead)\n" );
+            return "/var/cache/libffado/";
+        }
+        path.erase( 0, 1 ); // remove ~
+        path.insert( 0, home ); // prepend the home path
+    }
+    return path + "/cache/";
+}
+
+std::string
+FFADODevice::getCacheFileName()
+{
+    // the path looks like this:
+    // PATH_TO_CACHE + GUID + ROM_CRC-CACHE_ID
+    char configId[26];
+    snprintf( configId, sizeof(configId), "%08" PRIx32 "-%016" PRIx64,
+              getConfigRom().getRomCrc(), getCacheId() );
+    return getCachePath() + getConfigRom().getGuidString() + "/" + configId + ".bin";
+}
+
+uint64_t
+FFADODevice::getCacheId()
+{
+    return ((uint64_t)getConfigRom().getUnitVersion() << 32)
+           | getConfigRom().getModelId();
+}
+
 bool
-FFADODevice::loadFromCache()
+FFADODevice::serializeDiscovery( std::string basePath, Util::IOSerialize& ser ) const
 {
     return false;
 }
 
 bool
-FFADODevice::saveCache()
+FFADODevice::deserializeDiscovery( std::string basePath, Util::IODeserialize& deser )
 {
     return false;
 }
 
+bool
+FFADODevice::loadFromCache()
+{
+    std::string sFileName = getCacheFileName();
+    debugOutput( DEBUG_LEVEL_NORMAL, "filename %s\n", sFileName.c_str() );
+
+    struct stat buf;
+    if ( stat( sFileName.c_str(), &buf ) != 0 ) {
+        debugOutput( DEBUG_LEVEL_NORMAL,  "\"%s\" does not exist\n",  sFileName.c_str() );
+        return false;
+    }
+    if ( !S_ISREG( buf.st_mode ) ) {
+        debugOutput( DEBUG_LEVEL_NORMAL,  "\"%s\" is not a regular file\n",  sFileName.c_str() );
+        return false;
+    }
+
+    Util::BinaryDeserialize deser( sFileName, getDebugLevel() );
+    if ( !deser.isValid() ) {
+        debugOutput( DEBUG_LEVEL_NORMAL, "cache not valid: %s\n",
+                     sFileName.c_str() );
+        return false;
+    }
+
+    if ( !deserializeDiscovery( "", deser ) ) {
+        debugOutput( DEBUG_LEVEL_NORMAL, "could not load device from %s\n",
+                     sFileName.c_str() );
+        return false;
+    }
+    debugOutput( DEBUG_LEVEL_NORMAL, "loaded device from %s\n",
+                 sFileName.c_str() );
+    return true;
+}
+
+bool
+FFADODevice::saveCache()
+{
+    std::string sFileName = getCacheFileName();
+    if ( !createCacheDirectories( sFileName ) ) {
+        return false;
+    }
+    debugOutput( DEBUG_LEVEL_NORMAL, "filename %s\n", sFileName.c_str() );
+
+    // write to a temporary file first, such that a concurrent load never
+    // sees a partially written cache
+    std::ostringstream tmpName;
+    tmpName << sFileName << ".tmp" << getpid();
+    Util::BinarySerialize ser( tmpName.str() );
+    if ( !serializeDiscovery( "", ser ) || !ser.close() ) {
+        unlink( tmpName.str().c_str() );
+        return false;
+    }
+    if ( rename( tmpName.str().c_str(), sFileName.c_str() ) != 0 ) {
+        debugError( "Could not rename \"%s\"\n", tmpName.str().c_str() );
+        unlink( tmpName.str().c_str() );
+        return false;
+    }
+    return true;
+}
+
+bool
+FFADODevice::createCacheDirectories( const std::string& fileName )
+{
+    // Other devices can be discovered at the same time, so an existing
+    // directory is fine.
+    for ( std::string::size_type pos = fileName.find( '/', 1 );
+          pos != std::string::npos;
+          pos = fileName.find( '/', pos + 1 ) )
+    {
+        std::string path = fileName.substr( 0, pos );
+        if ( mkdir( path.c_str(), S_IRWXU | S_IRWXG ) != 0 && errno != EEXIST ) {
+            debugError( "Could not create \"%s\" directory\n", path.c_str() );
+            return false;
+        }
+        struct stat buf;
+        if ( stat( path.c_str(), &buf ) != 0 || !S_ISDIR( buf.st_mode ) ) {
+            debugError( "\"%s\" is not a directory\n",  path.c_str() );
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string
+FFADODevice::getStreamingStateFileName( int samplerate )
+{
+    std::ostringstream name;
+    name << getCachePath() << getConfigRom().getGuidString()
+         << "/streaming-" << samplerate << ".bin";
+    return name.str();
+}
+
+// the rates are stored as integers, in units of 1e-9
+#define STREAMING_STATE_RATE_SCALE 1e9
+
+bool
+FFADODevice::loadStreamingState( int samplerate, struct StreamingState& state )
+{
+    std::string sFileName = getStreamingStateFileName( samplerate );
+
+    struct stat buf;
+    if ( stat( sFileName.c_str(), &buf ) != 0 || !S_ISREG( buf.st_mode ) ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "no streaming state in \"%s\"\n", sFileName.c_str() );
+        return false;
+    }
+
+    Util::BinaryDeserialize deser( sFileName, getDebugLevel() );
+    if ( !deser.isValid() ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "streaming state not valid: %s\n",
+                     sFileName.c_str() );
+        return false;
+    }
+
+    long long value;
+    long long nb_streams;
+    bool result = true;
+    result &= deser.read( "CycleTimerRate", value );
+    state.cycle_timer_rate = (float)(value / STREAMING_STATE_RATE_SCALE);
+    result &= deser.read( "NbReceiveStreams", nb_streams );
+    state.ticks_per_frame.clear();
+    for ( long long i = 0; result && i < nb_streams; i++ ) {
+        std::ostringstream path;
+        path << "ReceiveStream" << i << "/TicksPerFrame";
+        result &= deser.read( path.str(), value );
+        state.ticks_per_frame.push_back( (float)(value / STREAMING_STATE_RATE_SCALE) );
+    }
+    if ( !result ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "could not read streaming state from %s\n",
+                     sFileName.c_str() );
+        return false;
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "loaded streaming state from %s\n",
+                 sFileName.c_str() );
+    return true;
+}
+
+bool
+FFADODevice::saveStreamingState( int samplerate, const struct StreamingState& state )
+{
+    std::string sFileName = getStreamingStateFileName( samplerate );
+    if ( !createCacheDirectories( sFileName ) ) {
+        return false;
+    }
+
+    std::ostringstream tmpName;
+    tmpName << sFileName << ".tmp" << getpid();
+    Util::BinarySerialize ser( tmpName.str() );
+    bool result = true;
+    result &= ser.write( "CycleTimerRate",
+                         (long long)(state.cycle_timer_rate * STREAMING_STATE_RATE_SCALE + 0.5) );
+    result &= ser.write( "NbReceiveStreams", (long long)state.ticks_per_frame.size() );
+    for ( unsigned int i = 0; i < state.ticks_per_frame.size(); i++ ) {
+        std::ostringstream path;
+        path << "ReceiveStream" << i << "/TicksPerFrame";
+        result &= ser.write( path.str(),
+                             (long long)(state.ticks_per_frame.at(i) * STREAMING_STATE_RATE_SCALE + 0.5) );
+    }
+    if ( !result || !ser.close() ) {
+        unlink( tmpName.str().c_str() );
+        return false;
+    }
+    if ( rename( tmpName.str().c_str(), sFileName.c_str() ) != 0 ) {
+        debugError( "Could not rename \"%s\"\n", tmpName.str().c_str() );
+        unlink( tmpName.str().c_str() );
+        return false;
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "saved streaming state to %s\n",
+                 sFileName.c_str() );
+    return true;
+}
+
 bool
 FFADODevice::needsRediscovery()
 {
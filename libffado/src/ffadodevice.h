@@ -48,6 +48,11 @@ namespace Control {
     class Container;
 }
 
+namespace Util {
+    class IOSerialize;
+    class IODeserialize;
+}
+
 /*!
 @brief Base class for device support
 
@@ -89,7 +94,8 @@ public:
      * @brief Called by DeviceManager to load device model from cache.
      *
      * This function is called before discover in order to speed up
-     * system initializing.
+     * system initializing. The default implementation loads the file
+     * selected by the GUID and getCacheId() using deserializeDiscovery().
      *
      * @returns true if device was cached and successfully loaded from cache
      */
@@ -99,11 +105,73 @@ public:
      * @brief Called by DeviceManager to allow device driver to save a cache version
      * of the current configuration.
      *
+     * The default implementation stores the result of serializeDiscovery()
+     * in a file selected by the GUID and getCacheId().
+     *
      * @returns true if caching was successful. False doesn't mean an error just,
      * the driver was unable to store the configuration
      */
     virtual bool saveCache();
 
+    /**
+     * @brief Returns the id of the cached discovery state
+     *
+     * The discovery cache is stored per GUID, and within that per config
+     * ROM CRC and cache id. A firmware update that changes the config ROM
+     * therefore invalidates the cache. The default id combines the unit
+     * version and the model id of the config rom, it doesn't cover the
+     * current configuration of the device. Drivers whose discovered state
+     * depends on that (e.g. on the sample rate or the sync source) have to
+     * fold it into the id before they opt into the cache, as the AV/C
+     * devices do with their configuration id and DICE does with its
+     * clock select register.
+     *
+     * @returns the cache id
+     */
+    virtual uint64_t getCacheId();
+
+    /**
+     * @brief Serializes the discovered device state for the discovery cache
+     *
+     * Drivers opt into the generic discovery cache by implementing this
+     * and deserializeDiscovery(). The default doesn't cache anything.
+     *
+     * @returns true if the state was serialized
+     */
+    virtual bool serializeDiscovery( std::string basePath, Util::IOSerialize& ser ) const;
+    /**
+     * @brief Restores the discovered device state from the discovery cache
+     *
+     * On success the device has to be in the same state as after discover().
+     *
+     * @returns true if the state was restored
+     */
+    virtual bool deserializeDiscovery( std::string basePath, Util::IODeserialize& deser );
+
+    /**
+     * @brief The DLL rates that the streaming code carries over between sessions
+     *
+     * The rates only depend on the clocks of the hardware, so the values
+     * a previous session converged to are a good starting point.
+     */
+    struct StreamingState {
+        float cycle_timer_rate;             ///< ticks per usec, 0 if unknown
+        std::vector<float> ticks_per_frame; ///< one per receive stream
+    };
+    /**
+     * @brief Loads the streaming state saved for the given sample rate
+     * @returns true if a valid state was found
+     */
+    bool loadStreamingState( int samplerate, struct StreamingState& state );
+    /**
+     * @brief Saves the streaming state for the given sample rate
+     *
+     * The state is stored next to the discovery cache of the device.
+     *
+     * @returns true if the state was saved
+     */
+    bool saveStreamingState( int samplerate, const struct StreamingState& state );
+
     /**
      * @brief Called by DeviceManager to check whether a device requires rediscovery
      *
@@ -479,6 +547,17 @@ public:
 
     DeviceManager& getDeviceManager()
         {return m_pDeviceManager;};
+
+protected:
+    /// Returns the root directory of the discovery cache
+    static std::string getCachePath();
+    /// Returns the discovery cache file for the current cache id
+    std::string getCacheFileName();
+    /// Returns the streaming state file for a sample rate
+    std::string getStreamingStateFileName( int samplerate );
+    /// Creates the directories leading to a cache file, like 'mkdir -p'
+    static bool createCacheDirectories( const std::string& fileName );
+
 private:
     std::auto_ptr<ConfigRom>( m_pConfigRom );
     DeviceManager& m_pDeviceManager;
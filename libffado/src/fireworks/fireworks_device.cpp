@@ -151,6 +151,38 @@ Device::discover()
     return true;
 }
 
+uint64_t
+Device::getConfigurationId()
+{
+    uint64_t id = GenericAVC::Device::getConfigurationId();
+
+    // the clock source is selected through EFC, so add it to the id.
+    // Don't use getClock() here, its fallback switches firmwares that
+    // report an invalid clock to the internal one.
+    EfcGetClockCmd gccmd;
+    if (doEfcOverAVC(gccmd) && gccmd.m_clock <= EFC_CMD_HW_CLOCK_COUNT) {
+        id |= ((uint64_t)gccmd.m_clock + 1) << 40;
+    }
+    return id;
+}
+
+bool
+Device::deserializeDiscovery( std::string basePath, Util::IODeserialize& deser )
+{
+    // the EFC hardware info isn't part of the AV/C model, so read it
+    // like discover() does
+    if ( !discoverUsingEFC() ) {
+        return false;
+    }
+    if ( !GenericAVC::Device::deserializeDiscovery( basePath, deser ) ) {
+        return false;
+    }
+    if(!buildMixer()) {
+        debugWarning("Could not build mixer\n");
+    }
+    return true;
+}
+
 bool
 Device::discoverUsingEFC()
 {
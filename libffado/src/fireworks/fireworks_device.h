@@ -56,6 +56,9 @@ public:
     static FFADODevice * createDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ));
     virtual bool discover();
 
+    virtual uint64_t getConfigurationId();
+    virtual bool deserializeDiscovery( std::string basePath, Util::IODeserialize& deser );
+
     virtual void showDevice();
     
     virtual bool buildMixer();
@@ -32,6 +32,8 @@
 #include "libavc/general/avc_plug_info.h"
 #include "libavc/general/avc_extended_plug_info.h"
 #include "libavc/general/avc_subunit_info.h"
+#include "libavc/streamformat/avc_extended_stream_format.h"
+#include "libavc/ccm/avc_signal_source.h"
 
 #include "debugmodule/debugmodule.h"
 
@@ -938,4 +940,152 @@ Device::deserialize( std::string basePath, Util::IODeserialize& deser )
     return result;
 }
 
+uint8_t
+Device::getConfigurationIdSampleRate()
+{
+    AVC::ExtendedStreamFormatCmd extStreamFormatCmd( get1394Service() );
+    AVC::UnitPlugAddress unitPlugAddress( AVC::UnitPlugAddress::ePT_PCR, 0 );
+    extStreamFormatCmd.setPlugAddress( AVC::PlugAddress( AVC::PlugAddress::ePD_Input,
+                                                         AVC::PlugAddress::ePAM_Unit,
+                                                         unitPlugAddress ) );
+
+    extStreamFormatCmd.setNodeId( getNodeId() );
+    extStreamFormatCmd.setCommandType( AVC::AVCCommand::eCT_Status );
+    extStreamFormatCmd.setVerbose( getDebugLevel() );
+
+    if ( !extStreamFormatCmd.fire() ) {
+        debugError( "Stream format command failed\n" );
+        return 0;
+    }
+
+    AVC::FormatInformation* formatInfo =
+        extStreamFormatCmd.getFormatInformation();
+    AVC::FormatInformationStreamsCompound* compoundStream
+        = dynamic_cast< AVC::FormatInformationStreamsCompound* > (
+            formatInfo->m_streams );
+    if ( compoundStream ) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Sample rate 0x%02x\n",
+                    compoundStream->m_samplingFrequency );
+        return compoundStream->m_samplingFrequency;
+    }
+
+    debugError( "Could not retrieve sample rate\n" );
+    return 0;
+}
+
+uint8_t
+Device::getConfigurationIdNumberOfChannel( AVC::PlugAddress::EPlugDirection ePlugDirection )
+{
+    AVC::ExtendedPlugInfoCmd extPlugInfoCmd( get1394Service() );
+    AVC::UnitPlugAddress unitPlugAddress( AVC::UnitPlugAddress::ePT_PCR,
+                                          0 );
+    extPlugInfoCmd.setPlugAddress( AVC::PlugAddress( ePlugDirection,
+                                                     AVC::PlugAddress::ePAM_Unit,
+                                                     unitPlugAddress ) );
+    extPlugInfoCmd.setNodeId( getNodeId() );
+    extPlugInfoCmd.setCommandType( AVC::AVCCommand::eCT_Status );
+    extPlugInfoCmd.setVerbose( getDebugLevel() );
+    AVC::ExtendedPlugInfoInfoType extendedPlugInfoInfoType(
+        AVC::ExtendedPlugInfoInfoType::eIT_NoOfChannels );
+    extendedPlugInfoInfoType.initialize();
+    extPlugInfoCmd.setInfoType( extendedPlugInfoInfoType );
+
+    if ( !extPlugInfoCmd.fire() ) {
+        debugError( "Number of channels command failed\n" );
+        return 0;
+    }
+
+    AVC::ExtendedPlugInfoInfoType* infoType = extPlugInfoCmd.getInfoType();
+    if ( infoType
+         && infoType->m_plugNrOfChns )
+    {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Number of channels 0x%02x\n",
+                    infoType->m_plugNrOfChns->m_nrOfChannels );
+        return infoType->m_plugNrOfChns->m_nrOfChannels;
+    }
+
+    debugError( "Could not retrieve number of channels\n" );
+    return 0;
+}
+
+uint16_t
+Device::getConfigurationIdSyncMode()
+{
+    AVC::SignalSourceCmd signalSourceCmd( get1394Service() );
+    AVC::SignalUnitAddress signalUnitAddr;
+    signalUnitAddr.m_plugId = 0x01;
+    signalSourceCmd.setSignalDestination( signalUnitAddr );
+    signalSourceCmd.setNodeId( getNodeId() );
+    signalSourceCmd.setSubunitType( AVC::eST_Unit  );
+    signalSourceCmd.setSubunitId( 0xff );
+    signalSourceCmd.setVerbose( getDebugLevel() );
+
+    signalSourceCmd.setCommandType( AVC::AVCCommand::eCT_Status );
+
+    if ( !signalSourceCmd.fire() ) {
+        debugError( "Signal source command failed\n" );
+        return 0;
+    }
+
+    AVC::SignalAddress* pSyncPlugSignalAddress = signalSourceCmd.getSignalSource();
+    AVC::SignalSubunitAddress* pSyncPlugSubunitAddress
+        = dynamic_cast<AVC::SignalSubunitAddress*>( pSyncPlugSignalAddress );
+    if ( pSyncPlugSubunitAddress ) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Sync mode 0x%02x\n",
+                    ( pSyncPlugSubunitAddress->m_subunitType << 3
+                      | pSyncPlugSubunitAddress->m_subunitId ) << 8
+                    | pSyncPlugSubunitAddress->m_plugId );
+
+        return ( pSyncPlugSubunitAddress->m_subunitType << 3
+                 | pSyncPlugSubunitAddress->m_subunitId ) << 8
+            | pSyncPlugSubunitAddress->m_plugId;
+    }
+
+    AVC::SignalUnitAddress* pSyncPlugUnitAddress
+      = dynamic_cast<AVC::SignalUnitAddress*>( pSyncPlugSignalAddress );
+    if ( pSyncPlugUnitAddress ) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Sync mode 0x%02x\n",
+                      0xff << 8 | pSyncPlugUnitAddress->m_plugId );
+
+        return ( 0xff << 8 | pSyncPlugUnitAddress->m_plugId );
+    }
+
+    debugError( "Could not retrieve sync mode\n" );
+    return 0;
+}
+
+uint64_t
+Device::getConfigurationId()
+{
+    // create a unique configuration id.
+    uint64_t id = 0;
+    id = getConfigurationIdSampleRate();
+    id |= getConfigurationIdNumberOfChannel( AVC::PlugAddress::ePD_Input ) << 8;
+    id |= getConfigurationIdNumberOfChannel( AVC::PlugAddress::ePD_Output ) << 16;
+    id |= ((uint64_t)getConfigurationIdSyncMode()) << 24;
+    return id;
+}
+
+uint64_t
+Device::getCacheId()
+{
+    return getConfigurationId();
+}
+
+bool
+Device::serializeDiscovery( std::string basePath, Util::IOSerialize& ser ) const
+{
+    // the discovered state is the unit model, which depends on the
+    // configuration the cache id is made of
+    return serialize( basePath, ser );
+}
+
+bool
+Device::deserializeDiscovery( std::string basePath, Util::IODeserialize& deser )
+{
+    // the plug connections, hence the active sync source, are re-read
+    // from the device by AVC::Unit::deserialize()
+    return deserialize( basePath, deser );
+}
+
 }
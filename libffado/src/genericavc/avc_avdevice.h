@@ -57,6 +57,19 @@ public:
     virtual bool serialize( std::string basePath, Util::IOSerialize& ser ) const;
     virtual bool deserialize( std::string basePath, Util::IODeserialize& deser );
 
+    virtual uint64_t getCacheId();
+    virtual bool serializeDiscovery( std::string basePath, Util::IOSerialize& ser ) const;
+    virtual bool deserializeDiscovery( std::string basePath, Util::IODeserialize& deser );
+
+    /**
+     * @brief Returns an id for the current configuration of the unit
+     *
+     * The id covers everything the unit model depends on and that can
+     * be read without discovering the unit: the sample rate, the number
+     * of channels of the first iso plugs and the sync mode.
+     */
+    virtual uint64_t getConfigurationId();
+
     virtual void setVerboseLevel(int l);
     virtual void showDevice();
 
@@ -89,6 +102,11 @@ public:
 
 protected:
     bool discoverGeneric();
+
+    virtual uint8_t getConfigurationIdSampleRate();
+    virtual uint8_t getConfigurationIdNumberOfChannel( AVC::PlugAddress::EPlugDirection ePlugDirection );
+    virtual uint16_t getConfigurationIdSyncMode();
+
     virtual bool addPlugToProcessor( AVC::Plug& plug, Streaming::StreamProcessor *processor,
                              Streaming::AmdtpAudioPort::E_Direction direction);
 /*    bool setSamplingFrequencyPlug( AVC::Plug& plug,
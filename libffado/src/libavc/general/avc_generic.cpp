@@ -212,11 +212,12 @@ AVCCommand::fire()
 
     bool result = false;
     unsigned int resp_len;
-    quadlet_t* resp = m_p1394Service->transactionBlock( m_nodeId,
-                                                        (quadlet_t*)m_fcpFrame,
-                                                        ( fcpFrameSize+3 ) / 4,
-                                                        &resp_len );
-    if ( resp ) {
+    quadlet_t resp[MAX_FCP_BLOCK_SIZE_QUADS];
+    if ( m_p1394Service->fcpTransaction( m_nodeId,
+                                         (quadlet_t*)m_fcpFrame,
+                                         ( fcpFrameSize+3 ) / 4,
+                                         resp,
+                                         &resp_len ) ) {
         resp_len *= 4;
         unsigned char* buf = ( unsigned char* ) resp;
 
@@ -260,11 +261,9 @@ AVCCommand::fire()
 
         }
         debugOutputShort( DEBUG_LEVEL_VERY_VERBOSE, "\n" );
-        m_p1394Service->transactionBlockClose();
     } else {
         debugOutput( DEBUG_LEVEL_VERBOSE, "no response\n" );
         result = false;
-        m_p1394Service->transactionBlockClose();
     }
 
     return result;
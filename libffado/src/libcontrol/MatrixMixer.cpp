@@ -25,6 +25,38 @@
 
 namespace Control {
 
+    bool MatrixMixer::setValues(const int row, const int col,
+                                const int nb_rows, const int nb_cols,
+                                const std::vector<double>& values) {
+        if (nb_rows < 0 || nb_cols < 0 || values.size() != (size_t)(nb_rows * nb_cols)) {
+            return false;
+        }
+        // setValue() returns the new value (or true), zero if it failed.
+        // A zero coefficient can't be told apart from a failure.
+        bool retval = true;
+        for (int i = 0; i < nb_rows; i++) {
+            for (int j = 0; j < nb_cols; j++) {
+                double v = values.at(i * nb_cols + j);
+                retval &= (setValue(row + i, col + j, v) != 0 || v == 0);
+            }
+        }
+        return retval;
+    }
+    bool MatrixMixer::getValues(const int row, const int col,
+                                const int nb_rows, const int nb_cols,
+                                std::vector<double>& values) {
+        if (nb_rows < 0 || nb_cols < 0) {
+            return false;
+        }
+        values.resize(nb_rows * nb_cols);
+        for (int i = 0; i < nb_rows; i++) {
+            for (int j = 0; j < nb_cols; j++) {
+                values.at(i * nb_cols + j) = getValue(row + i, col + j);
+            }
+        }
+        return true;
+    }
+
     std::string MatrixMixer::getRowName(const int) {
         return "";
     }
@@ -63,6 +63,25 @@ public:
     virtual double getValue(const int, const int) = 0;
     // @}
 
+    /*!
+      @{
+      @brief block access to a rectangle of coefficients
+
+      Accesses the nb_rows x nb_cols coefficients starting at (row, col).
+      The values are stored row by row. The default implementations use
+      the per-coefficient functions, mixers that can transfer a block of
+      coefficients at once should override them. The default setValues()
+      sets every coefficient and fails if any setValue() returned zero
+      for a non-zero value.
+      */
+    virtual bool setValues(const int row, const int col,
+                           const int nb_rows, const int nb_cols,
+                           const std::vector<double>& values);
+    virtual bool getValues(const int row, const int col,
+                           const int nb_rows, const int nb_cols,
+                           std::vector<double>& values);
+    // @}
+
     /*!
       @{
       @brief functions to access the entire coefficient map at once
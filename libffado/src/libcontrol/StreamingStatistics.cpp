@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "StreamingStatistics.h"
+#include "libutil/LatencyStatistics.h"
+
+namespace Control {
+
+StreamingStatistics::StreamingStatistics(Element *parent, Util::LatencyStatistics &local)
+: Element(parent, "LatencyStatistics")
+, m_local( local )
+, m_remote( new Util::LatencyStatistics() )
+{
+    setLabel("Latency statistics");
+    setDescription("Latency and jitter histograms of the streaming system");
+}
+
+StreamingStatistics::~StreamingStatistics()
+{
+    delete m_remote;
+}
+
+Util::LatencyStatistics *
+StreamingStatistics::getSource()
+{
+    if (m_local.isPublished()) {
+        return &m_local;
+    }
+    if (m_remote->open()) {
+        return m_remote;
+    }
+    return NULL;
+}
+
+StreamingStatistics::ValuesVector
+StreamingStatistics::getStatistics()
+{
+    ValuesVector v;
+    Util::LatencyStatistics *s = getSource();
+    if (s == NULL) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "no statistics available\n");
+        return v;
+    }
+    for (int i = 0; i < Util::LatencyStatistics::eS_Count; i++) {
+        enum Util::LatencyStatistics::eStatistic id = (enum Util::LatencyStatistics::eStatistic)i;
+        Util::LatencyHistogram &h = s->get(id);
+        struct Values values;
+        values.name = Util::LatencyStatistics::getName(id);
+        values.count = h.getCount();
+        values.min = h.getMin();
+        values.max = h.getMax();
+        values.mean = h.getMean();
+        values.p50 = h.getPercentile(0.5);
+        values.p90 = h.getPercentile(0.9);
+        values.p99 = h.getPercentile(0.99);
+        values.p999 = h.getPercentile(0.999);
+        v.push_back(values);
+    }
+    return v;
+}
+
+bool
+StreamingStatistics::reset()
+{
+    Util::LatencyStatistics *s = getSource();
+    if (s == NULL) {
+        return false;
+    }
+    s->reset();
+    return true;
+}
+
+void
+StreamingStatistics::show()
+{
+    Util::LatencyStatistics *s = getSource();
+    if (s == NULL) {
+        debugOutput( DEBUG_LEVEL_NORMAL, "StreamingStatistics Element %s, no statistics\n",
+                     getName().c_str());
+        return;
+    }
+    debugOutput( DEBUG_LEVEL_NORMAL, "StreamingStatistics Element %s\n",
+                 getName().c_str());
+    s->show();
+}
+
+} // namespace Control
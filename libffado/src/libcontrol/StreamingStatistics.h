@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONTROL_STREAMING_STATISTICS_H
+#define CONTROL_STREAMING_STATISTICS_H
+
+#include "debugmodule/debugmodule.h"
+
+#include "Element.h"
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace Util {
+    class LatencyStatistics;
+}
+
+namespace Control {
+
+/*!
+@brief Latency and jitter statistics of the streaming system
+
+ Shows the statistics collected by the process that is streaming. This
+ can be the current process, otherwise the statistics that process
+ published in shared memory are used.
+*/
+class StreamingStatistics : public Element
+{
+public:
+    struct Values {
+        std::string name;
+        uint64_t    count;
+        uint32_t    min;
+        uint32_t    max;
+        uint32_t    mean;
+        uint32_t    p50;
+        uint32_t    p90;
+        uint32_t    p99;
+        uint32_t    p999;
+    };
+    typedef std::vector<struct Values> ValuesVector;
+
+public:
+    StreamingStatistics(Element *parent, Util::LatencyStatistics &local);
+    virtual ~StreamingStatistics();
+
+    ///> empty if no process is streaming
+    virtual ValuesVector getStatistics();
+    virtual bool reset();
+
+    virtual bool canChangeValue() {return true;};
+
+    virtual void show();
+
+private:
+    Util::LatencyStatistics *getSource();
+
+    Util::LatencyStatistics &m_local;
+    Util::LatencyStatistics *m_remote;
+};
+
+}; // namespace Control
+
+#endif // CONTROL_STREAMING_STATISTICS_H
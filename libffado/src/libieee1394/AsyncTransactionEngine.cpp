@@ -0,0 +1,570 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "AsyncTransactionEngine.h"
+#include "ieee1394service.h"
+
+#include "libutil/PosixThread.h"
+#include "libutil/Configuration.h"
+#include "libutil/SystemTimeSource.h"
+
+#include <sys/poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+IMPL_DEBUG_MODULE( AsyncTransactionEngine, AsyncTransactionEngine, DEBUG_LEVEL_NORMAL );
+
+AsyncTransactionEngine::Request::Request()
+    : m_type( eRT_Read )
+    , m_nodeId( INVALID_NODE_ID )
+    , m_addr( 0 )
+    , m_length( 0 )
+    , m_buffer( NULL )
+    , m_completion( NULL )
+    , m_status( eRS_Idle )
+    , m_error( 0 )
+    , m_transaction( NULL )
+{
+}
+
+void
+AsyncTransactionEngine::Request::setRead(fb_nodeid_t nodeId, fb_nodeaddr_t addr,
+                                         size_t length, fb_quadlet_t *buffer)
+{
+    m_type = eRT_Read;
+    m_nodeId = nodeId;
+    m_addr = addr;
+    m_length = length;
+    m_buffer = buffer;
+    m_status = eRS_Idle;
+    m_error = 0;
+    m_transaction = NULL;
+}
+
+void
+AsyncTransactionEngine::Request::setWrite(fb_nodeid_t nodeId, fb_nodeaddr_t addr,
+                                          size_t length, fb_quadlet_t *data)
+{
+    m_type = eRT_Write;
+    m_nodeId = nodeId;
+    m_addr = addr;
+    m_length = length;
+    m_buffer = data;
+    m_status = eRS_Idle;
+    m_error = 0;
+    m_transaction = NULL;
+}
+
+AsyncTransactionEngine::AsyncTransactionEngine(Ieee1394Service &parent, bool rt, int prio)
+    : m_parent( parent )
+    , m_handle( NULL )
+    , m_thread( NULL )
+    , m_realtime( rt )
+    , m_priority( prio )
+    , m_running( false )
+    , m_wakeup_fd( -1 )
+    , m_max_outstanding( IEEE1394SERVICE_ASYNC_MAX_OUTSTANDING )
+    , m_max_outstanding_per_node( IEEE1394SERVICE_ASYNC_MAX_OUTSTANDING_PER_NODE )
+    , m_max_batch_quads( IEEE1394SERVICE_ASYNC_MAX_BATCH_QUADS )
+    , m_outstanding( 0 )
+{
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_completion_cond, NULL);
+}
+
+AsyncTransactionEngine::~AsyncTransactionEngine()
+{
+    Stop();
+    delete m_thread;
+    if (m_handle) {
+        raw1394_destroy_handle(m_handle);
+    }
+    if (m_wakeup_fd >= 0) {
+        close(m_wakeup_fd);
+    }
+    pthread_cond_destroy(&m_completion_cond);
+    pthread_mutex_destroy(&m_lock);
+}
+
+bool
+AsyncTransactionEngine::init()
+{
+    Util::Configuration *config = m_parent.getConfiguration();
+    int max_outstanding = m_max_outstanding;
+    int max_outstanding_per_node = m_max_outstanding_per_node;
+    int max_batch_quads = m_max_batch_quads;
+    if (config) {
+        config->getValueForSetting("ieee1394.async.max_outstanding", max_outstanding);
+        config->getValueForSetting("ieee1394.async.max_outstanding_per_node", max_outstanding_per_node);
+        config->getValueForSetting("ieee1394.async.max_batch_quads", max_batch_quads);
+    }
+    m_max_outstanding = (max_outstanding < 1 ? 1 : max_outstanding);
+    m_max_outstanding_per_node = (max_outstanding_per_node < 1 ? 1 : max_outstanding_per_node);
+    m_max_batch_quads = (max_batch_quads < 0 ? 0 : max_batch_quads);
+
+    m_handle = raw1394_new_handle_on_port( m_parent.getPort() );
+    if (!m_handle) {
+        debugError("Could not allocate handle: %s\n", strerror(errno));
+        return false;
+    }
+    raw1394_set_userdata( m_handle, this );
+    raw1394_set_tag_handler( m_handle, tagHandler );
+
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd < 0) {
+        debugError("Could not create wakeup eventfd: %s\n", strerror(errno));
+        return false;
+    }
+
+    debugOutput(DEBUG_LEVEL_VERBOSE,
+                "Async engine: max %u outstanding, %u per node, batches up to %u quadlets\n",
+                m_max_outstanding, m_max_outstanding_per_node, m_max_batch_quads);
+    return true;
+}
+
+bool
+AsyncTransactionEngine::Start()
+{
+    m_thread = new Util::PosixThread(this, "ASYNC", m_realtime, m_priority,
+                                     PTHREAD_CANCEL_DEFERRED);
+    if (!m_thread) {
+        debugFatal("No thread\n");
+        return false;
+    }
+    m_running = true;
+    if (m_thread->Start() != 0) {
+        debugFatal("Could not start async transaction thread\n");
+        m_running = false;
+        return false;
+    }
+    return true;
+}
+
+bool
+AsyncTransactionEngine::Stop()
+{
+    if (!m_running) {
+        return true;
+    }
+    // no new requests from now on
+    pthread_mutex_lock(&m_lock);
+    m_running = false;
+
+    // let the outstanding transactions complete, such that nothing
+    // refers to the transactions after the thread has stopped
+    int tries = 100;
+    while (m_outstanding && tries--) {
+        pthread_mutex_unlock(&m_lock);
+        Util::SystemTimeSource::SleepUsecRelative(10000);
+        pthread_mutex_lock(&m_lock);
+    }
+    if (m_outstanding) {
+        debugWarning("%u transactions still outstanding\n", m_outstanding);
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    uint64_t one = 1;
+    if (write(m_wakeup_fd, &one, sizeof(one)) != sizeof(one)) {
+        debugWarning("Could not wake up async thread\n");
+    }
+    if (m_thread) {
+        m_thread->Stop();
+    }
+    failPendingRequests();
+    return true;
+}
+
+bool
+AsyncTransactionEngine::setThreadParameters(bool rt, int priority)
+{
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) switch to: (rt=%d, prio=%d)...\n", this, rt, priority);
+    if (priority > THREAD_MAX_RTPRIO) priority = THREAD_MAX_RTPRIO; // cap the priority
+    m_realtime = rt;
+    m_priority = priority;
+    if (m_thread) {
+        if (m_realtime) {
+            m_thread->AcquireRealTime(m_priority);
+        } else {
+            m_thread->DropRealTime();
+        }
+    }
+    return true;
+}
+
+bool
+AsyncTransactionEngine::Init()
+{
+    return true;
+}
+
+bool
+AsyncTransactionEngine::Execute()
+{
+    dispatchRequests();
+
+    struct pollfd fds[2];
+    fds[0].fd = raw1394_get_fd(m_handle);
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = m_wakeup_fd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    int err = poll(fds, 2, IEEE1394SERVICE_ASYNC_POLL_TIMEOUT_MSEC);
+    if (err < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        debugError("poll error: %s\n", strerror(errno));
+        return false;
+    }
+    if (fds[1].revents & POLLIN) {
+        uint64_t count;
+        if (read(m_wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+            debugWarning("Could not read wakeup eventfd: %s\n", strerror(errno));
+        }
+    }
+    if (fds[0].revents & POLLIN) {
+        // dispatches the completions to tagHandler
+        if (raw1394_loop_iterate(m_handle) < 0) {
+            debugError("Failed to iterate handle\n");
+        }
+    }
+    return true;
+}
+
+bool
+AsyncTransactionEngine::queueRequest(Request &r)
+{
+    if (r.m_nodeId == INVALID_NODE_ID) {
+        debugWarning("operation on invalid node\n");
+        r.m_error = EINVAL;
+        r.m_status = Request::eRS_Error;
+        return false;
+    }
+    pthread_mutex_lock(&m_lock);
+    // checked with the lock held, such that Stop() can't miss a request
+    // that is queued while it fails the pending ones
+    if (!m_running) {
+        pthread_mutex_unlock(&m_lock);
+        r.m_error = ESHUTDOWN;
+        r.m_status = Request::eRS_Error;
+        return false;
+    }
+    r.m_status = Request::eRS_Queued;
+    r.m_error = 0;
+    m_queues[getQueueKey(r.m_nodeId)].queue.push_back(&r);
+    pthread_mutex_unlock(&m_lock);
+
+    uint64_t one = 1;
+    if (write(m_wakeup_fd, &one, sizeof(one)) != sizeof(one)) {
+        debugWarning("Could not wake up async thread\n");
+    }
+    return true;
+}
+
+bool
+AsyncTransactionEngine::waitForRequest(Request &r)
+{
+    // pthread_cond_timedwait() uses CLOCK_REALTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t nsecs = ts.tv_nsec + IEEE1394SERVICE_ASYNC_REQUEST_TIMEOUT_MSEC * 1000000ULL;
+    ts.tv_sec += nsecs / 1000000000ULL;
+    ts.tv_nsec = nsecs % 1000000000ULL;
+
+    pthread_mutex_lock(&m_lock);
+    while (r.m_status == Request::eRS_Queued || r.m_status == Request::eRS_Busy) {
+        if (pthread_cond_timedwait(&m_completion_cond, &m_lock, &ts) == ETIMEDOUT) {
+            if (r.m_status == Request::eRS_Queued || r.m_status == Request::eRS_Busy) {
+                debugError("Request to node 0x%hX, addr 0x%016" PRIX64 " timed out\n",
+                           r.m_nodeId, r.m_addr);
+                abortRequest(r, ETIMEDOUT);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    if (r.m_status != Request::eRS_Done) {
+        errno = r.m_error;
+        return false;
+    }
+    return true;
+}
+
+bool
+AsyncTransactionEngine::doRequest(Request &r)
+{
+    if (!queueRequest(r)) {
+        errno = r.m_error;
+        return false;
+    }
+    return waitForRequest(r);
+}
+
+// has to be called with m_lock held
+AsyncTransactionEngine::Transaction *
+AsyncTransactionEngine::createTransaction(NodeQueue &q)
+{
+    Request *r = q.queue.front();
+    q.queue.pop_front();
+
+    Transaction *t = new Transaction;
+    t->engine = this;
+    t->type = r->m_type;
+    t->nodeId = r->m_nodeId;
+    t->addr = r->m_addr;
+    t->length = r->m_length;
+    t->buffer = r->m_buffer;
+    t->requests.push_back(r);
+    t->lengths.push_back(r->m_length);
+
+    // merge adjacent block reads, as long as they fit in the max payload
+    // of the node. Quadlet reads are never merged since some registers
+    // don't support block access.
+    if (t->type == Request::eRT_Read && t->length > 1) {
+        unsigned int max_quads = m_max_batch_quads;
+        if (q.max_payload < max_quads) {
+            max_quads = q.max_payload;
+        }
+        while (!q.queue.empty()) {
+            Request *next = q.queue.front();
+            if (next->m_type != Request::eRT_Read
+                || next->m_length < 2
+                || next->m_addr != t->addr + t->length * 4
+                || t->length + next->m_length > max_quads) {
+                break;
+            }
+            q.queue.pop_front();
+            t->requests.push_back(next);
+            t->lengths.push_back(next->m_length);
+            t->length += next->m_length;
+        }
+        if (t->requests.size() > 1) {
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
+                        "Merged %zd reads from node 0x%hX, addr 0x%016" PRIX64 ", %zd quadlets\n",
+                        t->requests.size(), t->nodeId, t->addr, t->length);
+        }
+    }
+    if (t->type == Request::eRT_Read) {
+        t->read_buffer.resize(t->length);
+        t->buffer = &t->read_buffer[0];
+    }
+    for (std::vector<Request *>::iterator it = t->requests.begin();
+         it != t->requests.end();
+         ++it)
+    {
+        (*it)->m_status = Request::eRS_Busy;
+        (*it)->m_transaction = t;
+    }
+    return t;
+}
+
+void
+AsyncTransactionEngine::dispatchRequests()
+{
+    std::vector<Transaction *> failed;
+
+    pthread_mutex_lock(&m_lock);
+    // serve the nodes round-robin until the limits are reached
+    bool dispatched = true;
+    while (dispatched && m_outstanding < m_max_outstanding) {
+        dispatched = false;
+        for (NodeQueueMapIterator it = m_queues.begin();
+             it != m_queues.end() && m_outstanding < m_max_outstanding;
+             ++it)
+        {
+            NodeQueue &q = it->second;
+            if (q.queue.empty() || q.outstanding >= m_max_outstanding_per_node) {
+                continue;
+            }
+            Transaction *t = createTransaction(q);
+            int err;
+            if (t->type == Request::eRT_Read) {
+                err = raw1394_start_read(m_handle, t->nodeId, t->addr, t->length * 4,
+                                         t->buffer, (unsigned long)t);
+            } else {
+                err = raw1394_start_write(m_handle, t->nodeId, t->addr, t->length * 4,
+                                          t->buffer, (unsigned long)t);
+            }
+            if (err < 0) {
+                debugOutput(DEBUG_LEVEL_VERBOSE,
+                            "Could not start transaction to node 0x%hX, addr 0x%016" PRIX64 ": %s\n",
+                            t->nodeId, t->addr, strerror(errno));
+                failed.push_back(t);
+                // count it such that completeTransaction can uncount it
+                q.outstanding++;
+                m_outstanding++;
+                continue;
+            }
+            q.outstanding++;
+            m_outstanding++;
+            dispatched = true;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    for (std::vector<Transaction *>::iterator it = failed.begin();
+         it != failed.end();
+         ++it)
+    {
+        completeTransaction(*it, EIO);
+    }
+}
+
+void
+AsyncTransactionEngine::completeTransaction(Transaction *t, int error)
+{
+    std::vector<Util::Functor *> completions;
+
+    pthread_mutex_lock(&m_lock);
+    size_t offset = 0;
+    for (unsigned int i = 0; i < t->requests.size(); i++) {
+        Request *r = t->requests.at(i);
+        if (r) {
+            if (!error && t->type == Request::eRT_Read) {
+                // scatter the (merged) read
+                memcpy(r->m_buffer, t->buffer + offset, r->m_length * 4);
+            }
+            r->m_error = error;
+            r->m_transaction = NULL;
+            if (r->m_completion) {
+                completions.push_back(r->m_completion);
+            }
+            r->m_status = (error ? Request::eRS_Error : Request::eRS_Done);
+        }
+        offset += t->lengths.at(i);
+    }
+    m_queues[getQueueKey(t->nodeId)].outstanding--;
+    m_outstanding--;
+    pthread_cond_broadcast(&m_completion_cond);
+    pthread_mutex_unlock(&m_lock);
+
+    #ifdef DEBUG
+    if (error) {
+        debugOutput(DEBUG_LEVEL_VERBOSE,
+                    "%s failed: node 0x%hX, addr = 0x%016" PRIX64 ", length = %zd: %s\n",
+                    (t->type == Request::eRT_Read ? "read" : "write"),
+                    t->nodeId, t->addr, t->length, strerror(error));
+    }
+    #endif
+    delete t;
+
+    // the requests can be gone already, hence only the functors are used
+    for (std::vector<Util::Functor *>::iterator it = completions.begin();
+         it != completions.end();
+         ++it)
+    {
+        (*(*it))();
+    }
+}
+
+void
+AsyncTransactionEngine::failPendingRequests()
+{
+    pthread_mutex_lock(&m_lock);
+    for (NodeQueueMapIterator it = m_queues.begin();
+         it != m_queues.end();
+         ++it)
+    {
+        std::deque<Request *> &queue = it->second.queue;
+        while (!queue.empty()) {
+            Request *r = queue.front();
+            queue.pop_front();
+            r->m_error = ESHUTDOWN;
+            r->m_status = Request::eRS_Error;
+        }
+    }
+    pthread_cond_broadcast(&m_completion_cond);
+    pthread_mutex_unlock(&m_lock);
+}
+
+// has to be called with m_lock held
+void
+AsyncTransactionEngine::abortRequest(Request &r, int error)
+{
+    if (r.m_status == Request::eRS_Queued) {
+        std::deque<Request *> &queue = m_queues[getQueueKey(r.m_nodeId)].queue;
+        std::deque<Request *>::iterator it = std::find(queue.begin(), queue.end(), &r);
+        if (it != queue.end()) {
+            queue.erase(it);
+        }
+    } else if (r.m_status == Request::eRS_Busy && r.m_transaction) {
+        // the transaction completes without it
+        std::vector<Request *> &requests = r.m_transaction->requests;
+        std::replace(requests.begin(), requests.end(), &r, (Request *)NULL);
+        r.m_transaction = NULL;
+    }
+    r.m_error = error;
+    r.m_status = Request::eRS_Error;
+}
+
+void
+AsyncTransactionEngine::setMaxPayload(fb_nodeid_t nodeId, unsigned int quads)
+{
+    if (nodeId == INVALID_NODE_ID) {
+        return;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Node 0x%hX: max payload %u quadlets\n", nodeId, quads);
+    pthread_mutex_lock(&m_lock);
+    m_queues[getQueueKey(nodeId)].max_payload = quads;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void
+AsyncTransactionEngine::resetMaxPayloads()
+{
+    pthread_mutex_lock(&m_lock);
+    for (NodeQueueMapIterator it = m_queues.begin();
+         it != m_queues.end();
+         ++it)
+    {
+        it->second.max_payload = 0;
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+int
+AsyncTransactionEngine::tagHandler(raw1394handle_t handle, unsigned long tag,
+                                   raw1394_errcode_t err)
+{
+    AsyncTransactionEngine *engine =
+        static_cast<AsyncTransactionEngine *>(raw1394_get_userdata(handle));
+    Transaction *t = reinterpret_cast<Transaction *>(tag);
+    int error = raw1394_errcode_to_errno(err);
+    engine->completeTransaction(t, error);
+    return 0;
+}
+
+void
+AsyncTransactionEngine::setVerboseLevel(int l)
+{
+    setDebugLevel(l);
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_ASYNCTRANSACTIONENGINE__
+#define __FFADO_ASYNCTRANSACTIONENGINE__
+
+#include "fbtypes.h"
+
+#include "libutil/Thread.h"
+#include "libutil/Functors.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include <libraw1394/raw1394.h>
+#include <pthread.h>
+
+#include <map>
+#include <deque>
+#include <vector>
+
+class Ieee1394Service;
+
+/**
+ * @brief Pipelined engine for asynchronous read/write transactions
+ *
+ * The engine owns a 1394 handle and a thread that submits the queued
+ * requests and dispatches their completions. Requests are queued per
+ * node. A configurable number of transactions can be outstanding on the
+ * bus, with a separate limit per node (most devices don't handle more
+ * than one outstanding transaction gracefully). Adjacent block reads to
+ * the same node are merged into one transaction, up to the max payload
+ * of the node (see setMaxPayload()). Reads are never merged for a node
+ * whose max payload is unknown.
+ *
+ * A Request acts as a future: it can be waited for, or a functor can be
+ * attached that is called from the engine thread on completion. The
+ * functor must not wait for other transactions.
+ */
+class AsyncTransactionEngine : public Util::RunnableInterface
+{
+private:
+    struct Transaction;
+
+public:
+    class Request {
+    public:
+        enum eType {
+            eRT_Read,
+            eRT_Write,
+        };
+        enum eStatus {
+            eRS_Idle,
+            eRS_Queued,
+            eRS_Busy,
+            eRS_Done,
+            eRS_Error,
+        };
+
+        Request();
+
+        void setRead(fb_nodeid_t nodeId, fb_nodeaddr_t addr,
+                     size_t length, fb_quadlet_t *buffer);
+        void setWrite(fb_nodeid_t nodeId, fb_nodeaddr_t addr,
+                      size_t length, fb_quadlet_t *data);
+        /// called from the engine thread when the request is completed
+        void setCompletionHandler(Util::Functor *f) {m_completion = f;};
+
+        bool isCompleted() {return m_status == eRS_Done || m_status == eRS_Error;};
+        bool isSuccessful() {return m_status == eRS_Done;};
+        /// the errno of a failed request
+        int getError() {return m_error;};
+
+    private:
+        friend class AsyncTransactionEngine;
+        enum eType      m_type;
+        fb_nodeid_t     m_nodeId;
+        fb_nodeaddr_t   m_addr;
+        size_t          m_length; // in quadlets
+        fb_quadlet_t   *m_buffer;
+        Util::Functor  *m_completion;
+        volatile enum eStatus m_status;
+        int             m_error;
+        Transaction    *m_transaction; // while busy
+    };
+
+    AsyncTransactionEngine(Ieee1394Service &, bool rt, int prio);
+    virtual ~AsyncTransactionEngine();
+
+    bool init();
+    bool Start();
+    bool Stop();
+    bool setThreadParameters(bool rt, int priority);
+
+    virtual bool Init();
+    virtual bool Execute();
+
+    /**
+     * @brief queue a request
+     *
+     * The request (and its buffer) has to stay valid until it is completed.
+     *
+     * @return true if the request was queued
+     */
+    bool queueRequest(Request &r);
+    /**
+     * @brief wait until a request is completed
+     *
+     * A request that isn't completed within
+     * IEEE1394SERVICE_ASYNC_REQUEST_TIMEOUT_MSEC fails with ETIMEDOUT.
+     * The engine doesn't touch it (or its buffer) anymore after that.
+     *
+     * @return true if the request completed successfully
+     */
+    bool waitForRequest(Request &r);
+    /**
+     * @brief queue a request and wait for its completion
+     * @return true if the request completed successfully
+     */
+    bool doRequest(Request &r);
+
+    bool isRunning() {return m_running;};
+
+    /**
+     * @brief set the largest block a node accepts in one transaction
+     * @param quads the max payload in quadlets, 0 if unknown
+     */
+    void setMaxPayload(fb_nodeid_t nodeId, unsigned int quads);
+    /// forget the max payloads, the node ids change on a bus reset
+    void resetMaxPayloads();
+
+    void setVerboseLevel(int l);
+
+private:
+    // one transaction on the bus, can carry several merged requests
+    struct Transaction {
+        AsyncTransactionEngine *engine;
+        enum Request::eType type;
+        fb_nodeid_t         nodeId;
+        fb_nodeaddr_t       addr;
+        size_t              length;
+        fb_quadlet_t       *buffer;
+        // NULL once a request timed out
+        std::vector<Request *> requests;
+        std::vector<size_t> lengths;
+        // reads always go here, a request can time out before the
+        // response arrives
+        std::vector<fb_quadlet_t> read_buffer;
+    };
+
+    struct NodeQueue {
+        NodeQueue() : outstanding( 0 ), max_payload( 0 ) {};
+        std::deque<Request *> queue;
+        unsigned int outstanding;
+        unsigned int max_payload; // quadlets, 0 if unknown
+    };
+    typedef std::map<fb_nodeid_t, NodeQueue> NodeQueueMap;
+    typedef std::map<fb_nodeid_t, NodeQueue>::iterator NodeQueueMapIterator;
+
+    // a node can be addressed with or without the local bus id (0xFFC0),
+    // the requests for it have to end up in the same queue
+    static fb_nodeid_t getQueueKey(fb_nodeid_t nodeId)
+        {return nodeId & 0x3F;};
+
+    void dispatchRequests();
+    Transaction *createTransaction(NodeQueue &q);
+    void completeTransaction(Transaction *t, int error);
+    void failPendingRequests();
+    void abortRequest(Request &r, int error);
+
+    static int tagHandler(raw1394handle_t handle, unsigned long tag,
+                          raw1394_errcode_t err);
+
+    Ieee1394Service    &m_parent;
+    raw1394handle_t     m_handle;
+    Util::Thread       *m_thread;
+    bool                m_realtime;
+    int                 m_priority;
+    volatile bool       m_running;
+    int                 m_wakeup_fd;
+
+    unsigned int        m_max_outstanding;
+    unsigned int        m_max_outstanding_per_node;
+    unsigned int        m_max_batch_quads;
+
+    pthread_mutex_t     m_lock;
+    pthread_cond_t      m_completion_cond;
+    NodeQueueMap        m_queues;
+    unsigned int        m_outstanding;
+
+    DECLARE_DEBUG_MODULE;
+};
+
+#endif /* __FFADO_ASYNCTRANSACTIONENGINE__ */
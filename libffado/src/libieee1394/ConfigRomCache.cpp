@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "config.h"
+
+#include "ConfigRomCache.h"
+#include "configrom.h"
+#include "ieee1394service.h"
+
+#include "libutil/PosixMutex.h"
+
+IMPL_DEBUG_MODULE( ConfigRomCache, ConfigRomCache, DEBUG_LEVEL_NORMAL );
+
+ConfigRomCache::ConfigRomCache( Ieee1394Service& service )
+    : m_1394Service( service )
+    , m_lock( new Util::PosixMutex("CROMCACHE") )
+{
+}
+
+ConfigRomCache::~ConfigRomCache()
+{
+    clear();
+    delete m_lock;
+}
+
+void
+ConfigRomCache::clear()
+{
+    for ( EntryMapIterator it = m_entries.begin();
+          it != m_entries.end();
+          ++it )
+    {
+        delete it->second.rom;
+    }
+    m_entries.clear();
+}
+
+bool
+ConfigRomCache::readQuadlets( fb_nodeid_t nodeId, unsigned int index,
+                              unsigned int length, fb_quadlet_t* buffer )
+{
+    if ( !ConfigRom::readWithRetry( m_1394Service, 0xffc0 | nodeId,
+                                    CSR1212_CONFIG_ROM_SPACE_BASE + index * 4,
+                                    length, buffer ) ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "Could not read the ROM of node %d\n", nodeId );
+        return false;
+    }
+    for ( unsigned int i = 0; i < length; i++ ) {
+        buffer[i] = CSR1212_BE32_TO_CPU( buffer[i] );
+    }
+    return true;
+}
+
+void
+ConfigRomCache::setNode( fb_octlet_t guid, fb_nodeid_t nodeId, unsigned int generation )
+{
+    // a node holds one ROM at a time
+    for ( EntryMapIterator it = m_entries.begin();
+          it != m_entries.end();
+          ++it )
+    {
+        struct Entry& e = it->second;
+        if ( it->first == guid ) {
+            e.rom->setNodeId( nodeId );
+            e.generation = generation;
+            e.generation_valid = true;
+        } else if ( e.rom->getNodeId() == nodeId ) {
+            e.generation_valid = false;
+        }
+    }
+}
+
+bool
+ConfigRomCache::identify( fb_nodeid_t nodeId, unsigned int generation, fb_octlet_t& guid )
+{
+    fb_quadlet_t header;
+    if ( !readQuadlets( nodeId, 0, 1, &header ) ) {
+        return false;
+    }
+
+    bool have_guid = false;
+    std::vector<fb_quadlet_t> rootDirectory;
+    while ( true ) {
+        {
+            Util::MutexLockHelper lock( *m_lock );
+            unsigned int nb_candidates = 0;
+            EntryMapIterator match = m_entries.end();
+            for ( EntryMapIterator it = m_entries.begin();
+                  it != m_entries.end();
+                  ++it )
+            {
+                if ( it->second.rom->getBusInfoHeader() != header ) {
+                    continue;
+                }
+                nb_candidates++;
+                if ( !have_guid || it->first == guid ) {
+                    match = it;
+                }
+            }
+            if ( match == m_entries.end() ) {
+                return false;
+            }
+            // the CRC covers the GUID, a unique CRC that is computed
+            // correctly identifies the ROM
+            if ( have_guid
+                 || ( nb_candidates == 1 && match->second.rom->isBusInfoCrcValid() ) ) {
+                guid = match->first;
+                rootDirectory = match->second.rom->m_rootDirectory;
+                break;
+            }
+        }
+        // quadlet reads, like for the rest of the bus info block
+        fb_quadlet_t guid_quadlets[2];
+        if ( !readQuadlets( nodeId, 3, 1, &guid_quadlets[0] )
+             || !readQuadlets( nodeId, 4, 1, &guid_quadlets[1] ) ) {
+            return false;
+        }
+        guid = ( (fb_octlet_t)guid_quadlets[0] << 32 ) | guid_quadlets[1];
+        have_guid = true;
+    }
+
+    if ( !verifyRootDirectory( nodeId, header, rootDirectory ) ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE,
+                     "The ROM of node %d (GUID 0x%016"PRIX64") has changed\n",
+                     nodeId, guid );
+        return false;
+    }
+    Util::MutexLockHelper lock( *m_lock );
+    setNode( guid, nodeId, generation );
+    debugOutput( DEBUG_LEVEL_VERBOSE,
+                 "Node %d has the cached ROM of GUID 0x%016"PRIX64"\n",
+                 nodeId, guid );
+    return true;
+}
+
+bool
+ConfigRomCache::verifyRootDirectory( fb_nodeid_t nodeId, fb_quadlet_t header,
+                                     const std::vector<fb_quadlet_t>& rootDirectory )
+{
+    // it holds the vendor, model and unit directory entries, and a CRC
+    // over them in its first quadlet
+    if ( rootDirectory.empty() ) {
+        return false;
+    }
+    unsigned int index = 1 + ( header >> 24 );
+    unsigned int length = rootDirectory.size();
+    std::vector<fb_quadlet_t> buffer( length );
+
+    // one block read if the node allows it, like when the ROM was read
+    bool ok = false;
+    if ( length <= IEEE1394SERVICE_CONFIGROM_MAX_BLOCK_QUADLETS ) {
+        ok = m_1394Service.read( 0xffc0 | nodeId,
+                                 CSR1212_CONFIG_ROM_SPACE_BASE + index * 4,
+                                 length, &buffer[0] );
+        for ( unsigned int i = 0; ok && i < length; i++ ) {
+            buffer[i] = CSR1212_BE32_TO_CPU( buffer[i] );
+        }
+    }
+    for ( unsigned int i = 0; !ok && i < length; i++ ) {
+        if ( !readQuadlets( nodeId, index + i, 1, &buffer[i] ) ) {
+            return false;
+        }
+    }
+    return buffer == rootDirectory;
+}
+
+bool
+ConfigRomCache::lookup( ConfigRom& rom )
+{
+    fb_nodeid_t nodeId = rom.getNodeId();
+    // read before the ROM, such that a bus reset in between makes the
+    // entry outdated instead of wrong
+    unsigned int generation = m_1394Service.getGeneration();
+
+    fb_octlet_t guid;
+    {
+        Util::MutexLockHelper lock( *m_lock );
+        if ( m_entries.empty() ) {
+            return false;
+        }
+        for ( EntryMapIterator it = m_entries.begin();
+              it != m_entries.end();
+              ++it )
+        {
+            struct Entry& e = it->second;
+            if ( e.generation_valid && e.generation == generation
+                 && e.rom->getNodeId() == nodeId ) {
+                rom.copyRomData( *e.rom );
+                return true;
+            }
+        }
+    }
+
+    if ( !identify( nodeId, generation, guid ) ) {
+        return false;
+    }
+    Util::MutexLockHelper lock( *m_lock );
+    EntryMapIterator it = m_entries.find( guid );
+    if ( it == m_entries.end() ) {
+        return false;
+    }
+    rom.copyRomData( *it->second.rom );
+    return true;
+}
+
+void
+ConfigRomCache::update( const ConfigRom& rom, unsigned int generation )
+{
+    Util::MutexLockHelper lock( *m_lock );
+    fb_octlet_t guid = rom.getGuid();
+    EntryMapIterator it = m_entries.find( guid );
+    if ( it == m_entries.end() ) {
+        struct Entry e;
+        e.rom = new ConfigRom( m_1394Service, rom.getNodeId() );
+        e.generation = generation;
+        e.generation_valid = false;
+        it = m_entries.insert( std::make_pair( guid, e ) ).first;
+    }
+    it->second.rom->copyRomData( rom );
+    setNode( guid, rom.getNodeId(), generation );
+}
+
+bool
+ConfigRomCache::findNode( fb_octlet_t guid, fb_nodeid_t& nodeId )
+{
+    unsigned int generation = m_1394Service.getGeneration();
+    fb_nodeid_t last_node;
+    {
+        Util::MutexLockHelper lock( *m_lock );
+        EntryMapIterator it = m_entries.find( guid );
+        if ( it == m_entries.end() ) {
+            return false;
+        }
+        last_node = it->second.rom->getNodeId();
+        if ( it->second.generation_valid && it->second.generation == generation ) {
+            nodeId = last_node;
+            return true;
+        }
+    }
+
+    // most bus resets don't change the node id, try that one first
+    fb_octlet_t found;
+    int nb_nodes = m_1394Service.getNodeCount();
+    if ( last_node < nb_nodes
+         && identify( last_node, generation, found ) && found == guid ) {
+        nodeId = last_node;
+        return true;
+    }
+    for ( fb_nodeid_t node = 0; node < nb_nodes; node++ ) {
+        if ( node == last_node || node == m_1394Service.getLocalNodeId() ) {
+            continue;
+        }
+        if ( identify( node, generation, found ) && found == guid ) {
+            nodeId = node;
+            return true;
+        }
+    }
+    return false;
+}
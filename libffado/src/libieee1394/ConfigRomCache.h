@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef __FFADO_CONFIGROMCACHE__
+#define __FFADO_CONFIGROMCACHE__
+
+#include "fbtypes.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include <map>
+#include <vector>
+
+class ConfigRom;
+class Ieee1394Service;
+
+namespace Util {
+    class Mutex;
+}
+
+/**
+ * @brief Remembers the parsed config ROMs of the nodes on a bus
+ *
+ * Reading and parsing a config ROM takes a few dozen transactions. The
+ * cache keeps the ROMs parsed by this process by GUID, together with the
+ * bus generation in which they were last seen at their node. Within that
+ * generation a ROM is used without any bus access. In a later generation,
+ * e.g. after a bus reset, the node is identified by the first quadlet of
+ * the bus info block, which holds the CRC over the bus info block and
+ * thus over the GUID. For nodes whose CRC does not verify, or when the
+ * CRC is not unique in the cache, the GUID is read as well. The bus info
+ * block doesn't change with the firmware of a device, so the root
+ * directory is read and compared too before the ROM is used.
+ */
+class ConfigRomCache
+{
+public:
+    ConfigRomCache( Ieee1394Service& service );
+    ~ConfigRomCache();
+
+    /**
+     * @brief fills in a config ROM from the cache
+     *
+     * @param rom the config ROM to fill, its node id selects the node
+     * @return true if the node has a valid cached ROM, false if the
+     *         ROM has to be read from the node
+     */
+    bool lookup( ConfigRom& rom );
+
+    /**
+     * @brief stores a config ROM that was read from its node
+     *
+     * @param generation the bus generation from before the ROM was read
+     */
+    void update( const ConfigRom& rom, unsigned int generation );
+
+    /**
+     * @brief finds the node that has a ROM with the given GUID
+     *
+     * Only considers the ROMs in the cache, validating them as for
+     * lookup().
+     *
+     * @return true if the node was found
+     */
+    bool findNode( fb_octlet_t guid, fb_nodeid_t& nodeId );
+
+    void setVerboseLevel( int l ) { setDebugLevel( l ); };
+
+private:
+    struct Entry {
+        ConfigRom*      rom;
+        unsigned int    generation;
+        bool            generation_valid;
+    };
+    typedef std::map<fb_octlet_t, struct Entry> EntryMap;
+    typedef std::map<fb_octlet_t, struct Entry>::iterator EntryMapIterator;
+
+    bool readQuadlets( fb_nodeid_t nodeId, unsigned int index,
+                       unsigned int length, fb_quadlet_t* buffer );
+    bool identify( fb_nodeid_t nodeId, unsigned int generation, fb_octlet_t& guid );
+    bool verifyRootDirectory( fb_nodeid_t nodeId, fb_quadlet_t header,
+                              const std::vector<fb_quadlet_t>& rootDirectory );
+    void setNode( fb_octlet_t guid, fb_nodeid_t nodeId, unsigned int generation );
+    void clear();
+
+    Ieee1394Service&    m_1394Service;
+    EntryMap            m_entries;
+    Util::Mutex*        m_lock;
+
+    DECLARE_DEBUG_MODULE;
+};
+
+#endif /* __FFADO_CONFIGROMCACHE__ */
@@ -42,6 +42,7 @@ CycleTimerHelper::CycleTimerHelper(Ieee1394Service &parent, unsigned int update_
     , m_usecs_per_update ( update_period_us )
     , m_avg_wakeup_delay ( 0.0 )
     , m_dll_e2 ( 0.0 )
+    , m_preset_rate ( 0.0 )
     , m_current_time_usecs ( 0 )
     , m_next_time_usecs ( 0 )
     , m_current_time_ticks ( 0 )
@@ -72,6 +73,7 @@ CycleTimerHelper::CycleTimerHelper(Ieee1394Service &parent, unsigned int update_
     , m_usecs_per_update ( update_period_us )
     , m_avg_wakeup_delay ( 0.0 )
     , m_dll_e2 ( 0.0 )
+    , m_preset_rate ( 0.0 )
     , m_current_time_usecs ( 0 )
     , m_next_time_usecs ( 0 )
     , m_current_time_ticks ( 0 )
@@ -262,6 +264,20 @@ CycleTimerHelper::getNominalRate()
     return rate;
 }
 
+void
+CycleTimerHelper::setRate(float rate)
+{
+    Util::MutexLockHelper lock(*m_update_lock);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) preset rate: %f ticks/usec\n", this, rate);
+    m_preset_rate = rate;
+    if (m_first_run) {
+        // initDLL() picks it up
+        return;
+    }
+    m_dll_e2 = (rate > 0.0 ? rate * m_usecs_per_update : m_ticks_per_update);
+    m_next_time_ticks = addTicks( (uint64_t)m_current_time_ticks, (uint64_t)m_dll_e2);
+}
+
 /*
  * call with lock held
  */
@@ -301,7 +317,11 @@ CycleTimerHelper::initDLL() {
                        (unsigned int)TICKS_TO_OFFSET( (uint64_t)cycle_timer_ticks ) );
 
     m_sleep_until = local_time + m_usecs_per_update;
-    m_dll_e2 = m_ticks_per_update;
+    if (m_preset_rate > 0.0) {
+        m_dll_e2 = m_preset_rate * m_usecs_per_update;
+    } else {
+        m_dll_e2 = m_ticks_per_update;
+    }
     m_current_time_usecs = local_time;
     m_next_time_usecs = m_current_time_usecs + m_usecs_per_update;
     m_current_time_ticks = CYCLE_TIMER_TO_TICKS( cycle_timer );
@@ -717,6 +737,11 @@ CycleTimerHelper::getNominalRate()
     return rate;
 }
 
+void
+CycleTimerHelper::setRate(float rate)
+{
+}
+
 bool
 CycleTimerHelper::Execute()
 {
@@ -112,6 +112,18 @@ public:
     float getRate();
     float getNominalRate();
 
+    /**
+     * @brief preset the rate of the DLL (in ticks per usec)
+     *
+     * The DLL starts from this rate instead of the nominal one, also
+     * when it is re-initialized after a bus reset. This shortens the
+     * time it needs to converge, e.g. when the rate is the one that
+     * was measured in a previous session.
+     * @param rate the rate, 0 to return to the nominal rate
+     * @note thread safe
+     */
+    void setRate(float rate);
+
     /**
      * @brief handle a bus reset
      */
@@ -136,6 +148,7 @@ private:
 
     // state variables
     double m_dll_e2;
+    float m_preset_rate;
 
     double m_current_time_usecs;
     double m_next_time_usecs;
@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "config.h"
+
+#include "IsoCapture.h"
+
+#include "libutil/SystemTimeSource.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+IMPL_DEBUG_MODULE( IsoCaptureWriter, IsoCaptureWriter, DEBUG_LEVEL_NORMAL );
+IMPL_DEBUG_MODULE( IsoCaptureReader, IsoCaptureReader, DEBUG_LEVEL_NORMAL );
+
+static inline unsigned int
+paddedLength(unsigned int length)
+{
+    return (length + 3) & ~3;
+}
+
+#define ISO_CAPTURE_BUFFER_MASK     (ISO_CAPTURE_BUFFER_SIZE - 1)
+
+// each record in the buffer is preceded by its size in the buffer,
+// which is 0 until the record is complete. The records are a multiple
+// of 4 bytes long, so the size word never wraps.
+typedef uint32_t slot_size_t;
+
+// --- IsoCaptureWriter
+
+IsoCaptureWriter::IsoCaptureWriter(const std::string &filename)
+: m_filename( filename )
+, m_fd( -1 )
+, m_buffer( NULL )
+, m_reserved( 0 )
+, m_flushed( 0 )
+, m_file_buffer( NULL )
+, m_file_buffer_fill( 0 )
+, m_running( false )
+, m_lost_pending( false )
+, m_lost( 0 )
+, m_records( 0 )
+{
+}
+
+IsoCaptureWriter::~IsoCaptureWriter()
+{
+    close();
+}
+
+std::string
+IsoCaptureWriter::getRequestedFilename()
+{
+    const char *env = getenv("FFADO_ISO_CAPTURE");
+    if (env == NULL) {
+        return "";
+    }
+    return env;
+}
+
+bool
+IsoCaptureWriter::open()
+{
+    if (m_fd >= 0) {
+        return true;
+    }
+    m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        debugError("Could not open %s: %s\n", m_filename.c_str(), strerror(errno));
+        return false;
+    }
+    struct IsoCaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ISO_CAPTURE_MAGIC;
+    header.version = ISO_CAPTURE_VERSION;
+    header.start_usecs = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    if (::write(m_fd, &header, sizeof(header)) != sizeof(header)) {
+        debugError("Could not write to %s: %s\n", m_filename.c_str(), strerror(errno));
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    // the size words have to start out as 0
+    m_buffer = (unsigned char *)calloc(ISO_CAPTURE_BUFFER_SIZE, 1);
+    m_file_buffer = (unsigned char *)malloc(ISO_CAPTURE_WRITE_SIZE);
+    if (m_buffer == NULL || m_file_buffer == NULL) {
+        debugError("Could not allocate the capture buffer\n");
+        free(m_buffer);
+        m_buffer = NULL;
+        free(m_file_buffer);
+        m_file_buffer = NULL;
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_reserved = 0;
+    m_flushed = 0;
+    m_file_buffer_fill = 0;
+
+    // the flushing doesn't need to be realtime, it only has to
+    // keep up on average
+    pthread_attr_t attributes;
+    struct sched_param param;
+    pthread_attr_init(&attributes);
+    pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attributes, SCHED_OTHER);
+    param.sched_priority = 0;
+    pthread_attr_setschedparam(&attributes, &param);
+    m_running = true;
+    int res = pthread_create(&m_thread, &attributes, flushThread, (void *)this);
+    pthread_attr_destroy(&attributes);
+    if (res) {
+        debugError("Could not start the capture thread: %s\n", strerror(res));
+        m_running = false;
+        free(m_buffer);
+        m_buffer = NULL;
+        free(m_file_buffer);
+        m_file_buffer = NULL;
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_NORMAL, "Capturing the received ISO packets to %s\n", m_filename.c_str());
+    return true;
+}
+
+void
+IsoCaptureWriter::close()
+{
+    if (m_fd < 0) {
+        return;
+    }
+    m_running = false;
+    pthread_join(m_thread, NULL);
+    flush();
+    ::close(m_fd);
+    m_fd = -1;
+    free(m_buffer);
+    m_buffer = NULL;
+    free(m_file_buffer);
+    m_file_buffer = NULL;
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Captured %u packets to %s, %u lost\n",
+                m_records, m_filename.c_str(), m_lost);
+}
+
+void
+IsoCaptureWriter::copyToBuffer(uint32_t pos, const void *data, unsigned int length)
+{
+    unsigned int offset = pos & ISO_CAPTURE_BUFFER_MASK;
+    unsigned int first = ISO_CAPTURE_BUFFER_SIZE - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(m_buffer + offset, data, first);
+    memcpy(m_buffer, (const unsigned char *)data + first, length - first);
+}
+
+void
+IsoCaptureWriter::copyFromBuffer(uint32_t pos, unsigned char *data, unsigned int length)
+{
+    unsigned int offset = pos & ISO_CAPTURE_BUFFER_MASK;
+    unsigned int first = ISO_CAPTURE_BUFFER_SIZE - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(data, m_buffer + offset, first);
+    memcpy(data + first, m_buffer, length - first);
+}
+
+void
+IsoCaptureWriter::write(unsigned char channel, unsigned char tag, unsigned char sy,
+                        uint32_t cycle_timer, unsigned int dropped,
+                        unsigned char *data, unsigned int length)
+{
+    if (m_buffer == NULL) {
+        return;
+    }
+    struct IsoCaptureRecord rec;
+    rec.cycle_timer = cycle_timer;
+    rec.length = length;
+    rec.channel = channel;
+    rec.tag_sy = ((tag & 0x3) << 4) | (sy & 0xF);
+    rec.dropped = (dropped > 0xFFFF ? 0xFFFF : dropped);
+    rec.flags = 0;
+    unsigned int padded = paddedLength(length);
+    static const uint32_t pad = 0;
+
+    // reserve the space, this only has to be retried when another
+    // thread reserved in between
+    slot_size_t size = sizeof(slot_size_t) + sizeof(rec) + padded;
+    uint32_t pos;
+    do {
+        pos = m_reserved;
+        if (pos + size - m_flushed > ISO_CAPTURE_BUFFER_SIZE) {
+            __sync_fetch_and_add(&m_lost, 1);
+            m_lost_pending = 1;
+            return;
+        }
+    } while (!__sync_bool_compare_and_swap(&m_reserved, pos, pos + size));
+
+    if (m_lost_pending && __sync_bool_compare_and_swap(&m_lost_pending, 1, 0)) {
+        rec.flags |= ISO_CAPTURE_FLAG_LOST;
+    }
+    uint32_t p = pos + sizeof(slot_size_t);
+    copyToBuffer(p, &rec, sizeof(rec));
+    p += sizeof(rec);
+    copyToBuffer(p, data, length);
+    copyToBuffer(p + length, &pad, padded - length);
+
+    // commit, the record has to be complete before the size is seen
+    __sync_synchronize();
+    *(volatile slot_size_t *)(m_buffer + (pos & ISO_CAPTURE_BUFFER_MASK)) = size;
+    __sync_fetch_and_add(&m_records, 1);
+}
+
+void *
+IsoCaptureWriter::flushThread(void *arg)
+{
+    IsoCaptureWriter *w = (IsoCaptureWriter *)arg;
+    while (w->m_running) {
+        usleep(ISO_CAPTURE_FLUSH_USECS);
+        if (!w->flush()) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+bool
+IsoCaptureWriter::writeFile(const unsigned char *data, size_t length)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::write(m_fd, data + done, length - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            debugError("Could not write to %s: %s\n", m_filename.c_str(), strerror(errno));
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+bool
+IsoCaptureWriter::flush()
+{
+    // moves the committed records up to the first one that is still
+    // being written. Their space is cleared before it is handed back,
+    // such that the size word of a new record reads 0 until it is
+    // committed.
+    while (m_flushed != m_reserved) {
+        uint32_t pos = m_flushed;
+        volatile slot_size_t *slot = (volatile slot_size_t *)(m_buffer + (pos & ISO_CAPTURE_BUFFER_MASK));
+        slot_size_t size = *slot;
+        if (size == 0) {
+            break;
+        }
+        __sync_synchronize();
+
+        unsigned int length = size - sizeof(slot_size_t);
+        if (m_file_buffer_fill + length > ISO_CAPTURE_WRITE_SIZE) {
+            if (!writeFile(m_file_buffer, m_file_buffer_fill)) {
+                return false;
+            }
+            m_file_buffer_fill = 0;
+        }
+        copyFromBuffer(pos + sizeof(slot_size_t), m_file_buffer + m_file_buffer_fill, length);
+        m_file_buffer_fill += length;
+
+        unsigned int offset = pos & ISO_CAPTURE_BUFFER_MASK;
+        unsigned int first = ISO_CAPTURE_BUFFER_SIZE - offset;
+        if (first > size) {
+            first = size;
+        }
+        memset(m_buffer + offset, 0, first);
+        memset(m_buffer, 0, size - first);
+        __sync_synchronize();
+        m_flushed = pos + size;
+    }
+    if (m_file_buffer_fill) {
+        if (!writeFile(m_file_buffer, m_file_buffer_fill)) {
+            return false;
+        }
+        m_file_buffer_fill = 0;
+    }
+    return true;
+}
+
+void
+IsoCaptureWriter::show()
+{
+    debugOutputShort(DEBUG_LEVEL_NORMAL, " ISO capture to %s: %u packets, %u lost\n",
+                     m_filename.c_str(), m_records, m_lost);
+}
+
+// --- IsoCaptureReader
+
+IsoCaptureReader::IsoCaptureReader(const std::string &filename)
+: m_filename( filename )
+, m_map( NULL )
+, m_map_size( 0 )
+, m_pos( 0 )
+{
+}
+
+IsoCaptureReader::~IsoCaptureReader()
+{
+    close();
+}
+
+bool
+IsoCaptureReader::open()
+{
+    if (m_map) {
+        return true;
+    }
+    int fd = ::open(m_filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        debugError("Could not open %s: %s\n", m_filename.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat buf;
+    if (fstat(fd, &buf) != 0) {
+        debugError("Could not stat %s\n", m_filename.c_str());
+        ::close(fd);
+        return false;
+    }
+    if ((size_t)buf.st_size < sizeof(struct IsoCaptureHeader)) {
+        debugError("%s is not an ISO capture\n", m_filename.c_str());
+        ::close(fd);
+        return false;
+    }
+    m_map_size = buf.st_size;
+    m_map = mmap(NULL, m_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m_map == MAP_FAILED) {
+        debugError("Could not map %s: %s\n", m_filename.c_str(), strerror(errno));
+        m_map = NULL;
+        return false;
+    }
+    const struct IsoCaptureHeader *header = (const struct IsoCaptureHeader *)m_map;
+    if (header->magic != ISO_CAPTURE_MAGIC || header->version != ISO_CAPTURE_VERSION) {
+        debugError("%s is not an ISO capture of version %d\n",
+                   m_filename.c_str(), ISO_CAPTURE_VERSION);
+        close();
+        return false;
+    }
+    madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+    rewind();
+    return true;
+}
+
+void
+IsoCaptureReader::close()
+{
+    if (m_map) {
+        munmap(m_map, m_map_size);
+        m_map = NULL;
+        m_map_size = 0;
+    }
+}
+
+void
+IsoCaptureReader::rewind()
+{
+    m_pos = sizeof(struct IsoCaptureHeader);
+}
+
+bool
+IsoCaptureReader::next(const struct IsoCaptureRecord **rec, const unsigned char **data)
+{
+    if (m_map == NULL || m_pos + sizeof(struct IsoCaptureRecord) > m_map_size) {
+        return false;
+    }
+    const char *base = (const char *)m_map;
+    const struct IsoCaptureRecord *r = (const struct IsoCaptureRecord *)(base + m_pos);
+    size_t end = m_pos + sizeof(struct IsoCaptureRecord) + paddedLength(r->length);
+    if (end > m_map_size) {
+        // the capture was cut off in the middle of a record
+        debugOutput(DEBUG_LEVEL_VERBOSE, "%s: truncated record at %zu\n", m_filename.c_str(), m_pos);
+        return false;
+    }
+    *rec = r;
+    *data = (const unsigned char *)(r + 1);
+    m_pos = end;
+    return true;
+}
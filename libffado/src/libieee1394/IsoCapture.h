@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef __FFADO_ISOCAPTURE__
+#define __FFADO_ISOCAPTURE__
+
+#include "debugmodule/debugmodule.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+
+/*
+ * An ISO capture file is an IsoCaptureHeader followed by the packets,
+ * each as an IsoCaptureRecord followed by the payload padded to a
+ * multiple of 4 bytes. The payload is stored as it came from the bus,
+ * the record fields in host byte order.
+ */
+#define ISO_CAPTURE_MAGIC           0x50434946  // "FICP"
+#define ISO_CAPTURE_VERSION         1
+
+// records were lost between this one and the previous one because
+// the writer could not keep up
+#define ISO_CAPTURE_FLAG_LOST       0x0001
+
+struct IsoCaptureHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    start_usecs;    ///< system time when the capture was started
+};
+
+struct IsoCaptureRecord {
+    uint32_t    cycle_timer;    ///< when the packet was received, as CTR value
+    uint16_t    length;         ///< payload length in bytes
+    uint8_t     channel;
+    uint8_t     tag_sy;         ///< tag << 4 | sy
+    uint16_t    dropped;        ///< cycles dropped before this packet
+    uint16_t    flags;
+};
+
+/**
+ * @brief Writes received ISO packets to a capture file
+ *
+ * write() can be called from the iso threads, it only copies the
+ * packet into a buffer. A low priority thread moves the buffer contents
+ * to the file. When the buffer is full the packet is counted as lost
+ * and the next record that makes it gets ISO_CAPTURE_FLAG_LOST.
+ *
+ * The iso threads share the buffer without a lock, an iso thread never
+ * waits for another one. A writer reserves the space for its record by
+ * advancing the reserve position with a compare-and-swap, copies the
+ * record and then commits it by setting the size word in front of it.
+ * The flush thread only moves committed records, in the order they were
+ * reserved.
+ */
+class IsoCaptureWriter
+{
+public:
+    IsoCaptureWriter(const std::string &filename);
+    ~IsoCaptureWriter();
+
+    /// @return the file set in FFADO_ISO_CAPTURE, empty if none
+    static std::string getRequestedFilename();
+
+    bool open();
+    void close();
+
+    void write(unsigned char channel, unsigned char tag, unsigned char sy,
+               uint32_t cycle_timer, unsigned int dropped,
+               unsigned char *data, unsigned int length);
+
+    unsigned int getLost() {return m_lost;};
+
+    void show();
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    static void *flushThread(void *arg);
+    bool flush();
+    bool writeFile(const unsigned char *data, size_t length);
+    void copyToBuffer(uint32_t pos, const void *data, unsigned int length);
+    void copyFromBuffer(uint32_t pos, unsigned char *data, unsigned int length);
+
+    std::string         m_filename;
+    int                 m_fd;
+    unsigned char      *m_buffer;
+    // free running byte positions in m_buffer
+    volatile uint32_t   m_reserved;
+    volatile uint32_t   m_flushed;
+    unsigned char      *m_file_buffer;
+    size_t              m_file_buffer_fill;
+    pthread_t           m_thread;
+    volatile bool       m_running;
+
+    volatile int        m_lost_pending;
+    volatile unsigned int m_lost;
+    volatile unsigned int m_records;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+/**
+ * @brief Reads the packets of a capture file in order
+ */
+class IsoCaptureReader
+{
+public:
+    IsoCaptureReader(const std::string &filename);
+    ~IsoCaptureReader();
+
+    bool open();
+    void close();
+
+    /**
+     * @param rec the next record
+     * @param data its payload
+     * @return false at the end of the capture
+     */
+    bool next(const struct IsoCaptureRecord **rec, const unsigned char **data);
+    void rewind();
+
+    const std::string &getFilename() {return m_filename;};
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    std::string         m_filename;
+    void               *m_map;
+    size_t              m_map_size;
+    size_t              m_pos;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+#endif
@@ -33,10 +33,14 @@
 #include "libutil/SystemTimeSource.h"
 #include "libutil/Watchdog.h"
 #include "libutil/Configuration.h"
+#include "libutil/LatencyStatistics.h"
 
 #include <cstring>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 IMPL_DEBUG_MODULE( IsoHandlerManager, IsoHandlerManager, DEBUG_LEVEL_NORMAL );
 IMPL_DEBUG_MODULE( IsoHandlerManager::IsoTask, IsoTask, DEBUG_LEVEL_NORMAL );
@@ -46,39 +50,124 @@ using namespace Streaming;
 
 // --- ISO Thread --- //
 
-IsoHandlerManager::IsoTask::IsoTask(IsoHandlerManager& manager, enum IsoHandler::EHandlerType t)
+// epoll data tags for the non-handler fd's, the handler fd's use their
+// index in the shadow map
+#define ISOTASK_EPOLL_TAG_ACTIVITY      (ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT)
+#define ISOTASK_EPOLL_TAG_DEATH_TIMER   (ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT + 1)
+
+IsoHandlerManager::IsoTask::IsoTask(IsoHandlerManager& manager, enum IsoHandler::EHandlerType t,
+                                    unsigned int index, int cpu)
     : m_manager( manager )
+    , request_update( 0 )
+    , m_poll_nfds_shadow( 0 )
+    , m_poll_nfds_registered( 0 )
+    , m_poll_nfds_disarmed( 0 )
     , m_SyncIsoHandler ( NULL )
+    , m_epoll_fd( -1 )
+    , m_activity_fd( -1 )
+    , m_death_timer_fd( -1 )
     , m_handlerType( t )
+    , m_index( index )
+    , m_cpu( cpu )
     , m_running( false )
     , m_in_busreset( false )
     , m_activity_wait_timeout_nsec (ISOHANDLERMANAGER_ISO_TASK_WAIT_TIMEOUT_USECS * 1000LL)
 {
+    // the activity fd is created here since the clients can signal
+    // activity before the thread is started
+    m_activity_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_activity_fd < 0) {
+        debugError("Could not create activity eventfd: %s\n", strerror(errno));
+    }
 }
 
 IsoHandlerManager::IsoTask::~IsoTask()
 {
-    sem_destroy(&m_activity_semaphore);
+    if (m_death_timer_fd >= 0) close(m_death_timer_fd);
+    if (m_activity_fd >= 0) close(m_activity_fd);
+    if (m_epoll_fd >= 0) close(m_epoll_fd);
 }
 
 bool
 IsoHandlerManager::IsoTask::Init()
 {
-    request_update = 0;
-
+    // request_update is not reset here, the handlers can be registered
+    // and enabled before the thread gets to run. A pending request
+    // rebuilds the map that is cleared below.
     int i;
     for (i=0; i < ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT; i++) {
         m_IsoHandler_map_shadow[i] = NULL;
-        m_poll_fds_shadow[i].events = 0;
+        m_poll_armed_shadow[i] = false;
+        m_poll_fd_shadow[i] = -1;
     }
     m_poll_nfds_shadow = 0;
+    m_poll_nfds_registered = 0;
+    m_poll_nfds_disarmed = 0;
 
     #ifdef DEBUG
     m_last_loop_entry = 0;
     m_successive_short_loops = 0;
     #endif
 
-    sem_init(&m_activity_semaphore, 0, 0);
+    if (m_activity_fd < 0) {
+        debugFatal("No activity eventfd\n");
+        return false;
+    }
+
+    // Init() runs in the task's thread, so this pins the thread itself.
+    // failing to pin is not fatal, the thread just floats.
+    if (m_cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(m_cpu, &cpuset);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (err) {
+            debugWarning("(%p) could not pin ISO thread to cpu %d: %s\n",
+                         this, m_cpu, strerror(err));
+        } else {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) ISO thread %u pinned to cpu %d\n",
+                        this, m_index, m_cpu);
+        }
+    }
+    if (m_epoll_fd < 0) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd < 0) {
+            debugFatal("Could not create epoll fd: %s\n", strerror(errno));
+            return false;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = ISOTASK_EPOLL_TAG_ACTIVITY;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_activity_fd, &ev) < 0) {
+            debugFatal("Could not add activity fd to epoll set: %s\n", strerror(errno));
+            return false;
+        }
+
+        // the handler death detection doesn't have to run on every
+        // wakeup, a periodic timer is sufficient
+        m_death_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_death_timer_fd < 0) {
+            debugFatal("Could not create death detection timerfd: %s\n", strerror(errno));
+            return false;
+        }
+        struct itimerspec its;
+        its.it_interval.tv_sec = ISOHANDLERMANAGER_DEATH_CHECK_INTERVAL_USECS / 1000000LL;
+        its.it_interval.tv_nsec = (ISOHANDLERMANAGER_DEATH_CHECK_INTERVAL_USECS % 1000000LL) * 1000LL;
+        its.it_value = its.it_interval;
+        if (timerfd_settime(m_death_timer_fd, 0, &its, NULL) < 0) {
+            debugFatal("Could not arm death detection timerfd: %s\n", strerror(errno));
+            return false;
+        }
+        ev.events = EPOLLIN;
+        ev.data.u32 = ISOTASK_EPOLL_TAG_DEATH_TIMER;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_death_timer_fd, &ev) < 0) {
+            debugFatal("Could not add timerfd to epoll set: %s\n", strerror(errno));
+            return false;
+        }
+    }
+
     m_running = true;
     return true;
 }
@@ -113,6 +202,7 @@ IsoHandlerManager::IsoTask::handleBusReset()
 
         // skip the handlers not intended for us
         if(h->getType() != m_handlerType) continue;
+        if(h->getTaskIndex() != m_index) continue;
 
         if (!h->handleBusReset()) {
             debugWarning("Failed to handle busreset on %p\n", h);
@@ -133,12 +223,24 @@ void
 IsoHandlerManager::IsoTask::updateShadowMapHelper()
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) updating shadow vars...\n", this);
+
+    // drop the current registrations. The fd of a handler that has been
+    // deleted in the meantime is already gone from the epoll set, so
+    // errors are expected and harmless here.
+    unsigned int i, cnt, max;
+    for (i = 0; i < m_poll_nfds_registered; i++) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, m_poll_fd_shadow[i], NULL);
+        m_poll_armed_shadow[i] = false;
+        m_poll_fd_shadow[i] = -1;
+    }
+    m_poll_nfds_registered = 0;
+    m_poll_nfds_disarmed = 0;
+
     // we are handling a busreset
     if(m_in_busreset) {
         m_poll_nfds_shadow = 0;
         return;
     }
-    unsigned int i, cnt, max;
     max = m_manager.m_IsoHandlers.size();
     m_SyncIsoHandler = NULL;
     for (i = 0, cnt = 0; i < max; i++) {
@@ -160,6 +262,7 @@ IsoHandlerManager::IsoTask::updateShadowMapHelper()
 
         // skip the handlers not intended for us
         if(h->getType() != m_handlerType) continue;
+        if(h->getTaskIndex() != m_index) continue;
 
         // update the state of the handler
         // FIXME: maybe this is not the best place to do this
@@ -170,10 +273,24 @@ IsoHandlerManager::IsoTask::updateShadowMapHelper()
 
         // rebuild the map
         if (h->isEnabled()) {
+            if(cnt >= ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT) {
+                debugWarning("Too much ISO Handlers in thread...\n");
+                break;
+            }
+
+            // register the handler, initially disarmed
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = 0;
+            ev.data.u32 = cnt;
+            if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, h->getFileDescriptor(), &ev) < 0) {
+                debugError("(%p) could not add %s handler %p to epoll set: %s\n",
+                           this, h->getTypeString(), h, strerror(errno));
+                continue;
+            }
             m_IsoHandler_map_shadow[cnt] = h;
-            m_poll_fds_shadow[cnt].fd = h->getFileDescriptor();
-            m_poll_fds_shadow[cnt].revents = 0;
-            m_poll_fds_shadow[cnt].events = POLLIN;
+            m_poll_armed_shadow[cnt] = false;
+            m_poll_fd_shadow[cnt] = h->getFileDescriptor();
             cnt++;
             // FIXME: need a more generic approach here
             if(   m_SyncIsoHandler == NULL
@@ -187,32 +304,134 @@ IsoHandlerManager::IsoTask::updateShadowMapHelper()
             debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) %s handler %p skipped (disabled)\n",
                                               this, h->getTypeString(), h);
         }
-        if(cnt > ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT) {
-            debugWarning("Too much ISO Handlers in thread...\n");
-            break;
-        }
     }
 
     // FIXME: need a more generic approach here
     // if there are no active transmit handlers,
     // use the first receive handler
     if(   m_SyncIsoHandler == NULL
-       && m_poll_nfds_shadow) {
+       && cnt) {
         m_SyncIsoHandler = m_IsoHandler_map_shadow[0];
     }
     m_poll_nfds_shadow = cnt;
+    m_poll_nfds_registered = cnt;
+    m_poll_nfds_disarmed = cnt;
+
+    // arm the handlers whose client can already be iterated
+    armHandlers();
     debugOutput( DEBUG_LEVEL_VERBOSE, "(%p) updated shadow vars...\n", this);
 }
 
+/**
+ * @brief changes the epoll interest of a handler
+ *
+ * We should only poll on a handler whose client is ready to send or
+ * receive something. Otherwise it will end up in busy wait looping since
+ * the packet function will defer processing (also avoids the AGAIN
+ * problem).
+ */
+bool
+IsoHandlerManager::IsoTask::setHandlerArmed(unsigned int idx, bool armed)
+{
+    if (m_poll_armed_shadow[idx] == armed) return true;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (armed ? (EPOLLIN | EPOLLPRI) : 0);
+    ev.data.u32 = idx;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, m_poll_fd_shadow[idx], &ev) < 0) {
+        debugError("(%p) could not modify epoll interest of handler %u: %s\n",
+                   this, idx, strerror(errno));
+        return false;
+    }
+    m_poll_armed_shadow[idx] = armed;
+    if (armed) {
+        m_poll_nfds_disarmed--;
+    } else {
+        m_poll_nfds_disarmed++;
+    }
+    return true;
+}
+
+/**
+ * @brief arms the disarmed handlers whose client can be iterated again
+ *
+ * Only called when the clients signalled activity, since that is the only
+ * way a client that couldn't be iterated becomes ready.
+ */
+void
+IsoHandlerManager::IsoTask::armHandlers()
+{
+    unsigned int i;
+    for (i = 0; i < m_poll_nfds_shadow && m_poll_nfds_disarmed; i++) {
+        if (!m_poll_armed_shadow[i] && m_IsoHandler_map_shadow[i]->canIterateClient()) {
+            setHandlerArmed(i, true);
+        }
+    }
+}
+
+/**
+ * @brief finds the handlers that have died
+ *
+ * @param ctr_now the current cycle timer value
+ * @return false if a handler has died
+ */
+bool
+IsoHandlerManager::IsoTask::checkHandlersAlive(uint32_t ctr_now)
+{
+    unsigned int i;
+    uint64_t ctr_now_ticks = CYCLE_TIMER_TO_TICKS(ctr_now);
+    bool handler_died = false;
+    for (i = 0; i < m_poll_nfds_shadow; i++) {
+        // figure out if a handler has died
+
+        if (!m_IsoHandler_map_shadow[i]->isEnabled()) {
+            // This handler is already dead.
+            handler_died = true;
+            continue;
+        }
+
+        // this is the time of the last packet we saw in the iterate() handler
+        uint32_t last_packet_seen = m_IsoHandler_map_shadow[i]->getLastPacketTime();
+        if (last_packet_seen == 0xFFFFFFFF) {
+            // this was not iterated yet, so can't be dead
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
+                        "(%p, %s) handler %d didn't see any packets yet\n",
+                        this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"), i);
+            continue;
+        }
+
+        uint64_t last_packet_seen_ticks = CYCLE_TIMER_TO_TICKS(last_packet_seen);
+        // we use a relatively large value to distinguish between "death" and xrun
+        int64_t max_diff_ticks = TICKS_PER_SECOND * 2;
+        int64_t measured_diff_ticks = diffTicks(ctr_now_ticks, last_packet_seen_ticks);
+
+        debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
+                           "(%p, %s) check handler %d: diff = %"PRId64", max = %"PRId64", now: %08X, last: %08X\n",
+                           this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"), 
+                           i, measured_diff_ticks, max_diff_ticks, ctr_now, last_packet_seen);
+        if(measured_diff_ticks > max_diff_ticks) {
+            debugWarning("(%p, %s) Handler died: now: %08X, last: %08X, diff: %"PRId64" (max: %"PRId64")\n",
+                         this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"),
+                         ctr_now, last_packet_seen, measured_diff_ticks, max_diff_ticks);
+            m_IsoHandler_map_shadow[i]->notifyOfDeath();
+            handler_died = true;
+        }
+    }
+    return !handler_died;
+}
+
 bool
 IsoHandlerManager::IsoTask::Execute()
 {
     debugOutput(DEBUG_LEVEL_ULTRA_VERBOSE,
                 "(%p, %s) Execute\n",
                 this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"));
-    int err;
-    unsigned int i;
+    int nfds;
+    int i;
     unsigned int m_poll_timeout = 10;
+    struct epoll_event events[ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT + 2];
+    uint64_t counter;
 
     #ifdef DEBUG
     uint64_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
@@ -251,113 +470,49 @@ IsoHandlerManager::IsoTask::Execute()
         return true;
     }
 
-    // FIXME: what can happen is that poll() returns, but not all clients are
-    // ready. there might be some busy waiting behavior that still has to be solved.
-
-    // setup the poll here
-    // we should prevent a poll() where no events are specified, since that will only time-out
-    bool no_one_to_poll = true;
-    while(no_one_to_poll) {
-        for (i = 0; i < m_poll_nfds_shadow; i++) {
-            short events = 0;
-            IsoHandler *h = m_IsoHandler_map_shadow[i];
-            // we should only poll on a transmit handler
-            // that has a client that is ready to send
-            // something. Otherwise it will end up in
-            // busy wait looping since the packet function
-            // will defer processing (also avoids the
-            // AGAIN problem)
-            if (h->canIterateClient()) {
-                events = POLLIN | POLLPRI;
-                no_one_to_poll = false;
-            }
-            m_poll_fds_shadow[i].events = events;
-        }
-
-        if(no_one_to_poll) {
-            debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
-                        "(%p, %s) No one to poll, waiting for something to happen\n",
-                        this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"));
-            // wait for something to happen
-            switch(waitForActivity()) {
-                case IsoHandlerManager::IsoTask::eAR_Error:
-                    debugError("Error while waiting for activity\n");
-                    return false;
-                case IsoHandlerManager::IsoTask::eAR_Interrupted:
-                    // FIXME: what to do here?
-                    debugWarning("Interrupted while waiting for activity\n");
-                    break;
-                case IsoHandlerManager::IsoTask::eAR_Timeout:
-                    // FIXME: what to do here?
-                    debugWarning("Timeout while waiting for activity\n");
-                    no_one_to_poll = false; // exit the loop to be able to detect failing handlers
-                    break;
-                case IsoHandlerManager::IsoTask::eAR_Activity:
-                    // do nothing
-                    debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
-                                       "(%p, %s) something happened\n",
-                                       this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"));
-                    break;
-            }
-        }
-    }
-
-    // Use a shadow map of the fd's such that we don't have to update
-    // the fd map everytime we run poll().
-    err = poll (m_poll_fds_shadow, m_poll_nfds_shadow, m_poll_timeout);
+    // wait for a handler fd, client activity or the death detection timer.
+    // when no handler is armed this only returns on activity or the timer.
+    nfds = epoll_wait(m_epoll_fd, events, ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT + 2,
+                      (int)(m_activity_wait_timeout_nsec / 1000000LL));
     uint32_t ctr_at_poll_return = m_manager.get1394Service().getCycleTimer();
 
-    if (err < 0) {
+    if (nfds < 0) {
         if (errno == EINTR) {
             debugOutput(DEBUG_LEVEL_VERBOSE, "Ignoring poll return due to signal\n");
             return true;
         }
-        debugFatal("poll error: %s\n", strerror (errno));
+        debugFatal("epoll error: %s\n", strerror (errno));
         m_running = false;
         return false;
     }
+    if (nfds == 0) {
+        // FIXME: what to do here?
+        debugWarning("Timeout while waiting for activity\n");
+    }
 
-    // find handlers that have died
-    uint64_t ctr_at_poll_return_ticks = CYCLE_TIMER_TO_TICKS(ctr_at_poll_return);
-    bool handler_died = false;
-    for (i = 0; i < m_poll_nfds_shadow; i++) {
-        // figure out if a handler has died
-
-        if (!m_IsoHandler_map_shadow[i]->isEnabled()) {
-            // This handler is already dead.
-            handler_died = true;
-            continue;
-        }
-
-        // this is the time of the last packet we saw in the iterate() handler
-        uint32_t last_packet_seen = m_IsoHandler_map_shadow[i]->getLastPacketTime();
-        if (last_packet_seen == 0xFFFFFFFF) {
-            // this was not iterated yet, so can't be dead
-            debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
-                        "(%p, %s) handler %d didn't see any packets yet\n",
-                        this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"), i);
-            continue;
+    // pick up activity and timer events first
+    bool activity = false;
+    bool check_death = (nfds == 0);
+    for (i = 0; i < nfds; i++) {
+        if (events[i].data.u32 == ISOTASK_EPOLL_TAG_ACTIVITY) {
+            if (read(m_activity_fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+                debugWarning("(%p) could not read activity fd: %s\n", this, strerror(errno));
+            }
+            activity = true;
+        } else if (events[i].data.u32 == ISOTASK_EPOLL_TAG_DEATH_TIMER) {
+            if (read(m_death_timer_fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+                debugWarning("(%p) could not read timer fd: %s\n", this, strerror(errno));
+            }
+            check_death = true;
         }
+    }
 
-        uint64_t last_packet_seen_ticks = CYCLE_TIMER_TO_TICKS(last_packet_seen);
-        // we use a relatively large value to distinguish between "death" and xrun
-        int64_t max_diff_ticks = TICKS_PER_SECOND * 2;
-        int64_t measured_diff_ticks = diffTicks(ctr_at_poll_return_ticks, last_packet_seen_ticks);
-
-        debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
-                           "(%p, %s) check handler %d: diff = %"PRId64", max = %"PRId64", now: %08X, last: %08X\n",
-                           this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"), 
-                           i, measured_diff_ticks, max_diff_ticks, ctr_at_poll_return, last_packet_seen);
-        if(measured_diff_ticks > max_diff_ticks) {
-            debugWarning("(%p, %s) Handler died: now: %08X, last: %08X, diff: %"PRId64" (max: %"PRId64")\n",
-                         this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"),
-                         ctr_at_poll_return, last_packet_seen, measured_diff_ticks, max_diff_ticks);
-            m_IsoHandler_map_shadow[i]->notifyOfDeath();
-            handler_died = true;
-        }
+    // a shadow map update invalidates the handler indexes of this round
+    if (request_update) {
+        return true;
     }
 
-    if(handler_died) {
+    if (check_death && !checkHandlersAlive(ctr_at_poll_return)) {
         m_running = false;
         // One or more handlers have died, however it can be restarted again,
         // so keep looping. The xrun handling code will eventually time out if
@@ -366,103 +521,52 @@ IsoHandlerManager::IsoTask::Execute()
     }
 
     // iterate the handlers
-    for (i = 0; i < m_poll_nfds_shadow; i++) {
-        #ifdef DEBUG
-        if(m_poll_fds_shadow[i].revents) {
-            debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
-                        "(%p, %s) received events: %08X for (%d/%d, %p, %s)\n",
-                        this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"),
-                        m_poll_fds_shadow[i].revents,
-                        i, m_poll_nfds_shadow,
-                        m_IsoHandler_map_shadow[i],
-                        m_IsoHandler_map_shadow[i]->getTypeString());
-        }
-        #endif
+    for (i = 0; i < nfds; i++) {
+        unsigned int idx = events[i].data.u32;
+        if (idx >= m_poll_nfds_shadow) continue;
+
+        IsoHandler *h = m_IsoHandler_map_shadow[idx];
+        debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
+                    "(%p, %s) received events: %08X for (%d/%d, %p, %s)\n",
+                    this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"),
+                    events[i].events, idx, m_poll_nfds_shadow, h, h->getTypeString());
 
         // if we get here, it means two things:
-        // 1) the kernel can accept or provide packets (poll returned POLLIN)
-        // 2) the client can provide or accept packets (since we enabled polling)
-        if(m_poll_fds_shadow[i].revents & (POLLIN)) {
-            m_IsoHandler_map_shadow[i]->iterate(ctr_at_poll_return);
+        // 1) the kernel can accept or provide packets (epoll returned EPOLLIN)
+        // 2) the client can provide or accept packets (since we armed the handler)
+        if(events[i].events & EPOLLIN) {
+            h->iterate(ctr_at_poll_return);
         } else {
             // there might be some error condition
-            if (m_poll_fds_shadow[i].revents & POLLERR) {
-                debugWarning("(%p) error on fd for %d\n", this, i);
+            if (events[i].events & EPOLLERR) {
+                debugWarning("(%p) error on fd for %d\n", this, idx);
             }
-            if (m_poll_fds_shadow[i].revents & POLLHUP) {
-                debugWarning("(%p) hangup on fd for %d\n", this, i);
+            if (events[i].events & EPOLLHUP) {
+                debugWarning("(%p) hangup on fd for %d\n", this, idx);
             }
         }
-    }
-    return true;
-}
-
-enum IsoHandlerManager::IsoTask::eActivityResult
-IsoHandlerManager::IsoTask::waitForActivity()
-{
-    debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
-                       "(%p, %s) waiting for activity\n",
-                       this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"));
-    struct timespec ts;
-    int result;
-
-    // sem_timedwait() cannot be set up to use any clock rather than 
-    // CLOCK_REALTIME.  Therefore we get the time from CLOCK_REALTIME here.
-    // Doing this rather than Util::SystemTimeSource::clockGettime() doesn't
-    // pose a problem here because the resulting time is only used with
-    // sem_timedwait() to implement timeout functionality.
-    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-        debugError("clock_gettime failed\n");
-        return eAR_Error;
-    }
 
-    ts.tv_nsec += m_activity_wait_timeout_nsec;
-    while(ts.tv_nsec >= 1000000000LL) {
-        ts.tv_sec += 1;
-        ts.tv_nsec -= 1000000000LL;
-    }
-
-    result = sem_timedwait(&m_activity_semaphore, &ts);
-
-    if(result != 0) {
-        if (errno == ETIMEDOUT) {
-            debugOutput(DEBUG_LEVEL_VERBOSE,
-                        "(%p) sem_timedwait() timed out (result=%d)\n",
-                        this, result);
-            return eAR_Timeout;
-        } else if (errno == EINTR) {
-            debugOutput(DEBUG_LEVEL_VERBOSE,
-                        "(%p) sem_timedwait() interrupted by signal (result=%d)\n",
-                        this, result);
-            return eAR_Interrupted;
-        } else if (errno == EINVAL) {
-            debugError("(%p) sem_timedwait error (result=%d errno=EINVAL)\n", 
-                        this, result);
-            debugError("(%p) timeout_nsec=%lld ts.sec=%"PRId64" ts.nsec=%"PRId64"\n", 
-                       this, m_activity_wait_timeout_nsec, 
-		       (int64_t)ts.tv_sec, (int64_t)ts.tv_nsec);
-            return eAR_Error;
-        } else {
-            debugError("(%p) sem_timedwait error (result=%d errno=%d)\n", 
-                        this, result, errno);
-            debugError("(%p) timeout_nsec=%lld ts.sec=%"PRId64" ts.nsec=%"PRId64"\n", 
-                       this, m_activity_wait_timeout_nsec,
-		       (int64_t)ts.tv_sec, (int64_t)ts.tv_nsec);
-            return eAR_Error;
+        // stop polling the handler when its client can't take more,
+        // activity on the client side will re-arm it
+        if (!h->canIterateClient()) {
+            setHandlerArmed(idx, false);
         }
     }
 
-    debugOutput(DEBUG_LEVEL_ULTRA_VERBOSE,
-                "(%p, %s) got activity\n",
-                this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"));
-    return eAR_Activity;
+    if (activity) {
+        armHandlers();
+    }
+    return true;
 }
 
 void
 IsoHandlerManager::IsoTask::signalActivity()
 {
-    // signal the activity cond var
-    sem_post(&m_activity_semaphore);
+    // wake up the task if it's waiting
+    uint64_t one = 1;
+    if (write(m_activity_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        debugError("(%p) could not signal activity: %s\n", this, strerror(errno));
+    }
     debugOutput(DEBUG_LEVEL_ULTRA_VERBOSE,
                 "(%p, %s) activity\n",
                 this, (m_handlerType == IsoHandler::eHT_Transmit? "Transmit": "Receive"));
@@ -478,10 +582,8 @@ IsoHandlerManager::IsoHandlerManager(Ieee1394Service& service)
    : m_State(E_Created)
    , m_service( service )
    , m_realtime(false), m_priority(0)
-   , m_IsoThreadTransmit ( NULL )
-   , m_IsoTaskTransmit ( NULL )
-   , m_IsoThreadReceive ( NULL )
-   , m_IsoTaskReceive ( NULL )
+   , m_sharding ( eITS_PerDevice )
+   , m_capture ( NULL )
 {
 }
 
@@ -489,11 +591,9 @@ IsoHandlerManager::IsoHandlerManager(Ieee1394Service& service, bool run_rt, int
    : m_State(E_Created)
    , m_service( service )
    , m_realtime(run_rt), m_priority(rt_prio)
-   , m_IsoThreadTransmit ( NULL )
-   , m_IsoTaskTransmit ( NULL )
-   , m_IsoThreadReceive ( NULL )
-   , m_IsoTaskReceive ( NULL )
+   , m_sharding ( eITS_PerDevice )
    , m_MissedCyclesOK ( false )
+   , m_capture ( NULL )
 {
 }
 
@@ -504,20 +604,34 @@ IsoHandlerManager::~IsoHandlerManager()
     if(m_IsoHandlers.size() > 0) {
         debugError("Still some handlers in use\n");
     }
-    if (m_IsoThreadTransmit) {
-        m_IsoThreadTransmit->Stop();
-        delete m_IsoThreadTransmit;
+    for ( ThreadVectorIterator it = m_IsoThreadsTransmit.begin();
+          it != m_IsoThreadsTransmit.end();
+          ++it )
+    {
+        (*it)->Stop();
+        delete *it;
     }
-    if (m_IsoThreadReceive) {
-        m_IsoThreadReceive->Stop();
-        delete m_IsoThreadReceive;
+    for ( ThreadVectorIterator it = m_IsoThreadsReceive.begin();
+          it != m_IsoThreadsReceive.end();
+          ++it )
+    {
+        (*it)->Stop();
+        delete *it;
     }
-    if (m_IsoTaskTransmit) {
-        delete m_IsoTaskTransmit;
+    for ( IsoTaskVectorIterator it = m_IsoTasksTransmit.begin();
+          it != m_IsoTasksTransmit.end();
+          ++it )
+    {
+        delete *it;
     }
-    if (m_IsoTaskReceive) {
-        delete m_IsoTaskReceive;
+    for ( IsoTaskVectorIterator it = m_IsoTasksReceive.begin();
+          it != m_IsoTasksReceive.end();
+          ++it )
+    {
+        delete *it;
     }
+    // the threads are gone, nothing writes to the capture anymore
+    delete m_capture;
 }
 
 bool
@@ -528,19 +642,29 @@ IsoHandlerManager::handleBusReset()
     // 1) no devices added/removed => streams are still valid, but might have to be restarted
     // 2) a device was removed => some streams become invalid
     // 3) a device was added => same as 1, new device is ignored
-    if (!m_IsoTaskTransmit) {
+    if (m_IsoTasksTransmit.empty()) {
         debugError("No xmit task\n");
         return false;
     }
-    if (!m_IsoTaskReceive) {
+    if (m_IsoTasksReceive.empty()) {
         debugError("No receive task\n");
         return false;
     }
-    if (!m_IsoTaskTransmit->handleBusReset()) {
-        debugWarning("could no handle busreset on xmit\n");
+    for ( IsoTaskVectorIterator it = m_IsoTasksTransmit.begin();
+          it != m_IsoTasksTransmit.end();
+          ++it )
+    {
+        if (!(*it)->handleBusReset()) {
+            debugWarning("could no handle busreset on xmit\n");
+        }
     }
-    if (!m_IsoTaskReceive->handleBusReset()) {
-        debugWarning("could no handle busreset on recv\n");
+    for ( IsoTaskVectorIterator it = m_IsoTasksReceive.begin();
+          it != m_IsoTasksReceive.end();
+          ++it )
+    {
+        if (!(*it)->handleBusReset()) {
+            debugWarning("could no handle busreset on recv\n");
+        }
     }
     return true;
 }
@@ -548,8 +672,26 @@ IsoHandlerManager::handleBusReset()
 void
 IsoHandlerManager::requestShadowMapUpdate()
 {
-    if(m_IsoTaskTransmit) m_IsoTaskTransmit->requestShadowMapUpdate();
-    if(m_IsoTaskReceive) m_IsoTaskReceive->requestShadowMapUpdate();
+    for ( IsoTaskVectorIterator it = m_IsoTasksTransmit.begin();
+          it != m_IsoTasksTransmit.end();
+          ++it )
+    {
+        (*it)->requestShadowMapUpdate();
+    }
+    for ( IsoTaskVectorIterator it = m_IsoTasksReceive.begin();
+          it != m_IsoTasksReceive.end();
+          ++it )
+    {
+        (*it)->requestShadowMapUpdate();
+    }
+}
+
+IsoHandlerManager::IsoTask *
+IsoHandlerManager::getTaskForHandler(IsoHandler *h)
+{
+    IsoTaskVector &tasks = getTasks(h->getType());
+    assert(h->getTaskIndex() < tasks.size());
+    return tasks.at(h->getTaskIndex());
 }
 
 bool
@@ -571,22 +713,28 @@ IsoHandlerManager::setThreadParameters(bool rt, int priority) {
         config->getValueForSetting("ieee1394.isomanager.prio_increase_recv", ihm_iso_prio_increase_recv);
     }
 
-    if (m_IsoThreadTransmit) {
+    for ( ThreadVectorIterator it = m_IsoThreadsTransmit.begin();
+          it != m_IsoThreadsTransmit.end();
+          ++it )
+    {
         if (m_realtime) {
-            m_IsoThreadTransmit->AcquireRealTime(m_priority
-                                                 + ihm_iso_prio_increase
-                                                 + ihm_iso_prio_increase_xmit);
+            (*it)->AcquireRealTime(m_priority
+                                   + ihm_iso_prio_increase
+                                   + ihm_iso_prio_increase_xmit);
         } else {
-            m_IsoThreadTransmit->DropRealTime();
+            (*it)->DropRealTime();
         }
     }
-    if (m_IsoThreadReceive) {
+    for ( ThreadVectorIterator it = m_IsoThreadsReceive.begin();
+          it != m_IsoThreadsReceive.end();
+          ++it )
+    {
         if (m_realtime) {
-            m_IsoThreadReceive->AcquireRealTime(m_priority 
-                                                + ihm_iso_prio_increase
-                                                + ihm_iso_prio_increase_recv);
+            (*it)->AcquireRealTime(m_priority
+                                   + ihm_iso_prio_increase
+                                   + ihm_iso_prio_increase_recv);
         } else {
-            m_IsoThreadReceive->DropRealTime();
+            (*it)->DropRealTime();
         }
     }
 
@@ -608,88 +756,222 @@ bool IsoHandlerManager::init()
     int ihm_iso_prio_increase_xmit = ISOHANDLERMANAGER_ISO_PRIO_INCREASE_XMIT;
     int ihm_iso_prio_increase_recv = ISOHANDLERMANAGER_ISO_PRIO_INCREASE_RECV;
     int64_t isotask_activity_timeout_usecs = ISOHANDLERMANAGER_ISO_TASK_WAIT_TIMEOUT_USECS;
+    int nb_threads_xmit = ISOHANDLERMANAGER_ISO_THREADS_XMIT;
+    int nb_threads_recv = ISOHANDLERMANAGER_ISO_THREADS_RECV;
+    int sharding = ISOHANDLERMANAGER_ISO_THREAD_SHARDING;
+    int cpu_base = ISOHANDLERMANAGER_ISO_THREAD_CPU_BASE;
     if(config) {
         config->getValueForSetting("ieee1394.isomanager.prio_increase", ihm_iso_prio_increase);
         config->getValueForSetting("ieee1394.isomanager.prio_increase_xmit", ihm_iso_prio_increase_xmit);
         config->getValueForSetting("ieee1394.isomanager.prio_increase_recv", ihm_iso_prio_increase_recv);
         config->getValueForSetting("ieee1394.isomanager.isotask_activity_timeout_usecs", isotask_activity_timeout_usecs);
-    }
-
-    // create threads to iterate our ISO handlers
-    debugOutput( DEBUG_LEVEL_VERBOSE, "Create iso thread for %p transmit...\n", this);
-    m_IsoTaskTransmit = new IsoTask( *this, IsoHandler::eHT_Transmit );
-    if(!m_IsoTaskTransmit) {
-        debugFatal("No task\n");
+        config->getValueForSetting("ieee1394.isomanager.iso_threads_xmit", nb_threads_xmit);
+        config->getValueForSetting("ieee1394.isomanager.iso_threads_recv", nb_threads_recv);
+        config->getValueForSetting("ieee1394.isomanager.iso_thread_sharding", sharding);
+        config->getValueForSetting("ieee1394.isomanager.iso_thread_cpu_base", cpu_base);
+    }
+
+    // create the thread pools to iterate our ISO handlers
+    if (nb_threads_xmit < 1) nb_threads_xmit = 1;
+    if (nb_threads_recv < 1) nb_threads_recv = 1;
+    switch (sharding) {
+        case eITS_PerDevice:
+        case eITS_PerStream:
+            m_sharding = (enum eIsoThreadSharding)sharding;
+            break;
+        default:
+            debugWarning("Bogus ISO thread sharding setting in config: %d\n", sharding);
+            m_sharding = eITS_PerDevice;
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Create %d transmit and %d receive iso threads for %p...\n",
+                 nb_threads_xmit, nb_threads_recv, this);
+    if (!createIsoTasks(IsoHandler::eHT_Transmit, nb_threads_xmit,
+                        m_priority + ihm_iso_prio_increase + ihm_iso_prio_increase_xmit,
+                        isotask_activity_timeout_usecs, cpu_base)) {
         return false;
     }
-    m_IsoTaskTransmit->setVerboseLevel(getDebugLevel());
-    m_IsoTaskTransmit->m_activity_wait_timeout_nsec = isotask_activity_timeout_usecs * 1000LL;
-    m_IsoThreadTransmit = new Util::PosixThread(m_IsoTaskTransmit, "ISOXMT", m_realtime,
-                                                m_priority + ihm_iso_prio_increase
-                                                + ihm_iso_prio_increase_xmit,
-                                                PTHREAD_CANCEL_DEFERRED);
-
-    if(!m_IsoThreadTransmit) {
-        debugFatal("No thread\n");
+    // the receive threads are pinned to the cpu's following the transmit threads
+    if (!createIsoTasks(IsoHandler::eHT_Receive, nb_threads_recv,
+                        m_priority + ihm_iso_prio_increase + ihm_iso_prio_increase_recv,
+                        isotask_activity_timeout_usecs,
+                        (cpu_base < 0 ? cpu_base : cpu_base + nb_threads_xmit))) {
         return false;
     }
-    m_IsoThreadTransmit->setVerboseLevel(getDebugLevel());
 
-    debugOutput( DEBUG_LEVEL_VERBOSE, "Create iso thread for %p receive...\n", this);
-    m_IsoTaskReceive = new IsoTask( *this, IsoHandler::eHT_Receive );
-    if(!m_IsoTaskReceive) {
-        debugFatal("No task\n");
-        return false;
-    }
-    m_IsoTaskReceive->setVerboseLevel(getDebugLevel());
-    m_IsoThreadReceive = new Util::PosixThread(m_IsoTaskReceive, "ISORCV", m_realtime,
-                                               m_priority + ihm_iso_prio_increase
-                                               + ihm_iso_prio_increase_recv,
-                                               PTHREAD_CANCEL_DEFERRED);
-
-    if(!m_IsoThreadReceive) {
-        debugFatal("No thread\n");
-        return false;
-    }
-    m_IsoThreadReceive->setVerboseLevel(getDebugLevel());
-    // register the thread with the RT watchdog
+    // register the threads with the RT watchdog
     Util::Watchdog *watchdog = m_service.getWatchdog();
     if(watchdog) {
-        if(!watchdog->registerThread(m_IsoThreadTransmit)) {
-            debugWarning("could not register iso transmit thread with watchdog\n");
+        for ( ThreadVectorIterator it = m_IsoThreadsTransmit.begin();
+              it != m_IsoThreadsTransmit.end();
+              ++it )
+        {
+            if(!watchdog->registerThread(*it)) {
+                debugWarning("could not register iso transmit thread with watchdog\n");
+            }
         }
-        if(!watchdog->registerThread(m_IsoThreadReceive)) {
-            debugWarning("could not register iso receive thread with watchdog\n");
+        for ( ThreadVectorIterator it = m_IsoThreadsReceive.begin();
+              it != m_IsoThreadsReceive.end();
+              ++it )
+        {
+            if(!watchdog->registerThread(*it)) {
+                debugWarning("could not register iso receive thread with watchdog\n");
+            }
         }
     } else {
         debugWarning("could not find valid watchdog\n");
     }
 
-    if (m_IsoThreadTransmit->Start() != 0) {
-        debugFatal("Could not start ISO Transmit thread\n");
-        return false;
+    for ( ThreadVectorIterator it = m_IsoThreadsTransmit.begin();
+          it != m_IsoThreadsTransmit.end();
+          ++it )
+    {
+        if ((*it)->Start() != 0) {
+            debugFatal("Could not start ISO Transmit thread\n");
+            return false;
+        }
     }
-    if (m_IsoThreadReceive->Start() != 0) {
-        debugFatal("Could not start ISO Receive thread\n");
-        return false;
+    for ( ThreadVectorIterator it = m_IsoThreadsReceive.begin();
+          it != m_IsoThreadsReceive.end();
+          ++it )
+    {
+        if ((*it)->Start() != 0) {
+            debugFatal("Could not start ISO Receive thread\n");
+            return false;
+        }
+    }
+
+    std::string capture_file = IsoCaptureWriter::getRequestedFilename();
+    if (!capture_file.empty()) {
+        m_capture = new IsoCaptureWriter(capture_file);
+        m_capture->setVerboseLevel(getDebugLevel());
+        if (!m_capture->open()) {
+            debugWarning("Could not start the ISO capture, continuing without\n");
+            delete m_capture;
+            m_capture = NULL;
+        }
     }
 
     m_State=E_Running;
     return true;
 }
 
+bool
+IsoHandlerManager::createIsoTasks(enum IsoHandler::EHandlerType t, unsigned int nb_tasks,
+                                  int priority, int64_t activity_timeout_usecs, int cpu_base)
+{
+    IsoTaskVector &tasks = getTasks(t);
+    ThreadVector &threads = getThreads(t);
+    bool xmit = (t == IsoHandler::eHT_Transmit);
+    int nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_cpus < 1) nb_cpus = 1;
+
+    for (unsigned int i = 0; i < nb_tasks; i++) {
+        int cpu = -1;
+        if (cpu_base >= 0) {
+            cpu = (cpu_base + i) % nb_cpus;
+        }
+        IsoTask *task = new IsoTask( *this, t, i, cpu );
+        if(!task) {
+            debugFatal("No task\n");
+            return false;
+        }
+        task->setVerboseLevel(getDebugLevel());
+        task->m_activity_wait_timeout_nsec = activity_timeout_usecs * 1000LL;
+        tasks.push_back(task);
+
+        // the first thread keeps the traditional name
+        char name[16];
+        if (i == 0) {
+            snprintf(name, sizeof(name), "%s", (xmit ? "ISOXMT" : "ISORCV"));
+        } else {
+            snprintf(name, sizeof(name), "%s%u", (xmit ? "ISOXMT" : "ISORCV"), i);
+        }
+        Util::Thread *thread = new Util::PosixThread(task, name, m_realtime, priority,
+                                                     PTHREAD_CANCEL_DEFERRED);
+        if(!thread) {
+            debugFatal("No thread\n");
+            return false;
+        }
+        thread->setVerboseLevel(getDebugLevel());
+        threads.push_back(thread);
+    }
+    return true;
+}
+
+/**
+ * @brief selects the ISO thread that will iterate the handler of a stream
+ *
+ * When sharding per device, all streams of a device in one direction end
+ * up on the same thread, such that a device is processed in-order on one
+ * core. The first stream of a device (or every stream when sharding per
+ * stream) goes to the thread with the least handlers.
+ */
+unsigned int
+IsoHandlerManager::selectTaskIndexForStream(Streaming::StreamProcessor *stream,
+                                            enum IsoHandler::EHandlerType t)
+{
+    unsigned int nb_tasks = getTasks(t).size();
+    if (nb_tasks <= 1) return 0;
+
+    if (m_sharding == eITS_PerDevice) {
+        for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
+              it != m_IsoHandlers.end();
+              ++it )
+        {
+            if ((*it)->getType() != t) continue;
+            for ( Streaming::StreamProcessorVectorIterator sit = m_StreamProcessors.begin();
+                  sit != m_StreamProcessors.end();
+                  ++sit )
+            {
+                if ((*it)->isStreamRegistered(*sit)
+                    && &(*sit)->getParent() == &stream->getParent()) {
+                    return (*it)->getTaskIndex();
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned int> load(nb_tasks, 0);
+    for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
+          it != m_IsoHandlers.end();
+          ++it )
+    {
+        if ((*it)->getType() == t && (*it)->getTaskIndex() < nb_tasks) {
+            load[(*it)->getTaskIndex()]++;
+        }
+    }
+    unsigned int best = 0;
+    for (unsigned int i = 1; i < nb_tasks; i++) {
+        if (load[i] < load[best]) best = i;
+    }
+    return best;
+}
+
+// the clients don't know which thread serves them, so all threads of the
+// direction are woken up. The threads whose clients didn't change only
+// re-check their disarmed handlers.
 void
 IsoHandlerManager::signalActivityTransmit()
 {
-    assert(m_IsoTaskTransmit);
-    m_IsoTaskTransmit->signalActivity();
+    assert(!m_IsoTasksTransmit.empty());
+    for ( IsoTaskVectorIterator it = m_IsoTasksTransmit.begin();
+          it != m_IsoTasksTransmit.end();
+          ++it )
+    {
+        (*it)->signalActivity();
+    }
 }
 
 void
 IsoHandlerManager::signalActivityReceive()
 {
-    assert(m_IsoTaskReceive);
-    m_IsoTaskReceive->signalActivity();
+    assert(!m_IsoTasksReceive.empty());
+    for ( IsoTaskVectorIterator it = m_IsoTasksReceive.begin();
+          it != m_IsoTasksReceive.end();
+          ++it )
+    {
+        (*it)->signalActivity();
+    }
 }
 
 bool IsoHandlerManager::registerHandler(IsoHandler *handler)
@@ -902,6 +1184,9 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
     }
 
     h->setVerboseLevel(getDebugLevel());
+    h->setTaskIndex(selectTaskIndexForStream(stream, h->getType()));
+    debugOutput( DEBUG_LEVEL_VERBOSE, " handler will be iterated by %s thread %u\n",
+                 h->getTypeString(), h->getTaskIndex());
 
     // register the stream with the handler
     if(!h->registerStream(stream)) {
@@ -1051,7 +1336,9 @@ void IsoHandlerManager::setIsoStartCycleForStream(Streaming::StreamProcessor *st
     // requestEnable() doesn't set it.  This allows the override configured
     // by this function to take effect.
     IsoHandler *h = getHandlerForStream(stream);
-    h->setIsoStartCycle(cycle);
+    if (h) {
+        h->setIsoStartCycle(cycle);
+    }
 }
 
 bool
@@ -1077,11 +1364,7 @@ IsoHandlerManager::startHandlerForStream(Streaming::StreamProcessor *stream, int
                 return false;
             }
 
-            if((*it)->getType() == IsoHandler::eHT_Transmit) {
-                m_IsoTaskTransmit->requestShadowMapUpdate();
-            } else {
-                m_IsoTaskReceive->requestShadowMapUpdate();
-            }
+            getTaskForHandler(*it)->requestShadowMapUpdate();
 
             debugOutput(DEBUG_LEVEL_VERY_VERBOSE, " requested enable for handler %p\n", *it);
             return true;
@@ -1109,11 +1392,7 @@ IsoHandlerManager::stopHandlerForStream(Streaming::StreamProcessor *stream) {
                 return false;
             }
 
-            if((*it)->getType() == IsoHandler::eHT_Transmit) {
-                m_IsoTaskTransmit->requestShadowMapUpdate();
-            } else {
-                m_IsoTaskReceive->requestShadowMapUpdate();
-            }
+            getTaskForHandler(*it)->requestShadowMapUpdate();
 
             debugOutput(DEBUG_LEVEL_VERBOSE, " requested disable for handler %p\n", *it);
             return true;
@@ -1145,11 +1424,7 @@ bool IsoHandlerManager::stopHandlers() {
             return false;
         }
 
-        if((*it)->getType() == IsoHandler::eHT_Transmit) {
-            m_IsoTaskTransmit->requestShadowMapUpdate();
-        } else {
-            m_IsoTaskReceive->requestShadowMapUpdate();
-        }
+        getTaskForHandler(*it)->requestShadowMapUpdate();
 
         debugOutput(DEBUG_LEVEL_VERBOSE, " requested disable for handler %p\n", *it);
     }
@@ -1180,10 +1455,31 @@ void IsoHandlerManager::setVerboseLevel(int i) {
     {
         (*it)->setVerboseLevel(i);
     }
-    if(m_IsoThreadTransmit) m_IsoThreadTransmit->setVerboseLevel(i);
-    if(m_IsoTaskTransmit)   m_IsoTaskTransmit->setVerboseLevel(i);
-    if(m_IsoThreadReceive)  m_IsoThreadReceive->setVerboseLevel(i);
-    if(m_IsoTaskReceive)    m_IsoTaskReceive->setVerboseLevel(i);
+    for ( ThreadVectorIterator it = m_IsoThreadsTransmit.begin();
+          it != m_IsoThreadsTransmit.end();
+          ++it )
+    {
+        (*it)->setVerboseLevel(i);
+    }
+    for ( IsoTaskVectorIterator it = m_IsoTasksTransmit.begin();
+          it != m_IsoTasksTransmit.end();
+          ++it )
+    {
+        (*it)->setVerboseLevel(i);
+    }
+    for ( ThreadVectorIterator it = m_IsoThreadsReceive.begin();
+          it != m_IsoThreadsReceive.end();
+          ++it )
+    {
+        (*it)->setVerboseLevel(i);
+    }
+    for ( IsoTaskVectorIterator it = m_IsoTasksReceive.begin();
+          it != m_IsoTasksReceive.end();
+          ++it )
+    {
+        (*it)->setVerboseLevel(i);
+    }
+    if (m_capture) m_capture->setVerboseLevel(i);
     setDebugLevel(i);
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting verbose level to %d...\n", i );
 }
@@ -1201,6 +1497,7 @@ void IsoHandlerManager::dumpInfo() {
         debugOutputShort( DEBUG_LEVEL_NORMAL, " IsoHandler %d (%p)\n",i++,*it);
         (*it)->dumpInfo();
     }
+    if (m_capture) m_capture->show();
     #endif
 }
 
@@ -1247,6 +1544,8 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    : m_manager( manager )
    , m_type ( t )
    , m_handle( NULL )
+   , m_sim_context( NULL )
+   , m_sim_packet( NULL )
    , m_buf_packets( 400 )
    , m_max_packet_size( 1024 )
    , m_irq_interval( -1 )
@@ -1259,6 +1558,7 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    , m_State( eHS_Stopped )
    , m_NextState( eHS_Stopped )
    , m_switch_on_cycle(0)
+   , m_task_index(0)
 #ifdef DEBUG
    , m_packets ( 0 )
    , m_dropped( 0 )
@@ -1274,6 +1574,8 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    : m_manager( manager )
    , m_type ( t )
    , m_handle( NULL )
+   , m_sim_context( NULL )
+   , m_sim_packet( NULL )
    , m_buf_packets( buf_packets )
    , m_max_packet_size( max_packet_size )
    , m_irq_interval( irq )
@@ -1286,6 +1588,7 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    , m_State( eHS_Stopped )
    , m_NextState( eHS_Stopped )
    , m_switch_on_cycle(0)
+   , m_task_index(0)
 #ifdef DEBUG
    , m_packets ( 0 )
    , m_dropped( 0 )
@@ -1302,6 +1605,8 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    : m_manager( manager )
    , m_type ( t )
    , m_handle( NULL )
+   , m_sim_context( NULL )
+   , m_sim_packet( NULL )
    , m_buf_packets( buf_packets )
    , m_max_packet_size( max_packet_size )
    , m_irq_interval( irq )
@@ -1314,6 +1619,7 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    , m_State( eHS_Stopped )
    , m_NextState( eHS_Stopped )
    , m_switch_on_cycle(0)
+   , m_task_index(0)
 #ifdef DEBUG
    , m_packets( 0 )
    , m_dropped( 0 )
@@ -1344,12 +1650,13 @@ IsoHandlerManager::IsoHandler::~IsoHandler() {
         pthread_mutex_lock(&m_disable_lock);
     }
     pthread_mutex_unlock(&m_disable_lock);
-    if(m_handle) {
+    if(m_handle || m_sim_context) {
         if (m_State == eHS_Running) {
             debugError("BUG: Handler still running!\n");
             disable();
         }
     }
+    delete[] m_sim_packet;
     pthread_mutex_destroy(&m_disable_lock);
 }
 
@@ -1388,25 +1695,47 @@ IsoHandlerManager::IsoHandler::iterate(uint32_t cycle_timer_now) {
                        this, getTypeString(), cycle_timer_now);
     m_last_now = cycle_timer_now;
     if(m_State == eHS_Running) {
-        assert(m_handle);
-
-        #if ISOHANDLER_FLUSH_BEFORE_ITERATE
-        // this flushes all packets received since the poll() returned
-        // from kernel to userspace such that they are processed by this
-        // iterate. Doing so might result in lower latency capability
-        // and/or better reliability
-        if(m_type == eHT_Receive) {
-            raw1394_iso_recv_flush(m_handle);
-        }
-        #endif
+        unsigned int packets_before = m_packets;
+        if (m_sim_context) {
+            if (!iterateSimulated()) {
+                return false;
+            }
+        } else {
+            assert(m_handle);
+
+            #if ISOHANDLER_FLUSH_BEFORE_ITERATE
+            // this flushes all packets received since the poll() returned
+            // from kernel to userspace such that they are processed by this
+            // iterate. Doing so might result in lower latency capability
+            // and/or better reliability
+            if(m_type == eHT_Receive) {
+                raw1394_iso_recv_flush(m_handle);
+            }
+            #endif
 
-        if(raw1394_loop_iterate(m_handle)) {
-            debugError( "IsoHandler (%p): Failed to iterate handler: %s\n",
-                        this, strerror(errno));
-            return false;
+            if(raw1394_loop_iterate(m_handle)) {
+                debugError( "IsoHandler (%p): Failed to iterate handler: %s\n",
+                            this, strerror(errno));
+                return false;
+            }
         }
         debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE, "(%p, %s) done interating ISO handler...\n",
                            this, getTypeString());
+
+        Util::LatencyStatistics *stats = (m_Client ? m_Client->getLatencyStatistics() : NULL);
+        if (stats) {
+            stats->mark(Util::LatencyStatistics::eS_PacketsPerIterate,
+                        m_packets - packets_before);
+            // the age of the newest packet when we got to handle it
+            if (m_type == eHT_Receive && m_last_packet_handled_at != 0xFFFFFFFF
+                && m_packets != packets_before) {
+                int64_t ticks = diffTicks(CYCLE_TIMER_TO_TICKS(m_last_now),
+                                          CYCLE_TIMER_TO_TICKS(m_last_packet_handled_at));
+                if (ticks < 0) ticks = 0;
+                stats->mark(Util::LatencyStatistics::eS_IsoWakeupLatency,
+                            (uint32_t)(ticks / TICKS_PER_USEC));
+            }
+        }
         return true;
     } else {
         debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) Not iterating a non-running handler...\n",
@@ -1415,6 +1744,60 @@ IsoHandlerManager::IsoHandler::iterate(uint32_t cycle_timer_now) {
     }
 }
 
+int
+IsoHandlerManager::IsoHandler::getFileDescriptor()
+{
+    if (m_sim_context) {
+        return m_manager.get1394Service().getSimulatedBus()->getFileDescriptor(m_sim_context);
+    }
+    return raw1394_get_fd(m_handle);
+}
+
+/**
+ * Moves packets between the client and the simulated bus, the way
+ * raw1394_loop_iterate() does with the kernel buffers.
+ */
+bool
+IsoHandlerManager::IsoHandler::iterateSimulated()
+{
+    SimulatedBus *bus = m_manager.get1394Service().getSimulatedBus();
+    assert(bus);
+    bus->acknowledgeWakeup(m_sim_context);
+
+    unsigned char *data = m_sim_packet;
+    enum raw1394_iso_disposition retval = RAW1394_ISO_OK;
+    if (m_type == eHT_Receive) {
+        unsigned int length, cycle, dropped;
+        unsigned char tag, sy;
+        unsigned char channel = m_Client->getChannel();
+        // a deferred packet is lost here, the kernel would keep it. This
+        // only happens when the client isn't running yet.
+        while (retval == RAW1394_ISO_OK
+               && bus->receive(m_sim_context, data, &length, &tag, &sy, &cycle, &dropped)) {
+            retval = putPacket(data, length, channel, tag, sy, cycle, dropped);
+        }
+    } else {
+        int cycle;
+        while (retval == RAW1394_ISO_OK
+               && bus->getNextTransmitCycle(m_sim_context, &cycle)) {
+            unsigned int length = 0;
+            unsigned char tag = 0, sy = 0;
+            retval = getPacket(data, &length, &tag, &sy, cycle, 0, 0);
+            if (retval != RAW1394_ISO_AGAIN) {
+                bus->transmit(m_sim_context, data, length, tag, sy);
+            }
+        }
+    }
+    if (retval == RAW1394_ISO_ERROR) {
+        debugError("IsoHandler (%p): client error on the simulated bus\n", this);
+        return false;
+    }
+    if (retval == RAW1394_ISO_STOP || retval == RAW1394_ISO_STOP_NOSYNC) {
+        bus->stopIsoContext(m_sim_context);
+    }
+    return true;
+}
+
 /**
  * Bus reset handler
  *
@@ -1432,8 +1815,10 @@ IsoHandlerManager::IsoHandler::handleBusReset()
     // do a simple read on ourself in order to update the internal structures
     // this avoids read failures after a bus reset
     quadlet_t buf=0;
-    raw1394_read(m_handle, raw1394_get_local_id(m_handle),
-                 CSR_REGISTER_BASE | CSR_CYCLE_TIME, 4, &buf);
+    if (m_handle) {
+        raw1394_read(m_handle, raw1394_get_local_id(m_handle),
+                     CSR_REGISTER_BASE | CSR_CYCLE_TIME, 4, &buf);
+    }
 
     return m_Client->handleBusReset();
 }
@@ -1445,7 +1830,7 @@ IsoHandlerManager::IsoHandler::handleBusReset()
 void
 IsoHandlerManager::IsoHandler::notifyOfDeath()
 {
-    if(m_handle) {
+    if(m_handle || m_sim_context) {
         // Make sure the stream is fully disabled. Some controllers (Ricoh
         // R5C832) will leave the stream in a limbo state after an unscheduled
         // stop, making it impossible to restart the stream, so make sure all
@@ -1620,10 +2005,15 @@ enum raw1394_iso_disposition IsoHandlerManager::IsoHandler::putPacket(
     #endif
 
     // iterate the client if required
+    enum raw1394_iso_disposition retval = RAW1394_ISO_OK;
     if(m_Client)
-        return m_Client->putPacket(data, length, channel, tag, sy, pkt_ctr, dropped_cycles);
+        retval = m_Client->putPacket(data, length, channel, tag, sy, pkt_ctr, dropped_cycles);
 
-    return RAW1394_ISO_OK;
+    // a deferred packet comes again
+    if (m_manager.m_capture && retval != RAW1394_ISO_DEFER) {
+        m_manager.m_capture->write(channel, tag, sy, pkt_ctr, dropped_cycles, data, length);
+    }
+    return retval;
 }
 
 enum raw1394_iso_disposition
@@ -1793,19 +2183,37 @@ IsoHandlerManager::IsoHandler::enable(int cycle)
     }
 
     assert(m_handle == NULL);
-
-    // create a handle for the ISO traffic
-    m_handle = raw1394_new_handle_on_port( m_manager.get1394Service().getPort() );
-    if ( !m_handle ) {
-        if ( !errno ) {
-            debugError("libraw1394 not compatible\n");
-        } else {
-            debugError("Could not get 1394 handle: %s\n", strerror(errno) );
-            debugError("Are ieee1394 and raw1394 drivers loaded?\n");
+    assert(m_sim_context == NULL);
+
+    SimulatedBus *bus = m_manager.get1394Service().getSimulatedBus();
+    if (bus) {
+        m_sim_context = bus->createIsoContext(getType() == eHT_Transmit,
+                                              m_Client->getChannel(),
+                                              m_buf_packets,
+                                              m_max_packet_size,
+                                              m_irq_interval);
+        if (m_sim_context == NULL) {
+            debugError("Could not create a simulated ISO context\n");
+            return false;
         }
-        return false;
+        // the packet passed between the client and the bus
+        if (m_sim_packet == NULL) {
+            m_sim_packet = new unsigned char[m_max_packet_size];
+        }
+    } else {
+        // create a handle for the ISO traffic
+        m_handle = raw1394_new_handle_on_port( m_manager.get1394Service().getPort() );
+        if ( !m_handle ) {
+            if ( !errno ) {
+                debugError("libraw1394 not compatible\n");
+            } else {
+                debugError("Could not get 1394 handle: %s\n", strerror(errno) );
+                debugError("Are ieee1394 and raw1394 drivers loaded?\n");
+            }
+            return false;
+        }
+        raw1394_set_userdata(m_handle, static_cast<void *>(this));
     }
-    raw1394_set_userdata(m_handle, static_cast<void *>(this));
 
     // Reset housekeeping data before preparing and starting the handler. 
     // If only done afterwards, the transmit handler could be called before
@@ -1823,7 +2231,14 @@ IsoHandlerManager::IsoHandler::enable(int cycle)
     // prepare the handler, allocate the resources
     debugOutput( DEBUG_LEVEL_VERBOSE, "Preparing iso handler (%p, client=%p)\n", this, m_Client);
     dumpInfo();
-    if (getType() == eHT_Receive) {
+    if (m_sim_context) {
+        if (!bus->startIsoContext(m_sim_context, cycle)) {
+            debugFatal("Could not start simulated handler\n");
+            bus->destroyIsoContext(m_sim_context);
+            m_sim_context = NULL;
+            return false;
+        }
+    } else if (getType() == eHT_Receive) {
         if(raw1394_iso_recv_init(m_handle,
                                 iso_receive_handler,
                                 m_buf_packets,
@@ -1902,6 +2317,22 @@ IsoHandlerManager::IsoHandler::disable()
         return false;
     }
 
+    if (m_sim_context) {
+        SimulatedBus *bus = m_manager.get1394Service().getSimulatedBus();
+        bus->stopIsoContext(m_sim_context);
+        bus->destroyIsoContext(m_sim_context);
+        m_sim_context = NULL;
+
+        m_State = eHS_Stopped;
+        m_NextState = eHS_Stopped;
+
+        m_Client->packetsStopped();
+
+        if (have_lock)
+            pthread_mutex_unlock(&m_disable_lock);
+        return true;
+    }
+
     assert(m_handle != NULL);
 
     debugOutput( DEBUG_LEVEL_VERBOSE, "(%p, %s) wake up handle...\n", 
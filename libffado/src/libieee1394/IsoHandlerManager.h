@@ -30,10 +30,11 @@
 
 #include "libutil/Thread.h"
 
-#include <sys/poll.h>
+#include "SimulatedBus.h"
+#include "IsoCapture.h"
+
 #include <errno.h>
 #include <vector>
-#include <semaphore.h>
 
 class Ieee1394Service;
 //class IsoHandler;
@@ -106,6 +107,9 @@ class IsoHandlerManager
                                   unsigned char *tag, unsigned char *sy,
                                   int cycle, unsigned int dropped, unsigned int skipped);
 
+                // the same for the simulated bus
+                bool iterateSimulated();
+
         public:
 
     /**
@@ -121,7 +125,7 @@ class IsoHandlerManager
      */
             bool iterate(uint32_t ctr_now);
 
-            int getFileDescriptor() { return raw1394_get_fd(m_handle);};
+            int getFileDescriptor();
 
             bool init();
             void setVerboseLevel(int l);
@@ -198,10 +202,18 @@ class IsoHandlerManager
             void notifyOfDeath();
             bool handleBusReset();
 
+    /**
+             * @brief the index of the IsoTask (of the handler's direction) that iterates this handler
+     */
+            unsigned int getTaskIndex() {return m_task_index;};
+            void setTaskIndex(unsigned int i) {m_task_index = i;};
+
         private:
             IsoHandlerManager& m_manager;
             enum EHandlerType m_type;
             raw1394handle_t m_handle;
+            SimulatedBus::IsoContext *m_sim_context;
+            unsigned char  *m_sim_packet;
             unsigned int    m_buf_packets;
             unsigned int    m_max_packet_size;
             int             m_irq_interval;
@@ -223,6 +235,8 @@ class IsoHandlerManager
             enum EHandlerStates m_NextState;
             int m_switch_on_cycle;
 
+            unsigned int m_task_index;
+
             pthread_mutex_t m_disable_lock;
 
         public:
@@ -241,16 +255,23 @@ class IsoHandlerManager
     typedef std::vector<IsoHandler *> IsoHandlerVector;
     typedef std::vector<IsoHandler *>::iterator IsoHandlerVectorIterator;
 
+    class IsoTask;
+    typedef std::vector<IsoTask *> IsoTaskVector;
+    typedef std::vector<IsoTask *>::iterator IsoTaskVectorIterator;
+    typedef std::vector<Util::Thread *> ThreadVector;
+    typedef std::vector<Util::Thread *>::iterator ThreadVectorIterator;
+
 ////
     
 // threads that will handle the packet framing
-// one thread per direction, as a compromise for one per
-// channel and one for all
+// a pool of threads per direction, the handlers are sharded
+// over the threads of their direction by task index
     class IsoTask : public Util::RunnableInterface
     {
         friend class IsoHandlerManager;
         public:
-            IsoTask(IsoHandlerManager& manager, enum IsoHandler::EHandlerType);
+            IsoTask(IsoHandlerManager& manager, enum IsoHandler::EHandlerType,
+                    unsigned int index, int cpu);
             virtual ~IsoTask();
 
         private:
@@ -261,21 +282,11 @@ class IsoHandlerManager
              * @brief requests the thread to sync it's stream map with the manager
          */
             void requestShadowMapUpdate();
-            enum eActivityResult {
-                eAR_Activity,
-                eAR_Timeout,
-                eAR_Interrupted,
-                eAR_Error
-            };
 
         /**
              * @brief signals that something happened in one of the clients of this task
          */
             void signalActivity();
-        /**
-             * @brief wait until something happened in one of the clients of this task
-         */
-            enum eActivityResult waitForActivity();
 
         /**
              * @brief This should be called when a busreset has happened.
@@ -293,25 +304,45 @@ class IsoHandlerManager
         // static allocation due to RT constraints
         // this is the map used by the actual thread
         // it is a shadow of the m_StreamProcessors vector
-            struct pollfd   m_poll_fds_shadow[ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT];
             IsoHandler *    m_IsoHandler_map_shadow[ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT];
+        // whether the handler's fd is armed in the epoll set, i.e. whether
+        // its client can be iterated
+            bool            m_poll_armed_shadow[ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT];
+        // the registered fd's, kept since the handler can be gone when
+        // the registration is dropped
+            int             m_poll_fd_shadow[ISOHANDLERMANAGER_MAX_ISO_HANDLERS_PER_PORT];
             unsigned int    m_poll_nfds_shadow;
+            unsigned int    m_poll_nfds_registered;
+            unsigned int    m_poll_nfds_disarmed;
             IsoHandler *    m_SyncIsoHandler;
 
         // updates the streams map
             void updateShadowMapHelper();
 
+        // epoll interest management
+            bool setHandlerArmed(unsigned int idx, bool armed);
+            void armHandlers();
+            bool checkHandlersAlive(uint32_t ctr_now);
+
+        // the epoll set holds the handler fd's, the activity eventfd and
+        // the timerfd that drives the handler death detection
+            int m_epoll_fd;
+            int m_activity_fd;
+            int m_death_timer_fd;
+
 #ifdef DEBUG
             uint64_t m_last_loop_entry;
             int m_successive_short_loops;
 #endif
 
             enum IsoHandler::EHandlerType m_handlerType;
+        // the shard this task serves and the cpu it is pinned to (-1 = none)
+            unsigned int m_index;
+            int m_cpu;
             bool m_running;
             bool m_in_busreset;
 
         // activity signaling
-            sem_t m_activity_semaphore;
             long long int m_activity_wait_timeout_nsec;
 
         // debug stuff
@@ -378,6 +409,17 @@ class IsoHandlerManager
     private:
         IsoHandler * getHandlerForStream(Streaming::StreamProcessor *stream);
         void requestShadowMapUpdate();
+
+        // the ISO thread pools
+        IsoTaskVector & getTasks(enum IsoHandler::EHandlerType t)
+            {return (t == IsoHandler::eHT_Transmit ? m_IsoTasksTransmit : m_IsoTasksReceive);};
+        ThreadVector & getThreads(enum IsoHandler::EHandlerType t)
+            {return (t == IsoHandler::eHT_Transmit ? m_IsoThreadsTransmit : m_IsoThreadsReceive);};
+        IsoTask * getTaskForHandler(IsoHandler *h);
+        bool createIsoTasks(enum IsoHandler::EHandlerType t, unsigned int nb_tasks,
+                            int priority, int64_t activity_timeout_usecs, int cpu_base);
+        unsigned int selectTaskIndexForStream(Streaming::StreamProcessor *stream,
+                                              enum IsoHandler::EHandlerType t);
     public:
         Ieee1394Service& get1394Service() {return m_service;};
 
@@ -417,16 +459,25 @@ class IsoHandlerManager
         // the collection of streams
         Streaming::StreamProcessorVector m_StreamProcessors;
 
-        // handler thread/task
+        // handler threads/tasks
         bool            m_realtime;
         int             m_priority;
-        Util::Thread *  m_IsoThreadTransmit;
-        IsoTask *       m_IsoTaskTransmit;
-        Util::Thread *  m_IsoThreadReceive;
-        IsoTask *       m_IsoTaskReceive;
+        ThreadVector    m_IsoThreadsTransmit;
+        IsoTaskVector   m_IsoTasksTransmit;
+        ThreadVector    m_IsoThreadsReceive;
+        IsoTaskVector   m_IsoTasksReceive;
+        // how the handlers are distributed over the threads
+        enum eIsoThreadSharding {
+            eITS_PerDevice = 0,
+            eITS_PerStream = 1,
+        };
+        enum eIsoThreadSharding m_sharding;
 
         bool            m_MissedCyclesOK;
 
+        // set when the received packets are captured to a file
+        IsoCaptureWriter *m_capture;
+
         // debug stuff
         DECLARE_DEBUG_MODULE;
 
@@ -0,0 +1,723 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "SimulatedBus.h"
+#include "IsoCapture.h"
+#include "cycletimer.h"
+#include "csr1212.h"
+
+#include "libutil/SystemTimeSource.h"
+#include "libutil/Configuration.h"
+#include "libutil/ByteSwap.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+IMPL_DEBUG_MODULE( SimulatedBus, SimulatedBus, DEBUG_LEVEL_NORMAL );
+
+class SimulatedBus::IsoContext
+{
+public:
+    bool            transmit;
+    unsigned int    channel;
+    unsigned int    buf_packets;
+    unsigned int    max_packet_size;
+    unsigned int    irq_interval;
+    int             fd;
+    bool            running;
+    // transmit: the cycle the next packet is for
+    // receive: the first cycle that is accepted
+    uint64_t        next_cycle;
+    uint64_t        next_wakeup_nsecs;
+    unsigned int    dropped;
+    unsigned int    seed;
+};
+
+static uint64_t
+getMonotonicNsecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// --- Parameters
+
+SimulatedBus::Parameters::Parameters()
+: drift_ppm( SIMULATEDBUS_DEFAULT_DRIFT_PPM )
+, jitter_usecs( SIMULATEDBUS_DEFAULT_JITTER_USECS )
+, drop_ppm( SIMULATEDBUS_DEFAULT_DROP_PPM )
+, latency_cycles( SIMULATEDBUS_DEFAULT_LATENCY_CYCLES )
+, speed( 1.0 )
+{
+}
+
+void
+SimulatedBus::Parameters::load(Util::Configuration *c)
+{
+    if (c) {
+        c->getValueForSetting("ieee1394.loopback_drift_ppm", drift_ppm);
+        c->getValueForSetting("ieee1394.loopback_jitter_usecs", jitter_usecs);
+        c->getValueForSetting("ieee1394.loopback_drop_ppm", drop_ppm);
+        c->getValueForSetting("ieee1394.loopback_latency_cycles", latency_cycles);
+        c->getValueForSetting("ieee1394.loopback_speed", speed);
+    }
+    const char *env = getenv("FFADO_LOOPBACK");
+    if (env && !parse(env)) {
+        debugWarning("Could not parse FFADO_LOOPBACK='%s'\n", env);
+    }
+}
+
+bool
+SimulatedBus::Parameters::parse(const std::string &s)
+{
+    bool ok = true;
+    std::string::size_type pos = 0;
+    while (pos < s.size()) {
+        std::string::size_type end = s.find(',', pos);
+        if (end == std::string::npos) end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+
+        std::string::size_type eq = item.find('=');
+        if (eq == std::string::npos) {
+            // a plain "1" only enables the bus
+            continue;
+        }
+        std::string key = item.substr(0, eq);
+        if (key == "replay") {
+            replay_file = item.substr(eq + 1);
+            continue;
+        }
+        const char *value = item.c_str() + eq + 1;
+        char *tail;
+        errno = 0;
+        double v = strtod(value, &tail);
+        if (errno || *tail || tail == value) {
+            ok = false;
+            continue;
+        }
+        if (key == "drift") {
+            drift_ppm = v;
+        } else if (key == "jitter") {
+            jitter_usecs = (int)v;
+        } else if (key == "drop") {
+            drop_ppm = (int)v;
+        } else if (key == "latency") {
+            latency_cycles = (int)v;
+        } else if (key == "speed") {
+            speed = v;
+        } else {
+            ok = false;
+        }
+    }
+    if (jitter_usecs < 0) jitter_usecs = 0;
+    if (drop_ppm < 0) drop_ppm = 0;
+    if (latency_cycles < 0) latency_cycles = 0;
+    if (speed <= 0) {
+        speed = 1.0;
+        ok = false;
+    }
+    return ok;
+}
+
+bool
+SimulatedBus::isRequested(Util::Configuration *c)
+{
+    const char *env = getenv("FFADO_LOOPBACK");
+    if (env && *env && strcmp(env, "0") != 0) {
+        return true;
+    }
+    int32_t loopback = 0;
+    if (c) {
+        c->getValueForSetting("ieee1394.loopback", loopback);
+    }
+    return loopback != 0;
+}
+
+// --- SimulatedBus
+
+SimulatedBus::SimulatedBus(const Parameters &p)
+: m_params( p )
+, m_start_usecs( Util::SystemTimeSource::getCurrentTimeAsUsecs() )
+, m_start_ticks( (uint64_t)SIMULATEDBUS_START_SECONDS * TICKS_PER_SECOND )
+, m_rate( (1.0 + p.drift_ppm * 1e-6) * p.speed )
+, m_packets_transmitted( 0 )
+, m_packets_dropped( 0 )
+, m_generation( 1 )
+, m_reads( 0 )
+, m_replay( NULL )
+, m_replay_rec( NULL )
+, m_replay_data( NULL )
+, m_replay_cycle( 0 )
+, m_replay_end_cycle( 0 )
+, m_packets_replayed( 0 )
+{
+    pthread_mutex_init(&m_lock, NULL);
+    memset(m_channels, 0, sizeof(m_channels));
+    debugOutput(DEBUG_LEVEL_VERBOSE,
+                "Simulated bus: drift %f ppm, jitter %d usecs, drop %d ppm, latency %d cycles, speed %f\n",
+                p.drift_ppm, p.jitter_usecs, p.drop_ppm, p.latency_cycles, p.speed);
+}
+
+SimulatedBus::~SimulatedBus()
+{
+    for (unsigned int i = 0; i < 64; i++) {
+        if (m_channels[i].transmitter) {
+            debugWarning("transmit context on channel %u still present\n", i);
+            destroyIsoContext(m_channels[i].transmitter);
+        }
+        if (m_channels[i].receiver) {
+            debugWarning("receive context on channel %u still present\n", i);
+            destroyIsoContext(m_channels[i].receiver);
+        }
+    }
+    delete m_replay;
+    pthread_mutex_destroy(&m_lock);
+}
+
+bool
+SimulatedBus::init()
+{
+    if (m_params.replay_file.empty()) {
+        return true;
+    }
+    m_replay = new IsoCaptureReader(m_params.replay_file);
+    m_replay->setVerboseLevel(getDebugLevel());
+    if (!m_replay->open()) {
+        delete m_replay;
+        m_replay = NULL;
+        return false;
+    }
+    if (!m_replay->next(&m_replay_rec, &m_replay_data)) {
+        debugError("%s holds no packets\n", m_params.replay_file.c_str());
+        delete m_replay;
+        m_replay = NULL;
+        m_replay_rec = NULL;
+        return false;
+    }
+    // run the clock such that it reaches the cycle timer value of the
+    // first packet a bit after the start, which leaves time to set up
+    // the receivers
+    uint64_t first = CYCLE_TIMER_TO_TICKS(m_replay_rec->cycle_timer);
+    uint64_t lead = (uint64_t)SIMULATEDBUS_REPLAY_LEAD_CYCLES * TICKS_PER_CYCLE;
+    if (first < lead) {
+        first += 128ULL * TICKS_PER_SECOND;
+    }
+    m_start_ticks = first - lead;
+    uint64_t first_cycle = first / TICKS_PER_CYCLE;
+
+    // find out where it ends
+    m_replay_cycle = first_cycle;
+    m_replay_end_cycle = first_cycle;
+    while (nextReplayPacket()) {
+        if (m_replay_cycle > m_replay_end_cycle) {
+            m_replay_end_cycle = m_replay_cycle;
+        }
+    }
+    m_replay->rewind();
+    m_replay->next(&m_replay_rec, &m_replay_data);
+    m_replay_cycle = first_cycle;
+    debugOutput(DEBUG_LEVEL_NORMAL, "Replaying %s (%"PRIu64" cycles) at %f times real time\n",
+                m_params.replay_file.c_str(), m_replay_end_cycle - first_cycle, m_params.speed);
+    return true;
+}
+
+uint64_t
+SimulatedBus::getReplayCyclesLeft()
+{
+    uint64_t now = getCycle();
+    if (m_replay == NULL || m_replay_end_cycle <= now) {
+        return 0;
+    }
+    return m_replay_end_cycle - now;
+}
+
+/**
+ * Advances to the next packet of the capture. The bus cycle is derived
+ * from the difference with the previous cycle timer value, so the
+ * capture can span any number of cycle timer wraps.
+ */
+bool
+SimulatedBus::nextReplayPacket()
+{
+    const int64_t wrap = 128LL * CYCLES_PER_SECOND;
+    uint32_t prev = m_replay_rec->cycle_timer;
+    if (!m_replay->next(&m_replay_rec, &m_replay_data)) {
+        m_replay_rec = NULL;
+        return false;
+    }
+    int64_t prev_cycles = CYCLE_TIMER_GET_SECS(prev) * CYCLES_PER_SECOND + CYCLE_TIMER_GET_CYCLES(prev);
+    int64_t cycles = CYCLE_TIMER_GET_SECS(m_replay_rec->cycle_timer) * CYCLES_PER_SECOND
+                     + CYCLE_TIMER_GET_CYCLES(m_replay_rec->cycle_timer);
+    int64_t diff = (cycles - prev_cycles + wrap) % wrap;
+    // the packets of different receive threads can be slightly out of
+    // order in the capture
+    if (diff > wrap / 2) {
+        diff -= wrap;
+    }
+    m_replay_cycle += diff;
+    return true;
+}
+
+/// puts the captured packets up to the given cycle on the bus, m_lock held
+void
+SimulatedBus::replayUntil(uint64_t cycle)
+{
+    while (m_replay_rec && m_replay_cycle <= cycle) {
+        struct Channel &ch = m_channels[m_replay_rec->channel & 0x3F];
+        // what was on the bus before the receiver started is gone
+        if (ch.receiver && ch.receiver->running
+            && m_replay_cycle >= ch.receiver->next_cycle) {
+            if (ch.head - ch.tail >= SIMULATEDBUS_CHANNEL_PACKETS) {
+                // the receiver doesn't keep up, the oldest packet is lost
+                ch.tail++;
+                m_packets_dropped++;
+            }
+            queuePacket(ch, m_replay_cycle, m_replay_data, m_replay_rec->length,
+                        m_replay_rec->tag_sy >> 4, m_replay_rec->tag_sy & 0xF);
+            m_packets_replayed++;
+        }
+        if (!nextReplayPacket()) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "End of the replayed capture, %u packets delivered\n",
+                        m_packets_replayed);
+        }
+    }
+}
+
+uint64_t
+SimulatedBus::getTicks(uint64_t local_usecs)
+{
+    double elapsed = (double)(int64_t)(local_usecs - m_start_usecs);
+    return m_start_ticks + (uint64_t)(elapsed * TICKS_PER_USEC * m_rate);
+}
+
+uint64_t
+SimulatedBus::getCycle()
+{
+    return getTicks(Util::SystemTimeSource::getCurrentTimeAsUsecs()) / TICKS_PER_CYCLE;
+}
+
+bool
+SimulatedBus::readCycleTimer(uint32_t *cycle_timer, uint64_t *local_time)
+{
+    uint64_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    *cycle_timer = TICKS_TO_CYCLE_TIMER(getTicks(now));
+    *local_time = now;
+    return true;
+}
+
+SimulatedBus::IsoContext *
+SimulatedBus::createIsoContext(bool transmit, unsigned int channel,
+                               unsigned int buf_packets,
+                               unsigned int max_packet_size,
+                               int irq_interval)
+{
+    if (channel >= 64) {
+        debugError("Invalid channel %u\n", channel);
+        return NULL;
+    }
+    if (buf_packets + m_params.latency_cycles >= SIMULATEDBUS_CHANNEL_PACKETS) {
+        debugError("Buffer of %u packets too large for the simulated bus\n", buf_packets);
+        return NULL;
+    }
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        debugError("Could not create the wakeup timer: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    IsoContext *c = new IsoContext;
+    c->transmit = transmit;
+    c->channel = channel;
+    c->buf_packets = buf_packets;
+    c->max_packet_size = max_packet_size;
+    // the kernel default is a quarter of the buffer
+    c->irq_interval = (irq_interval > 0 ? irq_interval : buf_packets / 4);
+    if (c->irq_interval == 0) c->irq_interval = 1;
+    c->fd = fd;
+    c->running = false;
+    c->next_cycle = 0;
+    c->next_wakeup_nsecs = 0;
+    c->dropped = 0;
+    c->seed = (unsigned int)getMonotonicNsecs() ^ (channel << 8) ^ (transmit ? 1 : 0);
+
+    // check and claim the channel in one go, such that two contexts
+    // can't both find it free
+    pthread_mutex_lock(&m_lock);
+    struct Channel &ch = m_channels[channel];
+    if ((transmit && ch.transmitter) || (!transmit && ch.receiver)) {
+        pthread_mutex_unlock(&m_lock);
+        debugError("Channel %u already has a %s context\n",
+                   channel, (transmit ? "transmit" : "receive"));
+        close(fd);
+        delete c;
+        return NULL;
+    }
+    if (ch.packets == NULL) {
+        // the packets are stored with the size of the first context
+        // on the channel, longer ones are truncated
+        ch.packets = new struct Packet[SIMULATEDBUS_CHANNEL_PACKETS];
+        ch.data = new unsigned char[SIMULATEDBUS_CHANNEL_PACKETS * max_packet_size];
+        ch.max_packet_size = max_packet_size;
+        ch.head = 0;
+        ch.tail = 0;
+    }
+    if (transmit) {
+        ch.transmitter = c;
+    } else {
+        ch.receiver = c;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) %s context on channel %u, %u packets, irq %u\n",
+                c, (transmit ? "transmit" : "receive"), channel, buf_packets, c->irq_interval);
+    return c;
+}
+
+void
+SimulatedBus::destroyIsoContext(IsoContext *c)
+{
+    pthread_mutex_lock(&m_lock);
+    struct Channel &ch = m_channels[c->channel];
+    if (ch.transmitter == c) ch.transmitter = NULL;
+    if (ch.receiver == c) ch.receiver = NULL;
+    if (ch.transmitter == NULL && ch.receiver == NULL) {
+        delete[] ch.packets;
+        delete[] ch.data;
+        ch.packets = NULL;
+        ch.data = NULL;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    close(c->fd);
+    delete c;
+}
+
+void
+SimulatedBus::armWakeup(IsoContext *c, uint64_t now_nsecs)
+{
+    uint64_t interval = (uint64_t)(c->irq_interval * USECS_PER_CYCLE * 1000 / m_rate);
+    c->next_wakeup_nsecs += interval;
+    if (c->next_wakeup_nsecs < now_nsecs) {
+        // we're late, don't try to catch up
+        c->next_wakeup_nsecs = now_nsecs + interval;
+    }
+    uint64_t t = c->next_wakeup_nsecs;
+    if (m_params.jitter_usecs) {
+        t += (uint64_t)(rand_r(&c->seed) % (m_params.jitter_usecs + 1)) * 1000;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = t / 1000000000ULL;
+    its.it_value.tv_nsec = t % 1000000000ULL;
+    if (timerfd_settime(c->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        debugError("Could not arm the wakeup timer: %s\n", strerror(errno));
+    }
+}
+
+bool
+SimulatedBus::startIsoContext(IsoContext *c, int cycle)
+{
+    uint64_t now = getCycle();
+    uint64_t start = now + 1;
+    if (cycle >= 0) {
+        // the first matching cycle after now
+        start = now - (now % CYCLES_PER_SECOND) + (cycle % CYCLES_PER_SECOND);
+        if (start <= now) start += CYCLES_PER_SECOND;
+    }
+    c->next_cycle = start;
+    c->dropped = 0;
+
+    if (!c->transmit) {
+        // discard what was sent before we started listening
+        pthread_mutex_lock(&m_lock);
+        struct Channel &ch = m_channels[c->channel];
+        while (ch.tail != ch.head
+               && ch.packets[ch.tail % SIMULATEDBUS_CHANNEL_PACKETS].cycle < start) {
+            ch.tail++;
+        }
+        pthread_mutex_unlock(&m_lock);
+    }
+
+    c->running = true;
+    // the first wakeup is immediate, such that a transmit context
+    // can fill its buffer
+    uint64_t now_nsecs = getMonotonicNsecs();
+    c->next_wakeup_nsecs = now_nsecs;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    if (timerfd_settime(c->fd, 0, &its, NULL) < 0) {
+        debugError("Could not arm the wakeup timer: %s\n", strerror(errno));
+        c->running = false;
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) started on cycle %"PRIu64" (now %"PRIu64")\n",
+                c, start, now);
+    return true;
+}
+
+void
+SimulatedBus::stopIsoContext(IsoContext *c)
+{
+    c->running = false;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(c->fd, 0, &its, NULL);
+}
+
+int
+SimulatedBus::getFileDescriptor(IsoContext *c)
+{
+    return c->fd;
+}
+
+void
+SimulatedBus::acknowledgeWakeup(IsoContext *c)
+{
+    uint64_t expirations;
+    if (read(c->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        debugWarning("Could not read the wakeup timer: %s\n", strerror(errno));
+    }
+    if (c->running) {
+        armWakeup(c, getMonotonicNsecs());
+    }
+}
+
+bool
+SimulatedBus::getNextTransmitCycle(IsoContext *c, int *cycle)
+{
+    if (!c->running || c->next_cycle >= getCycle() + c->buf_packets) {
+        return false;
+    }
+    pthread_mutex_lock(&m_lock);
+    struct Channel &ch = m_channels[c->channel];
+    bool full = (ch.head - ch.tail >= SIMULATEDBUS_CHANNEL_PACKETS);
+    pthread_mutex_unlock(&m_lock);
+    if (full) {
+        // nobody is listening, the packets fall off the bus
+        if (ch.receiver == NULL) {
+            pthread_mutex_lock(&m_lock);
+            ch.tail = ch.head;
+            pthread_mutex_unlock(&m_lock);
+        } else {
+            return false;
+        }
+    }
+    *cycle = c->next_cycle % CYCLES_PER_SECOND;
+    return true;
+}
+
+void
+SimulatedBus::transmit(IsoContext *c, unsigned char *data, unsigned int length,
+                       unsigned char tag, unsigned char sy)
+{
+    uint64_t cycle = c->next_cycle++;
+    if (length == 0) {
+        // nothing goes on the wire
+        return;
+    }
+    pthread_mutex_lock(&m_lock);
+    queuePacket(m_channels[c->channel], cycle, data, length, tag, sy);
+    m_packets_transmitted++;
+    pthread_mutex_unlock(&m_lock);
+}
+
+/// m_lock held, the caller checks for space
+void
+SimulatedBus::queuePacket(struct Channel &ch, uint64_t cycle, const unsigned char *data,
+                          unsigned int length, unsigned char tag, unsigned char sy)
+{
+    unsigned int idx = ch.head % SIMULATEDBUS_CHANNEL_PACKETS;
+    if (length > ch.max_packet_size) {
+        length = ch.max_packet_size;
+    }
+    ch.packets[idx].cycle = cycle;
+    ch.packets[idx].length = length;
+    ch.packets[idx].tag = tag;
+    ch.packets[idx].sy = sy;
+    memcpy(ch.data + idx * ch.max_packet_size, data, length);
+    ch.head++;
+}
+
+bool
+SimulatedBus::receive(IsoContext *c, unsigned char *data, unsigned int *length,
+                      unsigned char *tag, unsigned char *sy,
+                      unsigned int *cycle, unsigned int *dropped)
+{
+    if (!c->running) {
+        return false;
+    }
+    uint64_t arrived = getCycle();
+    if (arrived < (uint64_t)m_params.latency_cycles) {
+        return false;
+    }
+    arrived -= m_params.latency_cycles;
+
+    pthread_mutex_lock(&m_lock);
+    if (m_replay_rec) {
+        replayUntil(arrived);
+    }
+    struct Channel &ch = m_channels[c->channel];
+    while (ch.tail != ch.head) {
+        unsigned int idx = ch.tail % SIMULATEDBUS_CHANNEL_PACKETS;
+        struct Packet &p = ch.packets[idx];
+        if (p.cycle > arrived) {
+            break;
+        }
+        ch.tail++;
+        if (m_params.drop_ppm
+            && (unsigned int)(rand_r(&c->seed) % 1000000) < (unsigned int)m_params.drop_ppm) {
+            c->dropped++;
+            m_packets_dropped++;
+            continue;
+        }
+        unsigned int len = p.length;
+        if (len > c->max_packet_size) {
+            len = c->max_packet_size;
+        }
+        memcpy(data, ch.data + idx * ch.max_packet_size, len);
+        *length = len;
+        *tag = p.tag;
+        *sy = p.sy;
+        *cycle = p.cycle % CYCLES_PER_SECOND;
+        *dropped = c->dropped;
+        c->dropped = 0;
+        pthread_mutex_unlock(&m_lock);
+        return true;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return false;
+}
+
+void
+SimulatedBus::setNode(unsigned int node, const std::vector<uint32_t> &rom,
+                      unsigned int max_block)
+{
+    pthread_mutex_lock(&m_lock);
+    struct Node &n = m_nodes[node & 0x3F];
+    n.rom = rom;
+    n.max_block = max_block;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void
+SimulatedBus::removeNode(unsigned int node)
+{
+    pthread_mutex_lock(&m_lock);
+    m_nodes.erase(node & 0x3F);
+    pthread_mutex_unlock(&m_lock);
+}
+
+void
+SimulatedBus::busReset()
+{
+    pthread_mutex_lock(&m_lock);
+    unsigned int generation = ++m_generation;
+    pthread_mutex_unlock(&m_lock);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Bus reset, generation %u\n", generation);
+}
+
+unsigned int
+SimulatedBus::getGeneration()
+{
+    pthread_mutex_lock(&m_lock);
+    unsigned int generation = m_generation;
+    pthread_mutex_unlock(&m_lock);
+    return generation;
+}
+
+int
+SimulatedBus::getNodeCount()
+{
+    pthread_mutex_lock(&m_lock);
+    int count = (m_nodes.empty() ? 0 : m_nodes.rbegin()->first + 1);
+    pthread_mutex_unlock(&m_lock);
+    return count;
+}
+
+bool
+SimulatedBus::asyncRead(unsigned int node, uint64_t addr, size_t length, uint32_t *buffer)
+{
+    pthread_mutex_lock(&m_lock);
+    m_reads++;
+    int error = 0;
+    std::map<unsigned int, struct Node>::iterator it = m_nodes.find(node & 0x3F);
+    uint64_t first = (addr - CSR1212_CONFIG_ROM_SPACE_BASE) / 4;
+    if (it == m_nodes.end()) {
+        // no ack
+        error = ETIMEDOUT;
+    } else if (length > it->second.max_block) {
+        // rcode type error
+        error = EPERM;
+    } else if (addr < CSR1212_CONFIG_ROM_SPACE_BASE || (addr & 3)
+               || first + length > it->second.rom.size()) {
+        // rcode address error
+        error = EINVAL;
+    } else {
+        for (size_t i = 0; i < length; i++) {
+            buffer[i] = CondSwapToBus32(it->second.rom[first + i]);
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    if (error) {
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+unsigned int
+SimulatedBus::getReadCount()
+{
+    pthread_mutex_lock(&m_lock);
+    unsigned int reads = m_reads;
+    pthread_mutex_unlock(&m_lock);
+    return reads;
+}
+
+void
+SimulatedBus::show()
+{
+    uint32_t ctr;
+    uint64_t local;
+    readCycleTimer(&ctr, &local);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, " Simulated bus, cycle timer %08X\n", ctr);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "  Drift, jitter, drop, latency: %f ppm, %d usecs, %d ppm, %d cycles\n",
+                     m_params.drift_ppm, m_params.jitter_usecs, m_params.drop_ppm, m_params.latency_cycles);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "  Packets transmitted, dropped: %u, %u\n",
+                     m_packets_transmitted, m_packets_dropped);
+    if (m_replay) {
+        debugOutputShort(DEBUG_LEVEL_NORMAL, "  Replaying %s at speed %f: %u packets%s\n",
+                         m_params.replay_file.c_str(), m_params.speed, m_packets_replayed,
+                         (m_replay_rec ? "" : ", finished"));
+    }
+}
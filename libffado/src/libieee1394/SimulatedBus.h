@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_SIMULATEDBUS__
+#define __FFADO_SIMULATEDBUS__
+
+#include "debugmodule/debugmodule.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Util {
+    class Configuration;
+}
+
+class IsoCaptureReader;
+struct IsoCaptureRecord;
+
+/**
+ * @brief A firewire bus without hardware behind it
+ *
+ * Provides the cycle timer and the ISO transport of an Ieee1394Service
+ * in loopback mode. The packets transmitted on a channel are delivered
+ * to the receive context of the same channel, so a transmit and a
+ * receive stream on the same channel form a loop. This allows to run
+ * the streaming code without a device, e.g. for testing and profiling.
+ *
+ * The bus can be made imperfect: the cycle timer can drift with
+ * respect to the system clock, the wakeups of the contexts can be
+ * delayed at random and received packets can be dropped.
+ *
+ * The bus can also replay an ISO capture (see IsoCaptureWriter). The
+ * cycle timer then follows the one of the capture, and the packets are
+ * delivered on their original channel and cycle to whoever listens.
+ *
+ * Nodes that only have a config ROM can be put on the bus, e.g. to test
+ * the config ROM handling. Their ROM can be read with async reads, and
+ * bus resets happen on request only.
+ * The whole bus can be run faster than real time.
+ *
+ * There is only one receive context per channel.
+ */
+class SimulatedBus
+{
+public:
+    struct Parameters {
+        Parameters();
+
+        float   drift_ppm;      ///< cycle timer rate error
+        int     jitter_usecs;   ///< max random delay of a wakeup
+        int     drop_ppm;       ///< received packets dropped, per million
+        int     latency_cycles; ///< cycles between transmission and reception
+        float   speed;          ///< bus clock rate relative to real time
+        std::string replay_file; ///< capture to replay, empty if none
+
+        /**
+         * Reads the parameters from the 'ieee1394.loopback_*' settings,
+         * and from the FFADO_LOOPBACK environment variable.
+         */
+        void load(Util::Configuration *c);
+        /// parses a "drift=20,jitter=100,drop=10,latency=2,replay=file,speed=2" string
+        bool parse(const std::string &s);
+    };
+
+    /**
+     * @return true if the configuration or the environment asks
+     *         for the loopback bus instead of the hardware
+     */
+    static bool isRequested(Util::Configuration *c);
+
+    class IsoContext;
+
+public:
+    SimulatedBus(const Parameters &p);
+    ~SimulatedBus();
+
+    /// opens the capture to replay, if any
+    bool init();
+    /**
+     * @return the cycles until the last packet of the replayed capture
+     *         is on the bus, 0 if there is nothing (more) to replay.
+     *         Streams have to be stopped before, they need packets to
+     *         change state.
+     */
+    uint64_t getReplayCyclesLeft();
+
+    const Parameters &getParameters() {return m_params;};
+
+    /// as raw1394_read_cycle_timer(), local_time in SystemTimeSource time
+    bool readCycleTimer(uint32_t *cycle_timer, uint64_t *local_time);
+
+    /**
+     * @param irq_interval packets between wakeups, -1 for the default
+     */
+    IsoContext *createIsoContext(bool transmit, unsigned int channel,
+                                 unsigned int buf_packets,
+                                 unsigned int max_packet_size,
+                                 int irq_interval);
+    void destroyIsoContext(IsoContext *c);
+    /// @param cycle the cycle to start on (0-7999), -1 for as soon as possible
+    bool startIsoContext(IsoContext *c, int cycle);
+    void stopIsoContext(IsoContext *c);
+    /// the fd that becomes readable when the context should be iterated
+    int getFileDescriptor(IsoContext *c);
+
+    // --- the iterate interface of a context
+    /// clears the wakeup and schedules the next one
+    void acknowledgeWakeup(IsoContext *c);
+    /**
+     * @param cycle the cycle (0-7999) to fill the next packet for
+     * @return false if the context is far enough ahead of the bus
+     */
+    bool getNextTransmitCycle(IsoContext *c, int *cycle);
+    /// queues the packet for the cycle returned by getNextTransmitCycle()
+    void transmit(IsoContext *c, unsigned char *data, unsigned int length,
+                  unsigned char tag, unsigned char sy);
+    /**
+     * gets the next packet that has arrived on the context's channel
+     * @param dropped the number of packets dropped before this one
+     * @return false if there is no packet
+     */
+    bool receive(IsoContext *c, unsigned char *data, unsigned int *length,
+                 unsigned char *tag, unsigned char *sy,
+                 unsigned int *cycle, unsigned int *dropped);
+
+    // --- the nodes
+    /**
+     * puts a node with the given config ROM on the bus, or replaces its
+     * ROM. Doesn't cause a bus reset.
+     * @param rom the quadlets of the config ROM space in CPU byte order,
+     *            starting with the bus info block header
+     * @param max_block the largest block read the node supports, in
+     *                  quadlets. Larger ones fail with a type error.
+     */
+    void setNode(unsigned int node, const std::vector<uint32_t> &rom,
+                 unsigned int max_block);
+    void removeNode(unsigned int node);
+    void busReset();
+    unsigned int getGeneration();
+    /// the number of node ids in use, i.e. the highest node + 1
+    int getNodeCount();
+    /**
+     * as raw1394_read(), fails with the errno raw1394 uses for the
+     * response code the node would send
+     * @param length the number of quadlets to read
+     * @param buffer receives the quadlets in bus byte order
+     */
+    bool asyncRead(unsigned int node, uint64_t addr, size_t length, uint32_t *buffer);
+    /// the number of async reads so far, including the failed ones
+    unsigned int getReadCount();
+
+    void show();
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    struct Packet {
+        uint64_t        cycle;
+        unsigned int    length;
+        unsigned char   tag;
+        unsigned char   sy;
+    };
+    struct Channel {
+        IsoContext     *transmitter;
+        IsoContext     *receiver;
+        struct Packet  *packets;
+        unsigned char  *data;
+        unsigned int    max_packet_size;
+        unsigned int    head; // next packet to write
+        unsigned int    tail; // next packet to read
+    };
+
+    uint64_t getTicks(uint64_t local_usecs);
+    uint64_t getCycle();
+    void armWakeup(IsoContext *c, uint64_t now_nsecs);
+    void queuePacket(struct Channel &ch, uint64_t cycle, const unsigned char *data,
+                     unsigned int length, unsigned char tag, unsigned char sy);
+    bool nextReplayPacket();
+    void replayUntil(uint64_t cycle);
+
+    Parameters      m_params;
+    uint64_t        m_start_usecs;
+    uint64_t        m_start_ticks;
+    double          m_rate;
+    pthread_mutex_t m_lock;
+    struct Channel  m_channels[64];
+
+    unsigned int    m_packets_transmitted;
+    unsigned int    m_packets_dropped;
+
+    struct Node {
+        std::vector<uint32_t>   rom;
+        unsigned int            max_block;
+    };
+    std::map<unsigned int, struct Node> m_nodes;
+    unsigned int    m_generation;
+    unsigned int    m_reads;
+
+    IsoCaptureReader               *m_replay;
+    const struct IsoCaptureRecord  *m_replay_rec;
+    const unsigned char            *m_replay_data;
+    uint64_t                        m_replay_cycle; // bus cycle of m_replay_rec
+    uint64_t                        m_replay_end_cycle;
+    unsigned int                    m_packets_replayed;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+#endif
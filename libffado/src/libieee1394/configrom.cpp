@@ -26,12 +26,14 @@
 #include "config.h"
 
 #include "configrom.h"
+#include "ConfigRomCache.h"
 #include "ieee1394service.h"
 
 #include "vendor_model_ids.h"
 
 #include "libutil/SystemTimeSource.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -58,11 +60,33 @@ static struct csr1212_bus_ops configrom_csr1212_ops = {
     getMaxRom
 };
 
+#define CONFIGROM_SPACE_QUADLETS    (CSR1212_CONFIG_ROM_SPACE_SIZE / 4)
+#define CONFIGROM_BUS_INFO_QUADLETS 5
+
 struct config_csr_info {
     Ieee1394Service* service;
     fb_nodeid_t      nodeId;
+    // the config ROM space of the node as far as it was read, as it
+    // came from the bus. The parser reads it quadlet by quadlet, the
+    // quadlets are fetched in blocks.
+    fb_quadlet_t     rom[CONFIGROM_SPACE_QUADLETS];
+    bool             rom_valid[CONFIGROM_SPACE_QUADLETS];
+    unsigned int     max_block;
+    unsigned int     nb_reads;
 };
 
+static void
+initCsrInfo( struct config_csr_info* csr_info,
+             Ieee1394Service* service,
+             fb_nodeid_t nodeId )
+{
+    csr_info->service = service;
+    csr_info->nodeId = 0xffc0 | nodeId;
+    memset( csr_info->rom_valid, 0, sizeof(csr_info->rom_valid) );
+    csr_info->max_block = IEEE1394SERVICE_CONFIGROM_MAX_BLOCK_QUADLETS;
+    csr_info->nb_reads = 0;
+}
+
 //-------------------------------------------------------------
 
 ConfigRom::ConfigRom( Ieee1394Service& ieee1394service, fb_nodeid_t nodeId )
@@ -86,6 +110,9 @@ ConfigRom::ConfigRom( Ieee1394Service& ieee1394service, fb_nodeid_t nodeId )
     , m_nodeVendorId( 0 )
     , m_chipIdHi( 0 )
     , m_chipIdLow( 0 )
+    , m_romCrc( 0 )
+    , m_busInfoHeader( 0 )
+    , m_busInfoCrcValid( false )
     , m_vendorNameKv( 0 )
     , m_modelNameKv( 0 )
     , m_csr( 0 )
@@ -113,6 +140,9 @@ ConfigRom::ConfigRom()
     , m_nodeVendorId( 0 )
     , m_chipIdHi( 0 )
     , m_chipIdLow( 0 )
+    , m_romCrc( 0 )
+    , m_busInfoHeader( 0 )
+    , m_busInfoCrcValid( false )
     , m_vendorNameKv( 0 )
     , m_modelNameKv( 0 )
     , m_csr( 0 )
@@ -140,8 +170,7 @@ bool
 ConfigRom::initialize()
 {
      struct config_csr_info csr_info;
-     csr_info.service = &m_1394Service;
-     csr_info.nodeId = 0xffc0 | m_nodeId;
+     initCsrInfo( &csr_info, &m_1394Service, m_nodeId );
 
      m_csr = csr1212_create_csr( &configrom_csr1212_ops,
                                  5 * sizeof(fb_quadlet_t),   // XXX Why 5 ?!?
@@ -165,10 +194,21 @@ ConfigRom::initialize()
     m_nodeVendorId = ( CSR1212_BE32_TO_CPU( m_csr->bus_info_data[3] ) >> 8 );
     m_chipIdHi = ( CSR1212_BE32_TO_CPU( m_csr->bus_info_data[3] ) ) & 0xff;
     m_chipIdLow = CSR1212_BE32_TO_CPU( m_csr->bus_info_data[4] );
+    updateAsyncMaxPayload();
 
     // Process Root Directory
     processRootDirectory(m_csr);
 
+    // the checksum of everything that was read, identifies the
+    // firmware for the discovery cache
+    m_romCrc = calculateRomCrc(m_csr);
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Config ROM CRC: 0x%08X (%u reads)\n",
+                 m_romCrc, csr_info.nb_reads );
+
+    m_busInfoHeader = CSR1212_BE32_TO_CPU( m_csr->bus_info_data[0] );
+    m_busInfoCrcValid = checkBusInfoCrc( m_csr );
+    storeRootDirectory( m_csr );
+
     if ( m_vendorNameKv ) {
         int len = ( m_vendorNameKv->value.leaf.len - 2) * sizeof( quadlet_t );
         char* buf = new char[len+2];
@@ -226,6 +266,167 @@ ConfigRom::initialize()
     return true;
 }
 
+static fb_quadlet_t
+crc32Update( fb_quadlet_t crc, const unsigned char *data, size_t length )
+{
+    crc = ~crc;
+    for ( size_t i = 0; i < length; i++ ) {
+        crc ^= data[i];
+        for ( int bit = 0; bit < 8; bit++ ) {
+            crc = ( crc >> 1 ) ^ ( 0xEDB88320 & ( -( crc & 1 ) ) );
+        }
+    }
+    return ~crc;
+}
+
+fb_quadlet_t
+ConfigRom::calculateRomCrc( struct csr1212_csr* csr )
+{
+    // the parser caches all parts of the ROM it has read, and records
+    // which regions of the cache are filled
+    fb_quadlet_t crc = 0;
+    for ( struct csr1212_csr_rom_cache* cache = csr->cache_head;
+          cache;
+          cache = cache->next )
+    {
+        for ( struct csr1212_cache_region* cr = cache->filled_head;
+              cr;
+              cr = cr->next )
+        {
+            u_int32_t end = cr->offset_end;
+            if ( end > cache->size ) {
+                end = cache->size;
+            }
+            if ( cr->offset_start >= end ) {
+                continue;
+            }
+            crc = crc32Update( crc,
+                               (const unsigned char *)cache->data + cr->offset_start,
+                               end - cr->offset_start );
+        }
+    }
+    return crc;
+}
+
+bool
+ConfigRom::checkBusInfoCrc( struct csr1212_csr* csr )
+{
+    // the CRC-16 of IEEE 1212, over the quadlets following the header
+    fb_quadlet_t header = CSR1212_BE32_TO_CPU( csr->bus_info_data[0] );
+    unsigned int crc_length = ( header >> 16 ) & 0xff;
+    if ( crc_length == 0 || crc_length >= CONFIGROM_SPACE_QUADLETS ) {
+        return false;
+    }
+    u_int16_t crc = 0;
+    for ( unsigned int i = 1; i <= crc_length; i++ ) {
+        fb_quadlet_t data = CSR1212_BE32_TO_CPU( csr->cache_head->data[i] );
+        for ( int shift = 28; shift >= 0; shift -= 4 ) {
+            u_int16_t sum = ( ( crc >> 12 ) ^ ( data >> shift ) ) & 0xf;
+            crc = ( crc << 4 ) ^ ( sum << 12 ) ^ ( sum << 5 ) ^ sum;
+        }
+    }
+    return crc == ( header & 0xffff );
+}
+
+void
+ConfigRom::storeRootDirectory( struct csr1212_csr* csr )
+{
+    // the root directory follows the bus info block
+    m_rootDirectory.clear();
+    struct csr1212_csr_rom_cache* cache = csr->cache_head;
+    unsigned int first = 1 + ( m_busInfoHeader >> 24 );
+    if ( !cache || cache->offset != CSR1212_CONFIG_ROM_SPACE_OFFSET
+         || ( first + 1 ) * 4 > cache->size ) {
+        return;
+    }
+    unsigned int length = CSR1212_BE32_TO_CPU( cache->data[first] ) >> 16;
+    if ( ( first + 1 + length ) * 4 > cache->size ) {
+        return;
+    }
+    for ( unsigned int i = first; i <= first + length; i++ ) {
+        m_rootDirectory.push_back( CSR1212_BE32_TO_CPU( cache->data[i] ) );
+    }
+}
+
+bool
+ConfigRom::readWithRetry( Ieee1394Service& service,
+                          fb_nodeid_t nodeId,
+                          fb_nodeaddr_t addr,
+                          size_t length,
+                          fb_quadlet_t* buffer )
+{
+    unsigned int wait_usecs = IEEE1394SERVICE_CONFIGROM_READ_WAIT_USECS;
+    for ( int tries = IEEE1394SERVICE_CONFIGROM_READ_TRIES; tries > 0; tries-- ) {
+        if ( service.read( nodeId, addr, length, buffer ) ) {
+            return true;
+        }
+        if ( tries > 1 ) {
+            Util::SystemTimeSource::SleepUsecRelative( wait_usecs );
+            wait_usecs *= 2;
+        }
+    }
+    return false;
+}
+
+// reads the block that starts with the given quadlet of the config ROM
+// space into the ROM image
+static bool
+fillRomImage( struct config_csr_info* csr_info, unsigned int index )
+{
+    // IEEE 1212 says the bus info block can be read in one go, but many
+    // devices don't allow that (see csr1212.c). So it is read one
+    // quadlet at a time, the rest of the ROM in blocks up to the max
+    // payload of the node.
+    unsigned int block = 1;
+    if ( index >= CONFIGROM_BUS_INFO_QUADLETS
+         && csr_info->rom_valid[2] ) {
+        block = csr_info->max_block;
+        unsigned int max_rec = ( CSR1212_BE32_TO_CPU( csr_info->rom[2] ) >> 12 ) & 0xf;
+        if ( max_rec > 0 && max_rec < 0xe ) {
+            unsigned int max_payload = ( 1 << ( max_rec + 1 ) ) / 4;
+            if ( block > max_payload ) {
+                block = max_payload;
+            }
+        }
+    }
+    // don't read what we already have
+    unsigned int length = 1;
+    while ( length < block
+            && index + length < CONFIGROM_SPACE_QUADLETS
+            && !csr_info->rom_valid[index + length] ) {
+        length++;
+    }
+
+    fb_nodeaddr_t addr = CSR1212_CONFIG_ROM_SPACE_BASE + index * 4;
+    while ( length > 1 ) {
+        errno = 0;
+        if ( csr_info->service->read( csr_info->nodeId, addr, length,
+                                      &csr_info->rom[index] ) ) {
+            break;
+        }
+        // retry right away with a smaller block, only failing quadlet
+        // reads are retried after a wait. A type error (EPERM in raw1394)
+        // means the node doesn't support blocks of this size, that holds
+        // for the rest of the ROM. Other errors, e.g. an address error
+        // for a block that runs past the end of the ROM, only concern
+        // this block.
+        length /= 2;
+        if ( errno == EPERM ) {
+            csr_info->max_block = length;
+        }
+    }
+    if ( length == 1
+         && !ConfigRom::readWithRetry( *csr_info->service, csr_info->nodeId,
+                                       addr, 1, &csr_info->rom[index] ) ) {
+        return false;
+    }
+    csr_info->nb_reads++;
+    for ( unsigned int i = index; i < index + length; i++ ) {
+        csr_info->rom_valid[i] = true;
+    }
+    return true;
+}
+
 static int
 busRead( struct csr1212_csr* csr,
          u_int64_t addr,
@@ -235,20 +436,28 @@ busRead( struct csr1212_csr* csr,
 {
     struct config_csr_info* csr_info = (struct config_csr_info*) private_data;
 
-    int nb_retries = 5;
-
-    while ( nb_retries-- 
-            && !csr_info->service->read( csr_info->nodeId,
-                                         addr,
-                                         (size_t)length/4,
-                                         ( quadlet_t* )buffer)  )
-    {// failed, retry
-        Util::SystemTimeSource::SleepUsecRelative(IEEE1394SERVICE_CONFIGROM_READ_WAIT_USECS);
+    if ( addr < CSR1212_CONFIG_ROM_SPACE_BASE
+         || addr + length > CSR1212_CONFIG_ROM_SPACE_END
+         || ( addr & 3 ) || ( length & 3 ) ) {
+        // not in the config ROM space, e.g. an extended ROM
+        csr_info->nb_reads++;
+        if ( ConfigRom::readWithRetry( *csr_info->service, csr_info->nodeId,
+                                       addr, (size_t)length/4,
+                                       ( quadlet_t* )buffer ) ) {
+            return 0; // success
+        } else {
+            return -1; // failure
+        }
     }
-    Util::SystemTimeSource::SleepUsecRelative(IEEE1394SERVICE_CONFIGROM_READ_WAIT_USECS);
 
-    if (nb_retries > -1) return 0; // success
-    else return -1; // failure
+    unsigned int first = ( addr - CSR1212_CONFIG_ROM_SPACE_BASE ) / 4;
+    for ( unsigned int i = first; i < first + length/4; i++ ) {
+        if ( !csr_info->rom_valid[i] && !fillRomImage( csr_info, i ) ) {
+            return -1; // failure
+        }
+    }
+    memcpy( buffer, &csr_info->rom[first], length );
+    return 0; // success
 }
 
 static int
@@ -530,14 +739,24 @@ ConfigRom::updatedNodeId()
                  "Checking for updated node id for device with GUID 0x%016"PRIX64"...\n",
                  getGuid());
 
+    // the ROMs that are known can be identified with a single read
+    fb_nodeid_t cachedNodeId;
+    if ( m_1394Service.getConfigRomCache().findNode( getGuid(), cachedNodeId ) ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE,
+                     "Device with GUID 0x%016"PRIX64" is at node %d (cached)\n",
+                     getGuid(), cachedNodeId );
+        m_nodeId = cachedNodeId;
+        updateAsyncMaxPayload();
+        return true;
+    }
+
     struct csr1212_csr* csr = NULL;
     for ( fb_nodeid_t nodeId = 0;
           nodeId < m_1394Service.getNodeCount();
           ++nodeId )
     {
         struct config_csr_info csr_info;
-        csr_info.service = &m_1394Service;
-        csr_info.nodeId = 0xffc0 | nodeId;
+        initCsrInfo( &csr_info, &m_1394Service, nodeId );
         debugOutput( DEBUG_LEVEL_VERBOSE, "Looking at node %d...\n", nodeId);
 
         csr = csr1212_create_csr( &configrom_csr1212_ops,
@@ -577,6 +796,7 @@ ConfigRom::updatedNodeId()
                              getGuid(),
                              getNodeId());
             }
+            updateAsyncMaxPayload();
             if (csr) {
                 csr1212_destroy_csr(csr);
                 csr = NULL;
@@ -645,6 +865,17 @@ ConfigRom::getAsyMaxPayload() const
     return 1 << ( m_maxRec + 1 );
 }
 
+// lets the async transaction engine merge reads up to the max payload
+void
+ConfigRom::updateAsyncMaxPayload()
+{
+    unsigned int quads = 0;
+    if ( m_maxRec > 0 && m_maxRec < 0xe ) {
+        quads = getAsyMaxPayload() / 4;
+    }
+    m_1394Service.setAsyncMaxPayload( m_nodeId, quads );
+}
+
 bool
 ConfigRom::serialize( std::string path, Util::IOSerialize& ser )
 {
@@ -667,6 +898,9 @@ ConfigRom::serialize( std::string path, Util::IOSerialize& ser )
     result &= ser.write( path + "m_nodeVendorId", m_nodeVendorId );
     result &= ser.write( path + "m_chipIdHi", m_chipIdHi );
     result &= ser.write( path + "m_chipIdLow", m_chipIdLow );
+    result &= ser.write( path + "m_romCrc", m_romCrc );
+    result &= ser.write( path + "m_busInfoHeader", m_busInfoHeader );
+    result &= ser.write( path + "m_busInfoCrcValid", m_busInfoCrcValid );
     return result;
 }
 
@@ -680,27 +914,7 @@ ConfigRom::deserialize( std::string path, Util::IODeserialize& deser, Ieee1394Se
 
     pConfigRom->m_1394Service = ieee1394Service;
 
-    bool result;
-    result  = deser.read( path + "m_nodeId", pConfigRom->m_nodeId );
-    result &= deser.read( path + "m_avcDevice", pConfigRom->m_avcDevice );
-    result &= deser.read( path + "m_guid", pConfigRom->m_guid );
-    result &= deser.read( path + "m_vendorName", pConfigRom->m_vendorName );
-    result &= deser.read( path + "m_modelName", pConfigRom->m_modelName );
-    result &= deser.read( path + "m_vendorId", pConfigRom->m_vendorId );
-    result &= deser.read( path + "m_modelId", pConfigRom->m_modelId );
-    result &= deser.read( path + "m_unit_specifier_id", pConfigRom->m_unit_specifier_id );
-    result &= deser.read( path + "m_unit_version", pConfigRom->m_unit_version );
-    result &= deser.read( path + "m_isIsoResourceManager", pConfigRom->m_isIsoResourceManager );
-    result &= deser.read( path + "m_isCycleMasterCapable", pConfigRom->m_isCycleMasterCapable );
-    result &= deser.read( path + "m_isSupportIsoOperations", pConfigRom->m_isSupportIsoOperations );
-    result &= deser.read( path + "m_isBusManagerCapable", pConfigRom->m_isBusManagerCapable );
-    result &= deser.read( path + "m_cycleClkAcc", pConfigRom->m_cycleClkAcc );
-    result &= deser.read( path + "m_maxRec", pConfigRom->m_maxRec );
-    result &= deser.read( path + "m_nodeVendorId", pConfigRom->m_nodeVendorId );
-    result &= deser.read( path + "m_chipIdHi", pConfigRom->m_chipIdHi );
-    result &= deser.read( path + "m_chipIdLow", pConfigRom->m_chipIdLow );
-
-    if ( !result ) {
+    if ( !pConfigRom->deserializeData( path, deser ) ) {
         delete pConfigRom;
         return 0;
     }
@@ -708,9 +922,69 @@ ConfigRom::deserialize( std::string path, Util::IODeserialize& deser, Ieee1394Se
     return pConfigRom;
 }
 
+bool
+ConfigRom::deserializeData( std::string path, Util::IODeserialize& deser )
+{
+    bool result;
+    result  = deser.read( path + "m_nodeId", m_nodeId );
+    result &= deser.read( path + "m_avcDevice", m_avcDevice );
+    result &= deser.read( path + "m_guid", m_guid );
+    result &= deser.read( path + "m_vendorName", m_vendorName );
+    result &= deser.read( path + "m_modelName", m_modelName );
+    result &= deser.read( path + "m_vendorId", m_vendorId );
+    result &= deser.read( path + "m_modelId", m_modelId );
+    result &= deser.read( path + "m_unit_specifier_id", m_unit_specifier_id );
+    result &= deser.read( path + "m_unit_version", m_unit_version );
+    result &= deser.read( path + "m_isIsoResourceManager", m_isIsoResourceManager );
+    result &= deser.read( path + "m_isCycleMasterCapable", m_isCycleMasterCapable );
+    result &= deser.read( path + "m_isSupportIsoOperations", m_isSupportIsoOperations );
+    result &= deser.read( path + "m_isBusManagerCapable", m_isBusManagerCapable );
+    result &= deser.read( path + "m_cycleClkAcc", m_cycleClkAcc );
+    result &= deser.read( path + "m_maxRec", m_maxRec );
+    result &= deser.read( path + "m_nodeVendorId", m_nodeVendorId );
+    result &= deser.read( path + "m_chipIdHi", m_chipIdHi );
+    result &= deser.read( path + "m_chipIdLow", m_chipIdLow );
+    if ( deser.isExisting( path + "m_romCrc" ) ) {
+        result &= deser.read( path + "m_romCrc", m_romCrc );
+    }
+    if ( deser.isExisting( path + "m_busInfoHeader" ) ) {
+        result &= deser.read( path + "m_busInfoHeader", m_busInfoHeader );
+        result &= deser.read( path + "m_busInfoCrcValid", m_busInfoCrcValid );
+    }
+    return result;
+}
+
+void
+ConfigRom::copyRomData( const ConfigRom& other )
+{
+    // everything but the node id, which is where this ROM was read
+    m_avcDevice = other.m_avcDevice;
+    m_guid = other.m_guid;
+    m_vendorName = other.m_vendorName;
+    m_modelName = other.m_modelName;
+    m_vendorId = other.m_vendorId;
+    m_modelId = other.m_modelId;
+    m_unit_specifier_id = other.m_unit_specifier_id;
+    m_unit_version = other.m_unit_version;
+    m_isIsoResourceManager = other.m_isIsoResourceManager;
+    m_isCycleMasterCapable = other.m_isCycleMasterCapable;
+    m_isSupportIsoOperations = other.m_isSupportIsoOperations;
+    m_isBusManagerCapable = other.m_isBusManagerCapable;
+    m_cycleClkAcc = other.m_cycleClkAcc;
+    m_maxRec = other.m_maxRec;
+    m_nodeVendorId = other.m_nodeVendorId;
+    m_chipIdHi = other.m_chipIdHi;
+    m_chipIdLow = other.m_chipIdLow;
+    m_romCrc = other.m_romCrc;
+    m_busInfoHeader = other.m_busInfoHeader;
+    m_busInfoCrcValid = other.m_busInfoCrcValid;
+    m_rootDirectory = other.m_rootDirectory;
+}
+
 bool
 ConfigRom::setNodeId( fb_nodeid_t nodeId )
 {
     m_nodeId = nodeId;
+    updateAsyncMaxPayload();
     return true;
 }
@@ -35,6 +35,7 @@
 #include "libcontrol/Element.h"
 
 #include <string>
+#include <vector>
 
 class Ieee1394Service;
 
@@ -80,6 +81,40 @@ class ConfigRom
     fb_quadlet_t getNodeVendorId() const
     { return m_nodeVendorId; }
 
+    /**
+     * @brief Returns a CRC-32 over the contents of the config ROM
+     *
+     * Covers the bus info block and all directories and leafs that were
+     * parsed, so it changes when e.g. a firmware update changes any of
+     * the ROM entries.
+     */
+    fb_quadlet_t getRomCrc() const
+    { return m_romCrc; }
+
+    /**
+     * @brief Returns the first quadlet of the bus info block
+     *
+     * Holds the length of the bus info block and the CRC-16 over it.
+     */
+    fb_quadlet_t getBusInfoHeader() const
+    { return m_busInfoHeader; }
+    /// @return true if the CRC-16 in the bus info header is correct
+    bool isBusInfoCrcValid() const
+    { return m_busInfoCrcValid; }
+
+    /**
+     * @brief Reads from a node, retrying on failure
+     *
+     * The wait between the tries doubles with every failed try.
+     *
+     * @param nodeId the full node id, including the bus id
+     */
+    static bool readWithRetry( Ieee1394Service& service,
+                               fb_nodeid_t nodeId,
+                               fb_nodeaddr_t addr,
+                               size_t length,
+                               fb_quadlet_t* buffer );
+
     bool updatedNodeId();
     bool setNodeId( fb_nodeid_t nodeId );
     
@@ -121,6 +156,14 @@ class ConfigRom
 
     void processRootDirectory( struct csr1212_csr* csr );
 
+    static fb_quadlet_t calculateRomCrc( struct csr1212_csr* csr );
+    static bool checkBusInfoCrc( struct csr1212_csr* csr );
+    void updateAsyncMaxPayload();
+    void storeRootDirectory( struct csr1212_csr* csr );
+
+    bool deserializeData( std::string path, Util::IODeserialize& deser );
+    void copyRomData( const ConfigRom& other );
+
     Ieee1394Service& m_1394Service;
     fb_nodeid_t      m_nodeId;
     bool             m_avcDevice;
@@ -140,6 +183,11 @@ class ConfigRom
     fb_quadlet_t     m_nodeVendorId;
     fb_byte_t        m_chipIdHi;
     fb_quadlet_t     m_chipIdLow;
+    fb_quadlet_t     m_romCrc;
+    fb_quadlet_t     m_busInfoHeader;
+    bool             m_busInfoCrcValid;
+    // the root directory as read, header included (CPU byte order)
+    std::vector<fb_quadlet_t> m_rootDirectory;
 
     /* only used during parsing */
     struct csr1212_keyval* m_vendorNameKv;
@@ -150,6 +198,8 @@ private:
     ConfigRom( const ConfigRom& ); // do not allow copy ctor
     ConfigRom();                   // ctor for deserialition
 
+    friend class ConfigRomCache;
+
     DECLARE_DEBUG_MODULE;
 };
 
@@ -29,6 +29,8 @@
 #include "cycletimer.h"
 #include "IsoHandlerManager.h"
 #include "CycleTimerHelper.h"
+#include "SimulatedBus.h"
+#include "ConfigRomCache.h"
 
 #include <unistd.h>
 #include <libraw1394/csr.h>
@@ -41,6 +43,7 @@
 #include "libutil/Configuration.h"
 
 #include <errno.h>
+#include <sys/poll.h>
 #include "libutil/ByteSwap.h"
 
 #include <string.h>
@@ -70,6 +73,7 @@ Ieee1394Service::Ieee1394Service()
     , m_resetHelper( NULL )
     , m_armHelperNormal( NULL )
     , m_armHelperRealtime( NULL )
+    , m_fcpHelper( NULL )
     , m_handle( 0 )
     , m_handle_lock( new Util::PosixMutex("SRVCHND") )
     , m_util_handle( 0 )
@@ -78,10 +82,17 @@ Ieee1394Service::Ieee1394Service()
     , m_base_priority ( 0 )
     , m_pIsoManager( new IsoHandlerManager( *this ) )
     , m_pCTRHelper ( new CycleTimerHelper( *this, IEEE1394SERVICE_CYCLETIMER_DLL_UPDATE_INTERVAL_USEC ) )
+    , m_pAsyncEngine( NULL )
+    , m_pSimulatedBus( NULL )
+    , m_pConfigRomCache( new ConfigRomCache( *this ) )
     , m_have_new_ctr_read ( false )
     , m_filterFCPResponse ( false )
     , m_pWatchdog ( new Util::Watchdog() )
+    , m_fcp_listening( false )
+    , m_fcp_block_lock( new Util::PosixMutex("FCPBLK") )
 {
+    pthread_mutex_init(&m_fcp_lock, NULL);
+    pthread_cond_init(&m_fcp_cond, NULL);
     for (unsigned int i=0; i<64; i++) {
         m_channels[i].channel=-1;
         m_channels[i].bandwidth=-1;
@@ -98,6 +109,7 @@ Ieee1394Service::Ieee1394Service(bool rt, int prio)
     , m_resetHelper( NULL )
     , m_armHelperNormal( NULL )
     , m_armHelperRealtime( NULL )
+    , m_fcpHelper( NULL )
     , m_handle( 0 )
     , m_handle_lock( new Util::PosixMutex("SRVCHND") )
     , m_util_handle( 0 )
@@ -108,10 +120,17 @@ Ieee1394Service::Ieee1394Service(bool rt, int prio)
     , m_pCTRHelper ( new CycleTimerHelper( *this, IEEE1394SERVICE_CYCLETIMER_DLL_UPDATE_INTERVAL_USEC,
                                            rt && IEEE1394SERVICE_CYCLETIMER_HELPER_RUN_REALTIME,
                                            IEEE1394SERVICE_CYCLETIMER_HELPER_PRIO ) )
+    , m_pAsyncEngine( NULL )
+    , m_pSimulatedBus( NULL )
+    , m_pConfigRomCache( new ConfigRomCache( *this ) )
     , m_have_new_ctr_read ( false )
     , m_filterFCPResponse ( false )
     , m_pWatchdog ( new Util::Watchdog() )
+    , m_fcp_listening( false )
+    , m_fcp_block_lock( new Util::PosixMutex("FCPBLK") )
 {
+    pthread_mutex_init(&m_fcp_lock, NULL);
+    pthread_cond_init(&m_fcp_cond, NULL);
     for (unsigned int i=0; i<64; i++) {
         m_channels[i].channel=-1;
         m_channels[i].bandwidth=-1;
@@ -127,10 +146,19 @@ Ieee1394Service::~Ieee1394Service()
 {
     delete m_pIsoManager;
     delete m_pCTRHelper;
+    delete m_pAsyncEngine;
+    delete m_pSimulatedBus;
+    delete m_pConfigRomCache;
 
-    m_resetHelper->Stop();
-    m_armHelperNormal->Stop();
-    m_armHelperRealtime->Stop();
+    if(m_fcpHelper) {
+        if(m_fcp_listening) {
+            raw1394_stop_fcp_listen(m_fcpHelper->get1394Handle());
+        }
+        m_fcpHelper->Stop();
+    }
+    if(m_resetHelper) m_resetHelper->Stop();
+    if(m_armHelperNormal) m_armHelperNormal->Stop();
+    if(m_armHelperRealtime) m_armHelperRealtime->Stop();
 
     for ( arm_handler_vec_t::iterator it = m_armHandlers.begin();
           it != m_armHandlers.end();
@@ -157,6 +185,11 @@ Ieee1394Service::~Ieee1394Service()
     if(m_resetHelper) delete m_resetHelper;
     if(m_armHelperNormal) delete m_armHelperNormal;
     if(m_armHelperRealtime) delete m_armHelperRealtime;
+    if(m_fcpHelper) delete m_fcpHelper;
+
+    delete m_fcp_block_lock;
+    pthread_cond_destroy(&m_fcp_cond);
+    pthread_mutex_destroy(&m_fcp_lock);
 
     if ( m_util_handle ) {
         raw1394_destroy_handle( m_util_handle );
@@ -213,6 +246,9 @@ Ieee1394Service::detectNbPorts()
 void
 Ieee1394Service::doBusReset() {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Issue bus reset on service %p (port %d).\n", this, getPort());
+    if (m_pSimulatedBus) {
+        return;
+    }
     raw1394_reset_bus(m_handle);
 }
 
@@ -247,6 +283,11 @@ Ieee1394Service::initialize( int port )
 {
     using namespace std;
 
+    if (SimulatedBus::isRequested(m_configuration)) {
+        m_port = port;
+        return initializeSimulatedBus();
+    }
+
     int nb_ports = detectNbPorts();
     if (port + 1 > nb_ports) {
         debugFatal("Requested port (%d) out of range (# ports: %d)\n", port, nb_ports);
@@ -274,6 +315,17 @@ Ieee1394Service::initialize( int port )
         return false;
     }
 
+    // the engine that executes the read/write transactions
+    // note: m_port has to be set!
+    // if it isn't available the transactions are done one by one
+    m_pAsyncEngine = new AsyncTransactionEngine(*this, m_realtime, m_base_priority);
+    m_pAsyncEngine->setVerboseLevel(getDebugLevel());
+    if ( !m_pAsyncEngine->init() || !m_pAsyncEngine->Start() ) {
+        debugWarning("Could not start the async transaction engine, using blocking transactions\n");
+        delete m_pAsyncEngine;
+        m_pAsyncEngine = NULL;
+    }
+
     // helper threads for all sorts of ASYNC events
     // note: m_port has to be set!
     m_resetHelper = new HelperThread(*this, "BUSRST");
@@ -291,6 +343,11 @@ Ieee1394Service::initialize( int port )
         debugFatal("Could not allocate realtime ARM handler helper\n");
         return false;
     }
+    m_fcpHelper = new HelperThread(*this, "FCP");
+    if ( !m_fcpHelper ) {
+        debugFatal("Could not allocate FCP response helper\n");
+        return false;
+    }
 
     // start helper threads
     if(!m_resetHelper->Start()) {
@@ -305,6 +362,10 @@ Ieee1394Service::initialize( int port )
         debugFatal("Could not start realtime ARM helper thread\n");
         return false;
     }
+    if(!m_fcpHelper->Start()) {
+        debugFatal("Could not start FCP helper thread\n");
+        return false;
+    }
 
     // attach the reset and ARM handlers
     // NOTE: the handlers have to be started first, or there is no 1394handle
@@ -314,6 +375,12 @@ Ieee1394Service::initialize( int port )
     m_default_arm_handler = raw1394_set_arm_tag_handler( m_armHelperNormal->get1394Handle(),
                                    this->armHandlerLowLevel );
 
+    // FCP responses are dispatched by the FCP helper. If listening fails
+    // here, it is retried when the first FCP command is sent.
+    raw1394_set_fcp_handler( m_fcpHelper->get1394Handle(),
+                             this->_avc_fcp_handler );
+    startFcpListen();
+
     // utility handle (used to read the CTR register)
     m_util_handle = raw1394_new_handle_on_port( port );
     if ( !m_util_handle ) {
@@ -447,6 +514,61 @@ Ieee1394Service::initialize( int port )
     return true;
 }
 
+/**
+ * Sets up the service on a simulated bus instead of a host controller.
+ * Only the cycle timer, the ISO streaming and reads from the config ROM
+ * of simulated nodes work there.
+ */
+bool
+Ieee1394Service::initializeSimulatedBus()
+{
+    if(!m_pWatchdog) {
+        debugError("No valid RT watchdog found.\n");
+        return false;
+    }
+    if(!m_pWatchdog->start()) {
+        debugError("Could not start RT watchdog.\n");
+        return false;
+    }
+
+    SimulatedBus::Parameters params;
+    params.load(m_configuration);
+    m_pSimulatedBus = new SimulatedBus(params);
+    m_pSimulatedBus->setVerboseLevel(getDebugLevel());
+    if(!m_pSimulatedBus->init()) {
+        debugFatal("Could not initialize the simulated bus\n");
+        return false;
+    }
+    m_portName = "Loopback";
+    debugWarning("Using the simulated loopback bus instead of port %d\n", m_port);
+
+    if(!m_pCTRHelper) {
+        debugFatal("No CycleTimerHelper available, bad!\n");
+        return false;
+    }
+    m_pCTRHelper->setVerboseLevel(getDebugLevel());
+    if(!m_pCTRHelper->Start()) {
+        debugFatal("Could not start CycleTimerHelper\n");
+        return false;
+    }
+
+    if(!m_pIsoManager) {
+        debugFatal("No IsoHandlerManager available, bad!\n");
+        return false;
+    }
+    m_pIsoManager->setVerboseLevel(getDebugLevel());
+    if(!m_pIsoManager->init()) {
+        debugFatal("Could not initialize IsoHandlerManager\n");
+        return false;
+    }
+
+    if(!setThreadParameters(m_realtime, m_base_priority)) {
+        debugFatal("Could not set thread parameters\n");
+        return false;
+    }
+    return true;
+}
+
 bool
 Ieee1394Service::setThreadParameters(bool rt, int priority) {
     bool result = true;
@@ -469,18 +591,35 @@ Ieee1394Service::setThreadParameters(bool rt, int priority) {
     if(m_armHelperRealtime) {
         m_armHelperRealtime->setThreadParameters(rt, priority);
     } //else debugError("Bogus RT ARM helper\n");
+    if(m_pAsyncEngine) {
+        result &= m_pAsyncEngine->setThreadParameters(rt, priority);
+    }
     return result;
 }
 
 int
 Ieee1394Service::getNodeCount()
 {
+    if(m_pSimulatedBus) return m_pSimulatedBus->getNodeCount();
     Util::MutexLockHelper lock(*m_handle_lock);
+    if(!m_handle) return 0;
     return raw1394_get_nodecount( m_handle );
 }
 
+unsigned int
+Ieee1394Service::getGeneration()
+{
+    if(m_pSimulatedBus) return m_pSimulatedBus->getGeneration();
+    Util::MutexLockHelper lock(*m_handle_lock);
+    if (!m_handle) return 0;
+    return raw1394_get_generation( m_handle );
+}
+
 nodeid_t Ieee1394Service::getLocalNodeId() {
     Util::MutexLockHelper lock(*m_handle_lock);
+    // not initialized (e.g. when the streaming code is used
+    // without a bus, as the stream processor benchmarks do)
+    if(!m_handle) return 0x3F;
     return raw1394_get_local_id(m_handle) & 0x3F;
 }
 
@@ -536,9 +675,22 @@ Ieee1394Service::getSystemTimeForCycleTimer(uint32_t ctr) {
     return m_pCTRHelper->getSystemTimeForCycleTimer(ctr);
 }
 
+float
+Ieee1394Service::getCycleTimerRate() {
+    return m_pCTRHelper->getRate();
+}
+
+void
+Ieee1394Service::setCycleTimerRate(float rate) {
+    m_pCTRHelper->setRate(rate);
+}
+
 bool
 Ieee1394Service::readCycleTimerReg(uint32_t *cycle_timer, uint64_t *local_time)
 {
+    if (m_pSimulatedBus) {
+        return m_pSimulatedBus->readCycleTimer(cycle_timer, local_time);
+    } else
     if (m_have_read_ctr_and_clock) {
         int err;
         err = raw1394_read_cycle_timer_and_clock(m_util_handle, cycle_timer, local_time, 
@@ -585,6 +737,27 @@ Ieee1394Service::read( fb_nodeid_t nodeId,
                        size_t length,
                        fb_quadlet_t* buffer )
 {
+    if (m_pAsyncEngine && m_pAsyncEngine->isRunning()) {
+        AsyncTransactionEngine::Request r;
+        r.setRead(nodeId, addr, length, buffer);
+        if (!m_pAsyncEngine->doRequest(r)) {
+            #ifdef DEBUG
+            int error = errno;
+            debugOutput(DEBUG_LEVEL_VERBOSE,
+                        "read failed: node 0x%hX, addr = 0x%016"PRIX64", length = %zd\n",
+                        nodeId, addr, length);
+            errno = error;
+            #endif
+            return false;
+        }
+        #ifdef DEBUG
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
+            "read: node 0x%hX, addr = 0x%016"PRIX64", length = %zd\n",
+            nodeId, addr, length);
+        printBuffer( DEBUG_LEVEL_VERY_VERBOSE, length, buffer );
+        #endif
+        return true;
+    }
     Util::MutexLockHelper lock(*m_handle_lock);
     return readNoLock(nodeId, addr, length, buffer);
 }
@@ -599,7 +772,13 @@ Ieee1394Service::readNoLock( fb_nodeid_t nodeId,
         debugWarning("operation on invalid node\n");
         return false;
     }
-    if ( raw1394_read( m_handle, nodeId, addr, length*4, buffer ) == 0 ) {
+    bool ok;
+    if (m_pSimulatedBus) {
+        ok = m_pSimulatedBus->asyncRead(nodeId, addr, length, buffer);
+    } else {
+        ok = (raw1394_read( m_handle, nodeId, addr, length*4, buffer ) == 0);
+    }
+    if ( ok ) {
 
         #ifdef DEBUG
         debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
@@ -611,9 +790,11 @@ Ieee1394Service::readNoLock( fb_nodeid_t nodeId,
         return true;
     } else {
         #ifdef DEBUG
+        int error = errno;
         debugOutput(DEBUG_LEVEL_VERBOSE,
                     "raw1394_read failed: node 0x%hX, addr = 0x%016"PRIX64", length = %zd\n",
                     nodeId, addr, length);
+        errno = error;
         #endif
         return false;
     }
@@ -642,10 +823,48 @@ Ieee1394Service::write( fb_nodeid_t nodeId,
                         size_t length,
                         fb_quadlet_t* data )
 {
+    if (m_pAsyncEngine && m_pAsyncEngine->isRunning()) {
+        #ifdef DEBUG
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"write: node 0x%hX, addr = 0x%016"PRIX64", length = %zd\n",
+                    nodeId, addr, length);
+        printBuffer( DEBUG_LEVEL_VERY_VERBOSE, length, data );
+        #endif
+        AsyncTransactionEngine::Request r;
+        r.setWrite(nodeId, addr, length, data);
+        return m_pAsyncEngine->doRequest(r);
+    }
     Util::MutexLockHelper lock(*m_handle_lock);
     return writeNoLock(nodeId, addr, length, data);
 }
 
+bool
+Ieee1394Service::queueAsyncRequest( AsyncTransactionEngine::Request &r )
+{
+    if (!m_pAsyncEngine) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "No async transaction engine\n");
+        return false;
+    }
+    return m_pAsyncEngine->queueRequest(r);
+}
+
+bool
+Ieee1394Service::waitForAsyncRequest( AsyncTransactionEngine::Request &r )
+{
+    if (!m_pAsyncEngine) {
+        debugError("No async transaction engine\n");
+        return false;
+    }
+    return m_pAsyncEngine->waitForRequest(r);
+}
+
+void
+Ieee1394Service::setAsyncMaxPayload( fb_nodeid_t nodeId, unsigned int quads )
+{
+    if (m_pAsyncEngine) {
+        m_pAsyncEngine->setMaxPayload(nodeId, quads);
+    }
+}
+
 bool
 Ieee1394Service::writeNoLock( fb_nodeid_t nodeId,
                               fb_nodeaddr_t addr,
@@ -657,6 +876,12 @@ Ieee1394Service::writeNoLock( fb_nodeid_t nodeId,
         return false;
     }
 
+    if (m_pSimulatedBus) {
+        // the simulated nodes only have a config ROM
+        debugError("write: not supported on the simulated bus\n");
+        return false;
+    }
+
     #ifdef DEBUG
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"write: node 0x%hX, addr = 0x%016"PRIX64", length = %zd\n",
                 nodeId, addr, length);
@@ -694,6 +919,10 @@ Ieee1394Service::lockCompareSwap64( fb_nodeid_t nodeId,
         debugWarning("operation on invalid node\n");
         return false;
     }
+    if (m_pSimulatedBus) {
+        debugError("lockCompareSwap64: not supported on the simulated bus\n");
+        return false;
+    }
     #ifdef DEBUG
     debugOutput(DEBUG_LEVEL_VERBOSE,"lockCompareSwap64: node 0x%X, addr = 0x%016"PRIX64"\n",
                 nodeId, addr);
@@ -736,6 +965,48 @@ Ieee1394Service::lockCompareSwap64( fb_nodeid_t nodeId,
     return (retval == 0);
 }
 
+bool
+Ieee1394Service::fcpTransaction( fb_nodeid_t nodeId,
+                                 fb_quadlet_t* request,
+                                 int len,
+                                 fb_quadlet_t* response,
+                                 unsigned int* resp_len )
+{
+    if (nodeId == INVALID_NODE_ID) {
+        debugWarning("operation on invalid node\n");
+        return false;
+    }
+    if (m_pSimulatedBus) {
+        debugError("fcpTransaction: not supported on the simulated bus\n");
+        *resp_len = 0;
+        return false;
+    }
+
+    struct sFcpBlock fcp_block;
+    memset(&fcp_block, 0, sizeof(fcp_block));
+
+    // make a local copy of the request
+    if(len < MAX_FCP_BLOCK_SIZE_QUADS) {
+        memcpy(fcp_block.request, request, len*sizeof(quadlet_t));
+        fcp_block.request_length = len;
+    } else {
+        debugWarning("Truncating FCP request\n");
+        memcpy(fcp_block.request, request, MAX_FCP_BLOCK_SIZE_BYTES);
+        fcp_block.request_length = MAX_FCP_BLOCK_SIZE_QUADS;
+    }
+    fcp_block.target_nodeid = 0xffc0 | nodeId;
+
+    if(doFcpTransaction(fcp_block)) {
+        memcpy(response, fcp_block.response, fcp_block.response_length*sizeof(quadlet_t));
+        *resp_len = fcp_block.response_length;
+        return true;
+    } else {
+        debugWarning("FCP transaction failed\n");
+        *resp_len = 0;
+        return false;
+    }
+}
+
 fb_quadlet_t*
 Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
                                    fb_quadlet_t* buf,
@@ -747,8 +1018,13 @@ Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
         debugWarning("operation on invalid node\n");
         return NULL;
     }
+    if (m_pSimulatedBus) {
+        debugError("transactionBlock: not supported on the simulated bus\n");
+        *resp_len = 0;
+        return NULL;
+    }
     // NOTE: this expects a call to transactionBlockClose to unlock
-    m_handle_lock->Lock();
+    m_fcp_block_lock->Lock();
 
     // clear the request & response memory
     memset(&m_fcp_block, 0, sizeof(m_fcp_block));
@@ -764,7 +1040,7 @@ Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
     }
     m_fcp_block.target_nodeid = 0xffc0 | nodeId;
 
-    bool success = doFcpTransaction();
+    bool success = doFcpTransaction(m_fcp_block);
     if(success) {
         *resp_len = m_fcp_block.response_length;
         return m_fcp_block.response;
@@ -778,16 +1054,40 @@ Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
 bool
 Ieee1394Service::transactionBlockClose()
 {
-    m_handle_lock->Unlock();
+    m_fcp_block_lock->Unlock();
     return true;
 }
 
 // FCP code
 bool
-Ieee1394Service::doFcpTransaction()
+Ieee1394Service::startFcpListen()
+{
+    bool retval = true;
+    pthread_mutex_lock(&m_fcp_lock);
+    if(!m_fcp_listening) {
+        if(!m_fcpHelper) {
+            debugError("No FCP helper thread\n");
+            retval = false;
+        } else {
+            // this fails if some other program is listening for a FCP response
+            int err = raw1394_start_fcp_listen(m_fcpHelper->get1394Handle());
+            if(err) {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "could not start FCP listen (err=%d, errno=%d)\n", err, errno);
+                retval = false;
+            } else {
+                m_fcp_listening = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_fcp_lock);
+    return retval;
+}
+
+bool
+Ieee1394Service::doFcpTransaction(struct sFcpBlock &fcp_block)
 {
     for(int i=0; i < IEEE1394SERVICE_FCP_MAX_TRIES; i++) {
-        if(doFcpTransactionTry()) {
+        if(doFcpTransactionTry(fcp_block)) {
             return true;
         } else {
             debugOutput(DEBUG_LEVEL_VERBOSE, "FCP transaction try %d failed\n", i);
@@ -825,79 +1125,82 @@ Ieee1394Service::doFcpTransaction()
 #define FCP_MASK_RESPONSE_OPERAND(x, n) ((x) & (0xFF000000 >> (((n)%4)*8)))
 
 bool
-Ieee1394Service::doFcpTransactionTry()
+Ieee1394Service::doFcpTransactionTry(struct sFcpBlock &fcp_block)
 {
-    // NOTE that access to this is protected by the m_handle lock
-    int err;
     bool retval = true;
     uint64_t timeout;
 
-    // prepare an fcp response handler
-    raw1394_set_fcp_handler(m_handle, _avc_fcp_handler);
-
-    // start listening for FCP requests
-    // this fails if some other program is listening for a FCP response
-    err = raw1394_start_fcp_listen(m_handle);
-    if(err) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "could not start FCP listen (err=%d, errno=%d)\n", err, errno);
-        retval = false;
-        goto out;
+    if(!startFcpListen()) {
+        return false;
     }
 
-    m_fcp_block.status = eFS_Waiting;
+    // only one command can be outstanding per node, wait for
+    // the previous one to be finished
+    pthread_mutex_lock(&m_fcp_lock);
+    while(m_fcp_pending.find(fcp_block.target_nodeid) != m_fcp_pending.end()) {
+        pthread_cond_wait(&m_fcp_cond, &m_fcp_lock);
+    }
+    fcp_block.status = eFS_Waiting;
+    fcp_block.interim = false;
+    m_fcp_pending[fcp_block.target_nodeid] = &fcp_block;
+    pthread_mutex_unlock(&m_fcp_lock);
 
     #ifdef DEBUG
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"fcp request: node 0x%hX, length = %d bytes\n",
-                m_fcp_block.target_nodeid, m_fcp_block.request_length*4);
-    printBuffer(DEBUG_LEVEL_VERY_VERBOSE, m_fcp_block.request_length, m_fcp_block.request );
+                fcp_block.target_nodeid, fcp_block.request_length*4);
+    printBuffer(DEBUG_LEVEL_VERY_VERBOSE, fcp_block.request_length, fcp_block.request );
     #endif
 
     // write the FCP request
-    if(!writeNoLock( m_fcp_block.target_nodeid, FCP_COMMAND_ADDR,
-                     m_fcp_block.request_length, m_fcp_block.request)) {
+    if(!write( fcp_block.target_nodeid, FCP_COMMAND_ADDR,
+               fcp_block.request_length, fcp_block.request)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "write of FCP request failed\n");
         retval = false;
-        goto out;
     }
 
-    // wait for the response to arrive
-    struct pollfd raw1394_poll;
-    raw1394_poll.fd = raw1394_get_fd(m_handle);
-    raw1394_poll.events = POLLIN;
-
+    // wait for the response to be dispatched by the FCP helper
+    pthread_mutex_lock(&m_fcp_lock);
     timeout = Util::SystemTimeSource::getCurrentTimeAsUsecs() +
               IEEE1394SERVICE_FCP_RESPONSE_TIMEOUT_USEC;
-
-    while(m_fcp_block.status == eFS_Waiting 
-          && Util::SystemTimeSource::getCurrentTimeAsUsecs() < timeout) {
-        if(poll( &raw1394_poll, 1, IEEE1394SERVICE_FCP_POLL_TIMEOUT_MSEC) > 0) {
-            if (raw1394_poll.revents & POLLIN) {
-                raw1394_loop_iterate(m_handle);
-            }
+    while(retval && fcp_block.status == eFS_Waiting) {
+        uint64_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        if(fcp_block.interim) {
+            // the target needs more time to produce the final response
+            fcp_block.interim = false;
+            timeout = now + IEEE1394SERVICE_FCP_INTERIM_TIMEOUT_USEC;
         }
-    }
+        if(now >= timeout) {
+            break;
+        }
+        // the system time source isn't necessarily CLOCK_REALTIME,
+        // hence the relative conversion
+        uint64_t wait = timeout - now;
+        if(wait > IEEE1394SERVICE_FCP_POLL_TIMEOUT_MSEC * 1000ULL) {
+            wait = IEEE1394SERVICE_FCP_POLL_TIMEOUT_MSEC * 1000ULL;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t nsecs = ts.tv_nsec + wait * 1000ULL;
+        ts.tv_sec += nsecs / 1000000000ULL;
+        ts.tv_nsec = nsecs % 1000000000ULL;
+        pthread_cond_timedwait(&m_fcp_cond, &m_fcp_lock, &ts);
+    }
+    m_fcp_pending.erase(fcp_block.target_nodeid);
+    // wake up the callers waiting for this node
+    pthread_cond_broadcast(&m_fcp_cond);
+    pthread_mutex_unlock(&m_fcp_lock);
 
     // check the request and figure out what happened
-    if(m_fcp_block.status == eFS_Waiting) {
+    if(retval && fcp_block.status == eFS_Waiting) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response timed out\n");
         retval = false;
-        goto out;
     }
-    if(m_fcp_block.status == eFS_Error) {
+    if(fcp_block.status == eFS_Error) {
         debugError("FCP request/response error\n");
         retval = false;
-        goto out;
-    }
-
-out:
-    // stop listening for FCP responses
-    err = raw1394_stop_fcp_listen(m_handle);
-    if(err) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "could not stop FCP listen (err=%d, errno=%d)\n", err, errno);
-        retval = false;
     }
 
-    m_fcp_block.status = eFS_Empty;
+    fcp_block.status = eFS_Empty;
     return retval;
 }
 
@@ -906,9 +1209,9 @@ Ieee1394Service::_avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid,
                                   int response, size_t length,
                                   unsigned char *data)
 {
-    Ieee1394Service *service = static_cast<Ieee1394Service *>(raw1394_get_userdata(handle));
-    if(service) {
-        return service->handleFcpResponse(nodeid, response, length, data);
+    HelperThread *helper = reinterpret_cast<HelperThread *>(raw1394_get_userdata(handle));
+    if(helper) {
+        return helper->get1394Service().handleFcpResponse(nodeid, response, length, data);
     } else return -1;
 }
 
@@ -917,8 +1220,6 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
                                    int response, size_t length,
                                    unsigned char *data)
 {
-    static struct sFcpBlock fcp_block_last;
-
     fb_quadlet_t *data_quads = (fb_quadlet_t *)data;
     #ifdef DEBUG
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"fcp response: node 0x%hX, response = %d, length = %zd bytes\n",
@@ -932,16 +1233,25 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
             debugWarning("Truncated FCP response\n");
         }
 
+        pthread_mutex_lock(&m_fcp_lock);
+        // look up the command outstanding for this node
+        fcp_block_map_t::iterator it = m_fcp_pending.find(nodeid);
+        struct sFcpBlock *fcp_block = NULL;
+        if(it != m_fcp_pending.end() && it->second->status == eFS_Waiting) {
+            fcp_block = it->second;
+        }
+
         // is it an actual response or is it INTERIM?
         quadlet_t first_quadlet = CondSwapFromBus32(data_quads[0]);
-        if(FCP_MASK_RESPONSE(first_quadlet) == FCP_RESPONSE_INTERIM) {
+        if(!fcp_block) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "No FCP request outstanding for node 0x%hX\n", nodeid);
+        } else if(FCP_MASK_RESPONSE(first_quadlet) == FCP_RESPONSE_INTERIM) {
             debugOutput(DEBUG_LEVEL_VERBOSE, "INTERIM\n");
+            fcp_block->interim = true;
+            pthread_cond_broadcast(&m_fcp_cond);
         } else {
             // it's an actual response, check if it matches our request
-            if(nodeid != m_fcp_block.target_nodeid) {
-                debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response node id's don't match! (%x, %x)\n",
-                                                 m_fcp_block.target_nodeid, nodeid);
-            } else if (first_quadlet == 0) {
+            if (first_quadlet == 0) {
                 debugWarning("Bogus FCP response\n");
                 printBuffer(DEBUG_LEVEL_WARNING, (length+3)/4, data_quads );
 #ifdef DEBUG
@@ -950,32 +1260,50 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
                 printBuffer(DEBUG_LEVEL_WARNING, (length+3)/4, data_quads );
 #endif
             } else if(FCP_MASK_SUBUNIT_AND_OPCODE(first_quadlet) 
-                      != FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(m_fcp_block.request[0]))) {
+                      != FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(fcp_block->request[0]))) {
                 debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response not for this request: %08X != %08X\n",
                              FCP_MASK_SUBUNIT_AND_OPCODE(first_quadlet),
-                             FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(m_fcp_block.request[0])));
-            } else if(m_filterFCPResponse && (memcmp(fcp_block_last.response, data, length) == 0)) {
+                             FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(fcp_block->request[0])));
+            } else if(m_filterFCPResponse && isDuplicateFcpResponse(nodeid, length, data)) {
                 // This is workaround for the Edirol FA-101. The device tends to send more than
                 // one responde to one request. This seems to happen when discovering 
                 // function blocks and looks very likely there is a race condition in the 
                 // device. The workaround here compares the just arrived FCP responde
-                // to the last one. If it is the same as the previously one then we
-                // just ignore it. The downside of this approach is, we cannot issue
-                // the same FCP twice.
+                // to the last one of the same node. If it is the same as the previously
+                // one then we just ignore it. The downside of this approach is, we cannot
+                // issue the same FCP twice in a row to a node.
                 debugWarning("Received duplicate FCP response. Ignore it\n");
             } else {
-                m_fcp_block.response_length = (length + sizeof(quadlet_t) - 1) / sizeof(quadlet_t);
-                memcpy(m_fcp_block.response, data, length);
+                fcp_block->response_length = (length + sizeof(quadlet_t) - 1) / sizeof(quadlet_t);
+                memcpy(fcp_block->response, data, length);
                 if (m_filterFCPResponse) {
-                    memcpy(fcp_block_last.response, data, length);
+                    struct sFcpResponse &last = m_fcp_last_response[nodeid];
+                    last.length = length;
+                    memcpy(last.data, data, length);
                 }
-                m_fcp_block.status = eFS_Responded;
+                fcp_block->status = eFS_Responded;
+                pthread_cond_broadcast(&m_fcp_cond);
             }
-       }
+        }
+        pthread_mutex_unlock(&m_fcp_lock);
     }
     return 0;
 }
 
+// has to be called with m_fcp_lock held
+bool
+Ieee1394Service::isDuplicateFcpResponse(nodeid_t nodeid, size_t length,
+                                        unsigned char *data)
+{
+    // the responses of different nodes can be the same
+    fcp_response_map_t::iterator it = m_fcp_last_response.find(nodeid);
+    if (it == m_fcp_last_response.end()) {
+        return false;
+    }
+    return it->second.length == length
+           && memcmp(it->second.data, data, length) == 0;
+}
+
 bool
 Ieee1394Service::setSplitTimeoutUsecs(fb_nodeid_t nodeId, unsigned int timeout)
 {
@@ -1102,6 +1430,12 @@ Ieee1394Service::resetHandler( unsigned int generation )
     raw1394_update_generation(m_handle, generation);
     m_handle_lock->Unlock();
 
+    // the nodes can have other ids now, the config ROMs set the max
+    // payloads again when they update their node id
+    if (m_pAsyncEngine) {
+        m_pAsyncEngine->resetMaxPayloads();
+    }
+
     // do a simple read on ourself in order to update the internal structures
     // this avoids failures after a bus reset
     read_quadlet( getLocalNodeId() | 0xFFC0,
@@ -1174,6 +1508,10 @@ nodeaddr_t Ieee1394Service::findFreeARMBlock( nodeaddr_t start, size_t length, s
     debugOutput(DEBUG_LEVEL_VERBOSE,
                 "Finding free ARM block of %zd bytes, from 0x%016"PRIX64" in steps of %zd bytes\n",
                 length, start, step);
+    if (m_pSimulatedBus) {
+        debugError("ARM blocks are not supported on the simulated bus\n");
+        return 0xFFFFFFFFFFFFFFFFLLU;
+    }
 
     int cnt=0;
     const int maxcnt=10;
@@ -1313,6 +1651,10 @@ Ieee1394Service::remBusResetHandler( Util::Functor* functor )
  */
 signed int Ieee1394Service::allocateIsoChannelGeneric(unsigned int bandwidth) {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Allocating ISO channel using generic method...\n" );
+    if (m_pSimulatedBus) {
+        debugError("The simulated bus has no IRM\n");
+        return -1;
+    }
 
     Util::MutexLockHelper lock(*m_handle_lock);
     struct ChannelInfo cinfo;
@@ -1372,6 +1714,10 @@ signed int Ieee1394Service::allocateFixedIsoChannelGeneric(
     unsigned int chan, unsigned int bandwidth
     ) {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Allocating ISO channel %d using generic method...\n", chan );
+    if (m_pSimulatedBus) {
+        debugError("The simulated bus has no IRM\n");
+        return -1;
+    }
 
     Util::MutexLockHelper lock(*m_handle_lock);
     struct ChannelInfo cinfo;
@@ -1438,6 +1784,10 @@ signed int Ieee1394Service::allocateIsoChannelCMP(
     }
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "Allocating ISO channel using IEC61883 CMP...\n" );
+    if (m_pSimulatedBus) {
+        debugError("The simulated bus has no IRM\n");
+        return -1;
+    }
     Util::MutexLockHelper lock(*m_handle_lock);
 
     struct ChannelInfo cinfo;
@@ -1597,6 +1947,10 @@ bool Ieee1394Service::unregisterIsoChannel(unsigned int c) {
  */
 signed int Ieee1394Service::getAvailableBandwidth() {
     quadlet_t buffer;
+    if (m_pSimulatedBus) {
+        debugError("The simulated bus has no IRM\n");
+        return -1;
+    }
     Util::MutexLockHelper lock(*m_handle_lock);
     signed int result = raw1394_read (m_handle, raw1394_get_irm_id (m_handle),
         CSR_REGISTER_BASE + CSR_BANDWIDTH_AVAILABLE,
@@ -1612,7 +1966,10 @@ Ieee1394Service::setVerboseLevel(int l)
 {
     if (m_pIsoManager) m_pIsoManager->setVerboseLevel(l);
     if (m_pCTRHelper) m_pCTRHelper->setVerboseLevel(l);
+    if (m_pAsyncEngine) m_pAsyncEngine->setVerboseLevel(l);
     if (m_pWatchdog) m_pWatchdog->setVerboseLevel(l);
+    if (m_pSimulatedBus) m_pSimulatedBus->setVerboseLevel(l);
+    if (m_pConfigRomCache) m_pConfigRomCache->setVerboseLevel(l);
     setDebugLevel(l);
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting verbose level to %d...\n", l );
 }
@@ -1640,6 +1997,7 @@ Ieee1394Service::show()
                 (unsigned int)TICKS_TO_OFFSET( ctr ) );
     debugOutputShort( DEBUG_LEVEL_NORMAL, "Iso handler info:\n");
     #endif
+    if (m_pSimulatedBus) m_pSimulatedBus->show();
     if (m_pIsoManager) m_pIsoManager->dumpInfo();
 }
 
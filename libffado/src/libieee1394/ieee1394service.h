@@ -33,11 +33,13 @@
 #include "debugmodule/debugmodule.h"
 
 #include "IEC61883.h"
+#include "AsyncTransactionEngine.h"
 
 #include <libraw1394/raw1394.h>
 #include <pthread.h>
 
 #include <vector>
+#include <map>
 #include <string>
 #include <stdint.h>
 
@@ -47,6 +49,8 @@
 
 class IsoHandlerManager;
 class CycleTimerHelper;
+class SimulatedBus;
+class ConfigRomCache;
 
 namespace Util {
     class Watchdog;
@@ -155,6 +159,17 @@ public:
      */
     uint64_t getSystemTimeForCycleTimer(uint32_t ctr);
 
+    /**
+     * @brief get the rate of the cycle timer DLL (in ticks per usec)
+     */
+    float getCycleTimerRate();
+
+    /**
+     * @brief preset the rate of the cycle timer DLL (in ticks per usec)
+     * @note thread safe
+     */
+    void setCycleTimerRate(float rate);
+
     /**
      * @brief read the cycle timer value from the controller (in CTR format)
      *
@@ -219,6 +234,36 @@ public:
                         fb_nodeaddr_t addr,
                         fb_octlet_t data );
 
+    /**
+     * @brief queue an asynchronous read/write request
+     *
+     * The request is executed by the transaction engine, pipelined with
+     * the requests to other nodes. Use waitForAsyncRequest() or a
+     * completion handler to find out when it's done.
+     *
+     * @note the request and its buffer have to stay valid until completion
+     *
+     * @param r the request
+     * @return true if the request was queued
+     */
+    bool queueAsyncRequest( AsyncTransactionEngine::Request &r );
+
+    /**
+     * @brief wait for the completion of a queued request
+     *
+     * @param r the request
+     * @return true if the request was successful, false otherwise (sets errno)
+     */
+    bool waitForAsyncRequest( AsyncTransactionEngine::Request &r );
+
+    /**
+     * @brief set the largest block the transaction engine reads from a node
+     *
+     * @param nodeId the node
+     * @param quads the max payload in quadlets, 0 if unknown
+     */
+    void setAsyncMaxPayload( fb_nodeid_t nodeId, unsigned int quads );
+
     /**
      * @brief send 64-bit compare-swap lock request and wait for response.
      *
@@ -241,8 +286,33 @@ public:
                             fb_octlet_t  swap_value,
                             fb_octlet_t* result );
 
+    /**
+     * @brief execute an FCP (AV/C) transaction
+     *
+     * Sends the request to the FCP command register of the node and waits
+     * for the matching response. Only one command is outstanding per
+     * node, but commands to different nodes are executed concurrently.
+     * INTERIM responses extend the wait for the final response.
+     *
+     * @param nodeId target node ID
+     * @param request the request frame
+     * @param len length of the request (in quadlets)
+     * @param response buffer for the response, should have room for
+     *                 MAX_FCP_BLOCK_SIZE_QUADS quadlets
+     * @param resp_len will contain the length of the response (in quadlets)
+     * @return true if a response was received
+     */
+    bool fcpTransaction( fb_nodeid_t nodeId,
+                         fb_quadlet_t* request,
+                         int len,
+                         fb_quadlet_t* response,
+                         unsigned int* resp_len );
+
     /**
      * initiate AV/C transaction
+     *
+     * @note transactions started by this function are serialized, use
+     *       fcpTransaction() instead.
      * @param nodeId 
      * @param buf 
      * @param len 
@@ -295,10 +365,7 @@ public:
      *
      * @return the current generation
      **/
-    unsigned int getGeneration() {
-        Util::MutexLockHelper lock(*m_handle_lock);
-        return raw1394_get_generation( m_handle );
-    }
+    unsigned int getGeneration();
 
     /**
      * @brief update the current generation
@@ -306,6 +373,7 @@ public:
      * @return the current generation
      **/
     void updateGeneration() {
+        if (!m_handle) return;
         Util::MutexLockHelper lock(*m_handle_lock);
         raw1394_update_generation( m_handle, getGeneration());
     }
@@ -366,6 +434,13 @@ public:
     bool freeIsoChannel(signed int channel);
 
     IsoHandlerManager& getIsoHandlerManager() {return *m_pIsoManager;};
+    /**
+     * @brief the simulated bus this service runs on
+     * @return NULL when running on real hardware
+     */
+    SimulatedBus* getSimulatedBus() {return m_pSimulatedBus;};
+    /// the config ROMs of the nodes on this port
+    ConfigRomCache& getConfigRomCache() {return *m_pConfigRomCache;};
 private:
     enum EAllocType {
         AllocFree = 0, // not allocated (by us)
@@ -430,9 +505,11 @@ private:
     HelperThread *m_resetHelper;
     HelperThread *m_armHelperNormal;
     HelperThread *m_armHelperRealtime;
+    HelperThread *m_fcpHelper;
 
 private: // unsorted
     bool configurationUpdated();
+    bool initializeSimulatedBus();
 
     void printBuffer( unsigned int level, size_t length, fb_quadlet_t* buffer ) const;
     void printBufferBytes( unsigned int level, size_t length, byte_t* buffer ) const;
@@ -459,6 +536,9 @@ private: // unsorted
 
     IsoHandlerManager*      m_pIsoManager;
     CycleTimerHelper*       m_pCTRHelper;
+    AsyncTransactionEngine* m_pAsyncEngine;
+    SimulatedBus*           m_pSimulatedBus;
+    ConfigRomCache*         m_pConfigRomCache;
     bool                    m_have_new_ctr_read;
     bool                    m_have_read_ctr_and_clock;
 
@@ -503,16 +583,36 @@ private: // unsorted
 
     struct sFcpBlock {
         enum eFcpStatus status;
+        bool interim; // an INTERIM response was received
         nodeid_t target_nodeid;
         unsigned int request_length;
         quadlet_t request[MAX_FCP_BLOCK_SIZE_QUADS];
         unsigned int response_length;
         quadlet_t response[MAX_FCP_BLOCK_SIZE_QUADS];
     };
+
+    // the outstanding FCP commands, one per target node
+    typedef std::map< nodeid_t, struct sFcpBlock * > fcp_block_map_t;
+    fcp_block_map_t m_fcp_pending;
+    pthread_mutex_t m_fcp_lock;
+    pthread_cond_t  m_fcp_cond;
+    bool            m_fcp_listening;
+
+    // for the transactionBlock/transactionBlockClose API
+    Util::Mutex*     m_fcp_block_lock;
     struct sFcpBlock m_fcp_block;
+    // the last response of each node, for duplicate filtering
+    struct sFcpResponse {
+        size_t length; // in bytes
+        quadlet_t data[MAX_FCP_BLOCK_SIZE_QUADS];
+    };
+    typedef std::map< nodeid_t, struct sFcpResponse > fcp_response_map_t;
+    fcp_response_map_t m_fcp_last_response;
 
-    bool doFcpTransaction();
-    bool doFcpTransactionTry();
+    bool isDuplicateFcpResponse(nodeid_t nodeid, size_t length, unsigned char *data);
+    bool startFcpListen();
+    bool doFcpTransaction(struct sFcpBlock &);
+    bool doFcpTransactionTry(struct sFcpBlock &);
 
 public:
     void setVerboseLevel(int l);
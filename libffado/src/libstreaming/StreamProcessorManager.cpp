@@ -29,15 +29,39 @@
 #include "libieee1394/cycletimer.h"
 
 #include "devicemanager.h"
+#include "ffadodevice.h"
+#include "libieee1394/ieee1394service.h"
+#include "libieee1394/IsoHandlerManager.h"
 
 #include "libutil/Time.h"
+#include "libutil/Atomic.h"
+#include "libutil/PosixThread.h"
 
 #include <errno.h>
 #include <assert.h>
 #include <math.h>
+#include <limits.h>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 namespace Streaming {
 
+// glibc doesn't wrap the futex syscall
+static inline int
+futexWait(volatile int32_t *addr, int32_t val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static inline int
+futexWake(volatile int32_t *addr, int nb_waiters)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nb_waiters, NULL, NULL, 0);
+}
+
 IMPL_DEBUG_MODULE( StreamProcessorManager, StreamProcessorManager, DEBUG_LEVEL_VERBOSE );
 
 StreamProcessorManager::StreamProcessorManager(DeviceManager &p)
@@ -50,6 +74,11 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p)
     , m_parent( p )
     , m_xrun_happened( false )
     , m_activity_wait_timeout_nsec( 0 ) // dynamically set
+    , m_thread_realtime( false )
+    , m_thread_priority( 0 )
+    , m_period_ready_mask_all( 0 )
+    , m_period_ready_mask( 0 )
+    , m_period_waiters( 0 )
     , m_nb_buffers( 0 )
     , m_period( 0 )
     , m_sync_delay( 0 )
@@ -60,6 +89,21 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p)
     , m_nbperiods(0)
     , m_WaitLock( new Util::PosixMutex("SPMWAIT") )
     , m_max_diff_ticks( 50 ) 
+    , m_fast_start( false )
+    , m_fast_start_tolerance( 0 )
+    , m_fast_start_stable_periods( 0 )
+    , m_cycle_timer_seeded( false )
+    , m_parallel_receive( false )
+    , m_parallel_transmit( false )
+    , m_transfer_sps( NULL )
+    , m_transfer_type( StreamProcessor::ePT_Receive )
+    , m_transfer_ticks_per_frame( 0.0 )
+    , m_transfer_job( 0 )
+    , m_transfer_next( 0 )
+    , m_transfer_busy_workers( 0 )
+    , m_transfer_failed( 0 )
+    , m_metering( false )
+    , m_nb_metered_capture_ports( 0 )
 {
     addOption(Util::OptionContainer::Option("slaveMode",false));
     sem_init(&m_activity_semaphore, 0, 0);
@@ -76,6 +120,11 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int pe
     , m_parent( p )
     , m_xrun_happened( false )
     , m_activity_wait_timeout_nsec( 0 ) // dynamically set
+    , m_thread_realtime( false )
+    , m_thread_priority( 0 )
+    , m_period_ready_mask_all( 0 )
+    , m_period_ready_mask( 0 )
+    , m_period_waiters( 0 )
     , m_nb_buffers(nb_buffers)
     , m_period(period)
     , m_sync_delay( 0 )
@@ -86,12 +135,39 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int pe
     , m_nbperiods(0)
     , m_WaitLock( new Util::PosixMutex("SPMWAIT") )
     , m_max_diff_ticks( 50 )
+    , m_fast_start( false )
+    , m_fast_start_tolerance( 0 )
+    , m_fast_start_stable_periods( 0 )
+    , m_cycle_timer_seeded( false )
+    , m_parallel_receive( false )
+    , m_parallel_transmit( false )
+    , m_transfer_sps( NULL )
+    , m_transfer_type( StreamProcessor::ePT_Receive )
+    , m_transfer_ticks_per_frame( 0.0 )
+    , m_transfer_job( 0 )
+    , m_transfer_next( 0 )
+    , m_transfer_busy_workers( 0 )
+    , m_transfer_failed( 0 )
+    , m_metering( false )
+    , m_nb_metered_capture_ports( 0 )
 {
     addOption(Util::OptionContainer::Option("slaveMode",false));
     sem_init(&m_activity_semaphore, 0, 0);
 }
 
 StreamProcessorManager::~StreamProcessorManager() {
+    stopTransferWorkers();
+    // the histograms go away with us
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        (*it)->setLatencyStatistics(NULL);
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it ) {
+        (*it)->setLatencyStatistics(NULL);
+    }
     sem_post(&m_activity_semaphore);
     sem_destroy(&m_activity_semaphore);
     delete m_WaitLock;
@@ -151,9 +227,34 @@ void
 StreamProcessorManager::signalActivity()
 {
     sem_post(&m_activity_semaphore);
+    // state changes (e.g. xruns) have to be picked up by a
+    // waitForPeriod() that is waiting for the period ready mask
+    if (m_period_waiters) {
+        futexWake(&m_period_ready_mask, 1);
+    }
     debugOutputExtreme(DEBUG_LEVEL_VERBOSE,"%p activity\n", this);
 }
 
+/**
+ * @brief mark an SP as ready for the next period transfer
+ *
+ * Called from the ISO threads. Setting a bit is idempotent, so an SP can
+ * signal as often as it likes. The client thread is woken by whoever
+ * sets the last missing bit.
+ *
+ * @param bit the period signal bit of the SP
+ */
+void
+StreamProcessorManager::signalPeriodReady(uint32_t bit)
+{
+    uint32_t old_mask = (uint32_t)OR_ATOMIC(&m_period_ready_mask, (int32_t)bit);
+    if ((old_mask & bit) == 0
+        && (old_mask | bit) == m_period_ready_mask_all
+        && m_period_waiters) {
+        futexWake(&m_period_ready_mask, 1);
+    }
+}
+
 enum StreamProcessorManager::eActivityResult
 StreamProcessorManager::waitForActivity()
 {
@@ -237,6 +338,7 @@ bool StreamProcessorManager::registerProcessor(StreamProcessor *processor)
         Util::Functor* f = new Util::MemberFunctor0< StreamProcessorManager*, void (StreamProcessorManager::*)() >
                     ( this, &StreamProcessorManager::updateShadowLists, false );
         processor->addPortManagerUpdateHandler(f);
+        processor->setLatencyStatistics(&m_latency_stats);
         updateShadowLists();
         return true;
     }
@@ -246,6 +348,7 @@ bool StreamProcessorManager::registerProcessor(StreamProcessor *processor)
         Util::Functor* f = new Util::MemberFunctor0< StreamProcessorManager*, void (StreamProcessorManager::*)() >
                     ( this, &StreamProcessorManager::updateShadowLists, false );
         processor->addPortManagerUpdateHandler(f);
+        processor->setLatencyStatistics(&m_latency_stats);
         updateShadowLists();
         return true;
     }
@@ -259,6 +362,16 @@ bool StreamProcessorManager::unregisterProcessor(StreamProcessor *processor)
     debugOutput( DEBUG_LEVEL_VERBOSE, "Unregistering processor (%p)\n",processor);
     assert(processor);
 
+    // the period ready mask is no longer complete, fall back to polling
+    // until the next prepare(). waitForPeriod() holds the wait lock while
+    // it uses the mask, so it never sees it change halfway.
+    {
+        Util::MutexLockHelper lock(*m_WaitLock);
+        m_period_ready_mask_all = 0;
+        processor->setPeriodSignalBit(0);
+    }
+    processor->setLatencyStatistics(NULL);
+
     if (processor->getType()==StreamProcessor::ePT_Receive) {
 
         for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
@@ -414,6 +527,13 @@ bool StreamProcessorManager::prepare() {
 
     m_shutdown_needed=false;
 
+    // make the statistics visible to other processes, they
+    // are still collected when this fails
+    if(!m_latency_stats.publish()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Statistics not published\n");
+    }
+    m_latency_stats.reset();
+
     // if no sync source is set, select one here
     if(m_SyncSource == NULL) {
        debugWarning("Sync Source is not set. Defaulting to first StreamProcessor.\n");
@@ -481,8 +601,116 @@ bool StreamProcessorManager::prepare() {
     debugOutput(DEBUG_LEVEL_VERBOSE, "setting activity timeout to %d\n", timeout_usec);
     setActivityWaitTimeoutUsec(timeout_usec);
 
+    // hand out the period signal bits. the event-driven wait supports
+    // up to 32 SP's, which is plenty for all practical setups.
+    int event_driven = STREAMPROCESSORMANAGER_EVENT_DRIVEN_PERIOD_SIGNAL;
+    Util::Configuration &config = m_parent.getConfiguration();
+    config.getValueForSetting("streaming.spm.event_driven_period_signal", event_driven);
+
+    unsigned int nb_sps = m_ReceiveProcessors.size() + m_TransmitProcessors.size();
+    if (event_driven && nb_sps > 32) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "%u SP's, too many for event-driven period signalling\n", nb_sps);
+        event_driven = 0;
+    }
+    m_period_ready_mask_all = 0;
+    unsigned int bit_nb = 0;
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        uint32_t bit = (event_driven ? (1U << bit_nb++) : 0);
+        (*it)->setPeriodSignalBit(bit);
+        m_period_ready_mask_all |= bit;
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        uint32_t bit = (event_driven ? (1U << bit_nb++) : 0);
+        (*it)->setPeriodSignalBit(bit);
+        m_period_ready_mask_all |= bit;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "period signalling: %s (mask 0x%08X)\n",
+                (m_period_ready_mask_all ? "event-driven" : "predicted"),
+                m_period_ready_mask_all);
+
+    // short packet losses are bridged by the SP's themselves
+    int soft_recovery_max_cycles = STREAMPROCESSOR_SOFT_RECOVERY_MAX_CYCLES;
+    config.getValueForSetting("streaming.spm.soft_recovery_max_cycles", soft_recovery_max_cycles);
+    if (soft_recovery_max_cycles < 0) {
+        soft_recovery_max_cycles = 0;
+    }
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        (*it)->setSoftRecoveryMaxCycles(soft_recovery_max_cycles);
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        (*it)->setSoftRecoveryMaxCycles(soft_recovery_max_cycles);
+    }
+
+    int fast_start = STREAMPROCESSORMANAGER_FAST_START;
+    float fast_start_tolerance_ppm = STREAMPROCESSORMANAGER_FAST_START_TOLERANCE_PPM;
+    int fast_start_stable_periods = STREAMPROCESSORMANAGER_FAST_START_STABLE_PERIODS;
+    config.getValueForSetting("streaming.spm.fast_start", fast_start);
+    config.getValueForSetting("streaming.spm.fast_start_tolerance_ppm", fast_start_tolerance_ppm);
+    config.getValueForSetting("streaming.spm.fast_start_stable_periods", fast_start_stable_periods);
+    m_fast_start = (fast_start != 0);
+    m_fast_start_tolerance = fast_start_tolerance_ppm * 1e-6;
+    m_fast_start_stable_periods = (fast_start_stable_periods > 1 ? fast_start_stable_periods : 1);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "fast start: %s (tolerance %f ppm, %u periods)\n",
+                (m_fast_start ? "on" : "off"), fast_start_tolerance_ppm,
+                m_fast_start_stable_periods);
+
+    // the meters are computed by the SP's, only the ports in the
+    // shadow lists are published
+    int port_meters = STREAMPROCESSORMANAGER_PORT_METERS;
+    config.getValueForSetting("streaming.spm.port_meters", port_meters);
+    m_metering = (port_meters != 0);
+    if (m_metering && !m_port_meters.publish()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Port meters not published\n");
+    }
+
     updateShadowLists();
 
+    // spread the transfer over worker threads for large setups only
+    int transfer_threads = STREAMPROCESSORMANAGER_TRANSFER_THREADS;
+    int transfer_min_samples = STREAMPROCESSORMANAGER_TRANSFER_MIN_SAMPLES;
+    int transfer_thread_cpu_base = STREAMPROCESSORMANAGER_TRANSFER_THREAD_CPU_BASE;
+    config.getValueForSetting("streaming.spm.transfer_threads", transfer_threads);
+    config.getValueForSetting("streaming.spm.transfer_min_samples", transfer_min_samples);
+    config.getValueForSetting("streaming.spm.transfer_thread_cpu_base", transfer_thread_cpu_base);
+
+    unsigned int receive_samples = m_CapturePorts_shadow.size() * m_period;
+    unsigned int transmit_samples = m_PlaybackPorts_shadow.size() * m_period;
+    m_parallel_receive = transfer_threads > 0 && m_ReceiveProcessors.size() > 1
+                         && receive_samples >= (unsigned int)transfer_min_samples;
+    m_parallel_transmit = transfer_threads > 0 && m_TransmitProcessors.size() > 1
+                          && transmit_samples >= (unsigned int)transfer_min_samples;
+
+    // the client thread takes part in the transfer, so there is no
+    // use for more workers than SP's minus one
+    unsigned int nb_workers = 0;
+    if (m_parallel_receive) {
+        nb_workers = std::max(nb_workers, (unsigned int)m_ReceiveProcessors.size() - 1);
+    }
+    if (m_parallel_transmit) {
+        nb_workers = std::max(nb_workers, (unsigned int)m_TransmitProcessors.size() - 1);
+    }
+    if (transfer_threads > 0) {
+        nb_workers = std::min(nb_workers, (unsigned int)transfer_threads);
+    }
+    stopTransferWorkers();
+    if (nb_workers > 0 && !startTransferWorkers(nb_workers, transfer_thread_cpu_base)) {
+        debugWarning("Could not start the transfer workers, transferring serially\n");
+        m_parallel_receive = false;
+        m_parallel_transmit = false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "parallel transfer: receive %s (%u samples), transmit %s (%u samples), %zd workers\n",
+                (m_parallel_receive ? "on" : "off"), receive_samples,
+                (m_parallel_transmit ? "on" : "off"), transmit_samples,
+                m_transfer_threads.size());
+
     return true;
 }
 
@@ -498,6 +726,11 @@ StreamProcessorManager::startDryRunning()
             return false;
         }
         if (!(*it)->isDryRunning()) {
+            if (m_fast_start) {
+                // don't wait for the cycle counter to come by cycle 0
+                (*it)->getParent().get1394Service().getIsoHandlerManager()
+                    .setIsoStartCycleForStream(*it, -1);
+            }
             if(!(*it)->scheduleStartDryRunning(-1)) {
                 debugError("Could not put '%s' SP %p into the dry-running state\n", (*it)->getTypeString(), *it);
                 return false;
@@ -514,6 +747,11 @@ StreamProcessorManager::startDryRunning()
             return false;
         }
         if (!(*it)->isDryRunning()) {
+            if (m_fast_start) {
+                // don't wait for the cycle counter to come by cycle 0
+                (*it)->getParent().get1394Service().getIsoHandlerManager()
+                    .setIsoStartCycleForStream(*it, -1);
+            }
             if(!(*it)->scheduleStartDryRunning(-1)) {
                 debugError("Could not put '%s' SP %p into the dry-running state\n", (*it)->getTypeString(), *it);
                 return false;
@@ -627,7 +865,12 @@ bool StreamProcessorManager::syncStartAll() {
     nb_sync_runs /= 1000;
     nb_sync_runs /= getPeriodSize();
 
-    while(nb_sync_runs--) { // or while not sync-ed?
+    // in fast start mode this is an upper bound, we stop waiting
+    // once the rate of the sync source has settled
+    unsigned int stable_periods = 0;
+    float prev_tpf = m_SyncSource->getTicksPerFrame();
+
+    while(nb_sync_runs--) {
         // check if we were woken up too soon
         uint64_t ticks_at_period = m_SyncSource->getTimeAtPeriod();
         uint64_t ticks_at_period_margin = ticks_at_period + m_sync_delay;
@@ -646,6 +889,20 @@ bool StreamProcessorManager::syncStartAll() {
         now = Util::SystemTimeSource::getCurrentTime();
         debugOutputExtreme(DEBUG_LEVEL_VERBOSE, "POSTWAIT pred: %"PRId64", now: %"PRId64", excess: %"PRId64"\n", pred_system_time_at_xfer, now, now-pred_system_time_at_xfer );
         #endif
+
+        if (m_fast_start) {
+            float cur_tpf = m_SyncSource->getTicksPerFrame();
+            if (fabsf(cur_tpf - prev_tpf) <= cur_tpf * m_fast_start_tolerance) {
+                stable_periods++;
+            } else {
+                stable_periods = 0;
+            }
+            prev_tpf = cur_tpf;
+            if (stable_periods >= m_fast_start_stable_periods) {
+                debugOutput( DEBUG_LEVEL_VERBOSE, " sync source rate settled at %f tpf\n", cur_tpf);
+                break;
+            }
+        }
     }
 
     debugOutput( DEBUG_LEVEL_VERBOSE, "Propagate sync info...\n");
@@ -904,9 +1161,17 @@ StreamProcessorManager::alignReceivedStreams()
     periods_per_align_try /= getPeriodSize();
     debugOutput( DEBUG_LEVEL_VERBOSE, " averaging over %u periods...\n", periods_per_align_try);
 
+    // in fast start mode the averaging ends early once the average
+    // offsets have not changed for a number of periods
+    int avg_offset_frames[nb_rcv_sp];
+    unsigned int nb_averaged;
+    unsigned int stable_periods;
+
     bool aligned = false;
     while (!aligned && cnt--) {
         nb_sync_runs = periods_per_align_try;
+        nb_averaged = 0;
+        stable_periods = 0;
         while(nb_sync_runs) {
             debugOutput( DEBUG_LEVEL_VERY_VERBOSE, " check (%d)...\n", nb_sync_runs);
             if(!waitForPeriod()) {
@@ -933,8 +1198,23 @@ StreamProcessorManager::alignReceivedStreams()
                     diff_between_streams[i] += diff;
                 }
             }
-
+            nb_averaged++;
             nb_sync_runs--;
+
+            if (m_fast_start) {
+                bool stable = true;
+                for ( i = 0; i < nb_rcv_sp; i++) {
+                    StreamProcessor *s = m_ReceiveProcessors.at(i);
+                    int frames = (int)roundf((diff_between_streams[i] / nb_averaged) / s->getTicksPerFrame());
+                    stable &= (nb_averaged > 1 && frames == avg_offset_frames[i]);
+                    avg_offset_frames[i] = frames;
+                }
+                stable_periods = (stable ? stable_periods + 1 : 0);
+                if (stable_periods >= m_fast_start_stable_periods) {
+                    debugOutput( DEBUG_LEVEL_VERBOSE, " offsets stable after %u periods\n", nb_averaged);
+                    break;
+                }
+            }
         }
         // calculate the average offsets
         debugOutput( DEBUG_LEVEL_VERBOSE, " Average offsets:\n");
@@ -945,7 +1225,7 @@ StreamProcessorManager::alignReceivedStreams()
         for ( i = 0; i < nb_rcv_sp; i++) {
             StreamProcessor *s = m_ReceiveProcessors.at(i);
 
-            diff_between_streams[i] /= periods_per_align_try;
+            diff_between_streams[i] /= nb_averaged;
             diff_between_streams_frames[i] = (int)roundf(diff_between_streams[i] / s->getTicksPerFrame());
             debugOutput( DEBUG_LEVEL_VERBOSE, "   avg offset between SyncSP %p and SP %p is %"PRId64" ticks, %d frames...\n", 
                 m_SyncSource, s, diff_between_streams[i], diff_between_streams_frames[i]);
@@ -997,9 +1277,110 @@ StreamProcessorManager::alignReceivedStreams()
     return true;
 }
 
+void
+StreamProcessorManager::getStreamingDevices(std::vector<FFADODevice *> &devices)
+{
+    devices.clear();
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        FFADODevice *dev = &(*it)->getParent();
+        if (std::find(devices.begin(), devices.end(), dev) == devices.end()) {
+            devices.push_back(dev);
+        }
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it ) {
+        FFADODevice *dev = &(*it)->getParent();
+        if (std::find(devices.begin(), devices.end(), dev) == devices.end()) {
+            devices.push_back(dev);
+        }
+    }
+}
+
+/**
+ * Seeds the receive SP DLL's and the cycle timer DLL with the rates
+ * that were saved when the streams of the same devices stopped at the
+ * same sample rate. Implausible rates are ignored.
+ */
+void
+StreamProcessorManager::loadStreamingState()
+{
+    float nominal_tpf = (float)TICKS_PER_SECOND / (float)m_nominal_framerate;
+    float nominal_ctr_rate = (float)TICKS_PER_SECOND / 1000000.0;
+
+    std::vector<FFADODevice *> devices;
+    getStreamingDevices(devices);
+    for ( std::vector<FFADODevice *>::iterator it = devices.begin();
+          it != devices.end();
+          ++it ) {
+        FFADODevice *dev = *it;
+        FFADODevice::StreamingState state;
+        if (!dev->loadStreamingState(m_nominal_framerate, state)) {
+            continue;
+        }
+
+        StreamProcessorVector sps;
+        for ( StreamProcessorVectorIterator it2 = m_ReceiveProcessors.begin();
+              it2 != m_ReceiveProcessors.end();
+              ++it2 ) {
+            if (&(*it2)->getParent() == dev) {
+                sps.push_back(*it2);
+            }
+        }
+        if (sps.size() != state.ticks_per_frame.size()) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "saved state is for %u streams, have %u\n",
+                        (unsigned int)state.ticks_per_frame.size(), (unsigned int)sps.size());
+            continue;
+        }
+        for (unsigned int i = 0; i < sps.size(); i++) {
+            float tpf = state.ticks_per_frame.at(i);
+            if (fabsf(tpf / nominal_tpf - 1.0) < 0.01) {
+                sps.at(i)->setInitialTicksPerFrame(tpf);
+            }
+        }
+        // the cycle timer DLL runs as long as the 1394 service and
+        // converges slowly, only seed it on the first start
+        float ctr_rate = state.cycle_timer_rate;
+        if (!m_cycle_timer_seeded && fabsf(ctr_rate / nominal_ctr_rate - 1.0) < 0.01) {
+            dev->get1394Service().setCycleTimerRate(ctr_rate);
+        }
+    }
+    m_cycle_timer_seeded = true;
+}
+
+void
+StreamProcessorManager::saveStreamingState()
+{
+    std::vector<FFADODevice *> devices;
+    getStreamingDevices(devices);
+    for ( std::vector<FFADODevice *>::iterator it = devices.begin();
+          it != devices.end();
+          ++it ) {
+        FFADODevice *dev = *it;
+        FFADODevice::StreamingState state;
+        state.cycle_timer_rate = dev->get1394Service().getCycleTimerRate();
+        for ( StreamProcessorVectorIterator it2 = m_ReceiveProcessors.begin();
+              it2 != m_ReceiveProcessors.end();
+              ++it2 ) {
+            if (&(*it2)->getParent() == dev) {
+                state.ticks_per_frame.push_back((*it2)->getTicksPerFrame());
+            }
+        }
+        if (!dev->saveStreamingState(m_nominal_framerate, state)) {
+            debugWarning("Could not save the streaming state of device %p\n", dev);
+        }
+    }
+}
+
 bool StreamProcessorManager::start() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Starting Processors...\n");
 
+    if (m_fast_start) {
+        loadStreamingState();
+    }
+
     // start all SP's synchonized
     bool start_result = false;
     for (int ntries=0; ntries < STREAMPROCESSORMANAGER_SYNCSTART_TRIES; ntries++) {
@@ -1036,6 +1417,12 @@ bool StreamProcessorManager::start() {
 bool StreamProcessorManager::stop() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Stopping...\n");
 
+    // the DLL's have converged while running, keep their rates
+    // for the next start
+    if (m_fast_start && m_SyncSource && m_SyncSource->isRunning()) {
+        saveStreamingState();
+    }
+
     debugOutput( DEBUG_LEVEL_VERBOSE, " scheduling stop for all SP's...\n");
     // switch SP's over to the dry-running state
     for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
@@ -1204,25 +1591,19 @@ bool StreamProcessorManager::handleXrun() {
 }
 
 /**
- * @brief Waits until the next period of samples is ready
+ * @brief Sleeps until the predicted time of the next period
  *
- * This function does not return until a full period of samples is (or should be)
- * ready to be transferred.
+ * The time at which the period should be ready is predicted from the
+ * sync source's timestamps. If STREAMPROCESSORMANAGER_ALLOW_DELAYED_PERIOD_SIGNAL
+ * is set, the wait is extended one cycle at a time until all SP's are
+ * ready.
  *
- * @return true if the period is ready, false if not
+ * @param xrun_occurred set when an xrun was detected
+ * @param in_error set when an SP is in error
  */
-bool StreamProcessorManager::waitForPeriod() {
-    if(m_SyncSource == NULL) return false;
-    if(m_shutdown_needed) return false;
-    bool xrun_occurred = false;
-    bool in_error = false;
-
-    // grab the wait lock
-    // this ensures that bus reset handling doesn't interfere
-    Util::MutexLockHelper lock(*m_WaitLock);
-    debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
-                        "waiting for period (%d frames in buffer)...\n",
-                        m_SyncSource->getBufferFill());
+void
+StreamProcessorManager::waitForPeriodPredicted(bool &xrun_occurred, bool &in_error)
+{
     uint64_t ticks_at_period = m_SyncSource->getTimeAtPeriod();
     uint64_t ticks_at_period_margin = ticks_at_period + m_sync_delay;
     uint64_t pred_system_time_at_xfer = m_SyncSource->getParent().get1394Service().getSystemTimeForCycleTimerTicks(ticks_at_period_margin);
@@ -1343,6 +1724,115 @@ bool StreamProcessorManager::waitForPeriod() {
         in_error |= (*it)->inError();
     }
     #endif
+}
+
+/**
+ * @brief Sleeps until the ISO threads signal that all SP's are ready
+ *
+ * The ready mask is cleared and re-armed with the SP's that are already
+ * ready. The ISO threads may set bits concurrently, but since setting a
+ * bit is idempotent nothing gets lost or counted twice. The futex wait
+ * times out once per period to re-check the error conditions, which also
+ * covers a missed wake-up in signalActivity().
+ *
+ * @param xrun_occurred set when an xrun was detected
+ * @param in_error set when an SP is in error
+ */
+void
+StreamProcessorManager::waitForPeriodSignalled(bool &xrun_occurred, bool &in_error)
+{
+    ZERO_ATOMIC(&m_period_ready_mask);
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        if ((*it)->canConsumePeriod()) {
+            OR_ATOMIC(&m_period_ready_mask, (int32_t)(*it)->getPeriodSignalBit());
+        }
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        if ((*it)->canProducePeriod()) {
+            OR_ATOMIC(&m_period_ready_mask, (int32_t)(*it)->getPeriodSignalBit());
+        }
+    }
+
+    // one period worth of time
+    struct timespec timeout;
+    int64_t timeout_nsec = m_activity_wait_timeout_nsec / 2;
+    timeout.tv_sec = timeout_nsec / 1000000000LL;
+    timeout.tv_nsec = timeout_nsec % 1000000000LL;
+
+    INC_ATOMIC(&m_period_waiters);
+    while(true) {
+        int32_t mask = m_period_ready_mask;
+        if ((uint32_t)mask == m_period_ready_mask_all) break;
+
+        // check for underruns/errors on the ISO side,
+        // those should make us bail out of the wait loop
+        checkProcessorErrors(xrun_occurred, in_error);
+        if(xrun_occurred | in_error | m_shutdown_needed) break;
+
+        if (futexWait(&m_period_ready_mask, mask, &timeout) != 0
+            && errno == ETIMEDOUT) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, " wait extended since period not ready (mask 0x%08X)...\n",
+                        (uint32_t)m_period_ready_mask);
+        }
+    }
+    DEC_ATOMIC(&m_period_waiters);
+
+    checkProcessorErrors(xrun_occurred, in_error);
+}
+
+/**
+ * @brief Checks all SP's for xruns and errors on the ISO side
+ *
+ * @param xrun_occurred set when an xrun has occurred
+ * @param in_error set when an SP is in error
+ */
+void
+StreamProcessorManager::checkProcessorErrors(bool &xrun_occurred, bool &in_error)
+{
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+        it != m_ReceiveProcessors.end();
+        ++it ) {
+        xrun_occurred |= (*it)->xrunOccurred();
+        in_error |= (*it)->inError();
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+        it != m_TransmitProcessors.end();
+        ++it ) {
+        xrun_occurred |= (*it)->xrunOccurred();
+        in_error |= (*it)->inError();
+    }
+}
+
+/**
+ * @brief Waits until the next period of samples is ready
+ *
+ * This function does not return until a full period of samples is (or should be)
+ * ready to be transferred.
+ *
+ * @return true if the period is ready, false if not
+ */
+bool StreamProcessorManager::waitForPeriod() {
+    if(m_SyncSource == NULL) return false;
+    if(m_shutdown_needed) return false;
+    bool xrun_occurred = false;
+    bool in_error = false;
+
+    // grab the wait lock
+    // this ensures that bus reset handling doesn't interfere
+    Util::MutexLockHelper lock(*m_WaitLock);
+    debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
+                        "waiting for period (%d frames in buffer)...\n",
+                        m_SyncSource->getBufferFill());
+
+    if (m_period_ready_mask_all) {
+        waitForPeriodSignalled(xrun_occurred, in_error);
+    } else {
+        waitForPeriodPredicted(xrun_occurred, in_error);
+    }
 
     if(xrun_occurred) {
         debugOutput( DEBUG_LEVEL_VERBOSE, "exit due to xrun...\n");
@@ -1429,13 +1919,20 @@ bool StreamProcessorManager::waitForPeriod() {
     m_nbperiods++;
 
     // this is to notify the client of the delay that we introduced by waiting
-    pred_system_time_at_xfer = m_SyncSource->getParent().get1394Service().getSystemTimeForCycleTimerTicks(m_time_of_transfer);
+    uint64_t pred_system_time_at_xfer = m_SyncSource->getParent().get1394Service().getSystemTimeForCycleTimerTicks(m_time_of_transfer);
 
     m_delayed_usecs = Util::SystemTimeSource::getCurrentTime() - pred_system_time_at_xfer;
     debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
                         "delayed for %d usecs...\n",
                         m_delayed_usecs);
 
+    if(!xrun_occurred) {
+        m_latency_stats.mark(Util::LatencyStatistics::eS_PeriodOversleep,
+                             (m_delayed_usecs > 0 ? m_delayed_usecs : 0));
+        m_latency_stats.mark(Util::LatencyStatistics::eS_BufferFill,
+                             m_SyncSource->getBufferFill());
+    }
+
     // now we can signal the client that we are (should be) ready
     return !xrun_occurred;
 }
@@ -1476,42 +1973,213 @@ bool StreamProcessorManager::transfer(enum StreamProcessor::eProcessorType t) {
     // a static cast could make sure that there is no performance
     // penalty for the virtual functions (to be checked)
     if (t==StreamProcessor::ePT_Receive) {
-        for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
-                it != m_ReceiveProcessors.end();
-                ++it ) {
-            if(!(*it)->getFrames(m_period, m_time_of_transfer)) {
-                    debugWarning("could not getFrames(%u, %11"PRIu64") from stream processor (%p)\n",
-                            m_period, m_time_of_transfer,*it);
-                retval &= false; // buffer underrun
+        struct timespec decode_start, decode_end;
+        Util::SystemTimeSource::clockGettime(&decode_start);
+        if (m_parallel_receive) {
+            retval = transferParallel(m_ReceiveProcessors, t, 0.0);
+        } else {
+            for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+                    it != m_ReceiveProcessors.end();
+                    ++it ) {
+                retval &= transferProcessor(*it, t, 0.0);
             }
         }
+        Util::SystemTimeSource::clockGettime(&decode_end);
+        int64_t decode_nsec = (decode_end.tv_sec - decode_start.tv_sec) * 1000000000LL
+                              + (decode_end.tv_nsec - decode_start.tv_nsec);
+        m_latency_stats.mark(Util::LatencyStatistics::eS_DecodeTime,
+                             (decode_nsec > 0xFFFFFFFFLL ? 0xFFFFFFFF : (uint32_t)decode_nsec));
     } else {
         // FIXME: in the SPM it would be nice to have system time instead of
         //        1394 time
         float rate = m_SyncSource->getTicksPerFrame();
 
-        for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
-                it != m_TransmitProcessors.end();
-                ++it ) {
-            // this is the delay in frames between the point where a frame is received and
-            // when it is transmitted again
-            unsigned int one_ringbuffer_in_frames = m_nb_buffers * m_period + (*it)->getExtraBufferFrames();
-            int64_t one_ringbuffer_in_ticks = (int64_t)(((float)one_ringbuffer_in_frames) * rate);
-    
-            // the data we are putting into the buffer is intended to be transmitted
-            // one ringbuffer size after it has been received
-            int64_t transmit_timestamp = addTicks(m_time_of_transfer, one_ringbuffer_in_ticks);
-
-            if(!(*it)->putFrames(m_period, transmit_timestamp)) {
-                debugWarning("could not putFrames(%u,%"PRIu64") to stream processor (%p)\n",
-                        m_period, transmit_timestamp, *it);
-                retval &= false; // buffer underrun
+        if (m_parallel_transmit) {
+            retval = transferParallel(m_TransmitProcessors, t, rate);
+        } else {
+            for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+                    it != m_TransmitProcessors.end();
+                    ++it ) {
+                retval &= transferProcessor(*it, t, rate);
             }
         }
     }
+    if (m_metering) {
+        updatePortMeters(t);
+    }
     return retval;
 }
 
+/**
+ * @brief Transfer one period of frames for one StreamProcessor
+ *
+ * Called from the client thread, or from a transfer worker when the
+ * transfer is done in parallel. Only touches the SP and its own ports.
+ *
+ * @param sp the StreamProcessor
+ * @param t The processor type of the SP
+ * @param ticks_per_frame the rate of the sync source (transmit only)
+ * @return true if successful, false otherwise (indicates xrun).
+ */
+bool StreamProcessorManager::transferProcessor(StreamProcessor *sp,
+                                               enum StreamProcessor::eProcessorType t,
+                                               float ticks_per_frame) {
+    if (t==StreamProcessor::ePT_Receive) {
+        if(!sp->getFrames(m_period, m_time_of_transfer)) {
+                debugWarning("could not getFrames(%u, %11"PRIu64") from stream processor (%p)\n",
+                        m_period, m_time_of_transfer, sp);
+            return false; // buffer underrun
+        }
+    } else {
+        // this is the delay in frames between the point where a frame is received and
+        // when it is transmitted again
+        unsigned int one_ringbuffer_in_frames = m_nb_buffers * m_period + sp->getExtraBufferFrames();
+        int64_t one_ringbuffer_in_ticks = (int64_t)(((float)one_ringbuffer_in_frames) * ticks_per_frame);
+
+        // the data we are putting into the buffer is intended to be transmitted
+        // one ringbuffer size after it has been received
+        int64_t transmit_timestamp = addTicks(m_time_of_transfer, one_ringbuffer_in_ticks);
+
+        if(!sp->putFrames(m_period, transmit_timestamp)) {
+            debugWarning("could not putFrames(%u,%"PRIu64") to stream processor (%p)\n",
+                    m_period, transmit_timestamp, sp);
+            return false; // buffer underrun
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Transfer one period of frames for a set of SP's on the transfer workers
+ *
+ * Publishes the transfer to the workers, takes part in it and waits
+ * until all workers are done with it.
+ *
+ * @return true if successful, false otherwise (indicates xrun).
+ */
+bool StreamProcessorManager::transferParallel(StreamProcessorVector &sps,
+                                              enum StreamProcessor::eProcessorType t,
+                                              float ticks_per_frame) {
+    m_transfer_sps = &sps;
+    m_transfer_type = t;
+    m_transfer_ticks_per_frame = ticks_per_frame;
+    m_transfer_next = 0;
+    m_transfer_failed = 0;
+    m_transfer_busy_workers = m_transfer_threads.size();
+    // the job number bump publishes the job description
+    INC_ATOMIC(&m_transfer_job);
+    futexWake(&m_transfer_job, INT_MAX);
+
+    runTransferJobs();
+
+    // wait until every worker is done with this transfer
+    int32_t busy;
+    while ((busy = m_transfer_busy_workers) != 0) {
+        futexWait(&m_transfer_busy_workers, busy, NULL);
+    }
+    return m_transfer_failed == 0;
+}
+
+/**
+ * @brief Take SP's from the current transfer until there are none left
+ */
+void StreamProcessorManager::runTransferJobs() {
+    unsigned int nb_sps = m_transfer_sps->size();
+    unsigned int idx;
+    while ((idx = INC_ATOMIC(&m_transfer_next)) < nb_sps) {
+        if (!transferProcessor(m_transfer_sps->at(idx), m_transfer_type,
+                               m_transfer_ticks_per_frame)) {
+            m_transfer_failed = 1;
+        }
+    }
+}
+
+bool StreamProcessorManager::startTransferWorkers(unsigned int nb_threads, int cpu_base) {
+    debugOutput(DEBUG_LEVEL_VERBOSE, "starting %u transfer workers...\n", nb_threads);
+    for (unsigned int i = 0; i < nb_threads; i++) {
+        int cpu = (cpu_base >= 0 ? cpu_base + (int)i : -1);
+        TransferWorker *worker = new TransferWorker(*this, i, cpu);
+        worker->setVerboseLevel(getDebugLevel());
+        char name[16];
+        snprintf(name, 16, "SPMXFR%u", i);
+        Util::Thread *thread = new Util::PosixThread(worker, name, m_thread_realtime,
+                                                     m_thread_priority, PTHREAD_CANCEL_DEFERRED);
+        thread->setVerboseLevel(getDebugLevel());
+        m_transfer_workers.push_back(worker);
+        m_transfer_threads.push_back(thread);
+        if (thread->Start() != 0) {
+            debugError("Could not start transfer worker %u\n", i);
+            stopTransferWorkers();
+            return false;
+        }
+    }
+    return true;
+}
+
+void StreamProcessorManager::stopTransferWorkers() {
+    if (m_transfer_threads.empty()) {
+        return;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "stopping %zd transfer workers...\n", m_transfer_threads.size());
+    for (unsigned int i = 0; i < m_transfer_threads.size(); i++) {
+        m_transfer_threads.at(i)->Stop();
+        delete m_transfer_threads.at(i);
+        delete m_transfer_workers.at(i);
+    }
+    m_transfer_threads.clear();
+    m_transfer_workers.clear();
+}
+
+// --- transfer worker
+
+IMPL_DEBUG_MODULE( StreamProcessorManager::TransferWorker, TransferWorker, DEBUG_LEVEL_NORMAL );
+
+StreamProcessorManager::TransferWorker::TransferWorker(StreamProcessorManager &manager,
+                                                       unsigned int index, int cpu)
+    : m_manager( manager )
+    , m_index( index )
+    , m_cpu( cpu )
+    , m_job( manager.m_transfer_job )
+{
+}
+
+bool
+StreamProcessorManager::TransferWorker::Init()
+{
+    if (m_cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_cpu, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err != 0) {
+            debugWarning("(%u) Could not pin to cpu %d: %s\n", m_index, m_cpu, strerror(err));
+        } else {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "(%u) pinned to cpu %d\n", m_index, m_cpu);
+        }
+    }
+    return true;
+}
+
+bool
+StreamProcessorManager::TransferWorker::Execute()
+{
+    int32_t job = m_manager.m_transfer_job;
+    if (job == m_job) {
+        // wake up now and then, Stop() waits for us to return
+        struct timespec timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_nsec = 100 * 1000 * 1000;
+        futexWait(&m_manager.m_transfer_job, job, &timeout);
+        return true;
+    }
+    m_job = job;
+    m_manager.runTransferJobs();
+    if (DEC_ATOMIC(&m_manager.m_transfer_busy_workers) == 1) {
+        futexWake(&m_manager.m_transfer_busy_workers, 1);
+    }
+    return true;
+}
+
 /**
  * @brief Transfer one period of silence for both receive and transmit StreamProcessors
  *
@@ -1610,6 +2278,8 @@ void StreamProcessorManager::dumpInfo() {
         (*it)->dumpInfo();
     }
 
+    m_latency_stats.show();
+
     debugOutputShort( DEBUG_LEVEL_NORMAL, "----------------------------------------------------\n");
 
     // list port info in verbose mode
@@ -1653,6 +2323,8 @@ void StreamProcessorManager::dumpInfo() {
 
 void StreamProcessorManager::setVerboseLevel(int l) {
     if(m_WaitLock) m_WaitLock->setVerboseLevel(l);
+    m_latency_stats.setVerboseLevel(l);
+    m_port_meters.setVerboseLevel(l);
 
     for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
         it != m_ReceiveProcessors.end();
@@ -1664,6 +2336,10 @@ void StreamProcessorManager::setVerboseLevel(int l) {
         ++it ) {
         (*it)->setVerboseLevel(l);
     }
+    for (unsigned int i = 0; i < m_transfer_threads.size(); i++) {
+        m_transfer_threads.at(i)->setVerboseLevel(l);
+        m_transfer_workers.at(i)->setVerboseLevel(l);
+    }
     setDebugLevel(l);
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting verbose level to %d...\n", l );
 }
@@ -1747,6 +2423,69 @@ StreamProcessorManager::updateShadowLists()
             m_PlaybackPorts_shadow.push_back(p);
         }
     }
+    updatePortMeterList();
+}
+
+/**
+ * @brief rebuild the list of metered ports and publish their names
+ */
+void
+StreamProcessorManager::updatePortMeterList()
+{
+    m_metered_ports.clear();
+    m_nb_metered_capture_ports = 0;
+    for ( PortVectorIterator it = m_CapturePorts_shadow.begin();
+          it != m_CapturePorts_shadow.end();
+          ++it ) {
+        if ((*it)->getPortType() == Port::E_Audio) {
+            m_metered_ports.push_back(static_cast<AudioPort *>(*it));
+        }
+    }
+    m_nb_metered_capture_ports = m_metered_ports.size();
+    for ( PortVectorIterator it = m_PlaybackPorts_shadow.begin();
+          it != m_PlaybackPorts_shadow.end();
+          ++it ) {
+        if ((*it)->getPortType() == Port::E_Audio) {
+            m_metered_ports.push_back(static_cast<AudioPort *>(*it));
+        }
+    }
+
+    m_port_meters.beginUpdate();
+    m_port_meters.setNbPorts(m_metered_ports.size());
+    for (unsigned int i = 0; i < m_metered_ports.size(); i++) {
+        AudioPort *p = m_metered_ports.at(i);
+        m_port_meters.setPort(i, p->getName().c_str(),
+                              (p->getDirection() == Port::E_Capture ?
+                               Util::PortMeters::eD_Capture : Util::PortMeters::eD_Playback));
+    }
+    m_port_meters.endUpdate();
+}
+
+/**
+ * @brief publish the meter values of the period that was just transferred
+ */
+void
+StreamProcessorManager::updatePortMeters(enum StreamProcessor::eProcessorType t)
+{
+    unsigned int first, last;
+    if (t == StreamProcessor::ePT_Receive) {
+        first = 0;
+        last = m_nb_metered_capture_ports;
+    } else {
+        first = m_nb_metered_capture_ports;
+        last = m_metered_ports.size();
+    }
+    if (last > PORT_METERS_MAX_PORTS) {
+        last = PORT_METERS_MAX_PORTS;
+    }
+
+    float peak, rms;
+    m_port_meters.beginUpdate();
+    for (unsigned int i = first; i < last; i++) {
+        m_metered_ports.at(i)->takeMeterValues(peak, rms);
+        m_port_meters.setValues(i, peak, rms);
+    }
+    m_port_meters.endUpdate();
 }
 
 Port* StreamProcessorManager::getPortByIndex(int idx, enum Port::E_Direction direction) {
@@ -1774,7 +2513,16 @@ Port* StreamProcessorManager::getPortByIndex(int idx, enum Port::E_Direction dir
 bool StreamProcessorManager::setThreadParameters(bool rt, int priority) {
     m_thread_realtime=rt;
     m_thread_priority=priority;
-    return true;
+    bool retval = true;
+    for (unsigned int i = 0; i < m_transfer_threads.size(); i++) {
+        Util::Thread *thread = m_transfer_threads.at(i);
+        if (rt) {
+            retval &= (thread->AcquireRealTime(priority) == 0);
+        } else {
+            retval &= (thread->DropRealTime() == 0);
+        }
+    }
+    return retval;
 }
 
 
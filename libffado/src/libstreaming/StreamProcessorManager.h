@@ -32,11 +32,14 @@
 #include "libutil/Thread.h"
 #include "libutil/Mutex.h"
 #include "libutil/OptionContainer.h"
+#include "libutil/LatencyStatistics.h"
+#include "libutil/PortMeters.h"
 
 #include <vector>
 #include <semaphore.h>
 
 class DeviceManager;
+class FFADODevice;
 
 namespace Streaming {
 
@@ -79,6 +82,8 @@ public:
     };
     void signalActivity();
     enum eActivityResult waitForActivity();
+    // event-driven period signalling
+    void signalPeriodReady(uint32_t bit);
 
     // this is the setup API
     bool registerProcessor(StreamProcessor *processor); ///< start managing a streamprocessor
@@ -122,15 +127,58 @@ public:
     void unlockWaitLoop() {m_WaitLock->Unlock();};
 
 private:
+    void waitForPeriodPredicted(bool &xrun_occurred, bool &in_error);
+    void waitForPeriodSignalled(bool &xrun_occurred, bool &in_error);
+    void checkProcessorErrors(bool &xrun_occurred, bool &in_error);
+
     bool transferSilence();
     bool transferSilence(enum StreamProcessor::eProcessorType);
 
+    // parallel transfer support
+    bool transferProcessor(StreamProcessor *sp, enum StreamProcessor::eProcessorType t,
+                           float ticks_per_frame);
+    bool transferParallel(StreamProcessorVector &sps, enum StreamProcessor::eProcessorType t,
+                          float ticks_per_frame);
+    void runTransferJobs();
+    bool startTransferWorkers(unsigned int nb_threads, int cpu_base);
+    void stopTransferWorkers();
+
+    // the worker threads of the parallel transfer. The client thread
+    // publishes a transfer by bumping the job number, all workers take
+    // part in every transfer.
+    class TransferWorker : public Util::RunnableInterface
+    {
+    public:
+        TransferWorker(StreamProcessorManager &manager, unsigned int index, int cpu);
+        virtual ~TransferWorker() {};
+
+        bool Init();
+        bool Execute();
+
+        void setVerboseLevel(int l) {setDebugLevel(l);};
+    private:
+        StreamProcessorManager &m_manager;
+        unsigned int m_index;
+        int m_cpu;
+        int32_t m_job;
+
+        DECLARE_DEBUG_MODULE;
+    };
+
     bool alignReceivedStreams();
+
+    // fast start support
+    void getStreamingDevices(std::vector<FFADODevice *> &devices);
+    void loadStreamingState();
+    void saveStreamingState();
 public:
     int getDelayedUsecs() {return m_delayed_usecs;};
     bool xrunOccurred();
     bool shutdownNeeded() {return m_shutdown_needed;};
     int getXrunCount() {return m_xruns;};
+    Util::LatencyStatistics &getLatencyStatistics() {return m_latency_stats;};
+    Util::PortMeters &getPortMeters() {return m_port_meters;};
+    bool isMetering() {return m_metering;};
 
     void setNominalRate(unsigned int r) {m_nominal_framerate = r;};
     unsigned int getNominalRate() {return m_nominal_framerate;};
@@ -180,6 +228,15 @@ protected: // FIXME: private?
     // activity signaling
     sem_t m_activity_semaphore;
 
+    // event-driven period signalling. Each SP owns a bit in the ready
+    // mask, which the ISO threads set once the SP can do a period
+    // transfer. The client thread sleeps on the mask (futex) until all
+    // bits are set. A zero m_period_ready_mask_all means that the
+    // predicted sleep + poll wait is used instead.
+    uint32_t m_period_ready_mask_all;
+    volatile int32_t m_period_ready_mask;
+    volatile int32_t m_period_waiters;
+
     // processor list
     StreamProcessorVector m_ReceiveProcessors;
     StreamProcessorVector m_TransmitProcessors;
@@ -189,6 +246,10 @@ protected: // FIXME: private?
     PortVector m_PlaybackPorts_shadow;
     void updateShadowLists();
 
+    // port meters, in the order of the shadow lists
+    void updatePortMeterList();
+    void updatePortMeters(enum StreamProcessor::eProcessorType t);
+
     unsigned int m_nb_buffers;
     unsigned int m_period;
     unsigned int m_sync_delay;
@@ -203,6 +264,37 @@ protected: // FIXME: private?
 
     signed int m_max_diff_ticks;
 
+    // fast start: seed the DLL's with the rates of the previous session
+    // and end the sync wait and the stream alignment on convergence
+    bool m_fast_start;
+    float m_fast_start_tolerance;
+    unsigned int m_fast_start_stable_periods;
+    bool m_cycle_timer_seeded;
+
+    // parallel transfer: whether a direction is spread over the workers
+    bool m_parallel_receive;
+    bool m_parallel_transmit;
+    std::vector<TransferWorker *> m_transfer_workers;
+    std::vector<Util::Thread *> m_transfer_threads;
+    // the current transfer job, only changed by the client thread
+    // while no worker is busy
+    StreamProcessorVector *m_transfer_sps;
+    enum StreamProcessor::eProcessorType m_transfer_type;
+    float m_transfer_ticks_per_frame;
+    volatile int32_t m_transfer_job;
+    volatile int32_t m_transfer_next;
+    volatile int32_t m_transfer_busy_workers;
+    volatile int32_t m_transfer_failed;
+
+    // always-on timing histograms, also fed by the SP's and ISO threads
+    Util::LatencyStatistics m_latency_stats;
+
+    // per-port meters, the capture ports come first
+    bool m_metering;
+    Util::PortMeters m_port_meters;
+    std::vector<AudioPort *> m_metered_ports;
+    unsigned int m_nb_metered_capture_ports;
+
     DECLARE_DEBUG_MODULE;
 
 };
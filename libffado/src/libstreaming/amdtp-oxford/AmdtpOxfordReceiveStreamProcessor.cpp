@@ -257,7 +257,7 @@ AmdtpOxfordReceiveStreamProcessor::processPacketData(unsigned char *data, unsign
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "Processing data\n");
 
     // put whatever is in the payload buffer at the moment into the timestamped buffer
-    if(m_data_buffer->writeFrames(m_syt_interval, m_payload_buffer, m_last_timestamp)) {
+    if(writeReceivedFrames((quadlet_t *)m_payload_buffer, m_syt_interval)) {
         return eCRV_OK;
     } else {
         return eCRV_XRun;
@@ -0,0 +1,1188 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "AmdtpKernels.h"
+
+#include "debugmodule/debugmodule.h"
+#include "libutil/ByteSwap.h"
+
+#include <cstddef>
+
+#define likely(x)   __builtin_expect((x),1)
+#define unlikely(x) __builtin_expect((x),0)
+
+// 24 bit full scale, as used by the AMDTP stream processors
+#define AMDTP_KERNEL_FLOAT_MULTIPLIER (1.0f * ((1<<23) - 1))
+
+// The SIMD kernels are compiled with function level target attributes
+// such that one binary can carry all of them, independent of the -m
+// flags used for the rest of the library. The actual kernel used is
+// chosen at runtime based on the CPU features.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define AMDTP_KERNELS_X86 1
+#include <immintrin.h>
+#define KERNEL_TARGET_SSE2     __attribute__((target("sse2")))
+#define KERNEL_TARGET_AVX2     __attribute__((target("avx2")))
+#define KERNEL_TARGET_AVX512   __attribute__((target("avx512f,avx512bw")))
+#else
+#define AMDTP_KERNELS_X86 0
+#endif
+
+namespace Streaming {
+namespace AmdtpKernels {
+
+/* --------------------- SCALAR ----------------------- */
+
+static inline uint32_t
+encodeFloatSample(float in)
+{
+#if AMDTP_CLIP_FLOATS
+    // clip directly to the value of a maxed event
+    if(unlikely(in > 1.0)) {
+        return CONDSWAPTOBUS32_CONST(0x407FFFFF);
+    } else if(unlikely(in < -1.0)) {
+        return CONDSWAPTOBUS32_CONST(0x40800001);
+    }
+#endif
+    float v = in * AMDTP_KERNEL_FLOAT_MULTIPLIER;
+    unsigned int tmp = ((int) v);
+    tmp = ( tmp & 0x00FFFFFF ) | 0x40000000;
+    return CondSwapToBus32((quadlet_t)tmp);
+}
+
+static inline uint32_t
+encodeInt24Sample(uint32_t in)
+{
+    return CondSwapToBus32((quadlet_t)((in & 0x00FFFFFF) | 0x40000000));
+}
+
+static inline float
+decodeFloatSample(uint32_t event)
+{
+    const float multiplier = 1.0f / (float)(0x7FFFFF);
+    unsigned int v = CondSwapFromBus32(event) & 0x00FFFFFF;
+    // sign-extend highest bit of 24-bit int
+    int tmp = (int)(v << 8) / 256;
+    return tmp * multiplier;
+}
+
+static inline uint32_t
+decodeInt24Sample(uint32_t event)
+{
+    return CondSwapFromBus32(event) & 0x00FFFFFF;
+}
+
+// The scalar kernels also take care of the remainders of the SIMD
+// kernels, hence the 'first_event' argument.
+static void
+encodeFloatScalarFrom(uint32_t *data, float * const *buffers,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        const float *buffer = buffers[i] + first_event;
+        uint32_t *target_event = data + first_event * dimension + i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            *target_event = encodeFloatSample(*buffer);
+            buffer++;
+            target_event += dimension;
+        }
+    }
+}
+
+static void
+encodeInt24ScalarFrom(uint32_t *data, uint32_t * const *buffers,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        const uint32_t *buffer = buffers[i] + first_event;
+        uint32_t *target_event = data + first_event * dimension + i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            *target_event = encodeInt24Sample(*buffer);
+            buffer++;
+            target_event += dimension;
+        }
+    }
+}
+
+static void
+decodeFloatScalarFrom(const uint32_t *data, float * const *buffers,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        float *buffer = buffers[i] + first_event;
+        const uint32_t *target_event = data + first_event * dimension + i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            *buffer = decodeFloatSample(*target_event);
+            buffer++;
+            target_event += dimension;
+        }
+    }
+}
+
+static void
+decodeInt24ScalarFrom(const uint32_t *data, uint32_t * const *buffers,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        uint32_t *buffer = buffers[i] + first_event;
+        const uint32_t *target_event = data + first_event * dimension + i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            *buffer = decodeInt24Sample(*target_event);
+            buffer++;
+            target_event += dimension;
+        }
+    }
+}
+
+static void
+encodeFloatScalar(uint32_t *data, float * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    encodeFloatScalarFrom(data, buffers, nb_ports, dimension, 0, nevents);
+}
+
+static void
+encodeInt24Scalar(uint32_t *data, uint32_t * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    encodeInt24ScalarFrom(data, buffers, nb_ports, dimension, 0, nevents);
+}
+
+static void
+decodeFloatScalar(const uint32_t *data, float * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    decodeFloatScalarFrom(data, buffers, nb_ports, dimension, 0, nevents);
+}
+
+static void
+decodeInt24Scalar(const uint32_t *data, uint32_t * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    decodeInt24ScalarFrom(data, buffers, nb_ports, dimension, 0, nevents);
+}
+
+// The event decoders convert the audio slots of whole events and keep
+// the layout, the slots after the audio ports are copied unchanged.
+// 'first_port' lets the SIMD kernels hand over the remaining ports.
+static inline void
+decodeEventFloatScalarFrom(const uint32_t *data, uint32_t *target,
+                           unsigned int first_port, unsigned int nb_ports,
+                           unsigned int dimension)
+{
+    unsigned int i;
+    for (i = first_port; i < nb_ports; i++) {
+        ((float *)target)[i] = decodeFloatSample(data[i]);
+    }
+    for (; i < dimension; i++) {
+        target[i] = data[i];
+    }
+}
+
+static inline void
+decodeEventInt24ScalarFrom(const uint32_t *data, uint32_t *target,
+                           unsigned int first_port, unsigned int nb_ports,
+                           unsigned int dimension)
+{
+    unsigned int i;
+    for (i = first_port; i < nb_ports; i++) {
+        target[i] = decodeInt24Sample(data[i]);
+    }
+    for (; i < dimension; i++) {
+        target[i] = data[i];
+    }
+}
+
+static void
+decodeEventsFloatScalar(const uint32_t *data, uint32_t *target,
+                        unsigned int nb_ports, unsigned int dimension,
+                        unsigned int nevents)
+{
+    for (unsigned int j = 0; j < nevents; j++) {
+        decodeEventFloatScalarFrom(data, target, 0, nb_ports, dimension);
+        data += dimension;
+        target += dimension;
+    }
+}
+
+static void
+decodeEventsInt24Scalar(const uint32_t *data, uint32_t *target,
+                        unsigned int nb_ports, unsigned int dimension,
+                        unsigned int nevents)
+{
+    for (unsigned int j = 0; j < nevents; j++) {
+        decodeEventInt24ScalarFrom(data, target, 0, nb_ports, dimension);
+        data += dimension;
+        target += dimension;
+    }
+}
+
+static void
+demuxScalarFrom(const uint32_t *data, uint32_t * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        uint32_t *buffer = buffers[i] + first_event;
+        const uint32_t *source_event = data + first_event * dimension + i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            *buffer = *source_event;
+            buffer++;
+            source_event += dimension;
+        }
+    }
+}
+
+static void
+demuxScalar(const uint32_t *data, uint32_t * const *buffers,
+            unsigned int nb_ports, unsigned int dimension,
+            unsigned int nevents)
+{
+    demuxScalarFrom(data, buffers, nb_ports, dimension, 0, nevents);
+}
+
+// The meter kernels return the peak and the sum of squares of the
+// samples per port, scaled to a full scale of 1.0
+static inline float
+meterInt24Sample(uint32_t in)
+{
+    const float multiplier = 1.0f / (float)(0x7FFFFF);
+    // sign-extend highest bit of 24-bit int
+    int tmp = (int)(in << 8) / 256;
+    return tmp * multiplier;
+}
+
+static void
+meterFloatScalarFrom(const float *buffer, unsigned int first_event,
+                     unsigned int nevents, float *peak, float *sum_sq)
+{
+    float p = *peak;
+    float s = *sum_sq;
+    for (unsigned int j = first_event; j < nevents; j++) {
+        float v = buffer[j];
+        float a = (v < 0.0f ? -v : v);
+        if (a > p) p = a;
+        s += v * v;
+    }
+    *peak = p;
+    *sum_sq = s;
+}
+
+static void
+meterInt24ScalarFrom(const uint32_t *buffer, unsigned int first_event,
+                     unsigned int nevents, float *peak, float *sum_sq)
+{
+    float p = *peak;
+    float s = *sum_sq;
+    for (unsigned int j = first_event; j < nevents; j++) {
+        float v = meterInt24Sample(buffer[j]);
+        float a = (v < 0.0f ? -v : v);
+        if (a > p) p = a;
+        s += v * v;
+    }
+    *peak = p;
+    *sum_sq = s;
+}
+
+static void
+meterFloatScalar(const float * const *buffers, unsigned int nb_ports,
+                 unsigned int nevents, float *peaks, float *sum_sqs)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        peaks[i] = 0.0f;
+        sum_sqs[i] = 0.0f;
+        meterFloatScalarFrom(buffers[i], 0, nevents, &peaks[i], &sum_sqs[i]);
+    }
+}
+
+static void
+meterInt24Scalar(const uint32_t * const *buffers, unsigned int nb_ports,
+                 unsigned int nevents, float *peaks, float *sum_sqs)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        peaks[i] = 0.0f;
+        sum_sqs[i] = 0.0f;
+        meterInt24ScalarFrom(buffers[i], 0, nevents, &peaks[i], &sum_sqs[i]);
+    }
+}
+
+#if AMDTP_KERNELS_X86
+
+/* --------------------- SSE2 ----------------------- */
+// Blocks of 4 ports x 4 events are loaded from the port buffers,
+// converted as a whole and then transposed into 4 events. The
+// remaining ports and events are done by the scalar code.
+
+KERNEL_TARGET_SSE2 static inline __m128i
+bswapSSE2(__m128i v)
+{
+    // SSE is always little endian, the bus is big endian
+    v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+    return _mm_or_si128( _mm_slli_epi32( v, 16 ), _mm_srli_epi32( v, 16 ) );
+}
+
+KERNEL_TARGET_SSE2 static inline void
+transpose4x4SSE2(__m128i r[4])
+{
+    __m128 r0 = _mm_castsi128_ps(r[0]);
+    __m128 r1 = _mm_castsi128_ps(r[1]);
+    __m128 r2 = _mm_castsi128_ps(r[2]);
+    __m128 r3 = _mm_castsi128_ps(r[3]);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    r[0] = _mm_castps_si128(r0);
+    r[1] = _mm_castps_si128(r1);
+    r[2] = _mm_castps_si128(r2);
+    r[3] = _mm_castps_si128(r3);
+}
+
+KERNEL_TARGET_SSE2 static void
+encodeFloatSSE2(uint32_t *data, float * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m128i label = _mm_set1_epi32(0x40000000);
+    const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128 mult = _mm_set1_ps(AMDTP_KERNEL_FLOAT_MULTIPLIER);
+#if AMDTP_CLIP_FLOATS
+    const __m128 v_max = _mm_set1_ps(1.0);
+    const __m128 v_min = _mm_set1_ps(-1.0);
+#endif
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                __m128 v_float = _mm_loadu_ps(buffers[i+k] + j);
+#if AMDTP_CLIP_FLOATS
+                v_float = _mm_max_ps(v_float, v_min);
+                v_float = _mm_min_ps(v_float, v_max);
+#endif
+                v_float = _mm_mul_ps(v_float, mult);
+                __m128i v_int = _mm_cvttps_epi32(v_float);
+                v_int = _mm_and_si128(v_int, mask);
+                v_int = _mm_or_si128(v_int, label);
+                r[k] = bswapSSE2(v_int);
+            }
+            transpose4x4SSE2(r);
+            for (k = 0; k < 4; k++) {
+                _mm_storeu_si128((__m128i *)(data + (j+k) * dimension + i), r[k]);
+            }
+        }
+        encodeFloatScalarFrom(data + i, buffers + i, 4, dimension, j, nevents);
+    }
+    encodeFloatScalarFrom(data + i, buffers + i, nb_ports - i, dimension, 0, nevents);
+}
+
+KERNEL_TARGET_SSE2 static void
+encodeInt24SSE2(uint32_t *data, uint32_t * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m128i label = _mm_set1_epi32(0x40000000);
+    const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                __m128i v_int = _mm_loadu_si128((const __m128i *)(buffers[i+k] + j));
+                v_int = _mm_and_si128(v_int, mask);
+                v_int = _mm_or_si128(v_int, label);
+                r[k] = bswapSSE2(v_int);
+            }
+            transpose4x4SSE2(r);
+            for (k = 0; k < 4; k++) {
+                _mm_storeu_si128((__m128i *)(data + (j+k) * dimension + i), r[k]);
+            }
+        }
+        encodeInt24ScalarFrom(data + i, buffers + i, 4, dimension, j, nevents);
+    }
+    encodeInt24ScalarFrom(data + i, buffers + i, nb_ports - i, dimension, 0, nevents);
+}
+
+KERNEL_TARGET_SSE2 static void
+decodeFloatSSE2(const uint32_t *data, float * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m128 mult = _mm_set1_ps(1.0f / (float)(0x7FFFFF));
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                r[k] = _mm_loadu_si128((const __m128i *)(data + (j+k) * dimension + i));
+            }
+            transpose4x4SSE2(r);
+            for (k = 0; k < 4; k++) {
+                __m128i v_int = bswapSSE2(r[k]);
+                // sign-extend highest bit of 24-bit int
+                v_int = _mm_srai_epi32(_mm_slli_epi32(v_int, 8), 8);
+                __m128 v_float = _mm_mul_ps(_mm_cvtepi32_ps(v_int), mult);
+                _mm_storeu_ps(buffers[i+k] + j, v_float);
+            }
+        }
+        decodeFloatScalarFrom(data + i, buffers + i, 4, dimension, j, nevents);
+    }
+    decodeFloatScalarFrom(data + i, buffers + i, nb_ports - i, dimension, 0, nevents);
+}
+
+KERNEL_TARGET_SSE2 static void
+decodeInt24SSE2(const uint32_t *data, uint32_t * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                r[k] = _mm_loadu_si128((const __m128i *)(data + (j+k) * dimension + i));
+            }
+            transpose4x4SSE2(r);
+            for (k = 0; k < 4; k++) {
+                __m128i v_int = _mm_and_si128(bswapSSE2(r[k]), mask);
+                _mm_storeu_si128((__m128i *)(buffers[i+k] + j), v_int);
+            }
+        }
+        decodeInt24ScalarFrom(data + i, buffers + i, 4, dimension, j, nevents);
+    }
+    decodeInt24ScalarFrom(data + i, buffers + i, nb_ports - i, dimension, 0, nevents);
+}
+
+// The event decoders convert 4 ports of an event at a time, the
+// demultiplexer moves 4 ports x 4 events like the decoders above.
+KERNEL_TARGET_SSE2 static void
+decodeEventsFloatSSE2(const uint32_t *data, uint32_t *target,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int nevents)
+{
+    const __m128 mult = _mm_set1_ps(1.0f / (float)(0x7FFFFF));
+    unsigned int i, j;
+
+    for (j = 0; j < nevents; j++) {
+        for (i = 0; i + 4 <= nb_ports; i += 4) {
+            __m128i v_int = bswapSSE2(_mm_loadu_si128((const __m128i *)(data + i)));
+            // sign-extend highest bit of 24-bit int
+            v_int = _mm_srai_epi32(_mm_slli_epi32(v_int, 8), 8);
+            __m128 v_float = _mm_mul_ps(_mm_cvtepi32_ps(v_int), mult);
+            _mm_storeu_ps((float *)(target + i), v_float);
+        }
+        decodeEventFloatScalarFrom(data, target, i, nb_ports, dimension);
+        data += dimension;
+        target += dimension;
+    }
+}
+
+KERNEL_TARGET_SSE2 static void
+decodeEventsInt24SSE2(const uint32_t *data, uint32_t *target,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int nevents)
+{
+    const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    unsigned int i, j;
+
+    for (j = 0; j < nevents; j++) {
+        for (i = 0; i + 4 <= nb_ports; i += 4) {
+            __m128i v_int = bswapSSE2(_mm_loadu_si128((const __m128i *)(data + i)));
+            _mm_storeu_si128((__m128i *)(target + i), _mm_and_si128(v_int, mask));
+        }
+        decodeEventInt24ScalarFrom(data, target, i, nb_ports, dimension);
+        data += dimension;
+        target += dimension;
+    }
+}
+
+KERNEL_TARGET_SSE2 static void
+demuxSSE2(const uint32_t *data, uint32_t * const *buffers,
+          unsigned int nb_ports, unsigned int dimension,
+          unsigned int nevents)
+{
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                r[k] = _mm_loadu_si128((const __m128i *)(data + (j+k) * dimension + i));
+            }
+            transpose4x4SSE2(r);
+            for (k = 0; k < 4; k++) {
+                _mm_storeu_si128((__m128i *)(buffers[i+k] + j), r[k]);
+            }
+        }
+        demuxScalarFrom(data + i, buffers + i, 4, dimension, j, nevents);
+    }
+    demuxScalarFrom(data + i, buffers + i, nb_ports - i, dimension, 0, nevents);
+}
+
+// The meters run along the port buffers, 4 events at a time, and
+// reduce the vectors once per port.
+KERNEL_TARGET_SSE2 static inline void
+meterReduceSSE2(__m128 peak, __m128 sum_sq, float *peak_out, float *sum_sq_out)
+{
+    peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1,0,3,2)));
+    peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(2,3,0,1)));
+    sum_sq = _mm_add_ps(sum_sq, _mm_shuffle_ps(sum_sq, sum_sq, _MM_SHUFFLE(1,0,3,2)));
+    sum_sq = _mm_add_ps(sum_sq, _mm_shuffle_ps(sum_sq, sum_sq, _MM_SHUFFLE(2,3,0,1)));
+    _mm_store_ss(peak_out, peak);
+    _mm_store_ss(sum_sq_out, sum_sq);
+}
+
+KERNEL_TARGET_SSE2 static void
+meterFloatSSE2(const float * const *buffers, unsigned int nb_ports,
+               unsigned int nevents, float *peaks, float *sum_sqs)
+{
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    unsigned int i, j;
+
+    for (i = 0; i < nb_ports; i++) {
+        const float *buffer = buffers[i];
+        __m128 peak = _mm_setzero_ps();
+        __m128 sum_sq = _mm_setzero_ps();
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            __m128 v = _mm_loadu_ps(buffer + j);
+            peak = _mm_max_ps(peak, _mm_and_ps(v, abs_mask));
+            sum_sq = _mm_add_ps(sum_sq, _mm_mul_ps(v, v));
+        }
+        meterReduceSSE2(peak, sum_sq, &peaks[i], &sum_sqs[i]);
+        meterFloatScalarFrom(buffer, j, nevents, &peaks[i], &sum_sqs[i]);
+    }
+}
+
+KERNEL_TARGET_SSE2 static void
+meterInt24SSE2(const uint32_t * const *buffers, unsigned int nb_ports,
+               unsigned int nevents, float *peaks, float *sum_sqs)
+{
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 mult = _mm_set1_ps(1.0f / (float)(0x7FFFFF));
+    unsigned int i, j;
+
+    for (i = 0; i < nb_ports; i++) {
+        const uint32_t *buffer = buffers[i];
+        __m128 peak = _mm_setzero_ps();
+        __m128 sum_sq = _mm_setzero_ps();
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            __m128i v_int = _mm_loadu_si128((const __m128i *)(buffer + j));
+            // sign-extend highest bit of 24-bit int
+            v_int = _mm_srai_epi32(_mm_slli_epi32(v_int, 8), 8);
+            __m128 v = _mm_mul_ps(_mm_cvtepi32_ps(v_int), mult);
+            peak = _mm_max_ps(peak, _mm_and_ps(v, abs_mask));
+            sum_sq = _mm_add_ps(sum_sq, _mm_mul_ps(v, v));
+        }
+        meterReduceSSE2(peak, sum_sq, &peaks[i], &sum_sqs[i]);
+        meterInt24ScalarFrom(buffer, j, nevents, &peaks[i], &sum_sqs[i]);
+    }
+}
+
+/* --------------------- AVX2 ----------------------- */
+// Same scheme as SSE2, but on 8 ports x 8 events. Remaining ports are
+// handed to the SSE2 kernel.
+
+KERNEL_TARGET_AVX2 static inline __m256i
+bswapAVX2(__m256i v)
+{
+    const __m256i shuf = _mm256_set_epi8(12, 13, 14, 15,  8,  9, 10, 11,
+                                          4,  5,  6,  7,  0,  1,  2,  3,
+                                         12, 13, 14, 15,  8,  9, 10, 11,
+                                          4,  5,  6,  7,  0,  1,  2,  3);
+    return _mm256_shuffle_epi8(v, shuf);
+}
+
+KERNEL_TARGET_AVX2 static inline void
+transpose8x8AVX2(__m256i r[8])
+{
+    __m256 t0, t1, t2, t3, t4, t5, t6, t7;
+    __m256 u0, u1, u2, u3, u4, u5, u6, u7;
+
+    t0 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[0]), _mm256_castsi256_ps(r[1]));
+    t1 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[0]), _mm256_castsi256_ps(r[1]));
+    t2 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[2]), _mm256_castsi256_ps(r[3]));
+    t3 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[2]), _mm256_castsi256_ps(r[3]));
+    t4 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[4]), _mm256_castsi256_ps(r[5]));
+    t5 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[4]), _mm256_castsi256_ps(r[5]));
+    t6 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[6]), _mm256_castsi256_ps(r[7]));
+    t7 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[6]), _mm256_castsi256_ps(r[7]));
+
+    u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+    u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+    u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+    u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+    u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1,0,1,0));
+    u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3,2,3,2));
+    u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1,0,1,0));
+    u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3,2,3,2));
+
+    r[0] = _mm256_castps_si256(_mm256_permute2f128_ps(u0, u4, 0x20));
+    r[1] = _mm256_castps_si256(_mm256_permute2f128_ps(u1, u5, 0x20));
+    r[2] = _mm256_castps_si256(_mm256_permute2f128_ps(u2, u6, 0x20));
+    r[3] = _mm256_castps_si256(_mm256_permute2f128_ps(u3, u7, 0x20));
+    r[4] = _mm256_castps_si256(_mm256_permute2f128_ps(u0, u4, 0x31));
+    r[5] = _mm256_castps_si256(_mm256_permute2f128_ps(u1, u5, 0x31));
+    r[6] = _mm256_castps_si256(_mm256_permute2f128_ps(u2, u6, 0x31));
+    r[7] = _mm256_castps_si256(_mm256_permute2f128_ps(u3, u7, 0x31));
+}
+
+KERNEL_TARGET_AVX2 static void
+encodeFloatAVX2(uint32_t *data, float * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m256i label = _mm256_set1_epi32(0x40000000);
+    const __m256i mask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256 mult = _mm256_set1_ps(AMDTP_KERNEL_FLOAT_MULTIPLIER);
+#if AMDTP_CLIP_FLOATS
+    const __m256 v_max = _mm256_set1_ps(1.0);
+    const __m256 v_min = _mm256_set1_ps(-1.0);
+#endif
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                __m256 v_float = _mm256_loadu_ps(buffers[i+k] + j);
+#if AMDTP_CLIP_FLOATS
+                v_float = _mm256_max_ps(v_float, v_min);
+                v_float = _mm256_min_ps(v_float, v_max);
+#endif
+                v_float = _mm256_mul_ps(v_float, mult);
+                __m256i v_int = _mm256_cvttps_epi32(v_float);
+                v_int = _mm256_and_si256(v_int, mask);
+                v_int = _mm256_or_si256(v_int, label);
+                r[k] = bswapAVX2(v_int);
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                _mm256_storeu_si256((__m256i *)(data + (j+k) * dimension + i), r[k]);
+            }
+        }
+        encodeFloatScalarFrom(data + i, buffers + i, 8, dimension, j, nevents);
+    }
+    encodeFloatSSE2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+KERNEL_TARGET_AVX2 static void
+encodeInt24AVX2(uint32_t *data, uint32_t * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m256i label = _mm256_set1_epi32(0x40000000);
+    const __m256i mask = _mm256_set1_epi32(0x00FFFFFF);
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                __m256i v_int = _mm256_loadu_si256((const __m256i *)(buffers[i+k] + j));
+                v_int = _mm256_and_si256(v_int, mask);
+                v_int = _mm256_or_si256(v_int, label);
+                r[k] = bswapAVX2(v_int);
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                _mm256_storeu_si256((__m256i *)(data + (j+k) * dimension + i), r[k]);
+            }
+        }
+        encodeInt24ScalarFrom(data + i, buffers + i, 8, dimension, j, nevents);
+    }
+    encodeInt24SSE2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+KERNEL_TARGET_AVX2 static void
+decodeFloatAVX2(const uint32_t *data, float * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m256 mult = _mm256_set1_ps(1.0f / (float)(0x7FFFFF));
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                r[k] = _mm256_loadu_si256((const __m256i *)(data + (j+k) * dimension + i));
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                __m256i v_int = bswapAVX2(r[k]);
+                // sign-extend highest bit of 24-bit int
+                v_int = _mm256_srai_epi32(_mm256_slli_epi32(v_int, 8), 8);
+                __m256 v_float = _mm256_mul_ps(_mm256_cvtepi32_ps(v_int), mult);
+                _mm256_storeu_ps(buffers[i+k] + j, v_float);
+            }
+        }
+        decodeFloatScalarFrom(data + i, buffers + i, 8, dimension, j, nevents);
+    }
+    decodeFloatSSE2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+KERNEL_TARGET_AVX2 static void
+decodeInt24AVX2(const uint32_t *data, uint32_t * const *buffers,
+                unsigned int nb_ports, unsigned int dimension,
+                unsigned int nevents)
+{
+    const __m256i mask = _mm256_set1_epi32(0x00FFFFFF);
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                r[k] = _mm256_loadu_si256((const __m256i *)(data + (j+k) * dimension + i));
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                __m256i v_int = _mm256_and_si256(bswapAVX2(r[k]), mask);
+                _mm256_storeu_si256((__m256i *)(buffers[i+k] + j), v_int);
+            }
+        }
+        decodeInt24ScalarFrom(data + i, buffers + i, 8, dimension, j, nevents);
+    }
+    decodeInt24SSE2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+// 8 ports of an event at a time, the remaining ports are handed to the
+// SSE2 code
+KERNEL_TARGET_AVX2 static void
+decodeEventsFloatAVX2(const uint32_t *data, uint32_t *target,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int nevents)
+{
+    const __m256 mult = _mm256_set1_ps(1.0f / (float)(0x7FFFFF));
+    const __m128 mult_sse = _mm_set1_ps(1.0f / (float)(0x7FFFFF));
+    unsigned int i, j;
+
+    for (j = 0; j < nevents; j++) {
+        for (i = 0; i + 8 <= nb_ports; i += 8) {
+            __m256i v_int = bswapAVX2(_mm256_loadu_si256((const __m256i *)(data + i)));
+            // sign-extend highest bit of 24-bit int
+            v_int = _mm256_srai_epi32(_mm256_slli_epi32(v_int, 8), 8);
+            __m256 v_float = _mm256_mul_ps(_mm256_cvtepi32_ps(v_int), mult);
+            _mm256_storeu_ps((float *)(target + i), v_float);
+        }
+        for (; i + 4 <= nb_ports; i += 4) {
+            __m128i v_int = bswapSSE2(_mm_loadu_si128((const __m128i *)(data + i)));
+            v_int = _mm_srai_epi32(_mm_slli_epi32(v_int, 8), 8);
+            __m128 v_float = _mm_mul_ps(_mm_cvtepi32_ps(v_int), mult_sse);
+            _mm_storeu_ps((float *)(target + i), v_float);
+        }
+        decodeEventFloatScalarFrom(data, target, i, nb_ports, dimension);
+        data += dimension;
+        target += dimension;
+    }
+}
+
+KERNEL_TARGET_AVX2 static void
+decodeEventsInt24AVX2(const uint32_t *data, uint32_t *target,
+                      unsigned int nb_ports, unsigned int dimension,
+                      unsigned int nevents)
+{
+    const __m256i mask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m128i mask_sse = _mm_set1_epi32(0x00FFFFFF);
+    unsigned int i, j;
+
+    for (j = 0; j < nevents; j++) {
+        for (i = 0; i + 8 <= nb_ports; i += 8) {
+            __m256i v_int = bswapAVX2(_mm256_loadu_si256((const __m256i *)(data + i)));
+            _mm256_storeu_si256((__m256i *)(target + i), _mm256_and_si256(v_int, mask));
+        }
+        for (; i + 4 <= nb_ports; i += 4) {
+            __m128i v_int = bswapSSE2(_mm_loadu_si128((const __m128i *)(data + i)));
+            _mm_storeu_si128((__m128i *)(target + i), _mm_and_si128(v_int, mask_sse));
+        }
+        decodeEventInt24ScalarFrom(data, target, i, nb_ports, dimension);
+        data += dimension;
+        target += dimension;
+    }
+}
+
+KERNEL_TARGET_AVX2 static void
+demuxAVX2(const uint32_t *data, uint32_t * const *buffers,
+          unsigned int nb_ports, unsigned int dimension,
+          unsigned int nevents)
+{
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                r[k] = _mm256_loadu_si256((const __m256i *)(data + (j+k) * dimension + i));
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                _mm256_storeu_si256((__m256i *)(buffers[i+k] + j), r[k]);
+            }
+        }
+        demuxScalarFrom(data + i, buffers + i, 8, dimension, j, nevents);
+    }
+    demuxSSE2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+// 8 events at a time
+KERNEL_TARGET_AVX2 static void
+meterFloatAVX2(const float * const *buffers, unsigned int nb_ports,
+               unsigned int nevents, float *peaks, float *sum_sqs)
+{
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    unsigned int i, j;
+
+    for (i = 0; i < nb_ports; i++) {
+        const float *buffer = buffers[i];
+        __m256 peak = _mm256_setzero_ps();
+        __m256 sum_sq = _mm256_setzero_ps();
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            __m256 v = _mm256_loadu_ps(buffer + j);
+            peak = _mm256_max_ps(peak, _mm256_and_ps(v, abs_mask));
+            sum_sq = _mm256_add_ps(sum_sq, _mm256_mul_ps(v, v));
+        }
+        meterReduceSSE2(_mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1)),
+                        _mm_add_ps(_mm256_castps256_ps128(sum_sq), _mm256_extractf128_ps(sum_sq, 1)),
+                        &peaks[i], &sum_sqs[i]);
+        meterFloatScalarFrom(buffer, j, nevents, &peaks[i], &sum_sqs[i]);
+    }
+}
+
+KERNEL_TARGET_AVX2 static void
+meterInt24AVX2(const uint32_t * const *buffers, unsigned int nb_ports,
+               unsigned int nevents, float *peaks, float *sum_sqs)
+{
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 mult = _mm256_set1_ps(1.0f / (float)(0x7FFFFF));
+    unsigned int i, j;
+
+    for (i = 0; i < nb_ports; i++) {
+        const uint32_t *buffer = buffers[i];
+        __m256 peak = _mm256_setzero_ps();
+        __m256 sum_sq = _mm256_setzero_ps();
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            __m256i v_int = _mm256_loadu_si256((const __m256i *)(buffer + j));
+            // sign-extend highest bit of 24-bit int
+            v_int = _mm256_srai_epi32(_mm256_slli_epi32(v_int, 8), 8);
+            __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(v_int), mult);
+            peak = _mm256_max_ps(peak, _mm256_and_ps(v, abs_mask));
+            sum_sq = _mm256_add_ps(sum_sq, _mm256_mul_ps(v, v));
+        }
+        meterReduceSSE2(_mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1)),
+                        _mm_add_ps(_mm256_castps256_ps128(sum_sq), _mm256_extractf128_ps(sum_sq, 1)),
+                        &peaks[i], &sum_sqs[i]);
+        meterInt24ScalarFrom(buffer, j, nevents, &peaks[i], &sum_sqs[i]);
+    }
+}
+
+/* --------------------- AVX-512 ----------------------- */
+// 16 ports x 16 events per block. Remaining ports are handed to the
+// AVX2 kernel. The meters are bound by the memory bandwidth, the
+// AVX2 ones are used.
+
+KERNEL_TARGET_AVX512 static inline __m512i
+bswapAVX512(__m512i v)
+{
+    const __m512i shuf = _mm512_set4_epi32(0x0C0D0E0F, 0x08090A0B,
+                                           0x04050607, 0x00010203);
+    return _mm512_shuffle_epi8(v, shuf);
+}
+
+KERNEL_TARGET_AVX512 static inline void
+transpose16x16AVX512(__m512i r[16])
+{
+    __m512 t[16], u[16];
+    int k;
+
+    for (k = 0; k < 16; k += 2) {
+        t[k]   = _mm512_unpacklo_ps(_mm512_castsi512_ps(r[k]), _mm512_castsi512_ps(r[k+1]));
+        t[k+1] = _mm512_unpackhi_ps(_mm512_castsi512_ps(r[k]), _mm512_castsi512_ps(r[k+1]));
+    }
+    for (k = 0; k < 16; k += 4) {
+        u[k]   = _mm512_shuffle_ps(t[k],   t[k+2], _MM_SHUFFLE(1,0,1,0));
+        u[k+1] = _mm512_shuffle_ps(t[k],   t[k+2], _MM_SHUFFLE(3,2,3,2));
+        u[k+2] = _mm512_shuffle_ps(t[k+1], t[k+3], _MM_SHUFFLE(1,0,1,0));
+        u[k+3] = _mm512_shuffle_ps(t[k+1], t[k+3], _MM_SHUFFLE(3,2,3,2));
+    }
+    for (k = 0; k < 4; k++) {
+        t[k]      = _mm512_shuffle_f32x4(u[k],     u[k+4],  0x88);
+        t[k+4]    = _mm512_shuffle_f32x4(u[k],     u[k+4],  0xdd);
+        t[k+8]    = _mm512_shuffle_f32x4(u[k+8],   u[k+12], 0x88);
+        t[k+12]   = _mm512_shuffle_f32x4(u[k+8],   u[k+12], 0xdd);
+    }
+    for (k = 0; k < 8; k++) {
+        r[k]   = _mm512_castps_si512(_mm512_shuffle_f32x4(t[k], t[k+8], 0x88));
+        r[k+8] = _mm512_castps_si512(_mm512_shuffle_f32x4(t[k], t[k+8], 0xdd));
+    }
+}
+
+KERNEL_TARGET_AVX512 static void
+encodeFloatAVX512(uint32_t *data, float * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    const __m512i label = _mm512_set1_epi32(0x40000000);
+    const __m512i mask = _mm512_set1_epi32(0x00FFFFFF);
+    const __m512 mult = _mm512_set1_ps(AMDTP_KERNEL_FLOAT_MULTIPLIER);
+#if AMDTP_CLIP_FLOATS
+    const __m512 v_max = _mm512_set1_ps(1.0);
+    const __m512 v_min = _mm512_set1_ps(-1.0);
+#endif
+    unsigned int i, j, k;
+    __m512i r[16];
+
+    for (i = 0; i + 16 <= nb_ports; i += 16) {
+        for (j = 0; j + 16 <= nevents; j += 16) {
+            for (k = 0; k < 16; k++) {
+                __m512 v_float = _mm512_loadu_ps(buffers[i+k] + j);
+#if AMDTP_CLIP_FLOATS
+                v_float = _mm512_max_ps(v_float, v_min);
+                v_float = _mm512_min_ps(v_float, v_max);
+#endif
+                v_float = _mm512_mul_ps(v_float, mult);
+                __m512i v_int = _mm512_cvttps_epi32(v_float);
+                v_int = _mm512_and_si512(v_int, mask);
+                v_int = _mm512_or_si512(v_int, label);
+                r[k] = bswapAVX512(v_int);
+            }
+            transpose16x16AVX512(r);
+            for (k = 0; k < 16; k++) {
+                _mm512_storeu_si512((void *)(data + (j+k) * dimension + i), r[k]);
+            }
+        }
+        encodeFloatScalarFrom(data + i, buffers + i, 16, dimension, j, nevents);
+    }
+    encodeFloatAVX2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+KERNEL_TARGET_AVX512 static void
+encodeInt24AVX512(uint32_t *data, uint32_t * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    const __m512i label = _mm512_set1_epi32(0x40000000);
+    const __m512i mask = _mm512_set1_epi32(0x00FFFFFF);
+    unsigned int i, j, k;
+    __m512i r[16];
+
+    for (i = 0; i + 16 <= nb_ports; i += 16) {
+        for (j = 0; j + 16 <= nevents; j += 16) {
+            for (k = 0; k < 16; k++) {
+                __m512i v_int = _mm512_loadu_si512((const void *)(buffers[i+k] + j));
+                v_int = _mm512_and_si512(v_int, mask);
+                v_int = _mm512_or_si512(v_int, label);
+                r[k] = bswapAVX512(v_int);
+            }
+            transpose16x16AVX512(r);
+            for (k = 0; k < 16; k++) {
+                _mm512_storeu_si512((void *)(data + (j+k) * dimension + i), r[k]);
+            }
+        }
+        encodeInt24ScalarFrom(data + i, buffers + i, 16, dimension, j, nevents);
+    }
+    encodeInt24AVX2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+KERNEL_TARGET_AVX512 static void
+decodeFloatAVX512(const uint32_t *data, float * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    const __m512 mult = _mm512_set1_ps(1.0f / (float)(0x7FFFFF));
+    unsigned int i, j, k;
+    __m512i r[16];
+
+    for (i = 0; i + 16 <= nb_ports; i += 16) {
+        for (j = 0; j + 16 <= nevents; j += 16) {
+            for (k = 0; k < 16; k++) {
+                r[k] = _mm512_loadu_si512((const void *)(data + (j+k) * dimension + i));
+            }
+            transpose16x16AVX512(r);
+            for (k = 0; k < 16; k++) {
+                __m512i v_int = bswapAVX512(r[k]);
+                // sign-extend highest bit of 24-bit int
+                v_int = _mm512_srai_epi32(_mm512_slli_epi32(v_int, 8), 8);
+                __m512 v_float = _mm512_mul_ps(_mm512_cvtepi32_ps(v_int), mult);
+                _mm512_storeu_ps(buffers[i+k] + j, v_float);
+            }
+        }
+        decodeFloatScalarFrom(data + i, buffers + i, 16, dimension, j, nevents);
+    }
+    decodeFloatAVX2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+KERNEL_TARGET_AVX512 static void
+decodeInt24AVX512(const uint32_t *data, uint32_t * const *buffers,
+                  unsigned int nb_ports, unsigned int dimension,
+                  unsigned int nevents)
+{
+    const __m512i mask = _mm512_set1_epi32(0x00FFFFFF);
+    unsigned int i, j, k;
+    __m512i r[16];
+
+    for (i = 0; i + 16 <= nb_ports; i += 16) {
+        for (j = 0; j + 16 <= nevents; j += 16) {
+            for (k = 0; k < 16; k++) {
+                r[k] = _mm512_loadu_si512((const void *)(data + (j+k) * dimension + i));
+            }
+            transpose16x16AVX512(r);
+            for (k = 0; k < 16; k++) {
+                __m512i v_int = _mm512_and_si512(bswapAVX512(r[k]), mask);
+                _mm512_storeu_si512((void *)(buffers[i+k] + j), v_int);
+            }
+        }
+        decodeInt24ScalarFrom(data + i, buffers + i, 16, dimension, j, nevents);
+    }
+    decodeInt24AVX2(data + i, buffers + i, nb_ports - i, dimension, nevents);
+}
+
+#endif // AMDTP_KERNELS_X86
+
+/* --------------------- DISPATCH ----------------------- */
+
+static const struct KernelTable kernel_table_scalar = {
+    eKT_Scalar, "scalar",
+    encodeFloatScalar, encodeInt24Scalar,
+    decodeFloatScalar, decodeInt24Scalar,
+    meterFloatScalar, meterInt24Scalar,
+    decodeEventsFloatScalar, decodeEventsInt24Scalar,
+    demuxScalar,
+};
+
+#if AMDTP_KERNELS_X86
+static const struct KernelTable kernel_table_sse2 = {
+    eKT_SSE2, "SSE2",
+    encodeFloatSSE2, encodeInt24SSE2,
+    decodeFloatSSE2, decodeInt24SSE2,
+    meterFloatSSE2, meterInt24SSE2,
+    decodeEventsFloatSSE2, decodeEventsInt24SSE2,
+    demuxSSE2,
+};
+
+static const struct KernelTable kernel_table_avx2 = {
+    eKT_AVX2, "AVX2",
+    encodeFloatAVX2, encodeInt24AVX2,
+    decodeFloatAVX2, decodeInt24AVX2,
+    meterFloatAVX2, meterInt24AVX2,
+    decodeEventsFloatAVX2, decodeEventsInt24AVX2,
+    demuxAVX2,
+};
+
+static const struct KernelTable kernel_table_avx512 = {
+    eKT_AVX512, "AVX-512",
+    encodeFloatAVX512, encodeInt24AVX512,
+    decodeFloatAVX512, decodeInt24AVX512,
+    meterFloatAVX2, meterInt24AVX2,
+    decodeEventsFloatAVX2, decodeEventsInt24AVX2,
+    demuxAVX2,
+};
+#endif
+
+bool
+isSupported(enum eKernelType t)
+{
+    switch(t) {
+        case eKT_Auto:
+        case eKT_Scalar:
+            return true;
+#if AMDTP_KERNELS_X86
+        case eKT_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case eKT_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case eKT_AVX512:
+            return __builtin_cpu_supports("avx512f")
+                   && __builtin_cpu_supports("avx512bw");
+#endif
+        default:
+            return false;
+    }
+}
+
+static const struct KernelTable *
+detectBestKernelTable()
+{
+#if AMDTP_KERNELS_X86
+    __builtin_cpu_init();
+    if (isSupported(eKT_AVX512)) return &kernel_table_avx512;
+    if (isSupported(eKT_AVX2)) return &kernel_table_avx2;
+    if (isSupported(eKT_SSE2)) return &kernel_table_sse2;
+#endif
+    return &kernel_table_scalar;
+}
+
+const struct KernelTable *
+getKernelTable(enum eKernelType t)
+{
+    // function-local static: the CPU is probed only once
+    static const struct KernelTable *best = detectBestKernelTable();
+
+    if (!isSupported(t)) {
+        return NULL;
+    }
+    switch(t) {
+        case eKT_Auto:
+            return best;
+        case eKT_Scalar:
+            return &kernel_table_scalar;
+#if AMDTP_KERNELS_X86
+        case eKT_SSE2:
+            return &kernel_table_sse2;
+        case eKT_AVX2:
+            return &kernel_table_avx2;
+        case eKT_AVX512:
+            return &kernel_table_avx512;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+const char *
+eKernelTypeToString(enum eKernelType t)
+{
+    switch(t) {
+        case eKT_Auto:   return "auto";
+        case eKT_Scalar: return "scalar";
+        case eKT_SSE2:   return "SSE2";
+        case eKT_AVX2:   return "AVX2";
+        case eKT_AVX512: return "AVX-512";
+        default:         return "unknown";
+    }
+}
+
+} // end of namespace AmdtpKernels
+} // end of namespace Streaming
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_AMDTPKERNELS__
+#define __FFADO_AMDTPKERNELS__
+
+#include <stdint.h>
+
+namespace Streaming {
+namespace AmdtpKernels {
+
+/**
+ * The conversion kernels move samples between the per-port client
+ * buffers and the interleaved AM824 events of an AMDTP stream.
+ *
+ * The event block is addressed as data[event * dimension + port], i.e.
+ * port i of event j lives at data + j * dimension + i. All audio ports
+ * are assumed to occupy positions 0..nb_ports-1 of each event, which is
+ * what the AMDTP port cache guarantees.
+ *
+ * Every entry of the buffers array has to point to a valid buffer of at
+ * least nevents samples, already adjusted for the block offset. Callers
+ * substitute a (zeroed) scratch buffer for disabled ports.
+ */
+typedef void (*encode_float_t)(uint32_t *data, float * const *buffers,
+                               unsigned int nb_ports, unsigned int dimension,
+                               unsigned int nevents);
+typedef void (*encode_int24_t)(uint32_t *data, uint32_t * const *buffers,
+                               unsigned int nb_ports, unsigned int dimension,
+                               unsigned int nevents);
+typedef void (*decode_float_t)(const uint32_t *data, float * const *buffers,
+                               unsigned int nb_ports, unsigned int dimension,
+                               unsigned int nevents);
+typedef void (*decode_int24_t)(const uint32_t *data, uint32_t * const *buffers,
+                               unsigned int nb_ports, unsigned int dimension,
+                               unsigned int nevents);
+
+/**
+ * The meter kernels run over the per-port client buffers (nevents
+ * samples each, already adjusted for the block offset) and return the
+ * peak and the sum of squares of each port, scaled to a full scale of
+ * 1.0.
+ */
+typedef void (*meter_float_t)(const float * const *buffers, unsigned int nb_ports,
+                              unsigned int nevents, float *peaks, float *sum_sqs);
+typedef void (*meter_int24_t)(const uint32_t * const *buffers, unsigned int nb_ports,
+                              unsigned int nevents, float *peaks, float *sum_sqs);
+
+/**
+ * The event decoders convert the audio slots of nevents events to the
+ * client format without de-interleaving them: target gets the layout of
+ * data, with float samples stored as their bit pattern. The slots
+ * nb_ports..dimension-1 (e.g. MIDI) are copied unchanged.
+ */
+typedef void (*decode_events_t)(const uint32_t *data, uint32_t *target,
+                                unsigned int nb_ports, unsigned int dimension,
+                                unsigned int nevents);
+
+/**
+ * The demultiplexer moves already converted samples from the events
+ * into the per-port client buffers, with the same addressing as the
+ * decoders.
+ */
+typedef void (*demux_t)(const uint32_t *data, uint32_t * const *buffers,
+                        unsigned int nb_ports, unsigned int dimension,
+                        unsigned int nevents);
+
+enum eKernelType {
+    eKT_Auto    = 0,
+    eKT_Scalar  = 1,
+    eKT_SSE2    = 2,
+    eKT_AVX2    = 3,
+    eKT_AVX512  = 4,
+};
+
+struct KernelTable {
+    enum eKernelType    type;
+    const char *        name;
+    encode_float_t      encodeFloat;
+    encode_int24_t      encodeInt24;
+    decode_float_t      decodeFloat;
+    decode_int24_t      decodeInt24;
+    meter_float_t       meterFloat;
+    meter_int24_t       meterInt24;
+    decode_events_t     decodeEventsFloat;
+    decode_events_t     decodeEventsInt24;
+    demux_t             demux;
+};
+
+/**
+ * @brief check whether a kernel set can be used on this host
+ *
+ * Combines compile-time availability (the SIMD kernels are only built
+ * for x86) with a runtime check of the CPU (and OS) features.
+ *
+ * @param t the kernel type
+ * @return true if the kernels of type t can be used
+ */
+bool isSupported(enum eKernelType t);
+
+/**
+ * @brief get the kernel table for a kernel type
+ *
+ * eKT_Auto returns the fastest kernel set supported by the host. The
+ * CPU detection is done only once.
+ *
+ * @param t the kernel type
+ * @return the kernel table, or NULL if the type is not supported
+ */
+const struct KernelTable *getKernelTable(enum eKernelType t);
+
+const char *eKernelTypeToString(enum eKernelType t);
+
+} // end of namespace AmdtpKernels
+} // end of namespace Streaming
+
+#endif /* __FFADO_AMDTPKERNELS__ */
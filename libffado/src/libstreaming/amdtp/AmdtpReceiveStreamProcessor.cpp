@@ -24,6 +24,7 @@
 
 #include "AmdtpReceiveStreamProcessor.h"
 #include "AmdtpPort.h"
+#include "AmdtpKernels.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -45,7 +46,12 @@ namespace Streaming {
 AmdtpReceiveStreamProcessor::AmdtpReceiveStreamProcessor(FFADODevice &parent, int dimension)
     : StreamProcessor(parent, ePT_Receive)
     , m_dimension( dimension )
+    , m_kernel_type( (enum AmdtpKernels::eKernelType)AMDTP_KERNEL_TYPE )
+    , m_kernels( NULL )
+    , m_decode_on_receive( AMDTP_DECODE_ON_RECEIVE )
+    , m_events_decoded( false )
     , m_nb_audio_ports( 0 )
+    , m_decode_block_events( 0 )
     , m_nb_midi_ports( 0 )
     , mb_head( 0 )
     , mb_tail( 0 )
@@ -79,6 +85,22 @@ bool AmdtpReceiveStreamProcessor::prepareChild() {
         return false;
     }
 
+    m_kernels = AmdtpKernels::getKernelTable(m_kernel_type);
+    if (m_kernels == NULL) {
+        debugWarning("%s kernels not supported on this CPU, using auto-detection\n",
+                     AmdtpKernels::eKernelTypeToString(m_kernel_type));
+        m_kernels = AmdtpKernels::getKernelTable(AmdtpKernels::eKT_Auto);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, " Conversion kernels: %s\n", m_kernels->name);
+
+    m_events_decoded = m_decode_on_receive;
+    debugOutput( DEBUG_LEVEL_VERBOSE, " Decode on receive: %s\n",
+                 (m_events_decoded ? "yes" : "no"));
+    if (m_events_decoded && !initDecodeBuffers()) {
+        debugError("Could not allocate the decode buffers\n");
+        return false;
+    }
+
     return true;
 }
 
@@ -123,18 +145,14 @@ AmdtpReceiveStreamProcessor::processPacketHeader(unsigned char *data, unsigned i
 }
 
 /**
- * extract the data from the packet
- * @pre the IEC61883 packet is valid according to isValidPacket
+ * @brief the number of events (frames) in a data packet
  * @param data 
  * @param length 
- * @param channel 
- * @param tag 
- * @param sy 
- * @param pkt_ctr 
  * @return 
  */
-enum StreamProcessor::eChildReturnValue
-AmdtpReceiveStreamProcessor::processPacketData(unsigned char *data, unsigned int length) {
+unsigned int
+AmdtpReceiveStreamProcessor::getPacketFrames(unsigned char *data, unsigned int length)
+{
     struct iec61883_packet *packet = (struct iec61883_packet *) data;
     assert(packet);
 
@@ -196,6 +214,26 @@ AmdtpReceiveStreamProcessor::processPacketData(unsigned char *data, unsigned int
             nevents=((length / sizeof (quadlet_t)) - 2)/packet->dbs;
 	    break;
         }
+    return nevents;
+}
+
+/**
+ * extract the data from the packet
+ * @pre the IEC61883 packet is valid according to isValidPacket
+ * @param data 
+ * @param length 
+ * @param channel 
+ * @param tag 
+ * @param sy 
+ * @param pkt_ctr 
+ * @return 
+ */
+enum StreamProcessor::eChildReturnValue
+AmdtpReceiveStreamProcessor::processPacketData(unsigned char *data, unsigned int length) {
+    struct iec61883_packet *packet = (struct iec61883_packet *) data;
+    assert(packet);
+
+    unsigned int nevents = getPacketFrames(data, length);
 
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE,
                 "packet->dbs %d calculated dbs %d packet->fdf %02X nevents %d\n",
@@ -229,13 +267,88 @@ AmdtpReceiveStreamProcessor::processPacketData(unsigned char *data, unsigned int
     }
     #endif
 
-    if(m_data_buffer->writeFrames(nevents, (char *)(data+8), m_last_timestamp)) {
+    if(writeReceivedFrames((quadlet_t *)(data+8), nevents)) {
         return eCRV_OK;
     } else {
         return eCRV_XRun;
     }
 }
 
+/**
+ * @brief allocate the buffer for decode-on-receive
+ *
+ * The buffer holds one decoded packet. getMaxPacketSize() limits the
+ * received packets to the nominal number of events.
+ */
+bool
+AmdtpReceiveStreamProcessor::initDecodeBuffers()
+{
+    m_decode_block_events = getNominalFramesPerPacket();
+    if (m_decode_block_events == 0) {
+        return false;
+    }
+    m_decode_events.assign(m_dimension * m_decode_block_events, 0);
+    return true;
+}
+
+/**
+ * @brief put the received events into the buffer
+ *
+ * In decode-on-receive mode the audio samples are decoded while they
+ * are written into the buffer, otherwise the events are copied as-is.
+ * Either way the packet is written at once, with its timestamp.
+ *
+ * @param events the AM824 events
+ * @param nevents number of events
+ * @return true if successful, false on buffer overrun
+ */
+bool
+AmdtpReceiveStreamProcessor::writeReceivedFrames(quadlet_t *events, unsigned int nevents)
+{
+    // a transparent buffer doesn't store the frames
+    if(!m_events_decoded || m_data_buffer->isTransparent()) {
+        return m_data_buffer->writeFrames(nevents, (char *)events, m_last_timestamp);
+    }
+
+    if (nevents > m_decode_block_events) {
+        debugWarning("Packet of %u events exceeds the decode buffer (%u)\n",
+                     nevents, m_decode_block_events);
+        return false;
+    }
+    decodeEventsToHost(events, &m_decode_events[0], nevents);
+    return m_data_buffer->writeFrames(nevents, (char *)&m_decode_events[0], m_last_timestamp);
+}
+
+/**
+ * @brief convert the audio samples of a block of events to host format
+ *
+ * The audio slots are converted to the float or int24 client format by
+ * the event decoder kernels, which keep the layout of the events. The
+ * other slots are copied unchanged.
+ *
+ * @param events the AM824 events
+ * @param target the destination events
+ * @param nevents number of events, at most m_decode_block_events
+ */
+void
+AmdtpReceiveStreamProcessor::decodeEventsToHost(const quadlet_t *events,
+                                                quadlet_t *target,
+                                                unsigned int nevents)
+{
+    assert(nevents <= m_decode_block_events);
+
+    switch(m_StreamProcessorManager.getAudioDataType()) {
+        case StreamProcessorManager::eADT_Int24:
+            m_kernels->decodeEventsInt24(events, target, m_nb_audio_ports,
+                                         m_dimension, nevents);
+            break;
+        case StreamProcessorManager::eADT_Float:
+            m_kernels->decodeEventsFloat(events, target, m_nb_audio_ports,
+                                         m_dimension, nevents);
+            break;
+    }
+}
+
 /***********************************************
  * Encoding/Decoding API                       *
  ***********************************************/
@@ -252,6 +365,16 @@ bool AmdtpReceiveStreamProcessor::processReadBlock(char *data,
     // update the variable parts of the cache
     updatePortCache();
 
+    if (m_events_decoded) {
+        // the samples were decoded on receive
+        demuxAudioPorts((quadlet_t *)data, offset, nevents);
+        if (m_StreamProcessorManager.isMetering()) {
+            meterAudioPorts(nevents);
+        }
+        decodeMidiPorts((quadlet_t *)data, offset, nevents);
+        return true;
+    }
+
     // decode audio data
     switch(m_StreamProcessorManager.getAudioDataType()) {
         case StreamProcessorManager::eADT_Int24:
@@ -261,17 +384,15 @@ bool AmdtpReceiveStreamProcessor::processReadBlock(char *data,
             decodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
             break;
     }
+    if (m_StreamProcessorManager.isMetering()) {
+        meterAudioPorts(nevents);
+    }
 
     // do midi ports
     decodeMidiPorts((quadlet_t *)data, offset, nevents);
     return true;
 }
 
-//#ifdef __SSE2__
-#if 0 // SSE code is not ready yet
-#include <emmintrin.h>
-#warning SSE2 build
-
 /**
  * @brief demux events to all audio ports (int24)
  * @param data 
@@ -283,28 +404,27 @@ AmdtpReceiveStreamProcessor::decodeAudioPortsInt24(quadlet_t *data,
                                                     unsigned int offset,
                                                     unsigned int nevents)
 {
-    unsigned int j;
-    quadlet_t *target_event;
     unsigned int i;
 
+    if (m_nb_audio_ports == 0) return;
+    assert(m_scratch_buffer_size_bytes >= nevents * 4);
+
     for (i = 0; i < m_nb_audio_ports; i++) {
         struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
 #ifdef DEBUG
         assert(nevents + offset <= p.buffer_size );
 #endif
-
         if(p.buffer && p.enabled) {
-            quadlet_t *buffer = (quadlet_t *)(p.buffer);
-            buffer += offset;
-
-            for(j = 0; j < nevents; j += 1) {
-                *(buffer)=(CondSwapFromBus32((*target_event) ) & 0x00FFFFFF);
-                buffer++;
-                target_event+=m_dimension;
-            }
+            m_int24_buffers[i] = ((uint32_t *)p.buffer) + offset;
+        } else {
+            // disabled ports are decoded into the scratch buffer, that
+            // is cheaper than breaking up the port blocks of the kernel
+            m_int24_buffers[i] = (uint32_t *)m_scratch_buffer;
         }
     }
+
+    m_kernels->decodeInt24(data, &m_int24_buffers[0], m_nb_audio_ports,
+                           m_dimension, nevents);
 }
 
 /**
@@ -318,111 +438,101 @@ AmdtpReceiveStreamProcessor::decodeAudioPortsFloat(quadlet_t *data,
                                                     unsigned int offset,
                                                     unsigned int nevents)
 {
-    unsigned int j;
-    quadlet_t *target_event;
     unsigned int i;
-    const float multiplier = 1.0f / (float)(0x7FFFFF);
+
+    if (m_nb_audio_ports == 0) return;
+    assert(m_scratch_buffer_size_bytes >= nevents * 4);
 
     for (i = 0; i < m_nb_audio_ports; i++) {
         struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
 #ifdef DEBUG
         assert(nevents + offset <= p.buffer_size );
 #endif
-
         if(p.buffer && p.enabled) {
-            float *buffer = (float *)(p.buffer);
-            buffer += offset;
-
-            for(j = 0; j < nevents; j += 1) {
-                unsigned int v = CondSwapFromBus32(*target_event) & 0x00FFFFFF;
-                // sign-extend highest bit of 24-bit int
-                int tmp = (int)(v << 8) / 256;
-                *buffer = tmp * multiplier;
-                buffer++;
-                target_event+=m_dimension;
-            }
+            m_float_buffers[i] = ((float *)p.buffer) + offset;
+        } else {
+            // disabled ports are decoded into the scratch buffer, that
+            // is cheaper than breaking up the port blocks of the kernel
+            m_float_buffers[i] = (float *)m_scratch_buffer;
         }
     }
+
+    m_kernels->decodeFloat(data, &m_float_buffers[0], m_nb_audio_ports,
+                           m_dimension, nevents);
 }
 
-#else
 /**
- * @brief demux events to all audio ports (int24)
+ * @brief demux decoded samples to all audio ports
+ *
+ * Used in decode-on-receive mode, where the buffer already holds the
+ * samples in the client format.
+ *
  * @param data 
  * @param offset 
  * @param nevents 
  */
 void
-AmdtpReceiveStreamProcessor::decodeAudioPortsInt24(quadlet_t *data,
-                                                    unsigned int offset,
-                                                    unsigned int nevents)
+AmdtpReceiveStreamProcessor::demuxAudioPorts(quadlet_t *data,
+                                             unsigned int offset,
+                                             unsigned int nevents)
 {
-    unsigned int j;
-    quadlet_t *target_event;
     unsigned int i;
 
+    if (m_nb_audio_ports == 0) return;
+    assert(m_scratch_buffer_size_bytes >= nevents * 4);
+
     for (i = 0; i < m_nb_audio_ports; i++) {
         struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
 #ifdef DEBUG
         assert(nevents + offset <= p.buffer_size );
 #endif
-
         if(p.buffer && p.enabled) {
-            quadlet_t *buffer = (quadlet_t *)(p.buffer);
-            buffer += offset;
-
-            for(j = 0; j < nevents; j += 1) {
-                *(buffer)=(CondSwapFromBus32((*target_event) ) & 0x00FFFFFF);
-                buffer++;
-                target_event+=m_dimension;
-            }
+            m_int24_buffers[i] = ((uint32_t *)p.buffer) + offset;
+        } else {
+            m_int24_buffers[i] = (uint32_t *)m_scratch_buffer;
         }
+        // for the meters
+        m_float_buffers[i] = (float *)m_int24_buffers[i];
     }
+
+    m_kernels->demux(data, &m_int24_buffers[0], m_nb_audio_ports,
+                     m_dimension, nevents);
 }
 
 /**
- * @brief demux events to all audio ports (float)
- * @param data 
- * @param offset 
+ * @brief add the meter values of a block to the audio ports
+ *
+ * Runs over the buffer pointers set up by the decoder, i.e. while the
+ * samples are still in the cache.
+ *
  * @param nevents 
  */
 void
-AmdtpReceiveStreamProcessor::decodeAudioPortsFloat(quadlet_t *data,
-                                                    unsigned int offset,
-                                                    unsigned int nevents)
+AmdtpReceiveStreamProcessor::meterAudioPorts(unsigned int nevents)
 {
-    unsigned int j;
-    quadlet_t *target_event;
     unsigned int i;
-    const float multiplier = 1.0f / (float)(0x7FFFFF);
+
+    if (m_nb_audio_ports == 0) return;
+
+    switch(m_StreamProcessorManager.getAudioDataType()) {
+        case StreamProcessorManager::eADT_Int24:
+            m_kernels->meterInt24(&m_int24_buffers[0], m_nb_audio_ports, nevents,
+                                  &m_meter_peaks[0], &m_meter_sum_sqs[0]);
+            break;
+        case StreamProcessorManager::eADT_Float:
+            m_kernels->meterFloat(&m_float_buffers[0], m_nb_audio_ports, nevents,
+                                  &m_meter_peaks[0], &m_meter_sum_sqs[0]);
+            break;
+    }
 
     for (i = 0; i < m_nb_audio_ports; i++) {
         struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
-#ifdef DEBUG
-        assert(nevents + offset <= p.buffer_size );
-#endif
-
         if(p.buffer && p.enabled) {
-            float *buffer = (float *)(p.buffer);
-            buffer += offset;
-
-            for(j = 0; j < nevents; j += 1) {
-                unsigned int v = CondSwapFromBus32(*target_event) & 0x00FFFFFF;
-                // sign-extend highest bit of 24-bit int
-                int tmp = (int)(v << 8) / 256;
-                *buffer = tmp * multiplier;
-                buffer++;
-                target_event+=m_dimension;
-            }
+            p.port->addMeterValues(m_meter_peaks[i], m_meter_sum_sqs[i], nevents);
         }
     }
 }
 
-#endif
-
 /**
  * @brief decode all midi ports in the cache from events
  * @param data 
@@ -501,6 +611,11 @@ AmdtpReceiveStreamProcessor::initPortCache() {
     
     m_nb_midi_ports = 0;
     m_midi_ports.clear();
+
+    m_float_buffers.clear();
+    m_int24_buffers.clear();
+    m_meter_peaks.clear();
+    m_meter_sum_sqs.clear();
     
     for(PortVectorIterator it = m_Ports.begin();
         it != m_Ports.end();
@@ -559,6 +674,13 @@ next_index:
         continue;
     }
 
+    // the kernels take an array of buffer pointers, preallocate it here
+    // such that no allocation is needed in the RT path
+    m_float_buffers.resize(m_nb_audio_ports, NULL);
+    m_int24_buffers.resize(m_nb_audio_ports, NULL);
+    m_meter_peaks.resize(m_nb_audio_ports, 0.0f);
+    m_meter_sum_sqs.resize(m_nb_audio_ports, 0.0f);
+
     for(PortVectorIterator it = m_Ports.begin();
         it != m_Ports.end();
         ++it )
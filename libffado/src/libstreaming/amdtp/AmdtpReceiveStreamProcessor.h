@@ -29,6 +29,7 @@
  */
 
 #include "AmdtpStreamProcessor-common.h"
+#include "AmdtpKernels.h"
 
 namespace Streaming {
 
@@ -60,6 +61,7 @@ public:
                                                        unsigned char tag, unsigned char sy,
                                                        uint32_t pkt_ctr);
     virtual enum eChildReturnValue processPacketData(unsigned char *data, unsigned int length);
+    virtual unsigned int getPacketFrames(unsigned char *data, unsigned int length);
 
     virtual bool prepareChild();
 
@@ -72,21 +74,48 @@ public:
                     { return m_dimension; };
     virtual unsigned int getNominalFramesPerPacket() 
                     {return getSytInterval();};
+    // conversion kernel selection, effective at the next prepare()
+    void setKernelType(enum AmdtpKernels::eKernelType t)
+                    {m_kernel_type = t;};
+    enum AmdtpKernels::eKernelType getKernelType()
+                    {return (m_kernels ? m_kernels->type : m_kernel_type);};
+    // decode the audio samples on the ISO thread instead of in the
+    // period transfer, effective at the next prepare()
+    void setDecodeOnReceive(bool b)
+                    {m_decode_on_receive = b;};
+    bool getDecodeOnReceive()
+                    {return m_decode_on_receive;};
 
 
 protected:
     bool processReadBlock(char *data, unsigned int nevents, unsigned int offset);
 
+    bool writeReceivedFrames(quadlet_t *events, unsigned int nevents);
+    void decodeEventsToHost(const quadlet_t *events, quadlet_t *target, unsigned int nevents);
+    /// the largest packet, in events, that can be decoded on receive
+    unsigned int getDecodeBlockEvents() {return m_decode_block_events;};
+    bool initDecodeBuffers();
+
 protected:
     void decodeAudioPortsFloat(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void decodeAudioPortsInt24(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void decodeMidiPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    void demuxAudioPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    void meterAudioPorts(unsigned int nevents);
 
     unsigned int getSytInterval();
 
     int m_dimension;
     unsigned int m_syt_interval;
 
+    enum AmdtpKernels::eKernelType m_kernel_type;
+    const struct AmdtpKernels::KernelTable *m_kernels;
+
+    // in decode-on-receive mode the buffer holds host-format audio
+    // samples instead of AM824 events. MIDI slots are kept as received.
+    bool m_decode_on_receive;
+    bool m_events_decoded;
+
 private: // local port caching for performance
     struct _MBLA_port_cache {
         AmdtpAudioPort*     port;
@@ -98,6 +127,16 @@ private: // local port caching for performance
     };
     std::vector<struct _MBLA_port_cache> m_audio_ports;
     unsigned int m_nb_audio_ports;
+    // per-port pointer arrays handed to the conversion kernels
+    std::vector<float *> m_float_buffers;
+    std::vector<uint32_t *> m_int24_buffers;
+    // decode-on-receive runs on the ISO thread and has its own buffer,
+    // the decoded events of one packet of at most m_decode_block_events
+    unsigned int m_decode_block_events;
+    std::vector<quadlet_t> m_decode_events;
+    // per-port meter results of the meter kernels
+    std::vector<float> m_meter_peaks;
+    std::vector<float> m_meter_sum_sqs;
 
     struct _MIDI_port_cache {
         AmdtpMidiPort*      port;
@@ -25,6 +25,7 @@
 
 #include "AmdtpTransmitStreamProcessor.h"
 #include "AmdtpPort.h"
+#include "AmdtpKernels.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -42,7 +43,6 @@
 #define likely(x)   __builtin_expect((x),1)
 #define unlikely(x) __builtin_expect((x),0)
 
-#define AMDTP_FLOAT_MULTIPLIER (1.0f * ((1<<23) - 1))
 namespace Streaming
 {
 
@@ -57,6 +57,8 @@ AmdtpTransmitStreamProcessor::AmdtpTransmitStreamProcessor(FFADODevice &parent,
         , m_max_cycles_to_transmit_early ( AMDTP_MAX_CYCLES_TO_TRANSMIT_EARLY )
         , m_transmit_transfer_delay ( AMDTP_TRANSMIT_TRANSFER_DELAY )
         , m_min_cycles_before_presentation ( AMDTP_MIN_CYCLES_BEFORE_PRESENTATION )
+        , m_kernel_type( (enum AmdtpKernels::eKernelType)AMDTP_KERNEL_TYPE )
+        , m_kernels( NULL )
         , m_nb_audio_ports( 0 )
         , m_nb_midi_ports( 0 )
 {}
@@ -473,6 +475,14 @@ bool AmdtpTransmitStreamProcessor::prepareChild()
         return false;
     }
 
+    m_kernels = AmdtpKernels::getKernelTable(m_kernel_type);
+    if (m_kernels == NULL) {
+        debugWarning("%s kernels not supported on this CPU, using auto-detection\n",
+                     AmdtpKernels::eKernelTypeToString(m_kernel_type));
+        m_kernels = AmdtpKernels::getKernelTable(AmdtpKernels::eKT_Auto);
+    }
+    debugOutput ( DEBUG_LEVEL_VERBOSE, " Conversion kernels             : %s\n", m_kernels->name );
+
     return true;
 }
 
@@ -494,6 +504,9 @@ bool AmdtpTransmitStreamProcessor::processWriteBlock ( char *data,
             encodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
             break;
     }
+    if (m_StreamProcessorManager.isMetering()) {
+        meterAudioPorts(nevents);
+    }
 
     // do midi ports
     encodeMidiPorts((quadlet_t *)data, offset, nevents);
@@ -537,12 +550,6 @@ AmdtpTransmitStreamProcessor::encodeAudioPortsSilence(quadlet_t *data,
     }
 }
 
-#ifdef __SSE2__
-#include <emmintrin.h>
-
-// There's no obvious reason to warn about this anymore - jwoithe.
-// #warning SSE2 build
-
 /**
  * @brief mux all audio ports to events
  * @param data 
@@ -554,196 +561,33 @@ AmdtpTransmitStreamProcessor::encodeAudioPortsFloat(quadlet_t *data,
                                                     unsigned int offset,
                                                     unsigned int nevents)
 {
-    unsigned int j;
-    quadlet_t *target_event;
     int i;
 
-    float * client_buffers[4];
-    float tmp_values[4] __attribute__ ((aligned (16)));
-    uint32_t tmp_values_int[4] __attribute__ ((aligned (16)));
+    if (m_nb_audio_ports == 0) return;
 
     // prepare the scratch buffer
-    assert(m_scratch_buffer_size_bytes > nevents * 4);
+    assert(m_scratch_buffer_size_bytes >= nevents * 4);
     memset(m_scratch_buffer, 0, nevents * 4);
 
-    const __m128i label = _mm_set_epi32 (0x40000000, 0x40000000, 0x40000000, 0x40000000);
-    const __m128i mask = _mm_set_epi32 (0x00FFFFFF, 0x00FFFFFF, 0x00FFFFFF, 0x00FFFFFF);
-    const __m128 mult = _mm_set_ps(AMDTP_FLOAT_MULTIPLIER, AMDTP_FLOAT_MULTIPLIER, AMDTP_FLOAT_MULTIPLIER, AMDTP_FLOAT_MULTIPLIER);
-
-#if AMDTP_CLIP_FLOATS
-    const __m128 v_max = _mm_set_ps(1.0, 1.0, 1.0, 1.0);
-    const __m128 v_min = _mm_set_ps(-1.0, -1.0, -1.0, -1.0);
-#endif
-
-    // this assumes that audio ports are sorted by position,
-    // and that there are no gaps
-    for (i = 0; i < ((int)m_nb_audio_ports)-4; i += 4) {
-        struct _MBLA_port_cache *p;
-
-        // get the port buffers
-        for (j=0; j<4; j++) {
-            p = &(m_audio_ports.at(i+j));
-            if(likely(p->buffer && p->enabled)) {
-                client_buffers[j] = (float *) p->buffer;
-                client_buffers[j] += offset;
-            } else {
-                // if a port is disabled or has no valid
-                // buffer, use the scratch buffer (all zero's)
-                client_buffers[j] = (float *) m_scratch_buffer;
-            }
-        }
-
-        // the base event for this position
-        target_event = (quadlet_t *)(data + i);
-        // process the events
-        for (j=0;j < nevents; j += 1)
-        {
-            // read the values
-            tmp_values[0] = *(client_buffers[0]);
-            tmp_values[1] = *(client_buffers[1]);
-            tmp_values[2] = *(client_buffers[2]);
-            tmp_values[3] = *(client_buffers[3]);
-
-            // now do the SSE based conversion/labeling
-            __m128 v_float = *((__m128*)tmp_values);
-            __m128i *target = (__m128i*)target_event;
-            __m128i v_int;
-
-            // clip
-#if AMDTP_CLIP_FLOATS
-            // do SSE clipping
-            v_float = _mm_max_ps(v_float, v_min);
-            v_float = _mm_min_ps(v_float, v_max);
-#endif
-
-            // multiply
-            v_float = _mm_mul_ps(v_float, mult);
-            // convert to signed integer
-            v_int = _mm_cvttps_epi32( v_float );
-            // mask
-            v_int = _mm_and_si128( v_int, mask );
-            // label it
-            v_int = _mm_or_si128( v_int, label );
-
-            // do endian conversion (SSE is always little endian)
-            // do first swap
-            v_int = _mm_or_si128( _mm_slli_epi16( v_int, 8 ), _mm_srli_epi16( v_int, 8 ) );
-            // do second swap
-            v_int = _mm_or_si128( _mm_slli_epi32( v_int, 16 ), _mm_srli_epi32( v_int, 16 ) );
-            // store the packed int
-            // (target misalignment is assumed since we don't know the m_dimension)
-            _mm_storeu_si128 (target, v_int);
-
-            // increment the buffer pointers
-            client_buffers[0]++;
-            client_buffers[1]++;
-            client_buffers[2]++; 
-            client_buffers[3]++;
-
-            // go to next target event position
-            target_event += m_dimension;
-        }
-    }
-
-    // do remaining ports
-    // NOTE: these can be time-SSE'd
-    for (; i < (int)m_nb_audio_ports; i++) {
+    for (i = 0; i < m_nb_audio_ports; i++) {
         struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
 #ifdef DEBUG
         assert(nevents + offset <= p.buffer_size );
 #endif
-
         if(likely(p.buffer && p.enabled)) {
-            float *buffer = (float *)(p.buffer);
-            buffer += offset;
-    
-            for (j = 0;j < nevents; j += 4)
-            {
-                // read the values
-                tmp_values[0] = *buffer;
-                buffer++;
-                tmp_values[1] = *buffer;
-                buffer++;
-                tmp_values[2] = *buffer;
-                buffer++;
-                tmp_values[3] = *buffer;
-                buffer++;
-
-                // now do the SSE based conversion/labeling
-                __m128 v_float = *((__m128*)tmp_values);
-                __m128i v_int;
-
-#if AMDTP_CLIP_FLOATS
-                // do SSE clipping
-                v_float = _mm_max_ps(v_float, v_min);
-                v_float = _mm_min_ps(v_float, v_max);
-#endif
-                // multiply
-                v_float = _mm_mul_ps(v_float, mult);
-                // convert to signed integer
-                v_int = _mm_cvttps_epi32( v_float );
-                // mask
-                v_int = _mm_and_si128( v_int, mask );
-                // label it
-                v_int = _mm_or_si128( v_int, label );
-    
-                // do endian conversion (SSE is always little endian)
-                // do first swap
-                v_int = _mm_or_si128( _mm_slli_epi16( v_int, 8 ), _mm_srli_epi16( v_int, 8 ) );
-                // do second swap
-                v_int = _mm_or_si128( _mm_slli_epi32( v_int, 16 ), _mm_srli_epi32( v_int, 16 ) );
-
-                // store the packed int
-                _mm_store_si128 ((__m128i *)(&tmp_values_int), v_int);
-
-                // increment the buffer pointers
-                *target_event = tmp_values_int[0];
-                target_event += m_dimension;
-                *target_event = tmp_values_int[1];
-                target_event += m_dimension;
-                *target_event = tmp_values_int[2];
-                target_event += m_dimension;
-                *target_event = tmp_values_int[3];
-                target_event += m_dimension;
-            }
-
-            // do the remainder of the events
-            for(;j < nevents; j += 1) {
-                float *in = (float *)buffer;
-#if AMDTP_CLIP_FLOATS
-                // clip directly to the value of a maxed event
-                if(unlikely(*in > 1.0)) {
-                    *target_event = CONDSWAPTOBUS32_CONST(0x407FFFFF);
-                } else if(unlikely(*in < -1.0)) {
-                    *target_event = CONDSWAPTOBUS32_CONST(0x40800001);
-                } else {
-                    float v = (*in) * AMDTP_FLOAT_MULTIPLIER;
-                    unsigned int tmp = ((int) v);
-                    tmp = ( tmp & 0x00FFFFFF ) | 0x40000000;
-                    *target_event = CondSwapToBus32((quadlet_t)tmp);
-                }
-#else
-                float v = (*in) * AMDTP_FLOAT_MULTIPLIER;
-                unsigned int tmp = ((int) v);
-                tmp = ( tmp & 0x00FFFFFF ) | 0x40000000;
-                *target_event = CondSwapToBus32((quadlet_t)tmp);
-#endif
-                buffer++;
-                target_event += m_dimension;
-            }
-
+            m_float_buffers[i] = ((float *)p.buffer) + offset;
         } else {
-            for (j = 0;j < nevents; j += 1)
-            {
-                // hardcoded byte swapped
-                *target_event = 0x00000040;
-                target_event += m_dimension;
-            }
+            // if a port is disabled or has no valid
+            // buffer, use the scratch buffer (all zero's)
+            m_float_buffers[i] = (float *)m_scratch_buffer;
         }
     }
-}
 
+    // this assumes that audio ports are sorted by position,
+    // and that there are no gaps
+    m_kernels->encodeFloat(data, &m_float_buffers[0], m_nb_audio_ports,
+                           m_dimension, nevents);
+}
 
 /**
  * @brief mux all audio ports to events
@@ -756,257 +600,67 @@ AmdtpTransmitStreamProcessor::encodeAudioPortsInt24(quadlet_t *data,
                                                     unsigned int offset,
                                                     unsigned int nevents)
 {
-    unsigned int j;
-    quadlet_t *target_event;
     int i;
 
-    uint32_t *client_buffers[4];
-    uint32_t tmp_values[4] __attribute__ ((aligned (16)));
+    if (m_nb_audio_ports == 0) return;
 
     // prepare the scratch buffer
-    assert(m_scratch_buffer_size_bytes > nevents * 4);
+    assert(m_scratch_buffer_size_bytes >= nevents * 4);
     memset(m_scratch_buffer, 0, nevents * 4);
 
-    const __m128i label = _mm_set_epi32 (0x40000000, 0x40000000, 0x40000000, 0x40000000);
-    const __m128i mask  = _mm_set_epi32 (0x00FFFFFF, 0x00FFFFFF, 0x00FFFFFF, 0x00FFFFFF);
-
-    // this assumes that audio ports are sorted by position,
-    // and that there are no gaps
-    for (i = 0; i < ((int)m_nb_audio_ports)-4; i += 4) {
-        struct _MBLA_port_cache *p;
-
-        // get the port buffers
-        for (j=0; j<4; j++) {
-            p = &(m_audio_ports.at(i+j));
-            if(likely(p->buffer && p->enabled)) {
-                client_buffers[j] = (uint32_t *) p->buffer;
-                client_buffers[j] += offset;
-            } else {
-                // if a port is disabled or has no valid
-                // buffer, use the scratch buffer (all zero's)
-                client_buffers[j] = (uint32_t *) m_scratch_buffer;
-            }
-        }
-
-        // the base event for this position
-        target_event = (quadlet_t *)(data + i);
-
-        // process the events
-        for (j=0;j < nevents; j += 1)
-        {
-            // read the values
-            tmp_values[0] = *(client_buffers[0]);
-            tmp_values[1] = *(client_buffers[1]);
-            tmp_values[2] = *(client_buffers[2]);
-            tmp_values[3] = *(client_buffers[3]);
-
-            // now do the SSE based conversion/labeling
-            __m128i *target = (__m128i*)target_event;
-            __m128i v_int = *((__m128i*)tmp_values);;
-
-            // mask
-            v_int = _mm_and_si128( v_int, mask );
-            // label it
-            v_int = _mm_or_si128( v_int, label );
-
-            // do endian conversion (SSE is always little endian)
-            // do first swap
-            v_int = _mm_or_si128( _mm_slli_epi16( v_int, 8 ), _mm_srli_epi16( v_int, 8 ) );
-            // do second swap
-            v_int = _mm_or_si128( _mm_slli_epi32( v_int, 16 ), _mm_srli_epi32( v_int, 16 ) );
-
-            // store the packed int
-            // (target misalignment is assumed since we don't know the m_dimension)
-            _mm_storeu_si128 (target, v_int);
-
-            // increment the buffer pointers
-            client_buffers[0]++;
-            client_buffers[1]++;
-            client_buffers[2]++; 
-            client_buffers[3]++;
-
-            // go to next target event position
-            target_event += m_dimension;
-        }
-    }
-
-    // do remaining ports
-    // NOTE: these can be time-SSE'd
-    for (; i < ((int)m_nb_audio_ports); i++) {
+    for (i = 0; i < m_nb_audio_ports; i++) {
         struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
 #ifdef DEBUG
         assert(nevents + offset <= p.buffer_size );
 #endif
-
         if(likely(p.buffer && p.enabled)) {
-            uint32_t *buffer = (uint32_t *)(p.buffer);
-            buffer += offset;
-    
-            for (j = 0;j < nevents; j += 4)
-            {
-                // read the values
-                tmp_values[0] = *buffer;
-                buffer++;
-                tmp_values[1] = *buffer;
-                buffer++;
-                tmp_values[2] = *buffer;
-                buffer++;
-                tmp_values[3] = *buffer;
-                buffer++;
-
-                // now do the SSE based conversion/labeling
-                __m128i v_int = *((__m128i*)tmp_values);;
-
-                // mask
-                v_int = _mm_and_si128( v_int, mask );
-                // label it
-                v_int = _mm_or_si128( v_int, label );
-
-                // do endian conversion (SSE is always little endian)
-                // do first swap
-                v_int = _mm_or_si128( _mm_slli_epi16( v_int, 8 ), _mm_srli_epi16( v_int, 8 ) );
-                // do second swap
-                v_int = _mm_or_si128( _mm_slli_epi32( v_int, 16 ), _mm_srli_epi32( v_int, 16 ) );
-
-                // store the packed int
-                _mm_store_si128 ((__m128i *)(&tmp_values), v_int);
-
-                // increment the buffer pointers
-                *target_event = tmp_values[0];
-                target_event += m_dimension;
-                *target_event = tmp_values[1];
-                target_event += m_dimension;
-                *target_event = tmp_values[2];
-                target_event += m_dimension;
-                *target_event = tmp_values[3];
-                target_event += m_dimension;
-            }
-
-            // do the remainder of the events
-            for(;j < nevents; j += 1) {
-                uint32_t in = (uint32_t)(*buffer);
-                *target_event = CondSwapToBus32((quadlet_t)((in & 0x00FFFFFF) | 0x40000000));
-                buffer++;
-                target_event += m_dimension;
-            }
-
+            m_int24_buffers[i] = ((uint32_t *)p.buffer) + offset;
         } else {
-            for (j = 0;j < nevents; j += 1)
-            {
-                // hardcoded byte swapped
-                *target_event = 0x00000040;
-                target_event += m_dimension;
-            }
+            // if a port is disabled or has no valid
+            // buffer, use the scratch buffer (all zero's)
+            m_int24_buffers[i] = (uint32_t *)m_scratch_buffer;
         }
     }
-}
 
-#else
+    // this assumes that audio ports are sorted by position,
+    // and that there are no gaps
+    m_kernels->encodeInt24(data, &m_int24_buffers[0], m_nb_audio_ports,
+                           m_dimension, nevents);
+}
 
 /**
- * @brief mux all audio ports to events
- * @param data 
- * @param offset 
+ * @brief add the meter values of a block to the audio ports
+ *
+ * Runs over the buffer pointers set up by the encoder, i.e. while the
+ * samples are still in the cache.
+ *
  * @param nevents 
  */
 void
-AmdtpTransmitStreamProcessor::encodeAudioPortsInt24(quadlet_t *data,
-                                                    unsigned int offset,
-                                                    unsigned int nevents)
+AmdtpTransmitStreamProcessor::meterAudioPorts(unsigned int nevents)
 {
-    unsigned int j;
-    quadlet_t *target_event;
     int i;
 
-    for (i = 0; i < m_nb_audio_ports; i++) {
-        struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
-#ifdef DEBUG
-        assert(nevents + offset <= p.buffer_size );
-#endif
+    if (m_nb_audio_ports == 0) return;
 
-        if(likely(p.buffer && p.enabled)) {
-            quadlet_t *buffer = (quadlet_t *)(p.buffer);
-            buffer += offset;
-    
-            for (j = 0;j < nevents; j += 1)
-            {
-                uint32_t in = (uint32_t)(*buffer);
-                *target_event = CondSwapToBus32((quadlet_t)((in & 0x00FFFFFF) | 0x40000000));
-                buffer++;
-                target_event += m_dimension;
-            }
-        } else {
-            for (j = 0;j < nevents; j += 1)
-            {
-                *target_event = CONDSWAPTOBUS32_CONST(0x40000000);
-                target_event += m_dimension;
-            }
-        }
+    switch(m_StreamProcessorManager.getAudioDataType()) {
+        case StreamProcessorManager::eADT_Int24:
+            m_kernels->meterInt24(&m_int24_buffers[0], m_nb_audio_ports, nevents,
+                                  &m_meter_peaks[0], &m_meter_sum_sqs[0]);
+            break;
+        case StreamProcessorManager::eADT_Float:
+            m_kernels->meterFloat(&m_float_buffers[0], m_nb_audio_ports, nevents,
+                                  &m_meter_peaks[0], &m_meter_sum_sqs[0]);
+            break;
     }
-}
-
-/**
- * @brief mux all audio ports to events
- * @param data 
- * @param offset 
- * @param nevents 
- */
-void
-AmdtpTransmitStreamProcessor::encodeAudioPortsFloat(quadlet_t *data,
-                                                    unsigned int offset,
-                                                    unsigned int nevents)
-{
-    unsigned int j;
-    quadlet_t *target_event;
-    int i;
 
     for (i = 0; i < m_nb_audio_ports; i++) {
         struct _MBLA_port_cache &p = m_audio_ports.at(i);
-        target_event = (quadlet_t *)(data + i);
-#ifdef DEBUG
-        assert(nevents + offset <= p.buffer_size );
-#endif
-
-        if(likely(p.buffer && p.enabled)) {
-            quadlet_t *buffer = (quadlet_t *)(p.buffer);
-            buffer += offset;
-    
-            for (j = 0;j < nevents; j += 1)
-            {
-                float *in = (float *)buffer;
-#if AMDTP_CLIP_FLOATS
-                // clip directly to the value of a maxed event
-                if(unlikely(*in > 1.0)) {
-                    *target_event = CONDSWAPTOBUS32_CONST(0x407FFFFF);
-                } else if(unlikely(*in < -1.0)) {
-                    *target_event = CONDSWAPTOBUS32_CONST(0x40800001);
-                } else {
-                    float v = (*in) * AMDTP_FLOAT_MULTIPLIER;
-                    unsigned int tmp = ((int) v);
-                    tmp = ( tmp & 0x00FFFFFF ) | 0x40000000;
-                    *target_event = CondSwapToBus32((quadlet_t)tmp);
-                }
-#else
-                float v = (*in) * AMDTP_FLOAT_MULTIPLIER;
-                unsigned int tmp = ((int) v);
-                tmp = ( tmp & 0x00FFFFFF ) | 0x40000000;
-                *target_event = CondSwapToBus32((quadlet_t)tmp);
-#endif
-                buffer++;
-                target_event += m_dimension;
-            }
-        } else {
-            for (j = 0;j < nevents; j += 1)
-            {
-                *target_event = CONDSWAPTOBUS32_CONST(0x40000000);
-                target_event += m_dimension;
-            }
+        if(p.buffer && p.enabled) {
+            p.port->addMeterValues(m_meter_peaks[i], m_meter_sum_sqs[i], nevents);
         }
     }
 }
-#endif
 
 /**
  * @brief encodes all midi ports in the cache to events (silence)
@@ -1099,6 +753,11 @@ AmdtpTransmitStreamProcessor::initPortCache() {
     
     m_nb_midi_ports = 0;
     m_midi_ports.clear();
+
+    m_float_buffers.clear();
+    m_int24_buffers.clear();
+    m_meter_peaks.clear();
+    m_meter_sum_sqs.clear();
     
     for(PortVectorIterator it = m_Ports.begin();
         it != m_Ports.end();
@@ -1157,6 +816,13 @@ next_index:
         continue;
     }
 
+    // the kernels take an array of buffer pointers, preallocate it here
+    // such that no allocation is needed in the RT path
+    m_float_buffers.resize(m_nb_audio_ports, NULL);
+    m_int24_buffers.resize(m_nb_audio_ports, NULL);
+    m_meter_peaks.resize(m_nb_audio_ports, 0.0f);
+    m_meter_sum_sqs.resize(m_nb_audio_ports, 0.0f);
+
     for(PortVectorIterator it = m_Ports.begin();
         it != m_Ports.end();
         ++it )
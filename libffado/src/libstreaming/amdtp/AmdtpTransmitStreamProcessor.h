@@ -30,6 +30,7 @@
 #include "config.h"
 
 #include "AmdtpStreamProcessor-common.h"
+#include "AmdtpKernels.h"
 
 namespace Streaming {
 
@@ -100,6 +101,11 @@ public:
                     {return m_min_cycles_before_presentation;};
     virtual void setMinCyclesBeforePresentation(int x)
                     {m_min_cycles_before_presentation = x;};
+    // conversion kernel selection, effective at the next prepare()
+    void setKernelType(enum AmdtpKernels::eKernelType t)
+                    {m_kernel_type = t;};
+    enum AmdtpKernels::eKernelType getKernelType()
+                    {return (m_kernels ? m_kernels->type : m_kernel_type);};
 
 protected:
     bool processWriteBlock(char *data, unsigned int nevents, unsigned int offset);
@@ -115,6 +121,7 @@ private:
     void encodeAudioPortsSilence(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeAudioPortsFloat(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeAudioPortsInt24(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    void meterAudioPorts(unsigned int nevents);
     void encodeMidiPortsSilence(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeMidiPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
 
@@ -135,6 +142,9 @@ private:
     unsigned int m_transmit_transfer_delay;
     int m_min_cycles_before_presentation;
 
+    enum AmdtpKernels::eKernelType m_kernel_type;
+    const struct AmdtpKernels::KernelTable *m_kernels;
+
 private: // local port caching for performance
     struct _MBLA_port_cache {
         AmdtpAudioPort*     port;
@@ -146,6 +156,12 @@ private: // local port caching for performance
     };
     std::vector<struct _MBLA_port_cache> m_audio_ports;
     int m_nb_audio_ports;
+    // per-port pointer arrays handed to the conversion kernels
+    std::vector<float *> m_float_buffers;
+    std::vector<uint32_t *> m_int24_buffers;
+    // per-port meter results of the meter kernels
+    std::vector<float> m_meter_peaks;
+    std::vector<float> m_meter_sum_sqs;
 
     struct _MIDI_port_cache {
         AmdtpMidiPort*      port;
@@ -26,6 +26,7 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <math.h>
 
 namespace Streaming {
 
@@ -169,4 +170,12 @@ void Port::setVerboseLevel(int l) {
     setDebugLevel(l);
 }
 
+void AudioPort::takeMeterValues(float &peak, float &rms) {
+    peak = m_meter_peak;
+    rms = (m_meter_frames ? sqrtf(m_meter_sum_sq / m_meter_frames) : 0.0f);
+    m_meter_peak = 0.0f;
+    m_meter_sum_sq = 0.0f;
+    m_meter_frames = 0;
+}
+
 }
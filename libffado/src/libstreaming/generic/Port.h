@@ -174,9 +174,32 @@ public:
 
     AudioPort(PortManager& m, std::string name, enum E_Direction direction)
       : Port(m, name, E_Audio, direction)
+      , m_meter_peak( 0.0f )
+      , m_meter_sum_sq( 0.0f )
+      , m_meter_frames( 0 )
     {};
 
     virtual ~AudioPort() {};
+
+    /**
+     * \brief add the meter values of a block of samples
+     *
+     * Called by the stream processor while it moves the samples of a
+     * period, the values are collected once per period.
+     */
+    void addMeterValues(float peak, float sum_sq, unsigned int nframes)
+        {if (peak > m_meter_peak) m_meter_peak = peak;
+         m_meter_sum_sq += sum_sq;
+         m_meter_frames += nframes;};
+    /**
+     * \brief get the peak and RMS values since the previous call
+     */
+    void takeMeterValues(float &peak, float &rms);
+
+protected:
+    float m_meter_peak;
+    float m_meter_sum_sq;
+    unsigned int m_meter_frames;
 };
 
 /*!
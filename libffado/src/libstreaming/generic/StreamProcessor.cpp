@@ -36,6 +36,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #define SIGNAL_ACTIVITY_SPM { \
     m_StreamProcessorManager.signalActivity(); \
@@ -66,6 +67,13 @@ StreamProcessor::StreamProcessor(FFADODevice &parent, enum eProcessorType type)
     , m_IsoHandlerManager( parent.get1394Service().getIsoHandlerManager() ) // local cache
     , m_StreamProcessorManager( m_Parent.getDeviceManager().getStreamProcessorManager() ) // local cache
     , m_local_node_id ( 0 ) // local cache
+    , m_soft_recovery_max_cycles( STREAMPROCESSOR_SOFT_RECOVERY_MAX_CYCLES )
+    , m_soft_recoveries( 0 )
+    , m_dropped_cycles_pending( 0 )
+    , m_silence_buffer( NULL )
+    , m_silence_buffer_size_bytes( 0 )
+    , m_period_signal_bit( 0 )
+    , m_latency_stats( NULL )
     , m_channel( -1 )
     , m_last_timestamp( 0 )
     , m_last_timestamp2( 0 )
@@ -73,6 +81,7 @@ StreamProcessor::StreamProcessor(FFADODevice &parent, enum eProcessorType type)
     , m_scratch_buffer( NULL )
     , m_scratch_buffer_size_bytes( 0 )
     , m_ticks_per_frame( 0 )
+    , m_initial_ticks_per_frame( 0 )
     , m_dll_bandwidth_hz ( STREAMPROCESSOR_DLL_BW_HZ )
     , m_extra_buffer_frames( 0 )
     , m_max_fs_diff_norm ( 0.01 )
@@ -91,6 +100,7 @@ StreamProcessor::~StreamProcessor() {
 
     if (m_data_buffer) delete m_data_buffer;
     if (m_scratch_buffer) delete[] m_scratch_buffer;
+    if (m_silence_buffer) delete[] m_silence_buffer;
 }
 
 bool
@@ -338,6 +348,13 @@ StreamProcessor::setTicksPerFrame(float tpf)
     m_data_buffer->setRate(tpf);
 }
 
+void
+StreamProcessor::setInitialTicksPerFrame(float tpf)
+{
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Setting initial rate to %f ticks/frame\n", tpf);
+    m_initial_ticks_per_frame = tpf;
+}
+
 bool
 StreamProcessor::setDllBandwidth(float bw)
 {
@@ -442,6 +459,25 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
     // check the packet header
     enum eChildReturnValue result = processPacketHeader(data, length, tag, sy, pkt_ctr);
 
+    // a short gap in a running stream is filled with silence once the
+    // next packet with data shows where the stream continues. if that
+    // doesn't work out it's handled as any other drop.
+    if (m_state == ePS_Running && m_next_state == ePS_Running) {
+        if (dropped_cycles
+            && m_dropped_cycles_pending + dropped_cycles <= m_soft_recovery_max_cycles) {
+            m_dropped_cycles_pending += dropped_cycles;
+            dropped_cycles = 0;
+        }
+        if (m_dropped_cycles_pending && result == eCRV_OK) {
+            if (!bridgeDroppedPackets(m_dropped_cycles_pending, getPacketFrames(data, length))) {
+                dropped_cycles += m_dropped_cycles_pending;
+            }
+            m_dropped_cycles_pending = 0;
+        }
+    } else {
+        m_dropped_cycles_pending = 0;
+    }
+
     // handle dropped cycles
     if(dropped_cycles) {
         // make sure the last_timestamp is corrected
@@ -580,6 +616,7 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
         // for all states that reach this we are allowed to
         // do protocol specific data reception
         enum eChildReturnValue result2 = processPacketData(data, length);
+        signalPeriodProgress();
 
         // if an xrun occured, switch to the dryRunning state and
         // allow for the xrun to be picked up
@@ -612,6 +649,87 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
     return RAW1394_ISO_ERROR;
 }
 
+/**
+ * @brief fill the frames lost in a short gap with silence
+ *
+ * Writes silent frames into the buffer such that the packet that just
+ * arrived (m_last_timestamp) continues the stream. The number of frames
+ * follows from the gap between the buffer tail and the new packet, the
+ * packets themselves can carry a varying number of frames (e.g. in
+ * non-blocking mode). The timestamps of the silent frames are spread
+ * evenly over the gap, so the DLL is re-anchored without a jump.
+ *
+ * @param dropped_cycles the number of cycles the ISO layer reported lost
+ * @param packet_frames the number of frames in the packet that just arrived
+ * @return false if the gap doesn't add up, a full resync is needed then
+ */
+bool
+StreamProcessor::bridgeDroppedPackets(unsigned int dropped_cycles, unsigned int packet_frames)
+{
+    ffado_timestamp_t ts_tail;
+    signed int fc;
+    m_data_buffer->getBufferTailTimestamp(&ts_tail, &fc);
+
+    // the tail timestamp moves on by the frames of the new packet too
+    int64_t gap = diffTicks(m_last_timestamp, (uint64_t)ts_tail);
+    int total = (int)((float)gap / getTicksPerFrame() + 0.5);
+    int missing = total - (int)packet_frames;
+
+    // no more frames can be missing than fit in the dropped cycles
+    unsigned int frames_per_packet = getNominalFramesPerPacket();
+    if (missing < 0 || missing > (int)(dropped_cycles * frames_per_packet)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE,
+                    "(%p) gap of %"PRId64" ticks doesn't match %u dropped cycles\n",
+                    this, gap, dropped_cycles);
+        return false;
+    }
+    size_t bytes_per_frame = getEventsPerFrame() * getEventSize();
+    unsigned int chunk_frames = m_silence_buffer_size_bytes / bytes_per_frame;
+    if (chunk_frames == 0 || (unsigned int)missing > m_data_buffer->getBufferSpace()) {
+        return false;
+    }
+
+    // the actual frame period over the gap, such that the new packet
+    // lands exactly on its own timestamp
+    double step = (double)gap / total;
+    int written = 0;
+    while (written < missing) {
+        unsigned int n = missing - written;
+        if (n > chunk_frames) n = chunk_frames;
+        written += n;
+        uint64_t ts = addTicks((uint64_t)ts_tail, (uint64_t)(step * written + 0.5));
+        if (!m_data_buffer->writeFrames(n, (char *)m_silence_buffer, ts)) {
+            return false;
+        }
+    }
+    m_soft_recoveries++;
+    debugOutput(DEBUG_LEVEL_NORMAL, "(%p) bridged %u dropped cycles with %d silent frames\n",
+                this, dropped_cycles, missing);
+    return true;
+}
+
+/**
+ * @brief allocate the silent frames used to bridge packet losses
+ */
+bool
+StreamProcessor::allocateSilenceBuffer()
+{
+    size_t size = getNominalFramesPerPacket() * getEventsPerFrame() * getEventSize();
+    if (m_silence_buffer && size == m_silence_buffer_size_bytes) {
+        return true;
+    }
+    if (m_silence_buffer) delete[] m_silence_buffer;
+    m_silence_buffer = new byte_t[size];
+    if (m_silence_buffer == NULL) {
+        debugFatal("Could not allocate silence buffer\n");
+        m_silence_buffer_size_bytes = 0;
+        return false;
+    }
+    memset(m_silence_buffer, 0, size);
+    m_silence_buffer_size_bytes = size;
+    return true;
+}
+
 enum raw1394_iso_disposition
 StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
                            unsigned char *tag, unsigned char *sy,
@@ -632,7 +750,16 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
     uint64_t prev_timestamp;
     // note that we can ignore skipped cycles since
     // the protocol will take care of that
-    if (dropped_cycles > 0) {
+    if (dropped_cycles > 0
+        && m_state == ePS_Running && m_next_state == ePS_Running
+        && dropped_cycles <= m_soft_recovery_max_cycles) {
+        // the packets of the dropped cycles are lost, but the timing of
+        // the stream isn't. If the frames are late by now, the header
+        // generation will still raise the xrun.
+        m_soft_recoveries++;
+        debugOutput(DEBUG_LEVEL_NORMAL, "(%p) continuing after %u dropped cycles\n",
+                    this, dropped_cycles);
+    } else if (dropped_cycles > 0) {
         // HACK: this should not be necessary, since the header generation functions should trigger the xrun.
         //       but apparently there are some issues with the 1394 stack
         m_in_xrun = true;
@@ -763,6 +890,7 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
             }
 
             enum eChildReturnValue result2 = generatePacketData(data, length);
+            signalPeriodProgress();
             // if an xrun occured, switch to the dryRunning state and
             // allow for the xrun to be picked up
             if (result2 == eCRV_XRun) {
@@ -887,6 +1015,36 @@ send_empty_packet:
     return RAW1394_ISO_OK;
 }
 
+/**
+ * @brief tell the SPM when this SP can do a period transfer
+ *
+ * Called by the ISO thread each time a packet has been processed. When
+ * the client can transfer a full period to/from this SP, its bit is set
+ * in the SPM's period ready mask.
+ */
+void
+StreamProcessor::signalPeriodProgress()
+{
+    if (m_period_signal_bit == 0) return;
+    bool ready;
+    if (getType() == ePT_Receive) {
+        ready = canConsumePeriod();
+    } else {
+        ready = canProducePeriod();
+    }
+    if (ready) {
+        m_StreamProcessorManager.signalPeriodReady(m_period_signal_bit);
+    }
+}
+
+void
+StreamProcessor::setLatencyStatistics(Util::LatencyStatistics *s)
+{
+    m_latency_stats = s;
+    m_data_buffer->setDllErrorHistogram(
+        s ? &s->get(Util::LatencyStatistics::eS_DllError) : NULL);
+}
+
 void StreamProcessor::packetsStopped() {
     m_state = ePS_Stopped;
     m_next_state = ePS_Stopped;
@@ -1177,6 +1335,10 @@ bool StreamProcessor::prepare()
         return false;
     }
 
+    if (!allocateSilenceBuffer()) {
+        return false;
+    }
+
     debugOutput( DEBUG_LEVEL_VERBOSE, "Prepared for:\n");
     debugOutput( DEBUG_LEVEL_VERBOSE, " Samplerate: %d  [DLL Bandwidth: %f Hz]\n",
              m_StreamProcessorManager.getNominalRate(), m_dll_bandwidth_hz);
@@ -1528,6 +1690,10 @@ StreamProcessor::doDryRunning()
                         this);
             m_local_node_id = m_1394service.getLocalNodeId() & 0x3f;
             if (getType() == ePT_Receive) {
+                // start the DLL from a known rate if we have one
+                if (m_initial_ticks_per_frame > 0) {
+                    m_data_buffer->setRate(m_initial_ticks_per_frame);
+                }
                 // this to ensure that there is no discontinuity when starting to 
                 // update the DLL based upon the received packets
                 m_data_buffer->setBufferTailTimestamp(m_last_timestamp);
@@ -1958,6 +2124,7 @@ StreamProcessor::dumpInfo()
                         (unsigned int)TICKS_TO_CYCLES(now),
                         (unsigned int)TICKS_TO_OFFSET(now));
     debugOutputShort( DEBUG_LEVEL_NORMAL, "  Xrun?                 : %s\n", (m_in_xrun ? "True":"False"));
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "  Soft recoveries       : %u\n", m_soft_recoveries);
     if (m_state == m_next_state) {
         debugOutputShort( DEBUG_LEVEL_NORMAL, "  State                 : %s\n", 
                                             ePSToString(m_state));
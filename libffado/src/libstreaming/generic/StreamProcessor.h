@@ -39,6 +39,10 @@
 class Ieee1394Service;
 class IsoHandlerManager;
 
+namespace Util {
+    class LatencyStatistics;
+}
+
 namespace Streaming {
 
     class StreamProcessorManager;
@@ -238,6 +242,9 @@ protected: // the helper receive/transmit functions
         {debugWarning("call not allowed\n"); return eCRV_Invalid;};
     virtual enum eChildReturnValue processPacketData(unsigned char *data, unsigned int length)
         {debugWarning("call not allowed\n"); return eCRV_Invalid;};
+    // the number of frames carried by a packet that passed processPacketHeader()
+    virtual unsigned int getPacketFrames(unsigned char *data, unsigned int length)
+        {return getNominalFramesPerPacket();};
     virtual bool processReadBlock(char *data, unsigned int nevents, unsigned int offset)
         {debugWarning("call not allowed\n"); return false;};
 
@@ -281,6 +288,47 @@ public:
     bool xrunOccurred() { return m_in_xrun; };
     void handlerDied();
 
+    /**
+     * @brief set the longest packet loss that doesn't cause an xrun
+     *
+     * Up to this number of dropped cycles is bridged with silence while
+     * the stream keeps running. Longer losses cause an xrun, and hence
+     * a full resync of the streams. 0 disables the soft recovery.
+     */
+    void setSoftRecoveryMaxCycles(unsigned int cycles)
+        {m_soft_recovery_max_cycles = cycles;};
+    unsigned int getSoftRecoveryCount()
+        {return m_soft_recoveries;};
+private:
+    bool bridgeDroppedPackets(unsigned int dropped_cycles, unsigned int packet_frames);
+    bool allocateSilenceBuffer();
+    unsigned int m_soft_recovery_max_cycles;
+    unsigned int m_soft_recoveries;
+    unsigned int m_dropped_cycles_pending;
+    // one packet of silent frames for the bridging, zeroed in prepare()
+    // and read-only afterwards: the ISO thread uses it while the client
+    // thread works on the scratch buffer
+    byte_t*         m_silence_buffer;
+    size_t          m_silence_buffer_size_bytes;
+
+// event-driven period signalling, see StreamProcessorManager::waitForPeriod()
+public:
+    void setPeriodSignalBit(uint32_t bit)
+        {m_period_signal_bit = bit;};
+    uint32_t getPeriodSignalBit()
+        {return m_period_signal_bit;};
+private:
+    void signalPeriodProgress();
+    uint32_t m_period_signal_bit;
+
+    Util::LatencyStatistics *m_latency_stats;
+
+public:
+    /// feed the DLL and ISO histograms into s, NULL to stop
+    void setLatencyStatistics(Util::LatencyStatistics *s);
+    Util::LatencyStatistics *getLatencyStatistics()
+        {return m_latency_stats;};
+
 // the ISO interface (can we get rid of this?)
 public:
     int getChannel() {return m_channel;};
@@ -380,6 +428,11 @@ protected:
 
         float getTicksPerFrame();
         void setTicksPerFrame(float tpf);
+        /**
+         * @brief set the rate the DLL starts from when a received stream starts
+         * @param tpf ticks per frame, 0 to start from the nominal rate
+         */
+        void setInitialTicksPerFrame(float tpf);
 
         bool setDllBandwidth(float bw);
 
@@ -429,6 +482,7 @@ protected:
 
     protected:
         float m_ticks_per_frame;
+        float m_initial_ticks_per_frame;
         float m_dll_bandwidth_hz;
         unsigned int m_extra_buffer_frames;
         float m_max_fs_diff_norm;
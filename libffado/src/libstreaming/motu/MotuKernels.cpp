@@ -0,0 +1,621 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "MotuKernels.h"
+
+#include "libutil/float_cast.h"
+
+#include <cstring>
+
+#define likely(x)   __builtin_expect((x),1)
+#define unlikely(x) __builtin_expect((x),0)
+
+// 24 bit full scale, as used by the MOTU stream processors
+#define MOTU_KERNEL_FLOAT_MULTIPLIER ((float)(0x7FFFFF))
+
+// See AmdtpKernels.cpp: the SIMD kernels use function level target
+// attributes and are selected at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define MOTU_KERNELS_X86 1
+#include <immintrin.h>
+#define KERNEL_TARGET_SSSE3    __attribute__((target("ssse3")))
+#define KERNEL_TARGET_AVX2     __attribute__((target("avx2")))
+#else
+#define MOTU_KERNELS_X86 0
+#endif
+
+namespace Streaming {
+namespace MotuKernels {
+
+/* --------------------- SCALAR ----------------------- */
+
+static inline void
+encodeFloatSample(uint8_t *target, float in)
+{
+#if MOTU_CLIP_FLOATS
+    if (unlikely(in > 1.0)) in = 1.0;
+    if (unlikely(in < -1.0)) in = -1.0;
+#endif
+    unsigned int v = lrintf(in * MOTU_KERNEL_FLOAT_MULTIPLIER);
+    target[0] = (v >> 16) & 0xff;
+    target[1] = (v >> 8) & 0xff;
+    target[2] = v & 0xff;
+}
+
+static inline void
+encodeInt24Sample(uint8_t *target, uint32_t in)
+{
+    target[0] = (in >> 16) & 0xff;
+    target[1] = (in >> 8) & 0xff;
+    target[2] = in & 0xff;
+}
+
+static inline int32_t
+decodeSample(const uint8_t *src)
+{
+    uint32_t v = (src[0] << 16) | (src[1] << 8) | src[2];
+    // sign-extend highest bit of 24-bit int
+    if (src[0] & 0x80)
+        v |= 0xff000000;
+    return (int32_t)v;
+}
+
+// The scalar kernels also take care of the remainders of the SIMD
+// kernels, hence the 'first_event' argument.
+static void
+encodeFloatScalarFrom(uint8_t *data, unsigned int event_size,
+                      float * const *buffers, unsigned int nb_ports,
+                      unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        const float *buffer = buffers[i] + first_event;
+        uint8_t *target = data + first_event * event_size + 3 * i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            encodeFloatSample(target, *buffer);
+            buffer++;
+            target += event_size;
+        }
+    }
+}
+
+static void
+encodeInt24ScalarFrom(uint8_t *data, unsigned int event_size,
+                      uint32_t * const *buffers, unsigned int nb_ports,
+                      unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        const uint32_t *buffer = buffers[i] + first_event;
+        uint8_t *target = data + first_event * event_size + 3 * i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            encodeInt24Sample(target, *buffer);
+            buffer++;
+            target += event_size;
+        }
+    }
+}
+
+static void
+decodeFloatScalarFrom(const uint8_t *data, unsigned int event_size,
+                      float * const *buffers, unsigned int nb_ports,
+                      unsigned int first_event, unsigned int nevents)
+{
+    const float multiplier = 1.0f / MOTU_KERNEL_FLOAT_MULTIPLIER;
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        float *buffer = buffers[i] + first_event;
+        const uint8_t *src = data + first_event * event_size + 3 * i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            *buffer = decodeSample(src) * multiplier;
+            buffer++;
+            src += event_size;
+        }
+    }
+}
+
+static void
+decodeInt24ScalarFrom(const uint8_t *data, unsigned int event_size,
+                      uint32_t * const *buffers, unsigned int nb_ports,
+                      unsigned int first_event, unsigned int nevents)
+{
+    for (unsigned int i = 0; i < nb_ports; i++) {
+        uint32_t *buffer = buffers[i] + first_event;
+        const uint8_t *src = data + first_event * event_size + 3 * i;
+        for (unsigned int j = first_event; j < nevents; j++) {
+            *buffer = (uint32_t)decodeSample(src);
+            buffer++;
+            src += event_size;
+        }
+    }
+}
+
+static void
+encodeFloatScalar(uint8_t *data, unsigned int event_size,
+                  float * const *buffers, unsigned int nb_ports,
+                  unsigned int nevents)
+{
+    encodeFloatScalarFrom(data, event_size, buffers, nb_ports, 0, nevents);
+}
+
+static void
+encodeInt24Scalar(uint8_t *data, unsigned int event_size,
+                  uint32_t * const *buffers, unsigned int nb_ports,
+                  unsigned int nevents)
+{
+    encodeInt24ScalarFrom(data, event_size, buffers, nb_ports, 0, nevents);
+}
+
+static void
+decodeFloatScalar(const uint8_t *data, unsigned int event_size,
+                  float * const *buffers, unsigned int nb_ports,
+                  unsigned int nevents)
+{
+    decodeFloatScalarFrom(data, event_size, buffers, nb_ports, 0, nevents);
+}
+
+static void
+decodeInt24Scalar(const uint8_t *data, unsigned int event_size,
+                  uint32_t * const *buffers, unsigned int nb_ports,
+                  unsigned int nevents)
+{
+    decodeInt24ScalarFrom(data, event_size, buffers, nb_ports, 0, nevents);
+}
+
+#if MOTU_KERNELS_X86
+
+/* --------------------- SSSE3 ----------------------- */
+// Blocks of 4 ports x 4 events. When decoding, the 12 bytes of the 4
+// ports of an event are loaded and shuffled such that each 32 bit lane
+// holds one sample in its upper 24 bits. An arithmetic shift then does
+// the sign extension. A 4x4 transpose turns the events into ports. The
+// encoder does the reverse. Remaining ports and events are done by the
+// scalar code.
+
+KERNEL_TARGET_SSSE3 static inline __m128i
+load12SSSE3(const uint8_t *src)
+{
+    int32_t hi;
+    memcpy(&hi, src + 8, sizeof(hi));
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)src),
+                              _mm_cvtsi32_si128(hi));
+}
+
+KERNEL_TARGET_SSSE3 static inline void
+store12SSSE3(uint8_t *target, __m128i v)
+{
+    int32_t hi = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+    _mm_storel_epi64((__m128i *)target, v);
+    memcpy(target + 8, &hi, sizeof(hi));
+}
+
+// 4 packed BE samples -> upper 24 bits of 4 lanes
+KERNEL_TARGET_SSSE3 static inline __m128i
+unpackMaskSSSE3()
+{
+    return _mm_set_epi8( 9, 10, 11, -128,  6,  7,  8, -128,
+                         3,  4,  5, -128,  0,  1,  2, -128);
+}
+
+// lower 24 bits of 4 lanes -> 4 packed BE samples
+KERNEL_TARGET_SSSE3 static inline __m128i
+packMaskSSSE3()
+{
+    return _mm_set_epi8(-128, -128, -128, -128, 12, 13, 14,  8,
+                          9, 10,  4,  5,  6,  0,  1,  2);
+}
+
+KERNEL_TARGET_SSSE3 static inline void
+transpose4x4SSSE3(__m128i r[4])
+{
+    __m128 r0 = _mm_castsi128_ps(r[0]);
+    __m128 r1 = _mm_castsi128_ps(r[1]);
+    __m128 r2 = _mm_castsi128_ps(r[2]);
+    __m128 r3 = _mm_castsi128_ps(r[3]);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    r[0] = _mm_castps_si128(r0);
+    r[1] = _mm_castps_si128(r1);
+    r[2] = _mm_castps_si128(r2);
+    r[3] = _mm_castps_si128(r3);
+}
+
+KERNEL_TARGET_SSSE3 static void
+encodeFloatSSSE3(uint8_t *data, unsigned int event_size,
+                 float * const *buffers, unsigned int nb_ports,
+                 unsigned int nevents)
+{
+    const __m128i mask = packMaskSSSE3();
+    const __m128 mult = _mm_set1_ps(MOTU_KERNEL_FLOAT_MULTIPLIER);
+#if MOTU_CLIP_FLOATS
+    const __m128 v_max = _mm_set1_ps(1.0f);
+    const __m128 v_min = _mm_set1_ps(-1.0f);
+#endif
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        uint8_t *target = data + 3 * i;
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                __m128 v = _mm_loadu_ps(buffers[i + k] + j);
+#if MOTU_CLIP_FLOATS
+                v = _mm_min_ps(_mm_max_ps(v, v_min), v_max);
+#endif
+                // rounds to nearest like lrintf()
+                r[k] = _mm_cvtps_epi32(_mm_mul_ps(v, mult));
+            }
+            transpose4x4SSSE3(r);
+            for (k = 0; k < 4; k++) {
+                store12SSSE3(target, _mm_shuffle_epi8(r[k], mask));
+                target += event_size;
+            }
+        }
+        encodeFloatScalarFrom(data + 3 * i, event_size, buffers + i, 4, j, nevents);
+    }
+    encodeFloatScalarFrom(data + 3 * i, event_size, buffers + i, nb_ports - i, 0, nevents);
+}
+
+KERNEL_TARGET_SSSE3 static void
+encodeInt24SSSE3(uint8_t *data, unsigned int event_size,
+                 uint32_t * const *buffers, unsigned int nb_ports,
+                 unsigned int nevents)
+{
+    const __m128i mask = packMaskSSSE3();
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        uint8_t *target = data + 3 * i;
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                r[k] = _mm_loadu_si128((const __m128i *)(buffers[i + k] + j));
+            }
+            transpose4x4SSSE3(r);
+            for (k = 0; k < 4; k++) {
+                store12SSSE3(target, _mm_shuffle_epi8(r[k], mask));
+                target += event_size;
+            }
+        }
+        encodeInt24ScalarFrom(data + 3 * i, event_size, buffers + i, 4, j, nevents);
+    }
+    encodeInt24ScalarFrom(data + 3 * i, event_size, buffers + i, nb_ports - i, 0, nevents);
+}
+
+KERNEL_TARGET_SSSE3 static void
+decodeFloatSSSE3(const uint8_t *data, unsigned int event_size,
+                 float * const *buffers, unsigned int nb_ports,
+                 unsigned int nevents)
+{
+    const __m128i mask = unpackMaskSSSE3();
+    const __m128 mult = _mm_set1_ps(1.0f / MOTU_KERNEL_FLOAT_MULTIPLIER);
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        const uint8_t *src = data + 3 * i;
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                r[k] = _mm_srai_epi32(_mm_shuffle_epi8(load12SSSE3(src), mask), 8);
+                src += event_size;
+            }
+            transpose4x4SSSE3(r);
+            for (k = 0; k < 4; k++) {
+                _mm_storeu_ps(buffers[i + k] + j, _mm_mul_ps(_mm_cvtepi32_ps(r[k]), mult));
+            }
+        }
+        decodeFloatScalarFrom(data + 3 * i, event_size, buffers + i, 4, j, nevents);
+    }
+    decodeFloatScalarFrom(data + 3 * i, event_size, buffers + i, nb_ports - i, 0, nevents);
+}
+
+KERNEL_TARGET_SSSE3 static void
+decodeInt24SSSE3(const uint8_t *data, unsigned int event_size,
+                 uint32_t * const *buffers, unsigned int nb_ports,
+                 unsigned int nevents)
+{
+    const __m128i mask = unpackMaskSSSE3();
+    unsigned int i, j, k;
+    __m128i r[4];
+
+    for (i = 0; i + 4 <= nb_ports; i += 4) {
+        const uint8_t *src = data + 3 * i;
+        for (j = 0; j + 4 <= nevents; j += 4) {
+            for (k = 0; k < 4; k++) {
+                r[k] = _mm_srai_epi32(_mm_shuffle_epi8(load12SSSE3(src), mask), 8);
+                src += event_size;
+            }
+            transpose4x4SSSE3(r);
+            for (k = 0; k < 4; k++) {
+                _mm_storeu_si128((__m128i *)(buffers[i + k] + j), r[k]);
+            }
+        }
+        decodeInt24ScalarFrom(data + 3 * i, event_size, buffers + i, 4, j, nevents);
+    }
+    decodeInt24ScalarFrom(data + 3 * i, event_size, buffers + i, nb_ports - i, 0, nevents);
+}
+
+/* --------------------- AVX2 ----------------------- */
+// Same scheme as SSSE3, but on 8 ports x 8 events. The 24 bytes of an
+// event are split over the two 128 bit lanes since the byte shuffle
+// doesn't cross lanes. Remaining ports are handed to the SSSE3 kernel.
+
+KERNEL_TARGET_AVX2 static inline __m256i
+load24AVX2(const uint8_t *src)
+{
+    // bytes 0..15 and 16..23, the upper lane gets bytes 12..23
+    __m128i lo = _mm_loadu_si128((const __m128i *)src);
+    __m128i hi = _mm_loadl_epi64((const __m128i *)(src + 16));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo),
+                                   _mm_alignr_epi8(hi, lo, 12), 1);
+}
+
+KERNEL_TARGET_AVX2 static inline void
+store24AVX2(uint8_t *target, __m256i v)
+{
+    // both lanes hold 12 bytes, make them contiguous first
+    const __m256i idx = _mm256_set_epi32(7, 3, 6, 5, 4, 2, 1, 0);
+    v = _mm256_permutevar8x32_epi32(v, idx);
+    _mm_storeu_si128((__m128i *)target, _mm256_castsi256_si128(v));
+    _mm_storel_epi64((__m128i *)(target + 16), _mm256_extracti128_si256(v, 1));
+}
+
+KERNEL_TARGET_AVX2 static inline void
+transpose8x8AVX2(__m256i r[8])
+{
+    __m256 t0, t1, t2, t3, t4, t5, t6, t7;
+    __m256 u0, u1, u2, u3, u4, u5, u6, u7;
+
+    t0 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[0]), _mm256_castsi256_ps(r[1]));
+    t1 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[0]), _mm256_castsi256_ps(r[1]));
+    t2 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[2]), _mm256_castsi256_ps(r[3]));
+    t3 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[2]), _mm256_castsi256_ps(r[3]));
+    t4 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[4]), _mm256_castsi256_ps(r[5]));
+    t5 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[4]), _mm256_castsi256_ps(r[5]));
+    t6 = _mm256_unpacklo_ps(_mm256_castsi256_ps(r[6]), _mm256_castsi256_ps(r[7]));
+    t7 = _mm256_unpackhi_ps(_mm256_castsi256_ps(r[6]), _mm256_castsi256_ps(r[7]));
+
+    u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+    u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+    u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+    u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+    u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1,0,1,0));
+    u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3,2,3,2));
+    u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1,0,1,0));
+    u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3,2,3,2));
+
+    r[0] = _mm256_castps_si256(_mm256_permute2f128_ps(u0, u4, 0x20));
+    r[1] = _mm256_castps_si256(_mm256_permute2f128_ps(u1, u5, 0x20));
+    r[2] = _mm256_castps_si256(_mm256_permute2f128_ps(u2, u6, 0x20));
+    r[3] = _mm256_castps_si256(_mm256_permute2f128_ps(u3, u7, 0x20));
+    r[4] = _mm256_castps_si256(_mm256_permute2f128_ps(u0, u4, 0x31));
+    r[5] = _mm256_castps_si256(_mm256_permute2f128_ps(u1, u5, 0x31));
+    r[6] = _mm256_castps_si256(_mm256_permute2f128_ps(u2, u6, 0x31));
+    r[7] = _mm256_castps_si256(_mm256_permute2f128_ps(u3, u7, 0x31));
+}
+
+KERNEL_TARGET_AVX2 static void
+encodeFloatAVX2(uint8_t *data, unsigned int event_size,
+                float * const *buffers, unsigned int nb_ports,
+                unsigned int nevents)
+{
+    const __m256i mask = _mm256_broadcastsi128_si256(packMaskSSSE3());
+    const __m256 mult = _mm256_set1_ps(MOTU_KERNEL_FLOAT_MULTIPLIER);
+#if MOTU_CLIP_FLOATS
+    const __m256 v_max = _mm256_set1_ps(1.0f);
+    const __m256 v_min = _mm256_set1_ps(-1.0f);
+#endif
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        uint8_t *target = data + 3 * i;
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                __m256 v = _mm256_loadu_ps(buffers[i + k] + j);
+#if MOTU_CLIP_FLOATS
+                v = _mm256_min_ps(_mm256_max_ps(v, v_min), v_max);
+#endif
+                r[k] = _mm256_cvtps_epi32(_mm256_mul_ps(v, mult));
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                store24AVX2(target, _mm256_shuffle_epi8(r[k], mask));
+                target += event_size;
+            }
+        }
+        encodeFloatScalarFrom(data + 3 * i, event_size, buffers + i, 8, j, nevents);
+    }
+    encodeFloatSSSE3(data + 3 * i, event_size, buffers + i, nb_ports - i, nevents);
+}
+
+KERNEL_TARGET_AVX2 static void
+encodeInt24AVX2(uint8_t *data, unsigned int event_size,
+                uint32_t * const *buffers, unsigned int nb_ports,
+                unsigned int nevents)
+{
+    const __m256i mask = _mm256_broadcastsi128_si256(packMaskSSSE3());
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        uint8_t *target = data + 3 * i;
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                r[k] = _mm256_loadu_si256((const __m256i *)(buffers[i + k] + j));
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                store24AVX2(target, _mm256_shuffle_epi8(r[k], mask));
+                target += event_size;
+            }
+        }
+        encodeInt24ScalarFrom(data + 3 * i, event_size, buffers + i, 8, j, nevents);
+    }
+    encodeInt24SSSE3(data + 3 * i, event_size, buffers + i, nb_ports - i, nevents);
+}
+
+KERNEL_TARGET_AVX2 static void
+decodeFloatAVX2(const uint8_t *data, unsigned int event_size,
+                float * const *buffers, unsigned int nb_ports,
+                unsigned int nevents)
+{
+    const __m256i mask = _mm256_broadcastsi128_si256(unpackMaskSSSE3());
+    const __m256 mult = _mm256_set1_ps(1.0f / MOTU_KERNEL_FLOAT_MULTIPLIER);
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        const uint8_t *src = data + 3 * i;
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                r[k] = _mm256_srai_epi32(_mm256_shuffle_epi8(load24AVX2(src), mask), 8);
+                src += event_size;
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                _mm256_storeu_ps(buffers[i + k] + j, _mm256_mul_ps(_mm256_cvtepi32_ps(r[k]), mult));
+            }
+        }
+        decodeFloatScalarFrom(data + 3 * i, event_size, buffers + i, 8, j, nevents);
+    }
+    decodeFloatSSSE3(data + 3 * i, event_size, buffers + i, nb_ports - i, nevents);
+}
+
+KERNEL_TARGET_AVX2 static void
+decodeInt24AVX2(const uint8_t *data, unsigned int event_size,
+                uint32_t * const *buffers, unsigned int nb_ports,
+                unsigned int nevents)
+{
+    const __m256i mask = _mm256_broadcastsi128_si256(unpackMaskSSSE3());
+    unsigned int i, j, k;
+    __m256i r[8];
+
+    for (i = 0; i + 8 <= nb_ports; i += 8) {
+        const uint8_t *src = data + 3 * i;
+        for (j = 0; j + 8 <= nevents; j += 8) {
+            for (k = 0; k < 8; k++) {
+                r[k] = _mm256_srai_epi32(_mm256_shuffle_epi8(load24AVX2(src), mask), 8);
+                src += event_size;
+            }
+            transpose8x8AVX2(r);
+            for (k = 0; k < 8; k++) {
+                _mm256_storeu_si256((__m256i *)(buffers[i + k] + j), r[k]);
+            }
+        }
+        decodeInt24ScalarFrom(data + 3 * i, event_size, buffers + i, 8, j, nevents);
+    }
+    decodeInt24SSSE3(data + 3 * i, event_size, buffers + i, nb_ports - i, nevents);
+}
+
+#endif // MOTU_KERNELS_X86
+
+/* --------------------- DISPATCH ----------------------- */
+
+static const struct KernelTable kernel_table_scalar = {
+    eKT_Scalar, "scalar",
+    encodeFloatScalar, encodeInt24Scalar,
+    decodeFloatScalar, decodeInt24Scalar,
+};
+
+#if MOTU_KERNELS_X86
+static const struct KernelTable kernel_table_ssse3 = {
+    eKT_SSSE3, "SSSE3",
+    encodeFloatSSSE3, encodeInt24SSSE3,
+    decodeFloatSSSE3, decodeInt24SSSE3,
+};
+
+static const struct KernelTable kernel_table_avx2 = {
+    eKT_AVX2, "AVX2",
+    encodeFloatAVX2, encodeInt24AVX2,
+    decodeFloatAVX2, decodeInt24AVX2,
+};
+#endif
+
+bool
+isSupported(enum eKernelType t)
+{
+    switch(t) {
+        case eKT_Auto:
+        case eKT_Scalar:
+            return true;
+#if MOTU_KERNELS_X86
+        case eKT_SSSE3:
+            return __builtin_cpu_supports("ssse3");
+        case eKT_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+static const struct KernelTable *
+detectBestKernelTable()
+{
+#if MOTU_KERNELS_X86
+    __builtin_cpu_init();
+    if (isSupported(eKT_AVX2)) return &kernel_table_avx2;
+    if (isSupported(eKT_SSSE3)) return &kernel_table_ssse3;
+#endif
+    return &kernel_table_scalar;
+}
+
+const struct KernelTable *
+getKernelTable(enum eKernelType t)
+{
+    // function-local static: the CPU is probed only once
+    static const struct KernelTable *best = detectBestKernelTable();
+
+    if (!isSupported(t)) {
+        return NULL;
+    }
+    switch(t) {
+        case eKT_Auto:
+            return best;
+        case eKT_Scalar:
+            return &kernel_table_scalar;
+#if MOTU_KERNELS_X86
+        case eKT_SSSE3:
+            return &kernel_table_ssse3;
+        case eKT_AVX2:
+            return &kernel_table_avx2;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+const char *
+eKernelTypeToString(enum eKernelType t)
+{
+    switch(t) {
+        case eKT_Auto:   return "auto";
+        case eKT_Scalar: return "scalar";
+        case eKT_SSSE3:  return "SSSE3";
+        case eKT_AVX2:   return "AVX2";
+        default:         return "unknown";
+    }
+}
+
+} // end of namespace MotuKernels
+} // end of namespace Streaming
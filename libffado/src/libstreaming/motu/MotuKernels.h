@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_MOTUKERNELS__
+#define __FFADO_MOTUKERNELS__
+
+#include <stdint.h>
+
+namespace Streaming {
+namespace MotuKernels {
+
+/**
+ * The conversion kernels move samples between the per-port client
+ * buffers and a group of adjacent audio channels in the MOTU events.
+ *
+ * MOTU audio samples are packed 24 bit big endian integers. The kernels
+ * handle a group of nb_ports channels that are stored back-to-back in
+ * each event: port i of event j lives at data + j * event_size + 3 * i,
+ * i.e. data points to the first sample of the group in the first event.
+ *
+ * Every entry of the buffers array has to point to a valid buffer of at
+ * least nevents samples, already adjusted for the block offset. Callers
+ * substitute a scratch buffer for disabled ports (zeroed when encoding).
+ *
+ * The kernels never access bytes outside of the channel group.
+ */
+typedef void (*encode_float_t)(uint8_t *data, unsigned int event_size,
+                               float * const *buffers, unsigned int nb_ports,
+                               unsigned int nevents);
+typedef void (*encode_int24_t)(uint8_t *data, unsigned int event_size,
+                               uint32_t * const *buffers, unsigned int nb_ports,
+                               unsigned int nevents);
+typedef void (*decode_float_t)(const uint8_t *data, unsigned int event_size,
+                               float * const *buffers, unsigned int nb_ports,
+                               unsigned int nevents);
+typedef void (*decode_int24_t)(const uint8_t *data, unsigned int event_size,
+                               uint32_t * const *buffers, unsigned int nb_ports,
+                               unsigned int nevents);
+
+enum eKernelType {
+    eKT_Auto    = 0,
+    eKT_Scalar  = 1,
+    eKT_SSSE3   = 2,
+    eKT_AVX2    = 3,
+};
+
+struct KernelTable {
+    enum eKernelType    type;
+    const char *        name;
+    encode_float_t      encodeFloat;
+    encode_int24_t      encodeInt24;
+    decode_float_t      decodeFloat;
+    decode_int24_t      decodeInt24;
+};
+
+/**
+ * @brief check whether a kernel set can be used on this host
+ *
+ * @param t the kernel type
+ * @return true if the kernels of type t can be used
+ */
+bool isSupported(enum eKernelType t);
+
+/**
+ * @brief get the kernel table for a kernel type
+ *
+ * eKT_Auto returns the fastest kernel set supported by the host.
+ *
+ * @param t the kernel type
+ * @return the kernel table, or NULL if the type is not supported
+ */
+const struct KernelTable *getKernelTable(enum eKernelType t);
+
+const char *eKernelTypeToString(enum eKernelType t);
+
+} // end of namespace MotuKernels
+} // end of namespace Streaming
+
+#endif /* __FFADO_MOTUKERNELS__ */
@@ -21,7 +21,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
-
+#include "config.h"
 
 #include "libutil/float_cast.h"
 
@@ -41,6 +41,7 @@
 #include <cstring>
 #include <math.h>
 #include <assert.h>
+#include <algorithm>
 
 /* Provide more intuitive access to GCC's branch predition built-ins */
 #define likely(x)   __builtin_expect((x),1)
@@ -84,6 +85,8 @@ uint32_t ts_sec = CYCLE_TIMER_GET_SECS(ct_now);
 MotuReceiveStreamProcessor::MotuReceiveStreamProcessor(FFADODevice &parent, unsigned int event_size)
     : StreamProcessor(parent, ePT_Receive)
     , m_event_size( event_size )
+    , m_kernel_type( (enum MotuKernels::eKernelType)MOTU_KERNEL_TYPE )
+    , m_kernels( NULL )
     , mb_head ( 0 )
     , mb_tail ( 0 )
 {
@@ -117,6 +120,66 @@ MotuReceiveStreamProcessor::getNominalFramesPerPacket() {
 bool
 MotuReceiveStreamProcessor::prepareChild() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Preparing (%p)...\n", this);
+
+    if (!initPortCache()) {
+        debugError("Could not init port cache\n");
+        return false;
+    }
+
+    m_kernels = MotuKernels::getKernelTable(m_kernel_type);
+    if (m_kernels == NULL) {
+        debugWarning("%s kernels not supported on this CPU, using auto-detection\n",
+                     MotuKernels::eKernelTypeToString(m_kernel_type));
+        m_kernels = MotuKernels::getKernelTable(MotuKernels::eKT_Auto);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, " Conversion kernels: %s\n", m_kernels->name);
+
+    return true;
+}
+
+static bool
+motuAudioPortPositionLess(MotuAudioPort *a, MotuAudioPort *b)
+{
+    return a->getPosition() < b->getPosition();
+}
+
+bool
+MotuReceiveStreamProcessor::initPortCache() {
+    m_audio_ports.clear();
+    m_audio_port_groups.clear();
+
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        if ((*it)->getPortType() == Port::E_Audio) {
+            m_audio_ports.push_back(static_cast<MotuAudioPort *>(*it));
+        }
+    }
+    std::sort(m_audio_ports.begin(), m_audio_ports.end(), motuAudioPortPositionLess);
+
+    for (unsigned int i = 0; i < m_audio_ports.size(); i++) {
+        unsigned int pos = m_audio_ports[i]->getPosition();
+        if (pos + 3 > m_event_size) {
+            debugError("Port %s at position %u doesn't fit in an event of %u bytes\n",
+                       m_audio_ports[i]->getName().c_str(), pos, m_event_size);
+            return false;
+        }
+        if (m_audio_port_groups.empty() ||
+            m_audio_port_groups.back().position
+              + 3 * m_audio_port_groups.back().nb_ports != pos) {
+            struct _audio_port_group g;
+            g.position = pos;
+            g.first = i;
+            g.nb_ports = 0;
+            m_audio_port_groups.push_back(g);
+        }
+        m_audio_port_groups.back().nb_ports++;
+    }
+    m_float_buffers.resize(m_audio_ports.size());
+    m_int24_buffers.resize(m_audio_ports.size());
+
+    debugOutput( DEBUG_LEVEL_VERBOSE, " %zd audio ports in %zd groups\n",
+                 m_audio_ports.size(), m_audio_port_groups.size());
     return true;
 }
 
@@ -266,6 +329,9 @@ bool MotuReceiveStreamProcessor::processReadBlock(char *data,
     if (m_motu_model != Motu::MOTU_MODEL_828MkI)
         decodeMotuCtrlEvents(data, nevents);
 
+    // all audio ports are decoded in one go
+    decodeMotuEventsToPorts((quadlet_t *)data, offset, nevents);
+
     for ( PortVectorIterator it = m_Ports.begin();
           it != m_Ports.end();
           ++it ) {
@@ -275,12 +341,6 @@ bool MotuReceiveStreamProcessor::processReadBlock(char *data,
 
         switch(port->getPortType()) {
 
-        case Port::E_Audio:
-            if(decodeMotuEventsToPort(static_cast<MotuAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not decode packet data to port %s\n",(*it)->getName().c_str());
-                no_problem=false;
-            }
-            break;
         case Port::E_Midi:
              if(decodeMotuMidiEventsToPort(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
                  debugWarning("Could not decode packet midi data to port %s\n",(*it)->getName().c_str());
@@ -295,72 +355,74 @@ bool MotuReceiveStreamProcessor::processReadBlock(char *data,
     return no_problem;
 }
 
-signed int MotuReceiveStreamProcessor::decodeMotuEventsToPort(MotuAudioPort *p,
-        quadlet_t *data, unsigned int offset, unsigned int nevents)
+/**
+ * @brief decode the events of a block to all audio ports
+ *
+ * The audio ports are handled per group of adjacent channels (see
+ * initPortCache()), which lets the conversion kernels process all
+ * channels of an event in one pass.  Disabled ports are decoded into
+ * the scratch buffer, that is cheaper than breaking up the groups.
+ */
+void
+MotuReceiveStreamProcessor::decodeMotuEventsToPorts(quadlet_t *data,
+        unsigned int offset, unsigned int nevents)
 {
-    unsigned int j=0;
+    unsigned int i;
+    unsigned int nb_ports = m_audio_ports.size();
 
     // Use char here since a port's source address won't necessarily be
-    // aligned; use of an unaligned quadlet_t may cause issues on
-    // certain architectures.  Besides, the source (data coming directly
-    // from the MOTU) isn't structured in quadlets anyway; it mainly
-    // consists of packed 24-bit integers.
+    // aligned.  The source (data coming directly from the MOTU) isn't
+    // structured in quadlets anyway; it mainly consists of packed 24-bit
+    // integers.
+    const unsigned char *src_data = (const unsigned char *)data;
 
-    unsigned char *src_data;
-    src_data = (unsigned char *)data + p->getPosition();
+    if (nb_ports == 0) return;
+    assert(m_scratch_buffer_size_bytes >= nevents * 4);
 
     switch(m_StreamProcessorManager.getAudioDataType()) {
         default:
         case StreamProcessorManager::eADT_Int24:
-            {
-                quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                // Offset is in frames, but each port is only a single
-                // channel, so the number of frames is the same as the
-                // number of quadlets to offset (assuming the port buffer
-                // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // Decode nsamples
-                    *buffer = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
-                    // Sign-extend highest bit of 24-bit int.
-                    // This isn't strictly needed since E_Int24 is a 24-bit,
-                    // but doing so shouldn't break anything and makes the data
-                    // easier to deal with during debugging.
-                    if (*src_data & 0x80)
-                        *buffer |= 0xff000000;
-
-                    buffer++;
-                    src_data+=m_event_size;
+            for (i = 0; i < nb_ports; i++) {
+                MotuAudioPort *p = m_audio_ports[i];
+                if (p->isDisabled()) {
+                    m_int24_buffers[i] = (uint32_t *)m_scratch_buffer;
+                } else {
+                    assert(nevents + offset <= p->getBufferSize());
+                    // Offset is in frames, but each port is only a single
+                    // channel, so the number of frames is the same as the
+                    // number of quadlets to offset.
+                    m_int24_buffers[i] = (uint32_t *)(p->getBufferAddress()) + offset;
                 }
             }
+            // The kernels sign-extend the 24-bit samples.  This isn't
+            // strictly needed since E_Int24 is a 24-bit, but doing so
+            // shouldn't break anything and makes the data easier to deal
+            // with during debugging.
+            for (i = 0; i < m_audio_port_groups.size(); i++) {
+                struct _audio_port_group &g = m_audio_port_groups[i];
+                m_kernels->decodeInt24(src_data + g.position, m_event_size,
+                                       &m_int24_buffers[g.first], g.nb_ports,
+                                       nevents);
+            }
             break;
         case StreamProcessorManager::eADT_Float:
-            {
-                const float multiplier = 1.0f / (float)(0x7FFFFF);
-                float *buffer=(float *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // decode max nsamples
-
-                    signed int v = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
-                    /* Sign-extend highest bit of incoming 24-bit integer */
-                    if (*src_data & 0x80)
-                      v |= 0xff000000;
-                    *buffer = v * multiplier;
-                    buffer++;
-                    src_data+=m_event_size;
+            for (i = 0; i < nb_ports; i++) {
+                MotuAudioPort *p = m_audio_ports[i];
+                if (p->isDisabled()) {
+                    m_float_buffers[i] = (float *)m_scratch_buffer;
+                } else {
+                    assert(nevents + offset <= p->getBufferSize());
+                    m_float_buffers[i] = (float *)(p->getBufferAddress()) + offset;
                 }
             }
+            for (i = 0; i < m_audio_port_groups.size(); i++) {
+                struct _audio_port_group &g = m_audio_port_groups[i];
+                m_kernels->decodeFloat(src_data + g.position, m_event_size,
+                                       &m_float_buffers[g.first], g.nb_ports,
+                                       nevents);
+            }
             break;
     }
-
-    return 0;
 }
 
 int
@@ -34,6 +34,10 @@
 #include "../generic/StreamProcessor.h"
 #include "../util/cip.h"
 
+#include "MotuKernels.h"
+
+#include <vector>
+
 namespace Streaming {
 
 #define MOTUFW_MAX_MIXBUSES        4
@@ -154,6 +158,11 @@ public:
     virtual unsigned int getEventsPerFrame() 
                     { return 1; };
     virtual unsigned int getNominalFramesPerPacket();
+    // conversion kernel selection, effective at the next prepare()
+    void setKernelType(enum MotuKernels::eKernelType t)
+                    {m_kernel_type = t;};
+    enum MotuKernels::eKernelType getKernelType()
+                    {return (m_kernels ? m_kernels->type : m_kernel_type);};
 
 protected:
     bool processReadBlock(char *data, unsigned int nevents, unsigned int offset);
@@ -161,7 +170,8 @@ protected:
 private:
     bool decodePacketPorts(quadlet_t *data, unsigned int nevents, unsigned int dbc);
 
-    int decodeMotuEventsToPort(MotuAudioPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
+    bool initPortCache();
+    void decodeMotuEventsToPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
     int decodeMotuMidiEventsToPort(MotuMidiPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
     int decodeMotuCtrlEvents(char *data, unsigned int nevents);
 
@@ -174,6 +184,23 @@ private:
     signed int m_motu_model;
     struct MotuDevControls m_devctrls;
 
+    enum MotuKernels::eKernelType m_kernel_type;
+    const struct MotuKernels::KernelTable *m_kernels;
+
+    // local port caching for performance: the audio ports sorted by
+    // position, split in groups of channels that are adjacent in the
+    // events so that each group is converted in a single kernel call
+    struct _audio_port_group {
+        unsigned int        position;
+        unsigned int        first;
+        unsigned int        nb_ports;
+    };
+    std::vector<MotuAudioPort *> m_audio_ports;
+    std::vector<struct _audio_port_group> m_audio_port_groups;
+    // per-port pointer arrays handed to the conversion kernels
+    std::vector<float *> m_float_buffers;
+    std::vector<uint32_t *> m_int24_buffers;
+
     /* A small MIDI buffer to cover for the case where we need to span a
      * period.  This can only occur if more than one MIDI byte is sent per
      * packet, but this has been observed with some MOTUs (eg: 828MkII). 
@@ -41,6 +41,7 @@
 
 #include <cstring>
 #include <assert.h>
+#include <algorithm>
 
 // Set to 1 to enable the generation of a 1 kHz test tone in analog output 1.  Even with
 // this defined to 1 the test tone will now only be produced if run with a non-zero 
@@ -71,6 +72,8 @@ MotuTransmitStreamProcessor::MotuTransmitStreamProcessor(FFADODevice &parent, un
         : StreamProcessor(parent, ePT_Transmit )
         , m_event_size( event_size )
         , m_motu_model( 0 )
+        , m_kernel_type( (enum MotuKernels::eKernelType)MOTU_KERNEL_TYPE )
+        , m_kernels( NULL )
         , m_tx_dbc( 0 )
         , mb_head( 0 )
         , mb_tail( 0 )
@@ -564,6 +567,66 @@ unsigned int MotuTransmitStreamProcessor::fillNoDataPacketHeader (
 bool MotuTransmitStreamProcessor::prepareChild()
 {
     debugOutput ( DEBUG_LEVEL_VERBOSE, "Preparing (%p)...\n", this );
+
+    if (!initPortCache()) {
+        debugError("Could not init port cache\n");
+        return false;
+    }
+
+    m_kernels = MotuKernels::getKernelTable(m_kernel_type);
+    if (m_kernels == NULL) {
+        debugWarning("%s kernels not supported on this CPU, using auto-detection\n",
+                     MotuKernels::eKernelTypeToString(m_kernel_type));
+        m_kernels = MotuKernels::getKernelTable(MotuKernels::eKT_Auto);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, " Conversion kernels: %s\n", m_kernels->name);
+
+    return true;
+}
+
+static bool
+motuAudioPortPositionLess(MotuAudioPort *a, MotuAudioPort *b)
+{
+    return a->getPosition() < b->getPosition();
+}
+
+bool
+MotuTransmitStreamProcessor::initPortCache() {
+    m_audio_ports.clear();
+    m_audio_port_groups.clear();
+
+    for ( PortVectorIterator it = m_Ports.begin();
+          it != m_Ports.end();
+          ++it ) {
+        if ((*it)->getPortType() == Port::E_Audio) {
+            m_audio_ports.push_back(static_cast<MotuAudioPort *>(*it));
+        }
+    }
+    std::sort(m_audio_ports.begin(), m_audio_ports.end(), motuAudioPortPositionLess);
+
+    for (unsigned int i = 0; i < m_audio_ports.size(); i++) {
+        unsigned int pos = m_audio_ports[i]->getPosition();
+        if (pos + 3 > m_event_size) {
+            debugError("Port %s at position %u doesn't fit in an event of %u bytes\n",
+                       m_audio_ports[i]->getName().c_str(), pos, m_event_size);
+            return false;
+        }
+        if (m_audio_port_groups.empty() ||
+            m_audio_port_groups.back().position
+              + 3 * m_audio_port_groups.back().nb_ports != pos) {
+            struct _audio_port_group g;
+            g.position = pos;
+            g.first = i;
+            g.nb_ports = 0;
+            m_audio_port_groups.push_back(g);
+        }
+        m_audio_port_groups.back().nb_ports++;
+    }
+    m_float_buffers.resize(m_audio_ports.size());
+    m_int24_buffers.resize(m_audio_ports.size());
+
+    debugOutput( DEBUG_LEVEL_VERBOSE, " %zd audio ports in %zd groups\n",
+                 m_audio_ports.size(), m_audio_port_groups.size());
     return true;
 }
 
@@ -587,28 +650,31 @@ bool MotuTransmitStreamProcessor::processWriteBlock(char *data,
         memset(data+4+i*m_event_size, 0x00, 6);
     }
 
+    // All audio ports are encoded in one go.  Disabled audio ports are
+    // sent silence.
+    encodePortsToMotuEvents((quadlet_t *)data, offset, nevents);
+
     for ( PortVectorIterator it = m_Ports.begin();
       it != m_Ports.end();
       ++it ) {
+        Port *port=(*it);
+
+        if (port->getPortType() == Port::E_Audio) {
+            continue;
+        }
+
         // If this port is disabled, unconditionally send it silence.
-        if((*it)->isDisabled()) {
-          if (encodeSilencePortToMotuEvents(static_cast<MotuAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
+        if(port->isDisabled()) {
+          if (port->getPortType() == Port::E_Midi &&
+              encodeSilencePortToMotuMidiEvents(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
             debugWarning("Could not encode silence for disabled port %s to Motu events\n",(*it)->getName().c_str());
             // Don't treat this as a fatal error at this point
           }
           continue;
         }
 
-        Port *port=(*it);
-
         switch(port->getPortType()) {
 
-        case Port::E_Audio:
-            if (encodePortToMotuEvents(static_cast<MotuAudioPort *>(*it), (quadlet_t *)data, offset, nevents)) {
-                debugWarning("Could not encode port %s to Motu events\n",(*it)->getName().c_str());
-                no_problem=false;
-            }
-            break;
         case Port::E_Midi:
              if (encodePortToMotuMidiEvents(static_cast<MotuMidiPort *>(*it), (quadlet_t *)data, offset, nevents)) {
                  debugWarning("Could not encode port %s to Midi events\n",(*it)->getName().c_str());
@@ -654,84 +720,80 @@ MotuTransmitStreamProcessor::transmitSilenceBlock(char *data,
     return no_problem;
 }
 
-int MotuTransmitStreamProcessor::encodePortToMotuEvents(MotuAudioPort *p, quadlet_t *data,
+/**
+ * @brief encode all audio ports into the events of a block
+ *
+ * Encodes nevents worth of data from the audio ports into the given
+ * buffer.  The format of the buffer is precisely that which will be sent
+ * to the MOTU.  The ports are handled per group of adjacent channels (see
+ * initPortCache()), which lets the conversion kernels process all
+ * channels of an event in one pass.  Disabled ports read from the zeroed
+ * scratch buffer and thus send silence.
+ *
+ * We include the ability to start the transfer from the given offset
+ * within the port (expressed in frames) so the 'efficient' transfer method
+ * can be utilised.
+ */
+void
+MotuTransmitStreamProcessor::encodePortsToMotuEvents(quadlet_t *data,
                        unsigned int offset, unsigned int nevents) {
-// Encodes nevents worth of data from the given port into the given buffer.  The
-// format of the buffer is precisely that which will be sent to the MOTU.
-// The basic idea:
-//   iterate over the ports
-//     * get port buffer address
-//     * loop over events
-//         - pick right sample in event based upon PortInfo
-//         - convert sample from Port format (E_Int24, E_Float, ..) to MOTU
-//           native format
-//
-// We include the ability to start the transfer from the given offset within
-// the port (expressed in frames) so the 'efficient' transfer method can be
-// utilised.
-
-    unsigned int j=0;
+    unsigned int i;
+    unsigned int nb_ports = m_audio_ports.size();
 
     // Use char here since the target address won't necessarily be
-    // aligned; use of an unaligned quadlet_t may cause issues on certain
-    // architectures.  Besides, the target (data going directly to the MOTU)
-    // isn't structured in quadlets anyway; it mainly consists of packed
-    // 24-bit integers.
-    unsigned char *target;
-    target = (unsigned char *)data + p->getPosition();
+    // aligned.  The target (data going directly to the MOTU) isn't
+    // structured in quadlets anyway; it mainly consists of packed 24-bit
+    // integers.
+    unsigned char *target = (unsigned char *)data;
+
+    if (nb_ports == 0) return;
+
+    // prepare the scratch buffer
+    assert(m_scratch_buffer_size_bytes >= nevents * 4);
+    memset(m_scratch_buffer, 0, nevents * 4);
 
     switch(m_StreamProcessorManager.getAudioDataType()) {
         default:
         case StreamProcessorManager::eADT_Int24:
-            {
-                quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                // Offset is in frames, but each port is only a single
-                // channel, so the number of frames is the same as the
-                // number of quadlets to offset (assuming the port buffer
-                // uses one quadlet per sample, which is the case currently).
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // Decode nsamples
-                    *target = (*buffer >> 16) & 0xff;
-                    *(target+1) = (*buffer >> 8) & 0xff;
-                    *(target+2) = (*buffer) & 0xff;
-
-                    buffer++;
-                    target+=m_event_size;
+            for (i = 0; i < nb_ports; i++) {
+                MotuAudioPort *p = m_audio_ports[i];
+                if (p->isDisabled()) {
+                    m_int24_buffers[i] = (uint32_t *)m_scratch_buffer;
+                } else {
+                    assert(nevents + offset <= p->getBufferSize());
+                    // Offset is in frames, but each port is only a single
+                    // channel, so the number of frames is the same as the
+                    // number of quadlets to offset.
+                    m_int24_buffers[i] = (uint32_t *)(p->getBufferAddress()) + offset;
                 }
             }
+            for (i = 0; i < m_audio_port_groups.size(); i++) {
+                struct _audio_port_group &g = m_audio_port_groups[i];
+                m_kernels->encodeInt24(target + g.position, m_event_size,
+                                       &m_int24_buffers[g.first], g.nb_ports,
+                                       nevents);
+            }
             break;
         case StreamProcessorManager::eADT_Float:
-            {
-                const float multiplier = (float)(0x7FFFFF);
-                float *buffer=(float *)(p->getBufferAddress());
-
-                assert(nevents + offset <= p->getBufferSize());
-
-                buffer+=offset;
-
-                for(j = 0; j < nevents; j += 1) { // decode max nsamples
-                    float in = *buffer;
-#if MOTU_CLIP_FLOATS
-                    if (unlikely(in > 1.0)) in = 1.0;
-                    if (unlikely(in < -1.0)) in = -1.0;
-#endif
-                    unsigned int v = lrintf(in * multiplier);
-                    *target = (v >> 16) & 0xff;
-                    *(target+1) = (v >> 8) & 0xff;
-                    *(target+2) = v & 0xff;
-
-                    buffer++;
-                    target+=m_event_size;
+            for (i = 0; i < nb_ports; i++) {
+                MotuAudioPort *p = m_audio_ports[i];
+                if (p->isDisabled()) {
+                    m_float_buffers[i] = (float *)m_scratch_buffer;
+                } else {
+                    assert(nevents + offset <= p->getBufferSize());
+                    m_float_buffers[i] = (float *)(p->getBufferAddress()) + offset;
                 }
             }
+            // The kernels clip the samples to [-1.0, 1.0] if
+            // MOTU_CLIP_FLOATS is set.
+            for (i = 0; i < m_audio_port_groups.size(); i++) {
+                struct _audio_port_group &g = m_audio_port_groups[i];
+                m_kernels->encodeFloat(target + g.position, m_event_size,
+                                       &m_float_buffers[g.first], g.nb_ports,
+                                       nevents);
+            }
             break;
     }
-
-    return 0;
 }
 
 int MotuTransmitStreamProcessor::encodeSilencePortToMotuEvents(MotuAudioPort *p, quadlet_t *data,
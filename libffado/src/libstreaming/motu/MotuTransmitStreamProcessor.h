@@ -34,6 +34,10 @@
 #include "../generic/StreamProcessor.h"
 #include "../util/cip.h"
 
+#include "MotuKernels.h"
+
+#include <vector>
+
 namespace Streaming {
 
 class Port;
@@ -78,6 +82,11 @@ public:
     virtual unsigned int getEventsPerFrame() 
                     { return 1; };
     virtual unsigned int getNominalFramesPerPacket();
+    // conversion kernel selection, effective at the next prepare()
+    void setKernelType(enum MotuKernels::eKernelType t)
+                    {m_kernel_type = t;};
+    enum MotuKernels::eKernelType getKernelType()
+                    {return (m_kernels ? m_kernels->type : m_kernel_type);};
 
 protected:
     bool processWriteBlock(char *data, unsigned int nevents, unsigned int offset);
@@ -93,7 +102,8 @@ private:
     bool encodePacketPorts(quadlet_t *data, unsigned int nevents,
                            unsigned int dbc);
 
-    int encodePortToMotuEvents(MotuAudioPort *, quadlet_t *data,
+    bool initPortCache();
+    void encodePortsToMotuEvents(quadlet_t *data,
                                 unsigned int offset, unsigned int nevents);
     int encodeSilencePortToMotuEvents(MotuAudioPort *, quadlet_t *data,
                                 unsigned int offset, unsigned int nevents);
@@ -117,6 +127,23 @@ private:
 
     signed int m_motu_model;
 
+    enum MotuKernels::eKernelType m_kernel_type;
+    const struct MotuKernels::KernelTable *m_kernels;
+
+    // local port caching for performance: the audio ports sorted by
+    // position, split in groups of channels that are adjacent in the
+    // events so that each group is converted in a single kernel call
+    struct _audio_port_group {
+        unsigned int        position;
+        unsigned int        first;
+        unsigned int        nb_ports;
+    };
+    std::vector<MotuAudioPort *> m_audio_ports;
+    std::vector<struct _audio_port_group> m_audio_port_groups;
+    // per-port pointer arrays handed to the conversion kernels
+    std::vector<float *> m_float_buffers;
+    std::vector<uint32_t *> m_int24_buffers;
+
     // Keep track of transmission data block count
     unsigned int m_tx_dbc;
 
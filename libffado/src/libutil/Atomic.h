@@ -103,5 +103,14 @@ static inline long ZERO_ATOMIC(volatile int32_t* val)
     return actual;
 }
 
+static inline long OR_ATOMIC(volatile int32_t* val, int32_t orval)
+{
+    int32_t actual;
+    do {
+        actual = *val;
+    } while (!CAS(actual, actual | orval, val));
+    return actual;
+}
+
 #endif // __FFADO_ATOMIC__
 
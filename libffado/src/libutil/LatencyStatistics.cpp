@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "LatencyStatistics.h"
+#include "PosixSharedMemory.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+namespace Util {
+
+struct LatencyStatisticsControl {
+    uint32_t            magic;
+    uint32_t            version;
+    volatile int32_t    pid;
+    uint32_t            nb_statistics;
+    struct LatencyHistogramData histograms[LatencyStatistics::eS_Count];
+};
+
+// --- LatencyHistogram
+
+LatencyHistogram::LatencyHistogram()
+: m_data( &m_local )
+{
+    reset();
+}
+
+unsigned int
+LatencyHistogram::getBucketIndex(uint32_t value)
+{
+    if (value < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    unsigned int msb = 31 - __builtin_clz(value);
+    unsigned int shift = msb - LATENCY_HISTOGRAM_SUB_BITS;
+    unsigned int sub = (value >> shift) - LATENCY_HISTOGRAM_SUB_BUCKETS;
+    return LATENCY_HISTOGRAM_SUB_BUCKETS + shift * LATENCY_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint32_t
+LatencyHistogram::getBucketUpperBound(unsigned int idx)
+{
+    if (idx < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return idx;
+    }
+    idx -= LATENCY_HISTOGRAM_SUB_BUCKETS;
+    unsigned int shift = idx / LATENCY_HISTOGRAM_SUB_BUCKETS;
+    uint64_t m = LATENCY_HISTOGRAM_SUB_BUCKETS + idx % LATENCY_HISTOGRAM_SUB_BUCKETS;
+    return (uint32_t)(((m + 1) << shift) - 1);
+}
+
+void
+LatencyHistogram::mark(uint32_t value)
+{
+    struct LatencyHistogramData *d = m_data;
+    __sync_fetch_and_add(&d->buckets[getBucketIndex(value)], 1);
+    __sync_fetch_and_add(&d->sum, value);
+    // min and max can be off by one concurrent update, that's ok
+    uint32_t v;
+    while (value > (v = d->max)) {
+        if (__sync_bool_compare_and_swap(&d->max, v, value)) break;
+    }
+    while (value < (v = d->min)) {
+        if (__sync_bool_compare_and_swap(&d->min, v, value)) break;
+    }
+    // the count last, readers use it to see if there is data
+    __sync_fetch_and_add(&d->count, 1);
+}
+
+void
+LatencyHistogram::reset()
+{
+    struct LatencyHistogramData *d = m_data;
+    d->count = 0;
+    d->sum = 0;
+    d->min = 0xFFFFFFFF;
+    d->max = 0;
+    for (unsigned int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        d->buckets[i] = 0;
+    }
+}
+
+void
+LatencyHistogram::attach(struct LatencyHistogramData *d, bool copy)
+{
+    if (copy) {
+        memcpy((void *)d, (void *)m_data, sizeof(*d));
+    }
+    __sync_synchronize();
+    m_data = d;
+}
+
+void
+LatencyHistogram::detach(bool copy)
+{
+    if (m_data != &m_local) {
+        attach(&m_local, copy);
+    }
+}
+
+uint32_t
+LatencyHistogram::getMean()
+{
+    uint64_t count = m_data->count;
+    if (count == 0) {
+        return 0;
+    }
+    return (uint32_t)(m_data->sum / count);
+}
+
+uint32_t
+LatencyHistogram::getPercentile(double fraction)
+{
+    uint64_t count = m_data->count;
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(fraction * count + 0.5);
+    if (target < 1) target = 1;
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += m_data->buckets[i];
+        if (seen >= target) {
+            uint32_t bound = getBucketUpperBound(i);
+            uint32_t max = m_data->max;
+            return (bound < max ? bound : max);
+        }
+    }
+    return m_data->max;
+}
+
+// --- LatencyStatistics
+
+// PosixSharedMemory::Open() complains loudly about a missing segment,
+// which is the normal case here
+static bool
+segmentExists()
+{
+    int fd = shm_open(LATENCY_STATISTICS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    ::close(fd);
+    return true;
+}
+
+IMPL_DEBUG_MODULE( LatencyStatistics, LatencyStatistics, DEBUG_LEVEL_NORMAL );
+
+LatencyStatistics::LatencyStatistics()
+: m_memblock( NULL )
+, m_owner( false )
+{
+}
+
+LatencyStatistics::~LatencyStatistics()
+{
+    close();
+}
+
+const char *
+LatencyStatistics::getName(enum eStatistic s)
+{
+    switch (s) {
+        case eS_PeriodOversleep:    return "period_oversleep_usecs";
+        case eS_IsoWakeupLatency:   return "iso_wakeup_latency_usecs";
+        case eS_PacketsPerIterate:  return "packets_per_iterate";
+        case eS_DecodeTime:         return "decode_time_nsecs";
+        case eS_BufferFill:         return "buffer_fill_frames";
+        case eS_DllError:           return "dll_error_ticks";
+        default:                    return "invalid";
+    }
+}
+
+bool
+LatencyStatistics::publish()
+{
+    if (m_owner) {
+        return true;
+    }
+    if (m_memblock) {
+        debugError("already attached to the statistics of another process\n");
+        return false;
+    }
+
+    // don't take over the segment of another live process
+    PosixSharedMemory probe(LATENCY_STATISTICS_SHM_NAME, sizeof(struct LatencyStatisticsControl));
+    probe.setVerboseLevel(getDebugLevel());
+    if (segmentExists() && probe.Open(PosixSharedMemory::eD_ReadOnly)) {
+        struct LatencyStatisticsControl *c = (struct LatencyStatisticsControl *)
+            probe.requestBlock(0, sizeof(struct LatencyStatisticsControl));
+        if (c && c->magic == LATENCY_STATISTICS_MAGIC && c->pid != 0
+            && c->pid != getpid()
+            && !(kill(c->pid, 0) < 0 && errno == ESRCH)) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "statistics are published by process %d\n", c->pid);
+            return false;
+        }
+    }
+
+    m_memblock = new PosixSharedMemory(LATENCY_STATISTICS_SHM_NAME,
+                                       sizeof(struct LatencyStatisticsControl));
+    if (!m_memblock->Create(PosixSharedMemory::eD_ReadWrite)) {
+        debugWarning("could not create the statistics segment\n");
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    struct LatencyStatisticsControl *c = (struct LatencyStatisticsControl *)
+        m_memblock->requestBlock(0, sizeof(struct LatencyStatisticsControl));
+    if (c == NULL) {
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    c->magic = 0;
+    c->version = LATENCY_STATISTICS_VERSION;
+    c->pid = getpid();
+    c->nb_statistics = eS_Count;
+    for (int i = 0; i < eS_Count; i++) {
+        m_histograms[i].attach(&c->histograms[i], true);
+    }
+    __sync_synchronize();
+    c->magic = LATENCY_STATISTICS_MAGIC;
+    m_owner = true;
+    return true;
+}
+
+bool
+LatencyStatistics::open()
+{
+    if (m_owner) {
+        return true;
+    }
+    if (m_memblock) {
+        struct LatencyStatisticsControl *c = (struct LatencyStatisticsControl *)
+            m_memblock->requestBlock(0, sizeof(struct LatencyStatisticsControl));
+        if (c && c->magic == LATENCY_STATISTICS_MAGIC) {
+            return true;
+        }
+        // the publisher is gone
+        close();
+    }
+    if (!segmentExists()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "no statistics published\n");
+        return false;
+    }
+    m_memblock = new PosixSharedMemory(LATENCY_STATISTICS_SHM_NAME,
+                                       sizeof(struct LatencyStatisticsControl));
+    m_memblock->setVerboseLevel(getDebugLevel());
+    if (!m_memblock->Open(PosixSharedMemory::eD_ReadWrite)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "no statistics published\n");
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    struct LatencyStatisticsControl *c = (struct LatencyStatisticsControl *)
+        m_memblock->requestBlock(0, sizeof(struct LatencyStatisticsControl));
+    if (c == NULL || c->magic != LATENCY_STATISTICS_MAGIC
+        || c->version != LATENCY_STATISTICS_VERSION
+        || c->nb_statistics != eS_Count) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "statistics segment is stale or incompatible\n");
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    for (int i = 0; i < eS_Count; i++) {
+        m_histograms[i].attach(&c->histograms[i], false);
+    }
+    return true;
+}
+
+void
+LatencyStatistics::close()
+{
+    if (m_memblock == NULL) {
+        return;
+    }
+    struct LatencyStatisticsControl *c = (struct LatencyStatisticsControl *)
+        m_memblock->requestBlock(0, sizeof(struct LatencyStatisticsControl));
+    if (m_owner && c) {
+        c->magic = 0;
+        c->pid = 0;
+    }
+    for (int i = 0; i < eS_Count; i++) {
+        m_histograms[i].detach(m_owner);
+    }
+    delete m_memblock;
+    m_memblock = NULL;
+    m_owner = false;
+}
+
+void
+LatencyStatistics::reset()
+{
+    for (int i = 0; i < eS_Count; i++) {
+        m_histograms[i].reset();
+    }
+}
+
+void
+LatencyStatistics::show()
+{
+    debugOutput(DEBUG_LEVEL_NORMAL, "Latency statistics%s:\n",
+                (m_owner ? " (published)" : ""));
+    for (int i = 0; i < eS_Count; i++) {
+        LatencyHistogram &h = m_histograms[i];
+        debugOutput(DEBUG_LEVEL_NORMAL,
+                    " %-26s: cnt %10"PRIu64", min %8u, mean %8u, p50 %8u, p99 %8u, p99.9 %8u, max %8u\n",
+                    getName((enum eStatistic)i), h.getCount(), h.getMin(), h.getMean(),
+                    h.getPercentile(0.5), h.getPercentile(0.99), h.getPercentile(0.999),
+                    h.getMax());
+    }
+}
+
+void
+LatencyStatistics::setVerboseLevel(int l)
+{
+    setDebugLevel(l);
+    if (m_memblock) m_memblock->setVerboseLevel(l);
+}
+
+} // Util
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __UTIL_LATENCY_STATISTICS__
+#define __UTIL_LATENCY_STATISTICS__
+
+#include "debugmodule/debugmodule.h"
+
+#include <stdint.h>
+
+// values below 2^LATENCY_HISTOGRAM_SUB_BITS are counted exactly, above
+// that every power of two is split in 2^LATENCY_HISTOGRAM_SUB_BITS
+// buckets, i.e. the relative error is below 1/16
+#define LATENCY_HISTOGRAM_SUB_BITS      4
+#define LATENCY_HISTOGRAM_SUB_BUCKETS   (1 << LATENCY_HISTOGRAM_SUB_BITS)
+#define LATENCY_HISTOGRAM_BUCKETS       ((32 - LATENCY_HISTOGRAM_SUB_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+#define LATENCY_STATISTICS_MAGIC        0x46534c31
+#define LATENCY_STATISTICS_VERSION      1
+#define LATENCY_STATISTICS_SHM_NAME     "ffado-latency-stats"
+
+namespace Util {
+
+class PosixSharedMemory;
+
+struct LatencyHistogramData {
+    volatile uint64_t   count;
+    volatile uint64_t   sum;
+    volatile uint32_t   min;
+    volatile uint32_t   max;
+    volatile uint32_t   buckets[LATENCY_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @brief A log-linear histogram that can be updated from any thread
+ *
+ * mark() only does atomic increments, so several threads can feed the
+ * same histogram and a reader can evaluate it at any time without
+ * stopping them. The data can be moved to shared memory with attach()
+ * to make it visible to other processes.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+    ~LatencyHistogram() {};
+
+    void mark(uint32_t value);
+    void reset();
+
+    /**
+     * Makes the histogram use the given storage
+     * @param copy take the current values along, otherwise use the
+     *             values that are in the storage already
+     */
+    void attach(struct LatencyHistogramData *d, bool copy);
+    /// goes back to the private storage
+    void detach(bool copy);
+
+    uint64_t getCount() {return m_data->count;};
+    uint32_t getMin() {return (m_data->count ? m_data->min : 0);};
+    uint32_t getMax() {return m_data->max;};
+    uint32_t getMean();
+    /**
+     * @param fraction e.g. 0.99 for the 99th percentile
+     * @return an upper bound for the value below which the given
+     *         fraction of the marked values lies
+     */
+    uint32_t getPercentile(double fraction);
+
+    static unsigned int getBucketIndex(uint32_t value);
+    static uint32_t getBucketUpperBound(unsigned int idx);
+
+private:
+    struct LatencyHistogramData m_local;
+    struct LatencyHistogramData *m_data;
+};
+
+/**
+ * @brief The set of histograms kept by the streaming code
+ *
+ * The histograms are always collected, also in release builds. The
+ * streaming process publishes them in a shared memory segment so that
+ * other processes (e.g. ffado-dbus-server) can read them.
+ */
+class LatencyStatistics
+{
+public:
+    // keep in sync with ffado_streaming_stat_id
+    enum eStatistic {
+        eS_PeriodOversleep = 0, ///< usecs waitForPeriod() returned late
+        eS_IsoWakeupLatency,    ///< usecs between reception and processing of a packet
+        eS_PacketsPerIterate,   ///< packets handled per ISO handler iteration
+        eS_DecodeTime,          ///< nsecs to decode one period
+        eS_BufferFill,          ///< frames in the sync source buffer at transfer
+        eS_DllError,            ///< ticks error of the timestamp DLL
+        eS_Count
+    };
+
+public:
+    LatencyStatistics();
+    ~LatencyStatistics();
+
+    /**
+     * Moves the histograms to shared memory. Fails if another live
+     * process already publishes its statistics.
+     */
+    bool publish();
+    /**
+     * Attaches to the statistics published by another process, or
+     * re-attaches if that process has gone and another one took over.
+     */
+    bool open();
+    bool isPublished() {return m_owner;};
+
+    LatencyHistogram &get(enum eStatistic s) {return m_histograms[s];};
+    void mark(enum eStatistic s, uint32_t value) {m_histograms[s].mark(value);};
+    void reset();
+
+    static const char *getName(enum eStatistic s);
+
+    void show();
+    void setVerboseLevel(int l);
+
+private:
+    void close();
+
+    LatencyHistogram    m_histograms[eS_Count];
+    PosixSharedMemory  *m_memblock;
+    bool                m_owner;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // Util
+
+#endif // __UTIL_LATENCY_STATISTICS__
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PortMeters.h"
+#include "PosixSharedMemory.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+// a reader gives up after this many torn snapshots
+#define PORT_METERS_READ_TRIES      100
+
+namespace Util {
+
+// PosixSharedMemory::Open() complains loudly about a missing segment,
+// which is the normal case here
+static bool
+segmentExists()
+{
+    int fd = shm_open(PORT_METERS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    ::close(fd);
+    return true;
+}
+
+IMPL_DEBUG_MODULE( PortMeters, PortMeters, DEBUG_LEVEL_NORMAL );
+
+PortMeters::PortMeters()
+: m_control( &m_local )
+, m_memblock( NULL )
+, m_owner( false )
+{
+    memset((void *)&m_local, 0, sizeof(m_local));
+    m_local.magic = PORT_METERS_MAGIC;
+    m_local.version = PORT_METERS_VERSION;
+    m_local.max_ports = PORT_METERS_MAX_PORTS;
+}
+
+PortMeters::~PortMeters()
+{
+    close();
+}
+
+bool
+PortMeters::publish()
+{
+    if (m_owner) {
+        return true;
+    }
+    if (m_memblock) {
+        debugError("already attached to the meters of another process\n");
+        return false;
+    }
+
+    // don't take over the segment of another live process, or of
+    // another instance in this one: there can only be one writer
+    PosixSharedMemory probe(PORT_METERS_SHM_NAME, sizeof(struct PortMetersControl));
+    probe.setVerboseLevel(getDebugLevel());
+    if (segmentExists() && probe.Open(PosixSharedMemory::eD_ReadOnly)) {
+        struct PortMetersControl *c = (struct PortMetersControl *)
+            probe.requestBlock(0, sizeof(struct PortMetersControl));
+        if (c && c->magic == PORT_METERS_MAGIC && c->pid != 0
+            && !(kill(c->pid, 0) < 0 && errno == ESRCH)) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "meters are published by process %d\n", c->pid);
+            return false;
+        }
+    }
+
+    m_memblock = new PosixSharedMemory(PORT_METERS_SHM_NAME,
+                                       sizeof(struct PortMetersControl));
+    // meter clients of other users only need to read it
+    if (!m_memblock->Create(PosixSharedMemory::eD_ReadWrite,
+                            S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) {
+        debugWarning("could not create the meter segment\n");
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    struct PortMetersControl *c = (struct PortMetersControl *)
+        m_memblock->requestBlock(0, sizeof(struct PortMetersControl));
+    if (c == NULL) {
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    memcpy((void *)c, (void *)&m_local, sizeof(*c));
+    c->magic = 0;
+    c->pid = getpid();
+    __sync_synchronize();
+    c->magic = PORT_METERS_MAGIC;
+    m_control = c;
+    m_owner = true;
+    return true;
+}
+
+bool
+PortMeters::open()
+{
+    if (m_owner) {
+        return true;
+    }
+    if (m_memblock) {
+        if (m_control->magic == PORT_METERS_MAGIC) {
+            return true;
+        }
+        // the publisher is gone
+        close();
+    }
+    if (!segmentExists()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "no meters published\n");
+        return false;
+    }
+    m_memblock = new PosixSharedMemory(PORT_METERS_SHM_NAME,
+                                       sizeof(struct PortMetersControl));
+    m_memblock->setVerboseLevel(getDebugLevel());
+    if (!m_memblock->Open(PosixSharedMemory::eD_ReadOnly)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "no meters published\n");
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    struct PortMetersControl *c = (struct PortMetersControl *)
+        m_memblock->requestBlock(0, sizeof(struct PortMetersControl));
+    if (c == NULL || c->magic != PORT_METERS_MAGIC
+        || c->version != PORT_METERS_VERSION
+        || c->max_ports != PORT_METERS_MAX_PORTS) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "meter segment is stale or incompatible\n");
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    m_control = c;
+    return true;
+}
+
+void
+PortMeters::close()
+{
+    if (m_memblock == NULL) {
+        return;
+    }
+    if (m_owner) {
+        // keep metering locally
+        memcpy((void *)&m_local, (void *)m_control, sizeof(m_local));
+        m_local.pid = 0;
+        m_control->magic = 0;
+        m_control->pid = 0;
+    }
+    m_control = &m_local;
+    delete m_memblock;
+    m_memblock = NULL;
+    m_owner = false;
+}
+
+void
+PortMeters::beginUpdate()
+{
+    m_control->sequence++;
+    __sync_synchronize();
+}
+
+void
+PortMeters::endUpdate()
+{
+    __sync_synchronize();
+    m_control->sequence++;
+}
+
+bool
+PortMeters::setNbPorts(unsigned int n)
+{
+    if (n > PORT_METERS_MAX_PORTS) {
+        debugWarning("%u ports, only the first %u are metered\n", n, PORT_METERS_MAX_PORTS);
+        m_control->nb_ports = PORT_METERS_MAX_PORTS;
+        return false;
+    }
+    m_control->nb_ports = n;
+    return true;
+}
+
+bool
+PortMeters::setPort(unsigned int idx, const char *name, enum eDirection d)
+{
+    if (idx >= PORT_METERS_MAX_PORTS) {
+        return false;
+    }
+    struct PortMeterData *p = &m_control->ports[idx];
+    strncpy(p->name, name, PORT_METERS_NAME_LENGTH - 1);
+    p->name[PORT_METERS_NAME_LENGTH - 1] = 0;
+    p->direction = d;
+    p->peak = 0.0f;
+    p->rms = 0.0f;
+    return true;
+}
+
+int
+PortMeters::read(struct PortMeterData *meters, unsigned int max_ports, uint32_t *sequence)
+{
+    struct PortMetersControl *c = m_control;
+    for (int tries = 0; tries < PORT_METERS_READ_TRIES; tries++) {
+        uint32_t seq = c->sequence;
+        if (seq & 1) {
+            // the writer is busy, that takes only a few usecs
+            sched_yield();
+            continue;
+        }
+        __sync_synchronize();
+        unsigned int n = c->nb_ports;
+        if (n > PORT_METERS_MAX_PORTS) n = PORT_METERS_MAX_PORTS;
+        if (n > max_ports) n = max_ports;
+        memcpy((void *)meters, (void *)c->ports, n * sizeof(struct PortMeterData));
+        __sync_synchronize();
+        if (c->sequence == seq) {
+            if (sequence) *sequence = seq;
+            return n;
+        }
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "no consistent meter snapshot\n");
+    return -1;
+}
+
+void
+PortMeters::show()
+{
+    struct PortMeterData meters[PORT_METERS_MAX_PORTS];
+    uint32_t seq = 0;
+    int n = read(meters, PORT_METERS_MAX_PORTS, &seq);
+    debugOutput(DEBUG_LEVEL_NORMAL, "Port meters%s (update %u):\n",
+                (m_owner ? " (published)" : ""), seq / 2);
+    for (int i = 0; i < n; i++) {
+        debugOutput(DEBUG_LEVEL_NORMAL, " %-40.*s %s: peak %8.5f, rms %8.5f\n",
+                    PORT_METERS_NAME_LENGTH, meters[i].name,
+                    (meters[i].direction == eD_Capture ? "capture " : "playback"),
+                    meters[i].peak, meters[i].rms);
+    }
+}
+
+void
+PortMeters::setVerboseLevel(int l)
+{
+    setDebugLevel(l);
+    if (m_memblock) m_memblock->setVerboseLevel(l);
+}
+
+} // Util
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __UTIL_PORT_METERS__
+#define __UTIL_PORT_METERS__
+
+#include "debugmodule/debugmodule.h"
+
+#include <stdint.h>
+
+#define PORT_METERS_MAGIC           0x46504d31
+#define PORT_METERS_VERSION         1
+// a well-known name, such that meter clients can find the segment
+// without knowing the streaming process. Hence only one process
+// can publish its meters at a time.
+#define PORT_METERS_SHM_NAME        "ffado-port-meters"
+#define PORT_METERS_MAX_PORTS       512
+#define PORT_METERS_NAME_LENGTH     64
+
+namespace Util {
+
+class PosixSharedMemory;
+
+struct PortMeterData {
+    char                name[PORT_METERS_NAME_LENGTH];
+    uint32_t            direction;
+    float               peak;   ///< of the last period, full scale is 1.0
+    float               rms;    ///< of the last period, full scale is 1.0
+};
+
+/**
+ * @brief The layout of the port meter segment
+ *
+ * The sequence number is a seqlock: it is odd while the writer
+ * updates the block. A reader copies what it needs and retries if the
+ * sequence number was odd or changed in the meantime, so readers never
+ * block the writer and need no write access to the segment.
+ */
+struct PortMetersControl {
+    uint32_t            magic;
+    uint32_t            version;
+    volatile int32_t    pid;
+    volatile uint32_t   sequence;
+    volatile uint32_t   nb_ports;
+    uint32_t            max_ports;
+    struct PortMeterData ports[PORT_METERS_MAX_PORTS];
+};
+
+/**
+ * @brief Per-port peak and RMS values of the streams
+ *
+ * The streaming code updates the meters once per period and publishes
+ * them in a shared memory segment, such that meter clients don't need
+ * to poll the device. Any number of readers can map the segment, also
+ * readers of other users as it is world-readable.
+ *
+ * There is a single segment per host: if several processes stream,
+ * only the first one to publish its meters is visible, the others
+ * keep metering locally.
+ */
+class PortMeters
+{
+public:
+    enum eDirection {
+        eD_Capture = 0,
+        eD_Playback,
+    };
+
+public:
+    PortMeters();
+    ~PortMeters();
+
+    /**
+     * Moves the meters to shared memory. Fails if another live
+     * process already publishes its meters, the meters then stay
+     * local to this process.
+     */
+    bool publish();
+    /**
+     * Attaches (read-only) to the meters published by another process,
+     * or re-attaches if that process has gone and another one took over.
+     */
+    bool open();
+    void close();
+    bool isPublished() {return m_owner;};
+
+    // writer side, the updates have to be done between
+    // beginUpdate() and endUpdate()
+    void beginUpdate();
+    void endUpdate();
+    bool setNbPorts(unsigned int n);
+    bool setPort(unsigned int idx, const char *name, enum eDirection d);
+    void setValues(unsigned int idx, float peak, float rms)
+        {m_control->ports[idx].peak = peak;
+         m_control->ports[idx].rms = rms;};
+
+    /**
+     * Takes a consistent snapshot of the meters
+     * @param meters the array to copy the meters to
+     * @param max_ports the size of the array
+     * @param sequence if not NULL, receives the sequence number of
+     *                 the snapshot (it increases by two per update)
+     * @return the number of ports copied, -1 if no consistent snapshot
+     *         could be taken
+     */
+    int read(struct PortMeterData *meters, unsigned int max_ports, uint32_t *sequence);
+
+    void show();
+    void setVerboseLevel(int l);
+
+private:
+    struct PortMetersControl    m_local;
+    struct PortMetersControl   *m_control;
+    PosixSharedMemory          *m_memblock;
+    bool                        m_owner;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // Util
+
+#endif // __UTIL_PORT_METERS__
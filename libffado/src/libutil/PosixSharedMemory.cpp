@@ -118,7 +118,7 @@ PosixSharedMemory::Open(enum eDirection d)
 }
 
 bool
-PosixSharedMemory::Create(enum eDirection d)
+PosixSharedMemory::Create(enum eDirection d, mode_t mode)
 {
     debugOutput(DEBUG_LEVEL_VERBOSE, 
                 "(%p, %s) create dir: %d, size: %u \n",
@@ -130,7 +130,7 @@ PosixSharedMemory::Create(enum eDirection d)
     // open the shared memory segment
     // always create it readwrite, if not, the other side can't map
     // it correctly, nor can we truncate it to the right length.
-    int fd = shm_open(m_name.c_str(), O_RDWR|O_CREAT, S_IRWXU);
+    int fd = shm_open(m_name.c_str(), O_RDWR|O_CREAT, mode);
     if (fd < 0) {
         debugError("(%p, %s) Cannot open shared memory: %s\n",
                     this, m_name.c_str(), strerror (errno));
@@ -138,6 +138,12 @@ PosixSharedMemory::Create(enum eDirection d)
         return false;
     }
 
+    // the umask applies to shm_open()
+    if (fchmod(fd, mode) < 0) {
+        debugWarning("(%p, %s) Cannot set shared memory permissions: %s\n",
+                     this, m_name.c_str(), strerror (errno));
+    }
+
     // set size
     if (ftruncate (fd, m_size) < 0) {
         debugError("(%p, %s) Cannot set shared memory size: %s\n",
@@ -27,6 +27,7 @@
 #include "debugmodule/debugmodule.h"
 
 #include <string>
+#include <sys/stat.h>
 
 namespace Util {
 
@@ -62,7 +63,14 @@ public:
      */
     bool LockInMemory(bool lock);
 
-    virtual bool Create(enum eDirection d=eD_ReadWrite);
+    /**
+     * Creates the segment and maps it
+     * @param d the access of this side
+     * @param mode the permissions of the segment, applied regardless
+     *             of the umask
+     * @return true if successful
+     */
+    virtual bool Create(enum eDirection d=eD_ReadWrite, mode_t mode=S_IRWXU);
     virtual bool Open(enum eDirection d=eD_ReadWrite);
     virtual bool Close();
 
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ShmClientRegistry.h"
+#include "PosixSharedMemory.h"
+#include "Atomic.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+
+namespace Util {
+
+struct ShmRegistryEntry {
+    volatile int32_t    state;
+    volatile int32_t    pid;
+    char                name[FFADO_SHM_REGISTRY_NAME_LEN];
+    uint32_t            nb_periods;
+    uint32_t            nb_capture;
+    uint32_t            nb_playback;
+    uint16_t            capture_map[FFADO_SHM_REGISTRY_MAX_CHANNELS];
+    uint16_t            playback_map[FFADO_SHM_REGISTRY_MAX_CHANNELS];
+    volatile uint32_t   overruns;
+    volatile uint32_t   underruns;
+};
+
+struct ShmRegistryControl {
+    uint32_t            magic;
+    uint32_t            version;
+    volatile int32_t    server_pid;
+    uint32_t            period;
+    uint32_t            samplerate;
+    uint32_t            nb_capture;
+    uint32_t            nb_playback;
+    struct ShmRegistryEntry entries[FFADO_SHM_REGISTRY_MAX_CLIENTS];
+};
+
+IMPL_DEBUG_MODULE( ShmClientRegistry, ShmClientRegistry, DEBUG_LEVEL_NORMAL );
+
+ShmClientRegistry::ShmClientRegistry(std::string name)
+: m_name( name )
+, m_server( false )
+, m_memblock( NULL )
+, m_control( NULL )
+{
+}
+
+ShmClientRegistry::~ShmClientRegistry()
+{
+    if(m_server && m_control) {
+        m_control->server_pid = 0;
+        m_control->magic = 0;
+    }
+    delete m_memblock;
+}
+
+bool
+ShmClientRegistry::create(unsigned int period, unsigned int samplerate,
+                          unsigned int nb_capture, unsigned int nb_playback)
+{
+    if(m_memblock) {
+        debugError("(%s) already open\n", m_name.c_str());
+        return false;
+    }
+    m_memblock = new PosixSharedMemory(m_name, sizeof(struct ShmRegistryControl));
+    if(!m_memblock->Create(PosixSharedMemory::eD_ReadWrite)) {
+        debugError("(%s) could not create registry\n", m_name.c_str());
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    m_control = (struct ShmRegistryControl *)
+        m_memblock->requestBlock(0, sizeof(struct ShmRegistryControl));
+    if(m_control == NULL) {
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    memset(m_control, 0, sizeof(struct ShmRegistryControl));
+    m_control->version = FFADO_SHM_REGISTRY_VERSION;
+    m_control->server_pid = getpid();
+    m_control->period = period;
+    m_control->samplerate = samplerate;
+    m_control->nb_capture = nb_capture;
+    m_control->nb_playback = nb_playback;
+    __sync_synchronize();
+    m_control->magic = FFADO_SHM_REGISTRY_MAGIC;
+    m_server = true;
+    return true;
+}
+
+bool
+ShmClientRegistry::open()
+{
+    if(m_memblock) {
+        debugError("(%s) already open\n", m_name.c_str());
+        return false;
+    }
+    m_memblock = new PosixSharedMemory(m_name, sizeof(struct ShmRegistryControl));
+    m_memblock->setVerboseLevel(getDebugLevel());
+    if(!m_memblock->Open(PosixSharedMemory::eD_ReadWrite)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%s) no registry\n", m_name.c_str());
+        delete m_memblock;
+        m_memblock = NULL;
+        return false;
+    }
+    m_control = (struct ShmRegistryControl *)
+        m_memblock->requestBlock(0, sizeof(struct ShmRegistryControl));
+    if(m_control == NULL || m_control->magic != FFADO_SHM_REGISTRY_MAGIC
+       || m_control->version != FFADO_SHM_REGISTRY_VERSION
+       || m_control->server_pid == 0
+       || (kill(m_control->server_pid, 0) < 0 && errno == ESRCH)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%s) registry is stale or incompatible\n",
+                    m_name.c_str());
+        delete m_memblock;
+        m_memblock = NULL;
+        m_control = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool
+ShmClientRegistry::isValidIndex(int idx)
+{
+    return m_control && idx >= 0 && idx < FFADO_SHM_REGISTRY_MAX_CLIENTS;
+}
+
+enum ShmClientRegistry::eClientState
+ShmClientRegistry::getClientState(int idx)
+{
+    if(!isValidIndex(idx)) {
+        return eCS_Free;
+    }
+    return (enum eClientState)m_control->entries[idx].state;
+}
+
+bool
+ShmClientRegistry::getClientRequest(int idx, ClientRequest &r)
+{
+    if(!isValidIndex(idx)) {
+        return false;
+    }
+    struct ShmRegistryEntry *e = &m_control->entries[idx];
+    // don't read the request before the state
+    __sync_synchronize();
+    if(e->nb_capture > FFADO_SHM_REGISTRY_MAX_CHANNELS
+       || e->nb_playback > FFADO_SHM_REGISTRY_MAX_CHANNELS) {
+        return false;
+    }
+    r.name = std::string(e->name, strnlen(e->name, FFADO_SHM_REGISTRY_NAME_LEN));
+    r.pid = e->pid;
+    r.nb_periods = e->nb_periods;
+    r.capture.assign(e->capture_map, e->capture_map + e->nb_capture);
+    r.playback.assign(e->playback_map, e->playback_map + e->nb_playback);
+    return true;
+}
+
+void
+ShmClientRegistry::setClientState(int idx, enum eClientState s)
+{
+    if(!isValidIndex(idx)) {
+        return;
+    }
+    __sync_synchronize();
+    m_control->entries[idx].state = s;
+}
+
+bool
+ShmClientRegistry::isClientGone(int idx)
+{
+    if(!isValidIndex(idx)) {
+        return true;
+    }
+    int32_t pid = m_control->entries[idx].pid;
+    return pid > 0 && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+void
+ShmClientRegistry::freeClient(int idx)
+{
+    if(!isValidIndex(idx)) {
+        return;
+    }
+    struct ShmRegistryEntry *e = &m_control->entries[idx];
+    e->pid = 0;
+    e->overruns = 0;
+    e->underruns = 0;
+    setClientState(idx, eCS_Free);
+}
+
+void
+ShmClientRegistry::addOverrun(int idx)
+{
+    if(isValidIndex(idx)) {
+        m_control->entries[idx].overruns++;
+    }
+}
+
+void
+ShmClientRegistry::addUnderrun(int idx)
+{
+    if(isValidIndex(idx)) {
+        m_control->entries[idx].underruns++;
+    }
+}
+
+int
+ShmClientRegistry::connect(const ClientRequest &r)
+{
+    if(m_control == NULL) {
+        debugError("(%s) not open\n", m_name.c_str());
+        return -1;
+    }
+    if(r.capture.size() > FFADO_SHM_REGISTRY_MAX_CHANNELS
+       || r.playback.size() > FFADO_SHM_REGISTRY_MAX_CHANNELS) {
+        debugError("(%s) too many channels requested\n", m_name.c_str());
+        return -1;
+    }
+
+    int idx = -1;
+    for(int i = 0; i < FFADO_SHM_REGISTRY_MAX_CLIENTS; i++) {
+        if(CAS(eCS_Free, eCS_Claimed, &m_control->entries[i].state)) {
+            idx = i;
+            break;
+        }
+    }
+    if(idx < 0) {
+        debugError("(%s) no free client entry\n", m_name.c_str());
+        return -1;
+    }
+
+    struct ShmRegistryEntry *e = &m_control->entries[idx];
+    memset(e->name, 0, sizeof(e->name));
+    strncpy(e->name, r.name.c_str(), sizeof(e->name) - 1);
+    e->pid = getpid();
+    e->nb_periods = r.nb_periods;
+    e->nb_capture = r.capture.size();
+    e->nb_playback = r.playback.size();
+    for(unsigned int i = 0; i < r.capture.size(); i++) {
+        e->capture_map[i] = r.capture.at(i);
+    }
+    for(unsigned int i = 0; i < r.playback.size(); i++) {
+        e->playback_map[i] = r.playback.at(i);
+    }
+    e->overruns = 0;
+    e->underruns = 0;
+    setClientState(idx, eCS_Requested);
+
+    // the server polls the requests every few milliseconds
+    for(int t = 0; t < FFADO_SHM_REGISTRY_CONNECT_TIMEOUT_MSEC; t++) {
+        enum eClientState s = getClientState(idx);
+        if(s == eCS_Active) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "(%s) connected as client %d\n",
+                        m_name.c_str(), idx);
+            return idx;
+        }
+        if(s == eCS_Rejected) {
+            debugError("(%s) request rejected by the server\n", m_name.c_str());
+            setClientState(idx, eCS_Closing);
+            return -1;
+        }
+        usleep(1000);
+    }
+    debugError("(%s) server did not respond\n", m_name.c_str());
+    setClientState(idx, eCS_Closing);
+    return -1;
+}
+
+void
+ShmClientRegistry::disconnect(int idx)
+{
+    if(!isValidIndex(idx)) {
+        return;
+    }
+    setClientState(idx, eCS_Closing);
+}
+
+unsigned int
+ShmClientRegistry::getPeriod()
+{
+    return (m_control ? m_control->period : 0);
+}
+
+unsigned int
+ShmClientRegistry::getSampleRate()
+{
+    return (m_control ? m_control->samplerate : 0);
+}
+
+unsigned int
+ShmClientRegistry::getNbCapture()
+{
+    return (m_control ? m_control->nb_capture : 0);
+}
+
+unsigned int
+ShmClientRegistry::getNbPlayback()
+{
+    return (m_control ? m_control->nb_playback : 0);
+}
+
+unsigned int
+ShmClientRegistry::getOverruns(int idx)
+{
+    return (isValidIndex(idx) ? m_control->entries[idx].overruns : 0);
+}
+
+unsigned int
+ShmClientRegistry::getUnderruns(int idx)
+{
+    return (isValidIndex(idx) ? m_control->entries[idx].underruns : 0);
+}
+
+std::string
+ShmClientRegistry::getRingName(int idx, bool capture)
+{
+    char tmp[16];
+    snprintf(tmp, sizeof(tmp), "-%d-", idx);
+    return m_name + tmp + (capture ? "capture" : "playback");
+}
+
+void
+ShmClientRegistry::show()
+{
+    debugOutput(DEBUG_LEVEL_NORMAL, "(%p) ShmClientRegistry %s\n", this, m_name.c_str());
+    if(m_control == NULL) {
+        return;
+    }
+    debugOutput(DEBUG_LEVEL_NORMAL, " server %d, period %u, rate %u, %u capture, %u playback\n",
+                m_control->server_pid, m_control->period, m_control->samplerate,
+                m_control->nb_capture, m_control->nb_playback);
+    for(int i = 0; i < FFADO_SHM_REGISTRY_MAX_CLIENTS; i++) {
+        struct ShmRegistryEntry *e = &m_control->entries[i];
+        if(e->state == eCS_Free) continue;
+        debugOutput(DEBUG_LEVEL_NORMAL,
+                    " client %d: '%.*s' pid %d, state %d, %u periods, %u/%u channels, %u overruns, %u underruns\n",
+                    i, FFADO_SHM_REGISTRY_NAME_LEN, e->name, e->pid, e->state,
+                    e->nb_periods, e->nb_capture, e->nb_playback,
+                    e->overruns, e->underruns);
+    }
+}
+
+void
+ShmClientRegistry::setVerboseLevel(int i)
+{
+    setDebugLevel(i);
+    if(m_memblock) m_memblock->setVerboseLevel(i);
+}
+
+} // Util
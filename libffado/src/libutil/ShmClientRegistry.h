@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __UTIL_SHM_CLIENT_REGISTRY__
+#define __UTIL_SHM_CLIENT_REGISTRY__
+
+#include "debugmodule/debugmodule.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define FFADO_SHM_REGISTRY_MAGIC        0x46524731
+#define FFADO_SHM_REGISTRY_VERSION      1
+
+#define FFADO_SHM_REGISTRY_MAX_CLIENTS  16
+#define FFADO_SHM_REGISTRY_MAX_CHANNELS 128
+#define FFADO_SHM_REGISTRY_NAME_LEN     32
+
+// how long a client waits for the server to accept it
+#define FFADO_SHM_REGISTRY_CONNECT_TIMEOUT_MSEC 2000
+
+namespace Util {
+
+class PosixSharedMemory;
+struct ShmRegistryControl;
+
+/**
+ * @brief A table of client connections in POSIX shared memory
+ *
+ * A streaming server publishes the stream layout (period, rate,
+ * channel counts) in the registry. A client claims a free entry,
+ * writes the channels it wants and the number of periods it wants to
+ * buffer, and waits until the server accepts the request. The server
+ * then creates one ShmRingBuffer per direction for the client, named
+ * by getRingName(). The ring blocks hold the selected channels one
+ * after the other, one period of float samples each.
+ *
+ * The server polls the table every few milliseconds, no locks are
+ * shared between the processes.
+ */
+class ShmClientRegistry
+{
+public:
+    enum eClientState {
+        eCS_Free        = 0,
+        eCS_Claimed     = 1, // a client is filling in its request
+        eCS_Requested   = 2, // waiting for the server
+        eCS_Active      = 3, // rings are set up
+        eCS_Rejected    = 4,
+        eCS_Closing     = 5, // the client has left
+    };
+
+    struct ClientRequest {
+        ClientRequest() : pid( 0 ), nb_periods( 0 ) {};
+        std::string                 name;
+        int                         pid;
+        unsigned int                nb_periods;
+        std::vector<unsigned int>   capture;  // server capture channel per ring channel
+        std::vector<unsigned int>   playback; // server playback channel per ring channel
+    };
+
+public:
+    ShmClientRegistry(std::string name);
+    ~ShmClientRegistry();
+
+    // server side
+    bool create(unsigned int period, unsigned int samplerate,
+                unsigned int nb_capture, unsigned int nb_playback);
+    enum eClientState getClientState(int idx);
+    bool getClientRequest(int idx, ClientRequest &r);
+    void setClientState(int idx, enum eClientState s);
+    /// true if the client process of an entry has died
+    bool isClientGone(int idx);
+    void freeClient(int idx);
+    void addOverrun(int idx);
+    void addUnderrun(int idx);
+
+    // client side
+    bool open();
+    /// @return the entry index, -1 if the request failed
+    int connect(const ClientRequest &r);
+    void disconnect(int idx);
+
+    unsigned int getPeriod();
+    unsigned int getSampleRate();
+    unsigned int getNbCapture();
+    unsigned int getNbPlayback();
+    unsigned int getOverruns(int idx);
+    unsigned int getUnderruns(int idx);
+
+    std::string getRingName(int idx, bool capture);
+
+    void show();
+    void setVerboseLevel(int l);
+
+private:
+    bool isValidIndex(int idx);
+
+private:
+    std::string         m_name;
+    bool                m_server;
+    PosixSharedMemory  *m_memblock;
+    ShmRegistryControl *m_control;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // Util
+
+#endif // __UTIL_SHM_CLIENT_REGISTRY__
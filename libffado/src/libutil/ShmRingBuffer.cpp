@@ -0,0 +1,595 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ShmRingBuffer.h"
+#include "PosixSharedMemory.h"
+#include "Atomic.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace Util {
+
+// each index lives on its own cache line, such that the producer and
+// the consumers don't bounce lines when they update their index
+#define SHM_RINGBUFFER_CACHELINE 64
+
+struct ShmRingSlot {
+    volatile int32_t    pid;        // 0: free, -1: being claimed
+    volatile uint32_t   read_idx;
+} __attribute__((aligned(SHM_RINGBUFFER_CACHELINE)));
+
+struct ShmRingControl {
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            nb_blocks;
+    uint32_t            block_size;
+    uint32_t            data_offset;
+    volatile int32_t    master_pid; // 0 once the master is gone
+    volatile int32_t    producer_pid;
+
+    // written by the producer, futex for sleeping consumers
+    volatile uint32_t   write_idx __attribute__((aligned(SHM_RINGBUFFER_CACHELINE)));
+    volatile int32_t    read_waiters;
+
+    // bumped by every consumer release, futex for a sleeping producer
+    volatile uint32_t   release_seq __attribute__((aligned(SHM_RINGBUFFER_CACHELINE)));
+    volatile int32_t    write_waiters;
+
+    struct ShmRingSlot  slots[FFADO_SHM_RINGBUFFER_MAX_SLOTS];
+};
+
+static int
+futex_wait(volatile uint32_t *addr, uint32_t value, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAIT, value, timeout, NULL, 0);
+}
+
+static int
+futex_wake(volatile uint32_t *addr)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static bool
+isProcessGone(int32_t pid)
+{
+    return pid > 0 && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+IMPL_DEBUG_MODULE( ShmRingBuffer, ShmRingBuffer, DEBUG_LEVEL_NORMAL );
+
+ShmRingBuffer::ShmRingBuffer(std::string name,
+                             enum eBufferType type,
+                             enum eDirection dir,
+                             enum eBlocking blocking,
+                             unsigned int nb_blocks, unsigned int block_size)
+: m_name(name)
+, m_blocks(nb_blocks)
+, m_blocksize(block_size)
+, m_type( type )
+, m_direction( dir )
+, m_blocking( blocking )
+, m_producer( (type == eBT_Master) == (dir == eD_Outward) )
+, m_initialized( false )
+, m_slot( -1 )
+, m_block_leased( false )
+, m_interrupt_seq( 0 )
+, m_memblock( NULL )
+, m_control( NULL )
+, m_data( NULL )
+{
+}
+
+ShmRingBuffer::~ShmRingBuffer()
+{
+    if(m_initialized) {
+        detach();
+    }
+    delete m_memblock;
+}
+
+bool
+ShmRingBuffer::init()
+{
+    if(m_initialized) {
+        debugError("(%s) already initialized\n", m_name.c_str());
+        return false;
+    }
+    if(!attach()) {
+        delete m_memblock;
+        m_memblock = NULL;
+        m_control = NULL;
+        return false;
+    }
+    m_initialized = true;
+    debugOutput(DEBUG_LEVEL_VERBOSE,
+                "(%s) attached as %s %s, %u blocks of %u bytes\n",
+                m_name.c_str(), (m_type == eBT_Master ? "master" : "slave"),
+                (m_producer ? "producer" : "consumer"),
+                m_blocks, m_blocksize);
+    return true;
+}
+
+bool
+ShmRingBuffer::attach()
+{
+    unsigned int data_offset = sizeof(struct ShmRingControl);
+    int32_t pid = getpid();
+
+    if(m_type == eBT_Master) {
+        if(m_blocks == 0 || m_blocksize == 0) {
+            debugError("(%s) bad geometry: %u blocks of %u bytes\n",
+                       m_name.c_str(), m_blocks, m_blocksize);
+            return false;
+        }
+        unsigned int size = data_offset + m_blocks * m_blocksize;
+        m_memblock = new PosixSharedMemory(m_name, size);
+        if(!m_memblock->Create(PosixSharedMemory::eD_ReadWrite)) {
+            debugError("(%s) could not create segment\n", m_name.c_str());
+            return false;
+        }
+        m_control = (struct ShmRingControl *)m_memblock->requestBlock(0, size);
+        if(m_control == NULL) {
+            return false;
+        }
+        if(!m_memblock->LockInMemory(true)) {
+            debugWarning("(%s) could not lock segment in memory\n", m_name.c_str());
+        }
+        memset(m_control, 0, data_offset);
+        m_control->version = FFADO_SHM_RINGBUFFER_VERSION;
+        m_control->nb_blocks = m_blocks;
+        m_control->block_size = m_blocksize;
+        m_control->data_offset = data_offset;
+        m_control->master_pid = pid;
+        if(m_producer) {
+            m_control->producer_pid = pid;
+        } else {
+            m_slot = 0;
+            m_control->slots[0].pid = pid;
+        }
+        // the magic marks the segment as ready
+        __sync_synchronize();
+        m_control->magic = FFADO_SHM_RINGBUFFER_MAGIC;
+    } else {
+        // map the control block first to learn the geometry
+        PosixSharedMemory header(m_name, data_offset);
+        if(!header.Open(PosixSharedMemory::eD_ReadWrite)) {
+            debugError("(%s) could not open segment\n", m_name.c_str());
+            return false;
+        }
+        struct ShmRingControl *c =
+            (struct ShmRingControl *)header.requestBlock(0, data_offset);
+        if(c == NULL || c->magic != FFADO_SHM_RINGBUFFER_MAGIC
+           || c->version != FFADO_SHM_RINGBUFFER_VERSION) {
+            debugError("(%s) segment has a bad magic or version\n", m_name.c_str());
+            return false;
+        }
+        if(c->data_offset != data_offset || c->master_pid == 0
+           || isProcessGone(c->master_pid)) {
+            debugError("(%s) segment is stale or incompatible\n", m_name.c_str());
+            return false;
+        }
+        m_blocks = c->nb_blocks;
+        m_blocksize = c->block_size;
+        header.Close();
+
+        unsigned int size = data_offset + m_blocks * m_blocksize;
+        m_memblock = new PosixSharedMemory(m_name, size);
+        if(!m_memblock->Open(PosixSharedMemory::eD_ReadWrite)) {
+            debugError("(%s) could not open segment\n", m_name.c_str());
+            return false;
+        }
+        m_control = (struct ShmRingControl *)m_memblock->requestBlock(0, size);
+        if(m_control == NULL) {
+            return false;
+        }
+
+        if(m_producer) {
+            int32_t current = m_control->producer_pid;
+            if(!CAS(0, pid, &m_control->producer_pid)
+               && !(isProcessGone(current) && CAS(current, pid, &m_control->producer_pid))) {
+                debugError("(%s) already has a producer (pid %d)\n",
+                           m_name.c_str(), current);
+                return false;
+            }
+        } else {
+            // a consumer starts at the current write position, it
+            // doesn't get blocks written before it attached
+            for(int pass = 0; pass < 2 && m_slot < 0; pass++) {
+                for(int i = 0; i < FFADO_SHM_RINGBUFFER_MAX_SLOTS; i++) {
+                    struct ShmRingSlot *s = &m_control->slots[i];
+                    if(CAS(0, (uint32_t)-1, &s->pid)) {
+                        s->read_idx = m_control->write_idx;
+                        __sync_synchronize();
+                        s->pid = pid;
+                        m_slot = i;
+                        break;
+                    }
+                }
+                if(m_slot < 0 && !reapConsumers()) {
+                    break;
+                }
+            }
+            if(m_slot < 0) {
+                debugError("(%s) no free consumer slot\n", m_name.c_str());
+                return false;
+            }
+        }
+    }
+    m_data = (char *)m_control + data_offset;
+    return true;
+}
+
+void
+ShmRingBuffer::detach()
+{
+    int32_t pid = getpid();
+    if(m_producer) {
+        CAS(pid, 0, &m_control->producer_pid);
+    } else if(m_slot >= 0) {
+        CAS(pid, 0, &m_control->slots[m_slot].pid);
+        m_slot = -1;
+    }
+    if(m_type == eBT_Master) {
+        m_control->master_pid = 0;
+        m_control->magic = 0;
+    }
+    // whoever waits should re-evaluate
+    __sync_synchronize();
+    INC_ATOMIC((volatile int32_t *)&m_control->release_seq);
+    futex_wake(&m_control->release_seq);
+    futex_wake(&m_control->write_idx);
+    m_memblock->LockInMemory(false);
+    m_initialized = false;
+}
+
+char *
+ShmRingBuffer::getBlock(unsigned int idx)
+{
+    return m_data + (idx % m_blocks) * m_blocksize;
+}
+
+unsigned int
+ShmRingBuffer::getMinReadIndex()
+{
+    uint32_t w = m_control->write_idx;
+    uint32_t max_fill = 0;
+    for(int i = 0; i < FFADO_SHM_RINGBUFFER_MAX_SLOTS; i++) {
+        struct ShmRingSlot *s = &m_control->slots[i];
+        if(s->pid > 0) {
+            uint32_t fill = w - s->read_idx;
+            if(fill > max_fill) max_fill = fill;
+        }
+    }
+    return w - max_fill;
+}
+
+bool
+ShmRingBuffer::reapConsumers()
+{
+    bool reaped = false;
+    for(int i = 0; i < FFADO_SHM_RINGBUFFER_MAX_SLOTS; i++) {
+        struct ShmRingSlot *s = &m_control->slots[i];
+        int32_t pid = s->pid;
+        if(isProcessGone(pid) && CAS(pid, 0, &s->pid)) {
+            debugWarning("(%s) consumer %d vanished, slot %d freed\n",
+                         m_name.c_str(), pid, i);
+            reaped = true;
+        }
+    }
+    return reaped;
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::waitOnWord(volatile uint32_t *word, uint32_t value,
+                          volatile int32_t *waiters)
+{
+    if(m_type == eBT_Slave && m_control->master_pid == 0) {
+        debugError("(%s) master is gone\n", m_name.c_str());
+        return eR_Error;
+    }
+    struct timespec ts;
+    ts.tv_sec = FFADO_SHM_RINGBUFFER_WAIT_TIMEOUT_MSEC / 1000;
+    ts.tv_nsec = (FFADO_SHM_RINGBUFFER_WAIT_TIMEOUT_MSEC % 1000) * 1000000L;
+
+    INC_ATOMIC(waiters);
+    __sync_synchronize();
+    int err = 0;
+    if(*word == value && futex_wait(word, value, &ts) < 0) {
+        err = errno;
+    }
+    DEC_ATOMIC(waiters);
+
+    if(err == ETIMEDOUT) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%s) wait timed out\n", m_name.c_str());
+        return eR_Timeout;
+    }
+    // woken, value changed (EAGAIN) or interrupted: let the caller recheck
+    return eR_OK;
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::requestBlockForWrite(void **block)
+{
+    if(!m_initialized || !m_producer) {
+        debugError("(%s) not a producer\n", m_name.c_str());
+        return eR_Error;
+    }
+    if(m_block_leased) {
+        debugError("(%s) block already requested\n", m_name.c_str());
+        return eR_Error;
+    }
+    uint32_t w = m_control->write_idx;
+    if(w - getMinReadIndex() >= m_blocks) {
+        if(m_blocking == eB_NonBlocking) {
+            if(!reapConsumers() || w - getMinReadIndex() >= m_blocks) {
+                return eR_Again;
+            }
+        } else {
+            enum eResult res = waitForWrite();
+            if(res != eR_OK) {
+                return res;
+            }
+        }
+    }
+    *block = getBlock(w);
+    m_block_leased = true;
+    return eR_OK;
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::releaseBlockForWrite()
+{
+    if(!m_block_leased) {
+        debugError("(%s) no block requested\n", m_name.c_str());
+        return eR_Error;
+    }
+    m_block_leased = false;
+    // the block contents have to be visible before the index
+    __sync_synchronize();
+    m_control->write_idx = m_control->write_idx + 1;
+    __sync_synchronize();
+    if(m_control->read_waiters) {
+        futex_wake(&m_control->write_idx);
+    }
+    return eR_OK;
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::waitForWrite()
+{
+    if(!m_initialized || !m_producer) {
+        debugError("(%s) not a producer\n", m_name.c_str());
+        return eR_Error;
+    }
+    while(true) {
+        uint32_t seq = m_control->release_seq;
+        __sync_synchronize();
+        if(m_control->write_idx - getMinReadIndex() < m_blocks) {
+            return eR_OK;
+        }
+        if(reapConsumers()) {
+            continue;
+        }
+        enum eResult res = waitOnWord(&m_control->release_seq, seq,
+                                      &m_control->write_waiters);
+        if(res != eR_OK) {
+            return res;
+        }
+    }
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::requestBlockForRead(void **block)
+{
+    if(!m_initialized || m_producer) {
+        debugError("(%s) not a consumer\n", m_name.c_str());
+        return eR_Error;
+    }
+    if(m_block_leased) {
+        debugError("(%s) block already requested\n", m_name.c_str());
+        return eR_Error;
+    }
+    struct ShmRingSlot *s = &m_control->slots[m_slot];
+    if(m_control->write_idx == s->read_idx) {
+        if(m_blocking == eB_NonBlocking) {
+            return eR_Again;
+        }
+        enum eResult res = waitForRead();
+        if(res != eR_OK) {
+            return res;
+        }
+    }
+    // don't read the block before the index
+    __sync_synchronize();
+    *block = getBlock(s->read_idx);
+    m_block_leased = true;
+    return eR_OK;
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::releaseBlockForRead()
+{
+    if(!m_block_leased) {
+        debugError("(%s) no block requested\n", m_name.c_str());
+        return eR_Error;
+    }
+    m_block_leased = false;
+    struct ShmRingSlot *s = &m_control->slots[m_slot];
+    // we're done with the block before the producer can reuse it
+    __sync_synchronize();
+    s->read_idx = s->read_idx + 1;
+    INC_ATOMIC((volatile int32_t *)&m_control->release_seq);
+    __sync_synchronize();
+    if(m_control->write_waiters) {
+        futex_wake(&m_control->release_seq);
+    }
+    return eR_OK;
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::waitForRead()
+{
+    if(!m_initialized || m_producer) {
+        debugError("(%s) not a consumer\n", m_name.c_str());
+        return eR_Error;
+    }
+    struct ShmRingSlot *s = &m_control->slots[m_slot];
+    while(true) {
+        uint32_t w = m_control->write_idx;
+        if(w != s->read_idx) {
+            return eR_OK;
+        }
+        enum eResult res = waitOnWord(&m_control->write_idx, w,
+                                      &m_control->read_waiters);
+        if(res != eR_OK) {
+            return res;
+        }
+    }
+}
+
+void
+ShmRingBuffer::flush()
+{
+    if(!m_initialized || m_producer || m_block_leased) {
+        return;
+    }
+    m_control->slots[m_slot].read_idx = m_control->write_idx;
+    INC_ATOMIC((volatile int32_t *)&m_control->release_seq);
+    __sync_synchronize();
+    if(m_control->write_waiters) {
+        futex_wake(&m_control->release_seq);
+    }
+}
+
+unsigned int
+ShmRingBuffer::getPosition()
+{
+    if(m_producer) {
+        return getMinReadIndex();
+    } else {
+        return m_control->write_idx;
+    }
+}
+
+enum ShmRingBuffer::eResult
+ShmRingBuffer::waitForPosition(unsigned int *position)
+{
+    if(!m_initialized) {
+        debugError("(%s) not initialized\n", m_name.c_str());
+        return eR_Error;
+    }
+    unsigned int interrupt_seq = m_interrupt_seq;
+    while(true) {
+        volatile uint32_t *word;
+        volatile int32_t *waiters;
+        if(m_producer) {
+            word = &m_control->release_seq;
+            waiters = &m_control->write_waiters;
+        } else {
+            word = &m_control->write_idx;
+            waiters = &m_control->read_waiters;
+        }
+        uint32_t value = *word;
+        __sync_synchronize();
+        unsigned int p = getPosition();
+        if(p != *position) {
+            *position = p;
+            return eR_OK;
+        }
+        if(m_interrupt_seq != interrupt_seq) {
+            return eR_Again;
+        }
+        enum eResult res = waitOnWord(word, value, waiters);
+        if(res != eR_OK) {
+            return res;
+        }
+        if(m_interrupt_seq != interrupt_seq) {
+            return eR_Again;
+        }
+    }
+}
+
+void
+ShmRingBuffer::interruptWait()
+{
+    if(!m_initialized) {
+        return;
+    }
+    m_interrupt_seq = m_interrupt_seq + 1;
+    __sync_synchronize();
+    // spurious wakeups are harmless for the other waiters, they recheck
+    futex_wake(m_producer ? &m_control->release_seq : &m_control->write_idx);
+}
+
+unsigned int
+ShmRingBuffer::getBufferFill()
+{
+    if(!m_initialized) {
+        return 0;
+    }
+    if(m_producer) {
+        return m_control->write_idx - getMinReadIndex();
+    } else {
+        return m_control->write_idx - m_control->slots[m_slot].read_idx;
+    }
+}
+
+void
+ShmRingBuffer::show()
+{
+    debugOutput(DEBUG_LEVEL_NORMAL, "(%p) ShmRingBuffer %s\n", this, m_name.c_str());
+    debugOutput(DEBUG_LEVEL_NORMAL, " %s %s, %u blocks of %u bytes\n",
+                (m_type == eBT_Master ? "master" : "slave"),
+                (m_producer ? "producer" : "consumer"),
+                m_blocks, m_blocksize);
+    if(!m_initialized) {
+        return;
+    }
+    debugOutput(DEBUG_LEVEL_NORMAL, " write idx: %u, fill: %u\n",
+                m_control->write_idx, getBufferFill());
+    for(int i = 0; i < FFADO_SHM_RINGBUFFER_MAX_SLOTS; i++) {
+        struct ShmRingSlot *s = &m_control->slots[i];
+        if(s->pid > 0) {
+            debugOutput(DEBUG_LEVEL_NORMAL, " slot %d: pid %d, read idx %u\n",
+                        i, s->pid, s->read_idx);
+        }
+    }
+}
+
+void
+ShmRingBuffer::setVerboseLevel(int i)
+{
+    setDebugLevel(i);
+    if(m_memblock) m_memblock->setVerboseLevel(i);
+}
+
+} // Util
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __UTIL_SHM_RINGBUFFER__
+#define __UTIL_SHM_RINGBUFFER__
+
+#include "debugmodule/debugmodule.h"
+
+#include <string>
+#include <stdint.h>
+
+#define FFADO_SHM_RINGBUFFER_MAGIC      0x46524231
+#define FFADO_SHM_RINGBUFFER_VERSION    1
+
+// max number of consumers that can attach to one ring
+#define FFADO_SHM_RINGBUFFER_MAX_SLOTS  8
+
+// how long a blocking wait sleeps before reporting a timeout
+#define FFADO_SHM_RINGBUFFER_WAIT_TIMEOUT_MSEC  2000
+
+namespace Util {
+
+class PosixSharedMemory;
+struct ShmRingControl;
+
+/**
+ * @brief A wait-free ringbuffer in POSIX shared memory
+ *
+ * The segment holds a control block and nb_blocks blocks of blocksize
+ * bytes. There is one producer and up to FFADO_SHM_RINGBUFFER_MAX_SLOTS
+ * consumers. The producer owns a free-running write index, every
+ * consumer owns a free-running read index in its own slot, so each
+ * producer/consumer pair is a single-producer/single-consumer queue
+ * that needs no locks. A block is only reused once all attached
+ * consumers have released it.
+ *
+ * Blocks are leased instead of copied: request a pointer, fill or use
+ * the block in place, then release it. Waiting is done on futexes in
+ * the shared segment; the wake-up syscall is only made when the other
+ * side actually sleeps.
+ *
+ * The master creates the segment, slaves attach to it. For an outward
+ * buffer the master produces and any number of slaves consume (e.g.
+ * several clients recording the same capture stream). For an inward
+ * buffer the master is the only consumer and one slave at a time can
+ * attach as producer.
+ */
+class ShmRingBuffer
+{
+public:
+    enum eBufferType {
+        eBT_Master,
+        eBT_Slave,
+    };
+    // direction as seen from the master
+    enum eDirection {
+        eD_Outward,
+        eD_Inward,
+    };
+    enum eBlocking {
+        eB_Blocking,
+        eB_NonBlocking,
+    };
+    enum eResult {
+        eR_OK,
+        eR_Again,
+        eR_Error,
+        eR_Timeout,
+    };
+
+public:
+    /**
+     * @param name name of the shared memory segment
+     * @param nb_blocks number of blocks, ignored by a slave
+     * @param blocksize size of one block in bytes, ignored by a slave
+     */
+    ShmRingBuffer(std::string name, enum eBufferType, enum eDirection,
+                  enum eBlocking, unsigned int nb_blocks, unsigned int blocksize);
+    ~ShmRingBuffer();
+
+    bool init();
+
+    // producer side
+    enum eResult requestBlockForWrite(void **block);
+    enum eResult releaseBlockForWrite();
+    enum eResult waitForWrite();
+
+    // consumer side
+    enum eResult requestBlockForRead(void **block);
+    enum eResult releaseBlockForRead();
+    enum eResult waitForRead();
+    /// drop everything that was not read yet
+    void flush();
+
+    /**
+     * Number of blocks the other side has completed: the blocks
+     * produced for a consumer, the blocks consumed by all consumers
+     * for the producer. Free running.
+     */
+    unsigned int getPosition();
+    /**
+     * Blocks until getPosition() differs from *position
+     * @param position last position seen, updated on return
+     */
+    enum eResult waitForPosition(unsigned int *position);
+    /**
+     * Makes a waitForPosition() in another thread return eR_Again,
+     * at the latest after the wait timeout.
+     */
+    void interruptWait();
+
+    bool isProducer() {return m_producer;};
+    unsigned int getBufferFill();
+    unsigned int getNbBlocks() {return m_blocks;};
+    unsigned int getBlockSize() {return m_blocksize;};
+
+    void show();
+    void setVerboseLevel(int l);
+
+private:
+    bool attach();
+    void detach();
+    unsigned int getMinReadIndex();
+    bool reapConsumers();
+    char *getBlock(unsigned int idx);
+    enum eResult waitOnWord(volatile uint32_t *word, uint32_t value,
+                            volatile int32_t *waiters);
+
+private:
+    std::string         m_name;
+    unsigned int        m_blocks;
+    unsigned int        m_blocksize;
+    enum eBufferType    m_type;
+    enum eDirection     m_direction;
+    enum eBlocking      m_blocking;
+    bool                m_producer;
+    bool                m_initialized;
+    int                 m_slot;
+    bool                m_block_leased;
+    volatile unsigned int m_interrupt_seq;
+
+    PosixSharedMemory  *m_memblock;
+    ShmRingControl     *m_control;
+    char               *m_data;
+
+protected:
+    DECLARE_DEBUG_MODULE;
+};
+
+} // Util
+
+#endif // __UTIL_SHM_RINGBUFFER__
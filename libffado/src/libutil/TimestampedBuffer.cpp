@@ -27,6 +27,7 @@
 #include "libieee1394/cycletimer.h"
 
 #include "TimestampedBuffer.h"
+#include "LatencyStatistics.h"
 #include "assert.h"
 #include "errno.h"
 
@@ -76,7 +77,8 @@ TimestampedBuffer::TimestampedBuffer(TimestampedBufferClient *c)
       m_dll_e2(0.0), m_dll_b(DLL_COEFF_B), m_dll_c(DLL_COEFF_C),
       m_nominal_rate(0.0), m_current_rate(0.0), m_update_period(0),
       // half a cycle is what we consider 'normal'
-      m_max_abs_diff(3072/2)
+      m_max_abs_diff(3072/2),
+      m_dll_error_histogram( NULL )
 {
     pthread_mutex_init(&m_framecounter_lock, NULL);
 }
@@ -1043,6 +1045,11 @@ void TimestampedBuffer::incrementFrameCounter(unsigned int nbframes, ffado_times
     else
     if (diff < -m_wrap_at/2)
       diff = m_wrap_at + diff;
+
+    if (m_dll_error_histogram) {
+        ffado_timestamp_t abs_diff = (diff < 0 ? -diff : diff);
+        m_dll_error_histogram->mark(abs_diff < 4294967295.0 ? (uint32_t)abs_diff : 0xFFFFFFFF);
+    }
 #ifdef DEBUG
 
     // check whether the update is within the allowed bounds
@@ -42,6 +42,7 @@ namespace Util
 {
 
 class TimestampedBufferClient;
+class LatencyHistogram;
 
 /**
     * \brief Class implementing a frame buffer that is time-aware
@@ -93,6 +94,8 @@ class TimestampedBuffer
         virtual ~TimestampedBuffer();
 
         void setMaxAbsDiff ( unsigned int n ) { m_max_abs_diff = n; };
+        /// receives the absolute DLL error of every update, can be NULL
+        void setDllErrorHistogram ( LatencyHistogram *h ) { m_dll_error_histogram = h; };
 
         bool writeDummyFrame();
         bool dropFrames ( unsigned int nbframes );
@@ -208,6 +211,7 @@ class TimestampedBuffer
         unsigned int m_update_period;
 
         unsigned int m_max_abs_diff;
+        LatencyHistogram *m_dll_error_histogram;
 };
 
 /**
@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "version.h" // FOR CACHE_VERSION
+
+#include "serialize_binary.h"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+IMPL_DEBUG_MODULE( Util::BinarySerialize,   BinarySerialize,   DEBUG_LEVEL_NORMAL );
+IMPL_DEBUG_MODULE( Util::BinaryDeserialize, BinaryDeserialize, DEBUG_LEVEL_NORMAL );
+
+/*
+ * File layout (host byte order, the byte order mark rejects foreign files):
+ *
+ *  header
+ *  records         nb_records x BinaryRecord, sorted by path
+ *  string offsets  (nb_strings + 1) x u32, string i is [off[i], off[i+1])
+ *  string data     the dictionary: all paths and string values, once each
+ *
+ * Integers are stored in the record, string values as dictionary index.
+ */
+#define BINSER_MAGIC            "FFADOBIN"
+#define BINSER_MAGIC_LENGTH     8
+#define BINSER_FORMAT_VERSION   2
+#define BINSER_BYTE_ORDER_MARK  0x01020304
+
+#define BINSER_TYPE_INTEGER     0
+#define BINSER_TYPE_STRING      1
+
+struct BinaryFileHeader {
+    char     magic[BINSER_MAGIC_LENGTH];
+    uint32_t format_version;
+    uint32_t byte_order;
+    uint32_t cache_version;   // dictionary index
+    uint32_t nb_records;
+    uint32_t nb_strings;
+    uint32_t string_data_size;
+};
+
+struct Util::BinaryRecord {
+    uint32_t path;            // dictionary index
+    uint32_t type;
+    int64_t  value;
+};
+
+std::string
+Util::normalizeSerializePath( const std::string& path )
+{
+    std::vector<std::string> tokens;
+    tokenize( path, tokens, "/" );
+    std::string result;
+    for ( std::vector<std::string>::iterator it = tokens.begin();
+          it != tokens.end();
+          ++it )
+    {
+        if ( result.size() ) {
+            result += "/";
+        }
+        result += *it;
+    }
+    return result;
+}
+
+Util::BinarySerialize::BinarySerialize( std::string fileName )
+    : IOSerialize()
+    , m_filepath( fileName )
+    , m_closed( false )
+    , m_verboseLevel( DEBUG_LEVEL_NORMAL )
+{
+    setDebugLevel( DEBUG_LEVEL_NORMAL );
+}
+
+Util::BinarySerialize::BinarySerialize( std::string fileName, int verboseLevel )
+    : IOSerialize()
+    , m_filepath( fileName )
+    , m_closed( false )
+    , m_verboseLevel( verboseLevel )
+{
+    setDebugLevel( verboseLevel );
+}
+
+Util::BinarySerialize::~BinarySerialize()
+{
+    if ( !m_closed ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "%s not written\n", m_filepath.c_str() );
+    }
+}
+
+uint32_t
+Util::BinarySerialize::addString( const std::string& str )
+{
+    StringMapIterator it = m_strings.find( str );
+    if ( it != m_strings.end() ) {
+        return it->second;
+    }
+    uint32_t index = m_strings.size();
+    m_strings.insert( std::make_pair( str, index ) );
+    return index;
+}
+
+bool
+Util::BinarySerialize::addMember( const std::string& strMemberName, Member& m )
+{
+    std::string path = normalizeSerializePath( strMemberName );
+    if ( path.size() == 0 ) {
+        debugWarning( "invalid member name '%s'\n", strMemberName.c_str() );
+        return false;
+    }
+    // like the XML backends, the first occurrence of a path wins
+    m_members.insert( std::make_pair( path, m ) );
+    return true;
+}
+
+bool
+Util::BinarySerialize::write( std::string strMemberName,
+                              long long value )
+{
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "write %s = %lld\n",
+                 strMemberName.c_str(), value );
+    Member m;
+    m.type = BINSER_TYPE_INTEGER;
+    m.value = value;
+    return addMember( strMemberName, m );
+}
+
+bool
+Util::BinarySerialize::write( std::string strMemberName,
+                              std::string str)
+{
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "write %s = %s\n",
+                 strMemberName.c_str(), str.c_str() );
+    Member m;
+    m.type = BINSER_TYPE_STRING;
+    m.value = addString( str );
+    return addMember( strMemberName, m );
+}
+
+bool
+Util::BinarySerialize::close()
+{
+    m_closed = true;
+
+    // the records, sorted by path since the member map is
+    std::vector<Util::BinaryRecord> records;
+    records.reserve( m_members.size() );
+    for ( MemberMapIterator it = m_members.begin();
+          it != m_members.end();
+          ++it )
+    {
+        Util::BinaryRecord r;
+        r.path = addString( it->first );
+        r.type = it->second.type;
+        r.value = it->second.value;
+        records.push_back( r );
+    }
+
+    BinaryFileHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, BINSER_MAGIC, BINSER_MAGIC_LENGTH );
+    header.format_version = BINSER_FORMAT_VERSION;
+    header.byte_order = BINSER_BYTE_ORDER_MARK;
+    header.cache_version = addString( CACHE_VERSION );
+    header.nb_records = records.size();
+    header.nb_strings = m_strings.size();
+
+    // the dictionary, in index order
+    std::vector<const std::string *> strings( m_strings.size() );
+    for ( StringMapIterator it = m_strings.begin();
+          it != m_strings.end();
+          ++it )
+    {
+        strings[it->second] = &it->first;
+    }
+    std::vector<uint32_t> offsets;
+    offsets.reserve( strings.size() + 1 );
+    uint32_t offset = 0;
+    for ( unsigned int i = 0; i < strings.size(); i++ ) {
+        offsets.push_back( offset );
+        offset += strings[i]->size();
+    }
+    offsets.push_back( offset );
+    header.string_data_size = offset;
+
+    FILE *f = fopen( m_filepath.c_str(), "wb" );
+    if ( f == NULL ) {
+        debugError( "Could not open %s for writing\n", m_filepath.c_str() );
+        return false;
+    }
+    bool result = fwrite( &header, sizeof( header ), 1, f ) == 1;
+    if ( result && records.size() ) {
+        result = fwrite( &records[0], sizeof( records[0] ), records.size(), f ) == records.size();
+    }
+    if ( result ) {
+        result = fwrite( &offsets[0], sizeof( offsets[0] ), offsets.size(), f ) == offsets.size();
+    }
+    for ( unsigned int i = 0; result && i < strings.size(); i++ ) {
+        if ( strings[i]->size() ) {
+            result = fwrite( strings[i]->data(), strings[i]->size(), 1, f ) == 1;
+        }
+    }
+    if ( fclose( f ) != 0 ) {
+        result = false;
+    }
+    if ( !result ) {
+        debugError( "Could not write %s\n", m_filepath.c_str() );
+    }
+    return result;
+}
+
+/***********************************/
+
+Util::BinaryDeserialize::BinaryDeserialize( std::string fileName )
+    : IODeserialize()
+    , m_filepath( fileName )
+    , m_map( NULL )
+    , m_map_size( 0 )
+    , m_records( NULL )
+    , m_nb_records( 0 )
+    , m_string_offsets( NULL )
+    , m_nb_strings( 0 )
+    , m_string_data( NULL )
+    , m_string_data_size( 0 )
+    , m_valid( false )
+    , m_verboseLevel( DEBUG_LEVEL_NORMAL )
+{
+    setDebugLevel( DEBUG_LEVEL_NORMAL );
+    m_valid = load();
+}
+
+Util::BinaryDeserialize::BinaryDeserialize( std::string fileName, int verboseLevel )
+    : IODeserialize()
+    , m_filepath( fileName )
+    , m_map( NULL )
+    , m_map_size( 0 )
+    , m_records( NULL )
+    , m_nb_records( 0 )
+    , m_string_offsets( NULL )
+    , m_nb_strings( 0 )
+    , m_string_data( NULL )
+    , m_string_data_size( 0 )
+    , m_valid( false )
+    , m_verboseLevel( verboseLevel )
+{
+    setDebugLevel( verboseLevel );
+    m_valid = load();
+}
+
+Util::BinaryDeserialize::~BinaryDeserialize()
+{
+    unload();
+}
+
+bool
+Util::BinaryDeserialize::load()
+{
+    int fd = open( m_filepath.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "Could not open %s\n", m_filepath.c_str() );
+        return false;
+    }
+    struct stat buf;
+    if ( fstat( fd, &buf ) != 0 ) {
+        debugError( "Could not stat %s\n", m_filepath.c_str() );
+        ::close( fd );
+        return false;
+    }
+    if ( (size_t)buf.st_size < sizeof( BinaryFileHeader ) ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "%s is not a binary cache file\n", m_filepath.c_str() );
+        ::close( fd );
+        return false;
+    }
+    m_map_size = buf.st_size;
+    m_map = mmap( NULL, m_map_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( m_map == MAP_FAILED ) {
+        debugError( "Could not map %s: %s\n", m_filepath.c_str(), strerror( errno ) );
+        m_map = NULL;
+        return false;
+    }
+
+    const char *base = (const char *)m_map;
+    const BinaryFileHeader *header = (const BinaryFileHeader *)base;
+    if ( memcmp( header->magic, BINSER_MAGIC, BINSER_MAGIC_LENGTH ) != 0 ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "%s is not a binary cache file\n", m_filepath.c_str() );
+        unload();
+        return false;
+    }
+    if ( header->format_version != BINSER_FORMAT_VERSION
+         || header->byte_order != BINSER_BYTE_ORDER_MARK ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "%s: unsupported format (version %u, bom 0x%08X)\n",
+                     m_filepath.c_str(), header->format_version, header->byte_order );
+        unload();
+        return false;
+    }
+
+    // check that all sections are within the file
+    uint64_t records_offset = sizeof( BinaryFileHeader );
+    uint64_t offsets_offset = records_offset + (uint64_t)header->nb_records * sizeof( BinaryRecord );
+    uint64_t data_offset = offsets_offset + ( (uint64_t)header->nb_strings + 1 ) * sizeof( uint32_t );
+    if ( data_offset + header->string_data_size != m_map_size ) {
+        debugError( "%s has an invalid size\n", m_filepath.c_str() );
+        unload();
+        return false;
+    }
+    m_records = (const BinaryRecord *)( base + records_offset );
+    m_nb_records = header->nb_records;
+    m_string_offsets = (const uint32_t *)( base + offsets_offset );
+    m_nb_strings = header->nb_strings;
+    m_string_data = base + data_offset;
+    m_string_data_size = header->string_data_size;
+
+    // the dictionary has to be consistent, the records are checked on access
+    for ( uint32_t i = 0; i < m_nb_strings; i++ ) {
+        if ( m_string_offsets[i] > m_string_offsets[i + 1] ) {
+            debugError( "%s has an invalid dictionary\n", m_filepath.c_str() );
+            unload();
+            return false;
+        }
+    }
+    if ( m_string_offsets[m_nb_strings] != m_string_data_size ) {
+        debugError( "%s has an invalid dictionary\n", m_filepath.c_str() );
+        unload();
+        return false;
+    }
+
+    const char *str;
+    uint32_t length;
+    if ( !getString( header->cache_version, str, length ) ) {
+        unload();
+        return false;
+    }
+    m_version.assign( str, length );
+
+    debugOutput( DEBUG_LEVEL_VERBOSE, "mapped %u records, %u strings from %s\n",
+                 m_nb_records, m_nb_strings, m_filepath.c_str() );
+    return true;
+}
+
+void
+Util::BinaryDeserialize::unload()
+{
+    if ( m_map ) {
+        munmap( m_map, m_map_size );
+    }
+    m_map = NULL;
+    m_map_size = 0;
+    m_records = NULL;
+    m_nb_records = 0;
+    m_string_offsets = NULL;
+    m_nb_strings = 0;
+    m_string_data = NULL;
+    m_string_data_size = 0;
+}
+
+bool
+Util::BinaryDeserialize::getString( uint32_t index, const char*& str, uint32_t& length )
+{
+    if ( index >= m_nb_strings ) {
+        debugError( "%s: invalid string index %u\n", m_filepath.c_str(), index );
+        return false;
+    }
+    str = m_string_data + m_string_offsets[index];
+    length = m_string_offsets[index + 1] - m_string_offsets[index];
+    return true;
+}
+
+bool
+Util::BinaryDeserialize::getStringValue( const BinaryRecord& r, const char*& str, uint32_t& length )
+{
+    // the value is 64 bit wide, don't let a corrupt one wrap into a
+    // valid index
+    if ( r.value < 0 || r.value >= (long long)m_nb_strings ) {
+        debugError( "%s: invalid string index %lld\n", m_filepath.c_str(), (long long)r.value );
+        return false;
+    }
+    return getString( (uint32_t)r.value, str, length );
+}
+
+uint32_t
+Util::BinaryDeserialize::lowerBound( const std::string& path )
+{
+    uint32_t first = 0;
+    uint32_t count = m_nb_records;
+    while ( count > 0 ) {
+        uint32_t step = count / 2;
+        uint32_t mid = first + step;
+
+        const char *str;
+        uint32_t length;
+        int cmp = 1;
+        if ( getString( m_records[mid].path, str, length ) ) {
+            // same ordering as std::string::compare
+            cmp = memcmp( str, path.data(), std::min( (size_t)length, path.size() ) );
+            if ( cmp == 0 ) {
+                cmp = ( length < path.size() ) ? -1 : ( length > path.size() ? 1 : 0 );
+            }
+        }
+        if ( cmp < 0 ) {
+            first = mid + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+const Util::BinaryRecord*
+Util::BinaryDeserialize::find( const std::string& strMemberName )
+{
+    std::string path = normalizeSerializePath( strMemberName );
+    uint32_t idx = lowerBound( path );
+    if ( idx >= m_nb_records ) {
+        return NULL;
+    }
+    const char *str;
+    uint32_t length;
+    if ( !getString( m_records[idx].path, str, length ) ) {
+        return NULL;
+    }
+    if ( length != path.size() || memcmp( str, path.data(), length ) != 0 ) {
+        return NULL;
+    }
+    return &m_records[idx];
+}
+
+bool
+Util::BinaryDeserialize::isValid()
+{
+    return m_valid && checkVersion();
+}
+
+bool
+Util::BinaryDeserialize::checkVersion()
+{
+    std::string expectedVersion = CACHE_VERSION;
+    debugOutput( DEBUG_LEVEL_NORMAL, "Cache version: %s, expected: %s.\n",
+                 m_version.c_str(), expectedVersion.c_str() );
+    if ( expectedVersion == m_version ) {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "Cache version OK.\n" );
+        return true;
+    } else {
+        debugOutput( DEBUG_LEVEL_VERBOSE, "Cache version not OK.\n" );
+        return false;
+    }
+}
+
+bool
+Util::BinaryDeserialize::read( std::string strMemberName,
+                               long long& value )
+{
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "lookup %s\n", strMemberName.c_str() );
+
+    const BinaryRecord *r = find( strMemberName );
+    if ( r == NULL ) {
+        debugWarning( "no such a node %s\n", strMemberName.c_str() );
+        return false;
+    }
+    if ( r->type == BINSER_TYPE_STRING ) {
+        const char *str;
+        uint32_t length;
+        if ( !getStringValue( *r, str, length ) ) {
+            return false;
+        }
+        char* tail;
+        value = strtoll( std::string( str, length ).c_str(), &tail, 0 );
+    } else {
+        value = r->value;
+    }
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "found %s = %lld\n",
+                 strMemberName.c_str(), value );
+    return true;
+}
+
+bool
+Util::BinaryDeserialize::read( std::string strMemberName,
+                               std::string& str )
+{
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "lookup %s\n", strMemberName.c_str() );
+
+    const BinaryRecord *r = find( strMemberName );
+    if ( r == NULL ) {
+        debugWarning( "no such a node %s\n", strMemberName.c_str() );
+        return false;
+    }
+    if ( r->type == BINSER_TYPE_STRING ) {
+        const char *data;
+        uint32_t length;
+        if ( !getStringValue( *r, data, length ) ) {
+            return false;
+        }
+        str.assign( data, length );
+    } else {
+        char tmp[32];
+        snprintf( tmp, sizeof( tmp ), "%lld", (long long)r->value );
+        str = tmp;
+    }
+    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "found %s = %s\n",
+                 strMemberName.c_str(), str.c_str() );
+    return true;
+}
+
+bool
+Util::BinaryDeserialize::isExisting( std::string strMemberName )
+{
+    if ( find( strMemberName ) ) {
+        return true;
+    }
+    // a path also exists if it has members
+    std::string path = normalizeSerializePath( strMemberName ) + "/";
+    uint32_t idx = lowerBound( path );
+    if ( idx >= m_nb_records ) {
+        return false;
+    }
+    const char *str;
+    uint32_t length;
+    if ( !getString( m_records[idx].path, str, length ) ) {
+        return false;
+    }
+    return length >= path.size() && memcmp( str, path.data(), path.size() ) == 0;
+}
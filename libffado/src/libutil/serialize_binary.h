@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_UTIL_SERIALIZE_BINARY_H__
+#define __FFADO_UTIL_SERIALIZE_BINARY_H__
+
+#include "serialize.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include <string>
+#include <map>
+#include <stdint.h>
+
+namespace Util {
+
+    struct BinaryRecord;
+
+    /**
+     * @brief Binary serializer, mainly for the discovery cache
+     *
+     * The file consists of a header, a table of fixed-width records
+     * sorted by path, and a string dictionary that holds every path and
+     * string value once. The header carries the format version and the
+     * CACHE_VERSION of the library that wrote it. The paths are
+     * normalized the same way the XML backends do, so both can be used
+     * interchangeably.
+     *
+     * Unlike the XML serializers the data is not written on destruction,
+     * only by close(), such that a failed serialization leaves no file.
+     */
+    class BinarySerialize: public IOSerialize {
+    public:
+        BinarySerialize( std::string fileName );
+        BinarySerialize( std::string fileName, int verboseLevel );
+        virtual ~BinarySerialize();
+
+        virtual bool write( std::string strMemberName,
+                            long long value );
+        virtual bool write( std::string strMemberName,
+                            std::string str);
+
+        /// write the data to the file
+        bool close();
+    private:
+        struct Member {
+            uint32_t  type;
+            long long value; // dictionary index for strings
+        };
+        typedef std::map<std::string, Member> MemberMap;
+        typedef std::map<std::string, Member>::iterator MemberMapIterator;
+        typedef std::map<std::string, uint32_t> StringMap;
+        typedef std::map<std::string, uint32_t>::iterator StringMapIterator;
+
+        uint32_t addString( const std::string& str );
+        bool addMember( const std::string& strMemberName, Member& m );
+
+        std::string      m_filepath;
+        MemberMap        m_members;
+        StringMap        m_strings;
+        bool             m_closed;
+        int              m_verboseLevel;
+
+        DECLARE_DEBUG_MODULE;
+    };
+
+    /**
+     * @brief Binary deserializer
+     *
+     * The file is mapped into memory and validated once. Lookups are a
+     * binary search in the record table, nothing is copied besides the
+     * values that are read.
+     */
+    class BinaryDeserialize: public IODeserialize {
+    public:
+        BinaryDeserialize( std::string fileName );
+        BinaryDeserialize( std::string fileName, int verboseLevel );
+        virtual ~BinaryDeserialize();
+
+        virtual bool read( std::string strMemberName,
+                           long long& value );
+        virtual bool read( std::string strMemberName,
+                           std::string& str );
+
+        virtual bool isExisting( std::string strMemberName );
+        bool isValid();
+        bool checkVersion();
+    private:
+        bool load();
+        void unload();
+        bool getString( uint32_t index, const char*& str, uint32_t& length );
+        /// the string a string record refers to
+        bool getStringValue( const BinaryRecord& r, const char*& str, uint32_t& length );
+        /// index of the first record with a path not less than path
+        uint32_t lowerBound( const std::string& path );
+        const BinaryRecord* find( const std::string& strMemberName );
+
+        std::string     m_filepath;
+        void           *m_map;
+        size_t          m_map_size;
+        const BinaryRecord *m_records;
+        uint32_t        m_nb_records;
+        const uint32_t *m_string_offsets;
+        uint32_t        m_nb_strings;
+        const char     *m_string_data;
+        uint32_t        m_string_data_size;
+        std::string     m_version;
+        bool            m_valid;
+        int             m_verboseLevel;
+
+        DECLARE_DEBUG_MODULE;
+    };
+
+    /// normalizes a member path like the XML backends do ("a//b/" -> "a/b")
+    std::string normalizeSerializePath( const std::string& path );
+}
+
+#endif
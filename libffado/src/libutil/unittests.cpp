@@ -22,6 +22,7 @@
  */
 
 #include "serialize.h"
+#include "serialize_binary.h"
 #include "OptionContainer.h"
 
 #include <libraw1394/raw1394.h>
@@ -414,6 +415,102 @@ testU3()
     return result;
 }
 
+///////////////////////////////////////
+
+static bool
+testU5()
+{
+    U0_SerializeMe sme1;
+    sme1.m_byte = 0x12;
+    sme1.m_quadlet = 0x12345678;
+    U3_SerializeMe sme3;
+    sme3.m_pString = strdup( "fancy string" );
+
+    {
+        BinarySerialize binSerialize( "unittest_u5.bin" );
+        if ( !sme1.serialize( binSerialize )
+             || !sme3.serialize( binSerialize )
+             || !binSerialize.close() ) {
+            printf( "(serializing failed)" );
+            return false;
+        }
+    }
+
+    U0_SerializeMe sme2;
+    U3_SerializeMe sme4;
+
+    {
+        BinaryDeserialize binDeserialize( "unittest_u5.bin" );
+        if ( !binDeserialize.isValid() ) {
+            printf( "(invalid file)" );
+            return false;
+        }
+        if ( !sme2.deserialize( binDeserialize )
+             || !sme4.deserialize( binDeserialize ) ) {
+            printf( "(deserializing failed)" );
+            return false;
+        }
+        if ( !binDeserialize.isExisting( "SerializeMe" )
+             || binDeserialize.isExisting( "SerializeM" ) ) {
+            printf( "(wrong existence)" );
+            return false;
+        }
+    }
+
+    bool result = ( sme1 == sme2 ) && ( sme3 == sme4 );
+    if ( !result ) {
+        printf( "(wrong values)" );
+    }
+    return result;
+}
+
+///////////////////////////////////////
+
+static bool
+testU6()
+{
+    {
+        BinarySerialize binSerialize( "unittest_u6.bin" );
+        if ( !binSerialize.write( "string", std::string( "value" ) )
+             || !binSerialize.close() ) {
+            printf( "(serializing failed)" );
+            return false;
+        }
+    }
+
+    // the only record follows the 32 byte header, its 64 bit value is at
+    // offset 8. Make it a valid index in the lower 32 bits only.
+    FILE* f = fopen( "unittest_u6.bin", "r+b" );
+    int64_t value;
+    if ( !f
+         || fseek( f, 32 + 8, SEEK_SET ) != 0
+         || fread( &value, sizeof( value ), 1, f ) != 1 ) {
+        printf( "(could not read the record)" );
+        if ( f ) fclose( f );
+        return false;
+    }
+    value += 1LL << 32;
+    if ( fseek( f, 32 + 8, SEEK_SET ) != 0
+         || fwrite( &value, sizeof( value ), 1, f ) != 1 ) {
+        printf( "(could not write the record)" );
+        fclose( f );
+        return false;
+    }
+    fclose( f );
+
+    BinaryDeserialize binDeserialize( "unittest_u6.bin" );
+    if ( !binDeserialize.isValid() ) {
+        printf( "(invalid file)" );
+        return false;
+    }
+    std::string str;
+    long long number;
+    bool result = true;
+    result &= TEST_SHOULD_RETURN_FALSE( binDeserialize.read( "string", str ) );
+    result &= TEST_SHOULD_RETURN_FALSE( binDeserialize.read( "string", number ) );
+    return result;
+}
+
 /////////////////////////////////////
 class testOC : public OptionContainer {
 public:
@@ -530,6 +627,8 @@ TestEntry TestTable[] = {
     { "serialize 1",  testU1 },
     { "serialize 2",  testU2 },
     { "serialize 3",  testU3 },
+    { "serialize binary",  testU5 },
+    { "serialize binary corrupt",  testU6 },
     { "OptionContainer 1",  testU4 },
 };
 
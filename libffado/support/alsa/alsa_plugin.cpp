@@ -26,7 +26,8 @@
 #include <src/debugmodule/debugmodule.h>
 DECLARE_GLOBAL_DEBUG_MODULE;
 
-#include "libutil/IpcRingBuffer.h"
+#include "libutil/ShmRingBuffer.h"
+#include "libutil/ShmClientRegistry.h"
 #include "libutil/SystemTimeSource.h"
 using namespace Util;
 
@@ -46,18 +47,23 @@ extern "C" {
 #include <alsa/asoundlib.h>
 #include <alsa/pcm_external.h>
 
-#define FFADO_PLUGIN_VERSION "0.0.2"
+#define FFADO_PLUGIN_VERSION "0.0.3"
 
 #define PRINT_FUNCTION_ENTRY (printMessage("entering %s\n",__FUNCTION__))
 // #define PRINT_FUNCTION_ENTRY
 
+// the streaming side puts one 32 bit word per sample in the blocks
+#define FFADO_PLUGIN_BYTES_PER_SAMPLE 4
+
+// the registry of ffado-streamd, used if the daemon runs
+#define FFADO_PLUGIN_DEFAULT_SERVER "ffado-streamd"
+
 typedef struct {
     snd_pcm_ioplug_t io;
 
     int fd;
     int activated;
 
-    unsigned int hw_ptr;
     unsigned int channels;
     snd_pcm_channel_area_t *areas;
 
@@ -65,9 +71,21 @@ typedef struct {
 
     // thread for polling
     pthread_t thread;
+    volatile int running;
 
     // IPC stuff
-    Util::IpcRingBuffer* buffer;
+    Util::ShmClientRegistry* registry;
+    int client_idx;
+    Util::ShmRingBuffer* buffer;
+    unsigned int format;
+    unsigned int rate;
+    // the block currently leased from the buffer and the
+    // number of frames transferred into/out of it
+    char *block;
+    snd_pcm_uframes_t block_fill;
+    // ring position at prepare time and last seen by the poll thread
+    unsigned int position_base;
+    unsigned int position;
 
     // options
     long int verbose;
@@ -76,276 +94,160 @@ typedef struct {
 
 } snd_pcm_ffado_t;
 
+// options from the plugin configuration
+typedef struct {
+    const char *server;
+    long int channels;
+    long int first_channel;
+    long int periods;
+} snd_pcm_ffado_config_t;
+
 static int snd_pcm_ffado_hw_params(snd_pcm_ioplug_t *io, snd_pcm_hw_params_t *params) {
     PRINT_FUNCTION_ENTRY;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
 
-    ffado->channels=0;
-    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
-        // HACK
-        ffado->channels=2;
-    } else {
-        // HACK
-        ffado->channels=2;
+    // the area steps follow the format, the block layout is fixed
+    if (snd_pcm_format_physical_width(io->format) != FFADO_PLUGIN_BYTES_PER_SAMPLE * 8) {
+        debugError("Unsupported sample format\n");
+        return -EINVAL;
     }
 
+    // setup the areas that describe the layout of a shared block, the
+    // address is filled in for every block we lease
+    for (unsigned int channel = 0; channel < ffado->channels; channel++) {
+        ffado->areas[channel].addr = NULL;
+        ffado->areas[channel].first = 0;
+        ffado->areas[channel].step = snd_pcm_format_physical_width(io->format);
+    }
     return 0;
 }
 
-// static snd_pcm_sframes_t snd_pcm_ffado_write(snd_pcm_ioplug_t *io,
-//                    const snd_pcm_channel_area_t *areas,
-//                    snd_pcm_uframes_t offset,
-//                    snd_pcm_uframes_t size)
-// {
-//     PRINT_FUNCTION_ENTRY;
-//     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
-//     IpcRingBuffer::eResult res;
-//     unsigned int i;
-// 
-//     do {
-//         uint32_t *audiobuffers_raw;
-//         res = ffado->buffer->requestBlockForWrite((void**) &audiobuffers_raw); // pointer voodoo
-//         if(res == IpcRingBuffer::eR_OK) {
-//             memset(audiobuffers_raw, 0, ffado->channels * ffado->period * 4);
-//             for (i = 0; i < ffado->channels; i++) {
-//                 uint32_t *alsa_data_ptr = (uint32_t *)((char *)areas[i].addr + (areas[i].step * offset / 8));
-//                 uint32_t *ffado_data_ptr = audiobuffers_raw + i*ffado->period;
-//                 memcpy(ffado_data_ptr, alsa_data_ptr, ffado->period * 4);
-//             }
-//             // release the block
-//             res = ffado->buffer->releaseBlockForWrite();
-//             if(res != IpcRingBuffer::eR_OK) {
-//                 debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error committing memory block\n");
-//                 break;
-//             }
-//         } else if(res != IpcRingBuffer::eR_Again) {
-//             debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error getting memory block\n");
-//         }
-//     } while (res == IpcRingBuffer::eR_Again);
-// 
-//     ffado->hw_ptr += ffado->period;
-//     ffado->hw_ptr %= io->buffer_size;
-// 
-//     if(size != ffado->period) {
-//         debugWarning("size %d, period %d, offset %d\n", size, ffado->period, offset);
-//     } else {
-//         debugOutput(DEBUG_LEVEL_NORMAL, "size %d, period %d, offset %d\n", size, ffado->period, offset);
-//     }
-// 
-//     if(res == IpcRingBuffer::eR_OK) {
-//         return ffado->period;
-//     } else {
-//         debugOutput(DEBUG_LEVEL_NORMAL, "error happened\n");
-//         return -1;
-//     }
-// }
-// 
-// static snd_pcm_sframes_t snd_pcm_ffado_read(snd_pcm_ioplug_t *io,
-//                   const snd_pcm_channel_area_t *areas,
-//                   snd_pcm_uframes_t offset,
-//                   snd_pcm_uframes_t size)
-// {
-//     PRINT_FUNCTION_ENTRY;
-//     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
-//     IpcRingBuffer::eResult res;
-//     unsigned int i;
-// 
-//     do {
-//         uint32_t *audiobuffers_raw;
-//         res = ffado->buffer->requestBlockForRead((void**) &audiobuffers_raw); // pointer voodoo
-//         if(res == IpcRingBuffer::eR_OK) {
-//             for (i = 0; i < ffado->channels; i++) {
-//                 uint32_t *alsa_data_ptr = (uint32_t *)((char *)areas[i].addr + (areas[i].step * offset / 8));
-//                 uint32_t *ffado_data_ptr = audiobuffers_raw + i*ffado->period;
-//                 memcpy(alsa_data_ptr, ffado_data_ptr, ffado->period * 4);
-//             }
-//             // release the block
-//             res = ffado->buffer->releaseBlockForRead();
-//             if(res != IpcRingBuffer::eR_OK) {
-//                 debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error committing memory block\n");
-//                 break;
-//             }
-//         } else if(res != IpcRingBuffer::eR_Again) {
-//             debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error getting memory block\n");
-//         }
-//     } while (res == IpcRingBuffer::eR_Again);
-// 
-//     ffado->hw_ptr += ffado->period;
-//     ffado->hw_ptr %= io->buffer_size;
-// 
-//     if(res == IpcRingBuffer::eR_OK) {
-//         return ffado->period;
-//     } else {
-//         debugOutput(DEBUG_LEVEL_NORMAL, "error happened\n");
-//         return -1;
-//     }
-// }
+static void
+snd_pcm_ffado_set_block(snd_pcm_ffado_t *ffado)
+{
+    for (unsigned int channel = 0; channel < ffado->channels; channel++) {
+        ffado->areas[channel].addr = ffado->block
+            + channel * ffado->period * FFADO_PLUGIN_BYTES_PER_SAMPLE;
+    }
+}
 
+// lease the next block, waits for it unless the pcm is non-blocking
 static int
-snd_pcm_ffado_pollfunction(snd_pcm_ffado_t *ffado)
+snd_pcm_ffado_lease_block(snd_pcm_ffado_t *ffado)
 {
-
-//      PRINT_FUNCTION_ENTRY;
-    static char buf[1];
-    snd_pcm_ioplug_t *io = &ffado->io;
-    const snd_pcm_channel_area_t *areas;
-
-    assert(ffado);
-    assert(ffado->buffer);
-
-    IpcRingBuffer::eResult res;
-    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "PBK: wait\n");
-        res = ffado->buffer->waitForWrite();
-        debugOutput(DEBUG_LEVEL_VERBOSE, "PBK: done, fill: %d\n", ffado->buffer->getBufferFill());
-
-        if(res == IpcRingBuffer::eR_OK) {
-            do {
-                uint32_t *audiobuffers_raw;
-                res = ffado->buffer->requestBlockForWrite((void**) &audiobuffers_raw); // pointer voodoo
-                if(res == IpcRingBuffer::eR_OK) {
-                    // we have the memory block, do the actual transfer
-                    // silence the block
-                    memset(audiobuffers_raw, 0, ffado->channels * ffado->period * 4);
-                    if(io->state == SND_PCM_STATE_RUNNING) {
-                        // get the data address the data comes from
-                        areas = snd_pcm_ioplug_mmap_areas(io);
-
-                        // create the list of areas where the data goes to
-                        unsigned int channel = 0;
-                        for (channel = 0; channel < ffado->channels; channel++) {
-                            uint32_t *target = (audiobuffers_raw + channel*ffado->period);
-                            ffado->areas[channel].addr = target;
-                            ffado->areas[channel].first = 0;
-                            ffado->areas[channel].step = 4*8; // FIXME: hardcoded sample size
-                        }
-                        snd_pcm_uframes_t xfer = 0;
-                        while (xfer < ffado->period) {
-                            snd_pcm_uframes_t frames = ffado->period - xfer;
-                            snd_pcm_uframes_t offset = ffado->hw_ptr;
-                            snd_pcm_uframes_t cont = io->buffer_size - offset;
-
-                            if (cont < frames)
-                                frames = cont;
-
-                            for (channel = 0; channel < ffado->channels; channel++) {
-                                snd_pcm_area_copy(&ffado->areas[channel], xfer, &areas[channel], offset, frames, io->format);
-                            }
-
-                            ffado->hw_ptr += frames;
-                            ffado->hw_ptr %= io->buffer_size;
-                            xfer += frames;
-                        }
-                    }
-                    // release the block
-                    res = ffado->buffer->releaseBlockForWrite();
-                    if(res != IpcRingBuffer::eR_OK) {
-                        debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error committing memory block\n");
-                        break;
-                    }
-                } else if(res != IpcRingBuffer::eR_Again) {
-                    debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error getting memory block\n");
-                }
-                if (res == IpcRingBuffer::eR_Again) {
-                    debugWarning("Again\n");
-                }
-            } while (res == IpcRingBuffer::eR_Again);
+    ShmRingBuffer::eResult res;
+    do {
+        if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+            res = ffado->buffer->requestBlockForWrite((void**) &ffado->block);
         } else {
-            debugError("Error while waiting\n");
+            res = ffado->buffer->requestBlockForRead((void**) &ffado->block);
         }
-    } else {
-        res = ffado->buffer->waitForRead();
-        if(res == IpcRingBuffer::eR_OK) {
-            do {
-                uint32_t *audiobuffers_raw;
-                res = ffado->buffer->requestBlockForRead((void**) &audiobuffers_raw); // pointer voodoo
-                if(res == IpcRingBuffer::eR_OK) {
-                    // we have the memory block, do the actual transfer
-                    if(io->state == SND_PCM_STATE_RUNNING) {
-                        // get the data address the data goes to
-                        areas = snd_pcm_ioplug_mmap_areas(io);
-
-                        // create the list of areas where the data comes from
-                        unsigned int channel = 0;
-                        for (channel = 0; channel < io->channels; channel++) {
-                            ffado->areas[channel].addr = audiobuffers_raw + channel*ffado->period;
-                            ffado->areas[channel].first = 0;
-                            ffado->areas[channel].step = 4*8; // FIXME: hardcoded sample size
-                        }
-                        snd_pcm_uframes_t xfer = 0;
-                        while (xfer < ffado->period) {
-                            snd_pcm_uframes_t frames = ffado->period - xfer;
-                            snd_pcm_uframes_t offset = ffado->hw_ptr;
-                            snd_pcm_uframes_t cont = io->buffer_size - offset;
-
-                            if (cont < frames)
-                                frames = cont;
-
-                            for (channel = 0; channel < io->channels; channel++) {
-                                snd_pcm_area_copy(&areas[channel], offset, &ffado->areas[channel], xfer, frames, io->format);
-                            }
-
-                            ffado->hw_ptr += frames;
-                            ffado->hw_ptr %= io->buffer_size;
-                            xfer += frames;
-                        }
-                    }
-                    // release the block
-                    res = ffado->buffer->releaseBlockForRead();
-                    if(res != IpcRingBuffer::eR_OK) {
-                        debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error committing memory block\n");
-                        break;
-                    }
-                } else if(res != IpcRingBuffer::eR_Again) {
-                    debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error getting memory block\n");
-                }
-            } while (res == IpcRingBuffer::eR_Again);
-        } else {
-            debugError("Error while waiting\n");
+        if (res == ShmRingBuffer::eR_Again) {
+            if (ffado->io.nonblock) {
+                return -EAGAIN;
+            }
+            if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+                res = ffado->buffer->waitForWrite();
+            } else {
+                res = ffado->buffer->waitForRead();
+            }
+            if (res == ShmRingBuffer::eR_OK) {
+                res = ShmRingBuffer::eR_Again;
+            }
         }
-    }
+    } while (res == ShmRingBuffer::eR_Again);
 
-    write(ffado->fd, buf, 1); /* for polling */
+    if (res != ShmRingBuffer::eR_OK) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "error getting memory block\n");
+        ffado->block = NULL;
+        return -EIO;
+    }
+    ffado->block_fill = 0;
+    snd_pcm_ffado_set_block(ffado);
+    return 0;
+}
 
-    if(res == IpcRingBuffer::eR_OK) {
-        return 0;
+static int
+snd_pcm_ffado_release_block(snd_pcm_ffado_t *ffado)
+{
+    ShmRingBuffer::eResult res;
+    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+        res = ffado->buffer->releaseBlockForWrite();
     } else {
-        debugOutput(DEBUG_LEVEL_NORMAL, "error happened\n");
-        return -1;
+        res = ffado->buffer->releaseBlockForRead();
+    }
+    ffado->block = NULL;
+    if (res != ShmRingBuffer::eR_OK) {
+        debugOutput(DEBUG_LEVEL_NORMAL, "error committing memory block\n");
+        return -EIO;
     }
+    return 0;
 }
 
-// static int
-// snd_pcm_ffado_pollfunction(snd_pcm_ffado_t *ffado)
-// {
-//     // wait for a period
-//     IpcRingBuffer::eResult res;
-//     if(ffado->stream == SND_PCM_STREAM_PLAYBACK) {
-//         res = ffado->buffer->waitForWrite();
-//     } else {
-//         res = ffado->buffer->waitForRead();
-//     }
-// 
-//     if(res == IpcRingBuffer::eR_OK) {
-//         char buf[1];
-//         write(ffado->fd, buf, 1); /* for polling */
-//         return 0;
-//     } else {
-//         return -1;
-//     }
-// }
+// the samples are copied once, between the application areas and
+// the block leased from the shared memory ring
+static snd_pcm_sframes_t snd_pcm_ffado_transfer(snd_pcm_ioplug_t *io,
+                   const snd_pcm_channel_area_t *areas,
+                   snd_pcm_uframes_t offset,
+                   snd_pcm_uframes_t size)
+{
+    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
+    snd_pcm_uframes_t xfer = 0;
+    unsigned int channel;
+
+    while (xfer < size) {
+        if (ffado->block == NULL) {
+            int err = snd_pcm_ffado_lease_block(ffado);
+            if (err < 0) {
+                if (xfer > 0) break;
+                return err;
+            }
+        }
+
+        snd_pcm_uframes_t frames = size - xfer;
+        if (frames > ffado->period - ffado->block_fill) {
+            frames = ffado->period - ffado->block_fill;
+        }
+
+        for (channel = 0; channel < ffado->channels; channel++) {
+            if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+                snd_pcm_area_copy(&ffado->areas[channel], ffado->block_fill,
+                                  &areas[channel], offset + xfer, frames, io->format);
+            } else {
+                snd_pcm_area_copy(&areas[channel], offset + xfer,
+                                  &ffado->areas[channel], ffado->block_fill, frames, io->format);
+            }
+        }
+        ffado->block_fill += frames;
+        xfer += frames;
+
+        if (ffado->block_fill == ffado->period) {
+            int err = snd_pcm_ffado_release_block(ffado);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+    return xfer;
+}
 
 static void * ffado_workthread(void *arg)
 {
     PRINT_FUNCTION_ENTRY;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)arg;
+    static char buf[1];
 
-    int oldstate;
-
-    pthread_setcancelstate (PTHREAD_CANCEL_DEFERRED, &oldstate);
-
-    while (snd_pcm_ffado_pollfunction(ffado) == 0) {
-        pthread_testcancel();
+    // wake up the poll() of the application whenever the streaming
+    // side has completed a period
+    while (ffado->running) {
+        ShmRingBuffer::eResult res;
+        res = ffado->buffer->waitForPosition(&ffado->position);
+        if (res == ShmRingBuffer::eR_OK) {
+            write(ffado->fd, buf, 1); /* for polling */
+        } else if (res == ShmRingBuffer::eR_Error) {
+            debugError("Error while waiting\n");
+            break;
+        }
     }
     return 0;
 }
@@ -373,14 +275,24 @@ static void snd_pcm_ffado_free(snd_pcm_ffado_t *ffado)
     }
 }
 
+static void snd_pcm_ffado_detach(snd_pcm_ffado_t *ffado)
+{
+    delete ffado->buffer;
+    ffado->buffer = NULL;
+    if (ffado->registry) {
+        ffado->registry->disconnect(ffado->client_idx);
+        delete ffado->registry;
+        ffado->registry = NULL;
+    }
+}
+
 static int snd_pcm_ffado_close(snd_pcm_ioplug_t *io)
 {
     PRINT_FUNCTION_ENTRY;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
 
     // cleanup the SHM structures here
-    delete ffado->buffer;
-    ffado->buffer = NULL;
+    snd_pcm_ffado_detach(ffado);
 
     snd_pcm_ffado_free(ffado);
     return 0;
@@ -388,9 +300,10 @@ static int snd_pcm_ffado_close(snd_pcm_ioplug_t *io)
 
 static snd_pcm_sframes_t snd_pcm_ffado_pointer(snd_pcm_ioplug_t *io)
 {
-    PRINT_FUNCTION_ENTRY;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
-    return ffado->hw_ptr;
+    // the streaming side moves in periods
+    unsigned int periods = ffado->buffer->getPosition() - ffado->position_base;
+    return (periods * ffado->period) % io->buffer_size;
 }
 
 static int snd_pcm_ffado_start(snd_pcm_ioplug_t *io)
@@ -400,10 +313,13 @@ static int snd_pcm_ffado_start(snd_pcm_ioplug_t *io)
 
     PRINT_FUNCTION_ENTRY;
 
+    ffado->position = ffado->buffer->getPosition();
+    ffado->running = 1;
     result = pthread_create (&ffado->thread, 0, ffado_workthread, ffado);
-    if(result) return result;
-
-    // FIXME: start the SHM stuff
+    if(result) {
+        ffado->running = 0;
+        return -result;
+    }
     return 0;
 }
 
@@ -413,21 +329,30 @@ static int snd_pcm_ffado_stop(snd_pcm_ioplug_t *io)
 
     PRINT_FUNCTION_ENTRY;
 
-    if(pthread_cancel(ffado->thread)) {
-        debugError("could not cancel thread!\n");
-    }
+    ffado->running = 0;
+    ffado->buffer->interruptWait();
 
     if(pthread_join(ffado->thread,NULL)) {
         debugError("could not join thread!\n");
     }
-
-    // FIXME: stop the SHM client
     return 0;
 } 
 
 static int snd_pcm_ffado_prepare(snd_pcm_ioplug_t *io)
 {
     PRINT_FUNCTION_ENTRY;
+    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
+
+    // a partially transferred block is handed on as it is
+    if (ffado->block) {
+        snd_pcm_ffado_release_block(ffado);
+    }
+    if (ffado->stream == SND_PCM_STREAM_CAPTURE) {
+        // don't deliver data that was captured before
+        ffado->buffer->flush();
+    }
+    ffado->position_base = ffado->buffer->getPosition();
+    ffado->position = ffado->position_base;
     return 0;
 }
 
@@ -440,16 +365,15 @@ static int ffado_set_hw_constraint(snd_pcm_ffado_t *ffado)
     PRINT_FUNCTION_ENTRY;
     unsigned int access_list[] = {
         SND_PCM_ACCESS_MMAP_NONINTERLEAVED,
-//         SND_PCM_ACCESS_RW_NONINTERLEAVED,
+        SND_PCM_ACCESS_RW_NONINTERLEAVED,
     };
 
     unsigned int rate_list[1];
 
-    unsigned int format = SND_PCM_FORMAT_S24;
+    unsigned int format = ffado->format;
     int err;
 
-    // FIXME: make all of the parameters dynamic instead of static
-    rate_list[0] = 48000;
+    rate_list[0] = ffado->rate;
 
     // setup the plugin capabilities
     if ((err = snd_pcm_ioplug_set_param_list(&ffado->io, SND_PCM_IOPLUG_HW_ACCESS,
@@ -461,7 +385,8 @@ static int ffado_set_hw_constraint(snd_pcm_ffado_t *ffado)
         (err = snd_pcm_ioplug_set_param_minmax(&ffado->io, SND_PCM_IOPLUG_HW_CHANNELS,
                            ffado->channels, ffado->channels)) < 0 ||
         (err = snd_pcm_ioplug_set_param_minmax(&ffado->io, SND_PCM_IOPLUG_HW_PERIOD_BYTES,
-                           ffado->period, ffado->period)) < 0 ||
+                           ffado->period * ffado->channels * FFADO_PLUGIN_BYTES_PER_SAMPLE,
+                           ffado->period * ffado->channels * FFADO_PLUGIN_BYTES_PER_SAMPLE)) < 0 ||
         (err = snd_pcm_ioplug_set_param_minmax(&ffado->io, SND_PCM_IOPLUG_HW_PERIODS,
                            ffado->nb_buffers, ffado->nb_buffers)) < 0)
         return err;
@@ -469,8 +394,81 @@ static int ffado_set_hw_constraint(snd_pcm_ffado_t *ffado)
     return 0;
 }
 
+// connect as a client of ffado-streamd, the stream can be shared
+// with other clients
+static int snd_pcm_ffado_connect_server(snd_pcm_ffado_t *ffado,
+                 snd_pcm_ffado_config_t *cfg)
+{
+    ffado->registry = new ShmClientRegistry(cfg->server);
+    if (!ffado->registry->open()) {
+        delete ffado->registry;
+        ffado->registry = NULL;
+        return -ENODEV;
+    }
+
+    ShmClientRegistry::ClientRequest request;
+    request.name = "alsa";
+    request.nb_periods = cfg->periods;
+    for (unsigned int i = 0; i < ffado->channels; i++) {
+        if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+            request.playback.push_back(cfg->first_channel + i);
+        } else {
+            request.capture.push_back(cfg->first_channel + i);
+        }
+    }
+    ffado->client_idx = ffado->registry->connect(request);
+    if (ffado->client_idx < 0) {
+        delete ffado->registry;
+        ffado->registry = NULL;
+        return -ENODEV;
+    }
+
+    bool capture = (ffado->stream == SND_PCM_STREAM_CAPTURE);
+    ffado->buffer = new ShmRingBuffer(ffado->registry->getRingName(ffado->client_idx, capture),
+                          ShmRingBuffer::eBT_Slave,
+                          (capture ? ShmRingBuffer::eD_Outward : ShmRingBuffer::eD_Inward),
+                          ShmRingBuffer::eB_NonBlocking,
+                          0, 0);
+    ffado->buffer->setVerboseLevel(ffado->verbose);
+    if (!ffado->buffer->init()) {
+        snd_pcm_ffado_detach(ffado);
+        return -ENODEV;
+    }
+    ffado->format = SND_PCM_FORMAT_FLOAT;
+    ffado->rate = ffado->registry->getSampleRate();
+    return 0;
+}
+
+// attach to the buffers of ffado-test-streaming-ipc
+static int snd_pcm_ffado_attach_legacy(snd_pcm_ffado_t *ffado)
+{
+    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+        ffado->buffer = new ShmRingBuffer("playbackbuffer",
+                              ShmRingBuffer::eBT_Slave,
+                              ShmRingBuffer::eD_Inward,
+                              ShmRingBuffer::eB_NonBlocking,
+                              0, 0);
+    } else {
+        ffado->buffer = new ShmRingBuffer("capturebuffer",
+                              ShmRingBuffer::eBT_Slave,
+                              ShmRingBuffer::eD_Outward,
+                              ShmRingBuffer::eB_NonBlocking,
+                              0, 0);
+    }
+    ffado->buffer->setVerboseLevel(ffado->verbose);
+    if (!ffado->buffer->init()) {
+        snd_pcm_ffado_detach(ffado);
+        return -ENODEV;
+    }
+    // FIXME: make all of the parameters dynamic instead of static
+    ffado->format = SND_PCM_FORMAT_S24;
+    ffado->rate = 48000;
+    return 0;
+}
+
 static int snd_pcm_ffado_open(snd_pcm_t **pcmp, const char *name,
-                 snd_pcm_stream_t stream, int mode)
+                 snd_pcm_stream_t stream, int mode,
+                 snd_pcm_ffado_config_t *cfg)
 {
 
     PRINT_FUNCTION_ENTRY;
@@ -486,8 +484,40 @@ static int snd_pcm_ffado_open(snd_pcm_t **pcmp, const char *name,
 
     ffado->stream=stream;
 
-    // discover the devices to discover the capabilities
-    // get the SHM structure
+    // these are the params
+    ffado->channels = cfg->channels;
+    ffado->verbose = 6;
+
+    setDebugLevel(ffado->verbose);
+
+    // attach to the buffers of the streaming process, they
+    // determine the period size and the number of periods
+    if (snd_pcm_ffado_connect_server(ffado, cfg) < 0
+        && snd_pcm_ffado_attach_legacy(ffado) < 0) {
+        debugError("Could not attach to the %s buffer\n",
+                   (stream == SND_PCM_STREAM_PLAYBACK ? "playback" : "capture"));
+        free(ffado);
+        return -ENODEV;
+    }
+    ffado->period = ffado->buffer->getBlockSize()
+                    / (ffado->channels * FFADO_PLUGIN_BYTES_PER_SAMPLE);
+    ffado->nb_buffers = ffado->buffer->getNbBlocks();
+    if(ffado->period == 0
+       || ffado->period * ffado->channels * FFADO_PLUGIN_BYTES_PER_SAMPLE
+          != ffado->buffer->getBlockSize()) {
+        debugError("Block size %u does not fit %u channels\n",
+                   ffado->buffer->getBlockSize(), ffado->channels);
+        snd_pcm_ffado_detach(ffado);
+        free(ffado);
+        return -EINVAL;
+    }
+
+    ffado->areas = (snd_pcm_channel_area_t *)calloc(ffado->channels, sizeof(snd_pcm_channel_area_t));
+    if (!ffado->areas) {
+        snd_pcm_ffado_detach(ffado);
+        free(ffado);
+        return -ENOMEM;
+    }
 
     socketpair(AF_LOCAL, SOCK_STREAM, 0, fd);
 
@@ -501,24 +531,21 @@ static int snd_pcm_ffado_open(snd_pcm_t **pcmp, const char *name,
     ffado_pcm_callback.hw_params = snd_pcm_ffado_hw_params;
     ffado_pcm_callback.prepare = snd_pcm_ffado_prepare;
     ffado_pcm_callback.poll_revents = snd_pcm_ffado_poll_revents;
-//     if (stream == SND_PCM_STREAM_PLAYBACK) {
-//         ffado_pcm_callback.transfer = snd_pcm_ffado_write;
-//     } else {
-//         ffado_pcm_callback.transfer = snd_pcm_ffado_read;
-//     }
+    ffado_pcm_callback.transfer = snd_pcm_ffado_transfer;
 
     // prepare io struct
     ffado->io.version = SND_PCM_IOPLUG_VERSION;
     ffado->io.name = "FFADO PCM Plugin";
     ffado->io.callback = &ffado_pcm_callback;
     ffado->io.private_data = ffado;
-//     ffado->io.mmap_rw = 0;
-    ffado->io.mmap_rw = 1;
+    // no intermediate buffer, the transfer callback goes to the ring
+    ffado->io.mmap_rw = 0;
     ffado->io.poll_fd = fd[1];
     ffado->io.poll_events = stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
 
     err = snd_pcm_ioplug_create(&ffado->io, name, stream, mode);
     if (err < 0) {
+        snd_pcm_ffado_detach(ffado);
         snd_pcm_ffado_free(ffado);
         return err;
     }
@@ -531,58 +558,6 @@ static int snd_pcm_ffado_open(snd_pcm_t **pcmp, const char *name,
 
     *pcmp = ffado->io.pcm;
 
-    // these are the params
-    ffado->channels = 2;
-    ffado->period = 1024;
-    ffado->verbose = 6;
-    ffado->nb_buffers = 5;
-
-    setDebugLevel(ffado->verbose);
-
-    ffado->areas = (snd_pcm_channel_area_t *)calloc(ffado->channels, sizeof(snd_pcm_channel_area_t));
-    if (!ffado->areas) {
-        snd_pcm_ffado_free(ffado);
-        return -ENOMEM;
-    }
-
-    // prepare the IPC buffer
-    unsigned int buffsize = ffado->channels * ffado->period * 4;
-    if(stream == SND_PCM_STREAM_PLAYBACK) {
-        ffado->buffer = new IpcRingBuffer("playbackbuffer",
-                              IpcRingBuffer::eBT_Slave,
-                              IpcRingBuffer::eD_Outward,
-                              IpcRingBuffer::eB_Blocking,
-                              ffado->nb_buffers, buffsize);
-        if(ffado->buffer == NULL) {
-            debugError("Could not create playbackbuffer\n");
-            return -1;
-        }
-        if(!ffado->buffer->init()) {
-            debugError("Could not init playbackbuffer\n");
-            delete ffado->buffer;
-            ffado->buffer = NULL;
-            return -1;
-        }
-        ffado->buffer->setVerboseLevel(ffado->verbose);
-    } else {
-        ffado->buffer = new IpcRingBuffer("capturebuffer",
-                              IpcRingBuffer::eBT_Slave,
-                              IpcRingBuffer::eD_Inward,
-                              IpcRingBuffer::eB_Blocking,
-                              ffado->nb_buffers, buffsize);
-        if(ffado->buffer == NULL) {
-            debugError("Could not create capturebuffer\n");
-            return -1;
-        }
-        if(!ffado->buffer->init()) {
-            debugError("Could not init capturebuffer\n");
-            delete ffado->buffer;
-            ffado->buffer = NULL;
-            return -1;
-        }
-        ffado->buffer->setVerboseLevel(ffado->verbose);
-    }
-
     return 0;
 }
 
@@ -594,6 +569,12 @@ SND_PCM_PLUGIN_DEFINE_FUNC(ffado)
     snd_config_iterator_t i, next;
     int err;
 
+    snd_pcm_ffado_config_t cfg;
+    cfg.server = FFADO_PLUGIN_DEFAULT_SERVER;
+    cfg.channels = 2;
+    cfg.first_channel = 0;
+    cfg.periods = 3;
+
     snd_config_for_each(i, next, conf) {
         snd_config_t *n = snd_config_iterator_entry(i);
         const char *id;
@@ -601,12 +582,40 @@ SND_PCM_PLUGIN_DEFINE_FUNC(ffado)
             continue;
         if (strcmp(id, "comment") == 0 || strcmp(id, "type") == 0)
             continue;
+        if (strcmp(id, "server") == 0) {
+            if (snd_config_get_string(n, &cfg.server) < 0) {
+                SNDERR("Invalid value for %s", id);
+                return -EINVAL;
+            }
+            continue;
+        }
+        if (strcmp(id, "channels") == 0) {
+            if (snd_config_get_integer(n, &cfg.channels) < 0 || cfg.channels <= 0) {
+                SNDERR("Invalid value for %s", id);
+                return -EINVAL;
+            }
+            continue;
+        }
+        if (strcmp(id, "first_channel") == 0) {
+            if (snd_config_get_integer(n, &cfg.first_channel) < 0 || cfg.first_channel < 0) {
+                SNDERR("Invalid value for %s", id);
+                return -EINVAL;
+            }
+            continue;
+        }
+        if (strcmp(id, "periods") == 0) {
+            if (snd_config_get_integer(n, &cfg.periods) < 0 || cfg.periods < 2) {
+                SNDERR("Invalid value for %s", id);
+                return -EINVAL;
+            }
+            continue;
+        }
 
         SNDERR("Unknown field %s", id);
         return -EINVAL;
     }
 
-    err = snd_pcm_ffado_open(pcmp, name, stream, mode);
+    err = snd_pcm_ffado_open(pcmp, name, stream, mode, &cfg);
 
     return err;
 
@@ -26,6 +26,7 @@
 #include "libcontrol/BasicElements.h"
 #include "libcontrol/MatrixMixer.h"
 #include "libcontrol/CrossbarRouter.h"
+#include "libcontrol/StreamingStatistics.h"
 #include "libutil/Time.h"
 #include "libutil/PosixMutex.h"
 
@@ -599,6 +600,50 @@ Text::getValue()
     return val;
 }
 
+// --- StreamingStatistics
+
+StreamingStatistics::StreamingStatistics( DBus::Connection& connection, std::string p, Element* parent,
+                                          Control::StreamingStatistics &slave)
+: Element(connection, p, parent, slave)
+, m_Slave(slave)
+{
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Created StreamingStatistics on '%s'\n",
+                 path().c_str() );
+}
+
+std::vector< DBus::Struct<std::string, uint64_t, uint32_t, uint32_t, uint32_t,
+                          uint32_t, uint32_t, uint32_t, uint32_t> >
+StreamingStatistics::getStatistics()
+{
+    std::vector< DBus::Struct<std::string, uint64_t, uint32_t, uint32_t, uint32_t,
+                              uint32_t, uint32_t, uint32_t, uint32_t> > out;
+    Control::StreamingStatistics::ValuesVector values = m_Slave.getStatistics();
+    for (Control::StreamingStatistics::ValuesVector::iterator it = values.begin();
+         it != values.end(); ++it)
+    {
+        DBus::Struct<std::string, uint64_t, uint32_t, uint32_t, uint32_t,
+                     uint32_t, uint32_t, uint32_t, uint32_t> s;
+        s._1 = it->name;
+        s._2 = it->count;
+        s._3 = it->min;
+        s._4 = it->max;
+        s._5 = it->mean;
+        s._6 = it->p50;
+        s._7 = it->p90;
+        s._8 = it->p99;
+        s._9 = it->p999;
+        out.push_back(s);
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "getStatistics() => %zd values\n", out.size() );
+    return out;
+}
+
+bool
+StreamingStatistics::reset()
+{
+    return m_Slave.reset();
+}
+
 // --- Register
 
 Register::Register( DBus::Connection& connection, std::string p, Element* parent, Control::Register &slave)
@@ -821,6 +866,23 @@ MatrixMixer::getValue( const int32_t& row, const int32_t& col) {
     return m_Slave.getValue(row,col);
 }
 
+bool
+MatrixMixer::setValues( const int32_t& row, const int32_t& col,
+                        const int32_t& nb_rows, const int32_t& nb_cols,
+                        const std::vector<double>& values ) {
+    return m_Slave.setValues(row, col, nb_rows, nb_cols, values);
+}
+
+std::vector<double>
+MatrixMixer::getValues( const int32_t& row, const int32_t& col,
+                        const int32_t& nb_rows, const int32_t& nb_cols ) {
+    std::vector<double> values;
+    if (!m_Slave.getValues(row, col, nb_rows, nb_cols, values)) {
+        values.clear();
+    }
+    return values;
+}
+
 bool
 MatrixMixer::hasNames() {
     return m_Slave.hasNames();
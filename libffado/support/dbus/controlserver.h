@@ -37,6 +37,7 @@
 namespace Control {
     class MatrixMixer;
     class CrossbarRouter;
+    class StreamingStatistics;
 };
 
 namespace DBusControl {
@@ -220,6 +221,23 @@ private:
     Control::Text &m_Slave;
 };
 
+class StreamingStatistics
+: public org::ffado::Control::Element::StreamingStatistics_adaptor
+, public Element
+{
+public:
+    StreamingStatistics( DBus::Connection& connection,
+                         std::string p, Element *,
+                         Control::StreamingStatistics &slave );
+
+    std::vector< DBus::Struct<std::string, uint64_t, uint32_t, uint32_t, uint32_t,
+                              uint32_t, uint32_t, uint32_t, uint32_t> > getStatistics( );
+    bool reset( );
+
+private:
+    Control::StreamingStatistics &m_Slave;
+};
+
 class Register
 : public org::ffado::Control::Element::Register_adaptor
 , public Element
@@ -313,6 +331,9 @@ public:
     int32_t canWrite( const int32_t&, const int32_t& );
     double setValue( const int32_t&, const int32_t&, const double& );
     double getValue( const int32_t&, const int32_t& );
+    bool setValues( const int32_t&, const int32_t&, const int32_t&, const int32_t&,
+                    const std::vector<double>& );
+    std::vector<double> getValues( const int32_t&, const int32_t&, const int32_t&, const int32_t& );
 
     bool hasNames();
     std::string getRowName( const int32_t& );
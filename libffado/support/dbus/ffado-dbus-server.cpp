@@ -40,6 +40,7 @@
 #include <dbus-c++/dbus.h>
 #include "controlserver.h"
 #include "libcontrol/BasicElements.h"
+#include "libcontrol/StreamingStatistics.h"
 
 #include "libutil/Functors.h"
 
@@ -62,6 +63,7 @@ DECLARE_GLOBAL_DEBUG_MODULE;
 // DBUS stuff
 DBus::BusDispatcher dispatcher;
 DBusControl::Container *container = NULL;
+DBusControl::StreamingStatistics *statistics = NULL;
 DBus::Connection * global_conn;
 DeviceManager *m_deviceManager = NULL;
 
@@ -326,6 +328,12 @@ main( int argc, char **argv )
     // unlock the control tree since the tree is built
     m_deviceManager->unlockControl();
 
+    // the statistics of the streaming process, not part of the device tree
+    Control::StreamingStatistics streaming_statistics(NULL,
+        m_deviceManager->getStreamProcessorManager().getLatencyStatistics());
+    statistics = new DBusControl::StreamingStatistics(conn, "/org/ffado/Control/LatencyStatistics",
+                                                       NULL, streaming_statistics);
+
     printMessage("DBUS service running\n");
     printMessage("press ctrl-c to stop it & exit\n");
     
@@ -345,6 +353,7 @@ main( int argc, char **argv )
         debugError("could not unregister post update notifier");
     }
     delete postupdate_functor;
+    delete statistics;
     delete container;
 
     signal (SIGINT, SIG_DFL);
@@ -122,6 +122,26 @@ class ControlInterface:
             log.error("Failed to get MatrixMixer %s on server %s" % (path, self.servername))
             return 0
 
+    def setMatrixMixerValues(self, subpath, row, col, nbrows, nbcols, values):
+        try:
+            path = self.basepath + subpath
+            dev = self.bus.get_object(self.servername, path)
+            dev_cont = dbus.Interface(dev, dbus_interface='org.ffado.Control.Element.MatrixMixer')
+            return dev_cont.setValues(row, col, nbrows, nbcols, values)
+        except:
+            log.error("Failed to set MatrixMixer %s on server %s" % (path, self.servername))
+            return False
+
+    def getMatrixMixerValues(self, subpath, row, col, nbrows, nbcols):
+        try:
+            path = self.basepath + subpath
+            dev = self.bus.get_object(self.servername, path)
+            dev_cont = dbus.Interface(dev, dbus_interface='org.ffado.Control.Element.MatrixMixer')
+            return dev_cont.getValues(row, col, nbrows, nbcols)
+        except:
+            log.error("Failed to get MatrixMixer %s on server %s" % (path, self.servername))
+            return []
+
     def enumSelect(self, subpath, v):
         try:
             path = self.basepath + subpath
@@ -56,6 +56,23 @@ def getStereoBalance(vl, vr):
     else:
         return round(float(vr-vl)/float(vr+vl),2)
 
+# write the coefficients of a settings file to the top left corner of the
+# mixer in a single call, coeffs holds the rows of the file
+def setMatrixCoefficients(interface, coeffs, transpose_coeff):
+    n_rows = len(coeffs)
+    if n_rows == 0:
+        return True
+    n_cols = len(coeffs[0])
+    if transpose_coeff:
+        values = [float(coeffs[i][j]) for j in range(n_cols) for i in range(n_rows)]
+        result = interface.setValues(0, 0, n_cols, n_rows, values)
+    else:
+        values = [float(c) for row in coeffs for c in row]
+        result = interface.setValues(0, 0, n_rows, n_cols, values)
+    if not result:
+        log.error("Failed to set the %dx%d matrix coefficients" % (n_rows, n_cols))
+    return result
+
 class ColorForNumber:
     def __init__(self):
         self.colors = dict()
@@ -478,15 +495,23 @@ class MatrixControlView(QtGui.QWidget):
             self.nodeConnect(self.items[n_0][n_1])
 
     def refreshValues(self):
-        for x in range(len(self.items)):
-            for y in range(len(self.items[x])):
-                val = self.interface.getValue(x,y)
+        # read the whole matrix in a single call
+        if (self.transpose):
+            nbrows, nbcols = self.cols, self.rows
+        else:
+            nbrows, nbcols = self.rows, self.cols
+        values = self.interface.getValues(0, 0, nbrows, nbcols)
+        if len(values) != nbrows*nbcols:
+            log.error("Failed to get the %dx%d matrix coefficients" % (nbrows, nbcols))
+            return
+        for i in range(self.rows):
+            for j in range(self.cols):
                 if (self.transpose):
-                    self.items[y][x].setValue(val)
-                    self.items[y][x].internalValueChanged(val)
+                    val = values[j*nbcols + i]
                 else:
-                    self.items[x][y].setValue(val)
-                    self.items[x][y].internalValueChanged(val)
+                    val = values[i*nbcols + j]
+                self.items[i][j].setValue(val)
+                self.items[i][j].internalValueChanged(val)
 
     def saveSettings(self, indent):
         matrixSaveString = []
@@ -566,21 +591,14 @@ class MatrixControlView(QtGui.QWidget):
             if idxe < idxb + n_rows + 1:
                 log.debug("Incoherent number of rows in coefficients")
                 return False
-            i = 0
+            values = []
             for s in readMatrixString[idxb+1:idxb + n_rows + 1]:
                 coeffs = s.split()
                 if len(coeffs) < n_cols:
                     log.debug("Incoherent number of columns in coefficients")
                     return False
-                j = 0
-                for c in coeffs[0:n_cols]:
-                    if transpose_coeff:
-                        self.interface.setValue(j, i, int(c))
-                    else:
-                        self.interface.setValue(i, j, int(c))
-                    j += 1
-                i += 1
-                del coeffs
+                values.append([int(c) for c in coeffs[0:n_cols]])
+            setMatrixCoefficients(self.interface, values, transpose_coeff)
 
         try:
             idxb = readMatrixString.index('<mutes>')
@@ -593,21 +611,14 @@ class MatrixControlView(QtGui.QWidget):
             if idxe < idxb + n_rows + 1:
                 log.debug("Incoherent number of rows in mute")
                 return false
-            i = 0
+            values = []
             for s in readMatrixString[idxb+1:idxb + n_rows + 1]:
                 coeffs = s.split()
                 if len(coeffs) < n_cols:
                     log.debug("Incoherent number of columns in mute")
                     return false
-                j = 0
-                for c in coeffs[0:n_cols]:
-                    if transpose_coeff:
-                        self.mutes_interface.setValue(j, i, int(c))
-                    else:
-                        self.mutes_interface.setValue(i, j, int(c))
-                    j += 1
-                i += 1
-                del coeffs
+                values.append([int(c) for c in coeffs[0:n_cols]])
+            setMatrixCoefficients(self.mutes_interface, values, transpose_coeff)
 
         try:
             idxb = readMatrixString.index('<inverts>')
@@ -620,21 +631,14 @@ class MatrixControlView(QtGui.QWidget):
             if idxe < idxb + n_rows + 1:
                 log.debug("Incoherent number of rows in inverts")
                 return false
-            i = 0
+            values = []
             for s in readMatrixString[idxb+1:idxb + n_rows + 1]:
                 coeffs = s.split()
                 if len(coeffs) < n_cols:
                     log.debug("Incoherent number of columns in inverts")
                     return false
-                j = 0
-                for c in coeffs[0:n_cols]:
-                    if transpose_coeff:
-                        self.inverts_interface.setValue(j, i, int(c))
-                    else:
-                        self.inverts_interface.setValue(i, j, int(c))
-                    j += 1
-                i += 1
-                del coeffs
+                values.append([int(c) for c in coeffs[0:n_cols]])
+            setMatrixCoefficients(self.inverts_interface, values, transpose_coeff)
 
         self.refreshValues()
         return True
@@ -1082,21 +1086,14 @@ class SliderControlView(QtGui.QWidget):
             if idxe < idxb + n_rows + 1:
                 log.debug("Incoherent number of rows in coefficients")
                 return False
-            i = 0
+            values = []
             for s in readMatrixString[idxb+1:idxb + n_rows + 1]:
                 coeffs = s.split()
                 if len(coeffs) < n_cols:
                     log.debug("Incoherent number of columns in coefficients")
                     return False
-                j = 0
-                for c in coeffs[0:n_cols]:
-                    if transpose_coeff:
-                        self.interface.setValue(j, i, int(c))
-                    else:
-                        self.interface.setValue(i, j, int(c))
-                    j += 1
-                i += 1
-                del coeffs
+                values.append([int(c) for c in coeffs[0:n_cols]])
+            setMatrixCoefficients(self.interface, values, transpose_coeff)
 
         self.refreshValues()
         return True
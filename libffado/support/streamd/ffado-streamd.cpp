@@ -0,0 +1,601 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * ffado-streamd: share the streams of the FFADO devices with several
+ * client processes.
+ *
+ * The daemon runs the streaming layer and publishes a client registry
+ * in shared memory. Every client asks for a subset of the capture and
+ * playback channels and for the number of periods it wants to buffer.
+ * The daemon then sets up a shared memory ring per direction for it.
+ * Captured periods are handed to all clients, the playback periods of
+ * all clients are mixed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <sched.h>
+#include <argp.h>
+
+#include <vector>
+
+#include "libffado/ffado.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include "libutil/ShmRingBuffer.h"
+#include "libutil/ShmClientRegistry.h"
+#include "libutil/PosixThread.h"
+
+#include "mixkernels.h"
+
+using namespace Util;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+// the registry is checked every so many microseconds, the liveness of
+// the client processes only every so many checks
+#define STREAMD_SERVICE_INTERVAL_USEC       2000
+#define STREAMD_LIVENESS_CHECK_INTERVALS    64
+
+// limits for the number of periods a client can buffer
+#define STREAMD_MIN_CLIENT_PERIODS      2
+#define STREAMD_MAX_CLIENT_PERIODS      64
+
+static int run;
+
+// Program documentation.
+static char doc[] = "ffado-streamd -- share FFADO devices with several client processes\n\n"
+                    "Clients (e.g. the ALSA plugin) connect through the shared memory\n"
+                    "registry named by --name.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int period;
+    long int slave_mode;
+    long int snoop_mode;
+    long int nb_buffers;
+    long int sample_rate;
+    long int rtprio;
+    const char *name;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Verbose level" },
+    {"rtprio",  'P', "prio",  0,  "Realtime priority (0 = no RT scheduling)" },
+    {"samplerate",  'r', "hz",  0,  "Sample rate" },
+    {"period",  'p', "frames",  0,  "Period (buffer) size" },
+    {"nb_buffers",  'n', "nb",  0,  "Nb buffers (periods)" },
+    {"slave_mode",  's', "bool",  0,  "Run in slave mode" },
+    {"snoop_mode",  'S', "bool",  0,  "Run in snoop mode" },
+    {"name",  'N', "name",  0,  "Name of the client registry (ffado-streamd)" },
+    { 0 }
+};
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+    long int *value = NULL;
+
+    errno = 0;
+    switch (key) {
+        case 'v': value = &arguments->verbose; break;
+        case 'P': value = &arguments->rtprio; break;
+        case 'r': value = &arguments->sample_rate; break;
+        case 'p': value = &arguments->period; break;
+        case 'n': value = &arguments->nb_buffers; break;
+        case 's': value = &arguments->slave_mode; break;
+        case 'S': value = &arguments->snoop_mode; break;
+        case 'N':
+            arguments->name = arg;
+            return 0;
+        case ARGP_KEY_ARG:
+        case ARGP_KEY_END:
+            return 0;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    *value = strtol( arg, &tail, 0 );
+    if ( errno || *tail ) {
+        fprintf( stderr, "Could not parse '%s' argument\n", arg );
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+static int
+set_realtime_priority(unsigned int prio)
+{
+    struct sched_param schp;
+    memset(&schp, 0, sizeof(schp));
+    schp.sched_priority = prio;
+    if (sched_setscheduler(0, (prio > 0 ? SCHED_FIFO : SCHED_OTHER), &schp) != 0) {
+        perror("sched_setscheduler");
+        return -1;
+    }
+    return 0;
+}
+
+///////////////////////////
+// client handling
+///////////////////////////
+
+// the hand-off between the service thread and the period loop
+enum eSlotState {
+    eSS_Free     = 0, // only the service thread touches the client
+    eSS_Ready    = 1, // the rings are set up, the period loop uses them
+    eSS_Retire   = 2, // the service thread wants the client back
+    eSS_Retired  = 3, // the period loop doesn't use the rings anymore
+};
+
+struct client {
+    client() : capture( NULL ), playback( NULL ), playback_started( false ), slot( eSS_Free ) {};
+    ShmRingBuffer *capture;
+    ShmRingBuffer *playback;
+    bool playback_started;
+    ShmClientRegistry::ClientRequest request;
+    int slot;
+};
+
+static inline enum eSlotState
+getSlotState(struct client &c)
+{
+    return (enum eSlotState)__sync_fetch_and_add(&c.slot, 0);
+}
+
+static inline bool
+switchSlotState(struct client &c, enum eSlotState from, enum eSlotState to)
+{
+    return __sync_bool_compare_and_swap(&c.slot, from, to);
+}
+
+static void
+teardownClient(ShmClientRegistry &registry, struct client &c, int idx)
+{
+    if (c.capture || c.playback) {
+        printMessage("client %d ('%s', pid %d) left, %u overruns, %u underruns\n",
+                     idx, c.request.name.c_str(), c.request.pid,
+                     registry.getOverruns(idx), registry.getUnderruns(idx));
+    }
+    delete c.capture;
+    delete c.playback;
+    c.capture = NULL;
+    c.playback = NULL;
+    c.playback_started = false;
+    registry.freeClient(idx);
+}
+
+static bool
+setupClient(ShmClientRegistry &registry, struct client &c, int idx,
+            unsigned int period, int verbose)
+{
+    ShmClientRegistry::ClientRequest &r = c.request;
+    if (!registry.getClientRequest(idx, r)) {
+        return false;
+    }
+    if (r.nb_periods < STREAMD_MIN_CLIENT_PERIODS
+        || r.nb_periods > STREAMD_MAX_CLIENT_PERIODS) {
+        debugWarning("client %d: bad number of periods: %u\n", idx, r.nb_periods);
+        return false;
+    }
+    if (r.capture.empty() && r.playback.empty()) {
+        debugWarning("client %d: no channels requested\n", idx);
+        return false;
+    }
+    for (unsigned int i = 0; i < r.capture.size(); i++) {
+        if (r.capture.at(i) >= registry.getNbCapture()) {
+            debugWarning("client %d: bad capture channel %u\n", idx, r.capture.at(i));
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < r.playback.size(); i++) {
+        if (r.playback.at(i) >= registry.getNbPlayback()) {
+            debugWarning("client %d: bad playback channel %u\n", idx, r.playback.at(i));
+            return false;
+        }
+    }
+
+    if (!r.capture.empty()) {
+        c.capture = new ShmRingBuffer(registry.getRingName(idx, true),
+                                      ShmRingBuffer::eBT_Master,
+                                      ShmRingBuffer::eD_Outward,
+                                      ShmRingBuffer::eB_NonBlocking,
+                                      r.nb_periods,
+                                      r.capture.size() * period * sizeof(float));
+        c.capture->setVerboseLevel(verbose);
+        if (!c.capture->init()) {
+            debugError("client %d: could not create capture ring\n", idx);
+            return false;
+        }
+    }
+    if (!r.playback.empty()) {
+        c.playback = new ShmRingBuffer(registry.getRingName(idx, false),
+                                       ShmRingBuffer::eBT_Master,
+                                       ShmRingBuffer::eD_Inward,
+                                       ShmRingBuffer::eB_NonBlocking,
+                                       r.nb_periods,
+                                       r.playback.size() * period * sizeof(float));
+        c.playback->setVerboseLevel(verbose);
+        if (!c.playback->init()) {
+            debugError("client %d: could not create playback ring\n", idx);
+            return false;
+        }
+    }
+    printMessage("client %d ('%s', pid %d) connected: %u capture, %u playback channels, %u periods\n",
+                 idx, r.name.c_str(), r.pid, (unsigned int)r.capture.size(),
+                 (unsigned int)r.playback.size(), r.nb_periods);
+    return true;
+}
+
+/**
+ * Sets up and tears down the clients outside of the period loop.
+ *
+ * Creating a ring means shm_open, ftruncate and mlock, so this runs in
+ * its own non-realtime thread. A client is handed to the period loop by
+ * setting its slot to eSS_Ready, and taken back by setting it to
+ * eSS_Retire and waiting until the loop acknowledges with eSS_Retired.
+ */
+class ClientService : public RunnableInterface
+{
+public:
+    ClientService(ShmClientRegistry &registry, std::vector<struct client> &clients,
+                  unsigned int period, int verbose)
+        : m_registry( registry )
+        , m_clients( clients )
+        , m_period( period )
+        , m_verbose( verbose )
+        , m_nb_checks( 0 )
+    {};
+
+    virtual bool Execute();
+
+private:
+    void serviceClient(struct client &c, int idx, bool check_liveness);
+
+    ShmClientRegistry &m_registry;
+    std::vector<struct client> &m_clients;
+    unsigned int m_period;
+    int m_verbose;
+    unsigned int m_nb_checks;
+};
+
+bool
+ClientService::Execute()
+{
+    bool check_liveness = (m_nb_checks++ % STREAMD_LIVENESS_CHECK_INTERVALS) == 0;
+    for (int idx = 0; idx < (int)m_clients.size(); idx++) {
+        serviceClient(m_clients.at(idx), idx, check_liveness);
+    }
+    usleep(STREAMD_SERVICE_INTERVAL_USEC);
+    return true;
+}
+
+void
+ClientService::serviceClient(struct client &c, int idx, bool check_liveness)
+{
+    enum ShmClientRegistry::eClientState state = m_registry.getClientState(idx);
+    switch (getSlotState(c)) {
+        case eSS_Free:
+            switch (state) {
+                case ShmClientRegistry::eCS_Requested:
+                    if (setupClient(m_registry, c, idx, m_period, m_verbose)) {
+                        switchSlotState(c, eSS_Free, eSS_Ready);
+                        m_registry.setClientState(idx, ShmClientRegistry::eCS_Active);
+                    } else {
+                        delete c.capture;
+                        delete c.playback;
+                        c.capture = NULL;
+                        c.playback = NULL;
+                        m_registry.setClientState(idx, ShmClientRegistry::eCS_Rejected);
+                    }
+                    break;
+                case ShmClientRegistry::eCS_Closing:
+                    teardownClient(m_registry, c, idx);
+                    break;
+                case ShmClientRegistry::eCS_Claimed:
+                case ShmClientRegistry::eCS_Rejected:
+                    if (check_liveness && m_registry.isClientGone(idx)) {
+                        teardownClient(m_registry, c, idx);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case eSS_Ready:
+            if (state == ShmClientRegistry::eCS_Closing
+                || (check_liveness && m_registry.isClientGone(idx))) {
+                switchSlotState(c, eSS_Ready, eSS_Retire);
+            }
+            break;
+        case eSS_Retired:
+            teardownClient(m_registry, c, idx);
+            switchSlotState(c, eSS_Retired, eSS_Free);
+            break;
+        default:
+            // waiting for the period loop
+            break;
+    }
+}
+
+// called at the start of every period: acknowledge the clients the
+// service thread wants back, the loop doesn't touch them anymore
+static void
+retireClients(std::vector<struct client> &clients)
+{
+    for (int idx = 0; idx < (int)clients.size(); idx++) {
+        switchSlotState(clients.at(idx), eSS_Retire, eSS_Retired);
+    }
+}
+
+// hand the captured period to every client that wants capture
+static void
+distributeCapture(ShmClientRegistry &registry, std::vector<struct client> &clients,
+                  std::vector<float *> &capture_buffers, unsigned int period)
+{
+    for (int idx = 0; idx < (int)clients.size(); idx++) {
+        struct client &c = clients.at(idx);
+        if (getSlotState(c) != eSS_Ready || c.capture == NULL) continue;
+
+        float *block;
+        if (c.capture->requestBlockForWrite((void **)&block) != ShmRingBuffer::eR_OK) {
+            // the client doesn't keep up, it misses this period
+            registry.addOverrun(idx);
+            continue;
+        }
+        for (unsigned int j = 0; j < c.request.capture.size(); j++) {
+            memcpy(block + j * period, capture_buffers.at(c.request.capture.at(j)),
+                   period * sizeof(float));
+        }
+        c.capture->releaseBlockForWrite();
+    }
+}
+
+// mix the playback periods of all clients
+static void
+mixPlayback(ShmClientRegistry &registry, std::vector<struct client> &clients,
+            std::vector<float *> &playback_buffers, unsigned int period,
+            Streamd::mix_add_t mix_add)
+{
+    for (unsigned int i = 0; i < playback_buffers.size(); i++) {
+        memset(playback_buffers.at(i), 0, period * sizeof(float));
+    }
+    for (int idx = 0; idx < (int)clients.size(); idx++) {
+        struct client &c = clients.at(idx);
+        if (getSlotState(c) != eSS_Ready || c.playback == NULL) continue;
+
+        float *block;
+        if (c.playback->requestBlockForRead((void **)&block) != ShmRingBuffer::eR_OK) {
+            // only count the periods missed once the client is running
+            if (c.playback_started) {
+                registry.addUnderrun(idx);
+            }
+            continue;
+        }
+        c.playback_started = true;
+        for (unsigned int j = 0; j < c.request.playback.size(); j++) {
+            mix_add(playback_buffers.at(c.request.playback.at(j)),
+                    block + j * period, period);
+        }
+        c.playback->releaseBlockForRead();
+    }
+}
+
+///////////////////////////
+// main
+///////////////////////////
+
+int
+main(int argc, char *argv[])
+{
+    struct arguments arguments;
+
+    // Default values.
+    arguments.verbose           = 0;
+    arguments.period            = 512;
+    arguments.slave_mode        = 0;
+    arguments.snoop_mode        = 0;
+    arguments.nb_buffers        = 3;
+    arguments.sample_rate       = 48000;
+    arguments.rtprio            = 0;
+    arguments.name              = "ffado-streamd";
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        debugError("Could not parse command line\n" );
+        return -1;
+    }
+    if (arguments.period <= 0 || arguments.nb_buffers <= 0) {
+        debugError("Invalid period or number of buffers\n" );
+        return -1;
+    }
+
+    setDebugLevel(arguments.verbose);
+    unsigned int period = arguments.period;
+
+    signal (SIGINT, sighandler);
+    signal (SIGTERM, sighandler);
+    signal (SIGPIPE, SIG_IGN);
+
+    ffado_device_info_t device_info;
+    memset(&device_info,0,sizeof(ffado_device_info_t));
+
+    ffado_options_t dev_options;
+    memset(&dev_options,0,sizeof(ffado_options_t));
+
+    dev_options.sample_rate = arguments.sample_rate;
+    dev_options.period_size = arguments.period;
+    dev_options.nb_buffers = arguments.nb_buffers;
+    dev_options.realtime = (arguments.rtprio != 0);
+    dev_options.packetizer_priority = arguments.rtprio;
+    dev_options.verbose = arguments.verbose;
+    dev_options.slave_mode = arguments.slave_mode;
+    dev_options.snoop_mode = arguments.snoop_mode;
+
+    ffado_device_t *dev = ffado_streaming_init(device_info, dev_options);
+    if (!dev) {
+        debugError("Could not init Ffado Streaming layer\n");
+        return -1;
+    }
+    // the clients exchange float samples, that makes mixing cheap
+    ffado_streaming_set_audio_datatype(dev, ffado_audio_datatype_float);
+
+    // one buffer per audio channel, the other streams are disabled
+    std::vector<float *> capture_buffers;
+    std::vector<float *> playback_buffers;
+    float *nullbuffer = (float *)calloc(period, sizeof(float));
+
+    int nb_capture_streams = ffado_streaming_get_nb_capture_streams(dev);
+    int nb_playback_streams = ffado_streaming_get_nb_playback_streams(dev);
+    for (int i = 0; i < nb_capture_streams; i++) {
+        if (ffado_streaming_get_capture_stream_type(dev, i) == ffado_stream_type_audio) {
+            float *buff = (float *)calloc(period, sizeof(float));
+            capture_buffers.push_back(buff);
+            ffado_streaming_set_capture_stream_buffer(dev, i, (char *)buff);
+            ffado_streaming_capture_stream_onoff(dev, i, 1);
+        } else {
+            ffado_streaming_set_capture_stream_buffer(dev, i, (char *)nullbuffer);
+            ffado_streaming_capture_stream_onoff(dev, i, 0);
+        }
+    }
+    for (int i = 0; i < nb_playback_streams; i++) {
+        if (ffado_streaming_get_playback_stream_type(dev, i) == ffado_stream_type_audio) {
+            float *buff = (float *)calloc(period, sizeof(float));
+            playback_buffers.push_back(buff);
+            ffado_streaming_set_playback_stream_buffer(dev, i, (char *)buff);
+            ffado_streaming_playback_stream_onoff(dev, i, 1);
+        } else {
+            ffado_streaming_set_playback_stream_buffer(dev, i, (char *)nullbuffer);
+            ffado_streaming_playback_stream_onoff(dev, i, 0);
+        }
+    }
+
+    const char *kernel_name;
+    Streamd::mix_add_t mix_add = Streamd::getMixAddKernel(&kernel_name);
+
+    printMessage("Serving %u capture and %u playback channels as '%s', period %u, %s mixing\n",
+                 (unsigned int)capture_buffers.size(), (unsigned int)playback_buffers.size(),
+                 arguments.name, period, kernel_name);
+
+    ShmClientRegistry registry(arguments.name);
+    registry.setVerboseLevel(arguments.verbose);
+    std::vector<struct client> clients(FFADO_SHM_REGISTRY_MAX_CLIENTS);
+    ClientService service(registry, clients, period, arguments.verbose);
+    PosixThread service_thread(&service, "STREAMD", false, 0, PTHREAD_CANCEL_DEFERRED);
+
+    int result = -1;
+
+    if (!registry.create(period, arguments.sample_rate,
+                         capture_buffers.size(), playback_buffers.size())) {
+        debugError("Could not create the client registry\n");
+        goto out;
+    }
+
+    // start it before this thread goes realtime, a new thread inherits
+    // the scheduling policy
+    if (service_thread.Start() != 0) {
+        debugError("Could not start the client service thread\n");
+        goto out;
+    }
+
+    set_realtime_priority(arguments.rtprio);
+
+    if (ffado_streaming_prepare(dev)) {
+        debugFatal("Could not prepare streaming system\n");
+        goto out;
+    }
+    if (ffado_streaming_start(dev)) {
+        debugFatal("Could not start streaming system\n");
+        goto out;
+    }
+
+    run = 1;
+    while (run) {
+        ffado_wait_response response = ffado_streaming_wait(dev);
+        if (response == ffado_wait_xrun) {
+            debugOutput(DEBUG_LEVEL_NORMAL, "Xrun\n");
+            ffado_streaming_reset(dev);
+            continue;
+        } else if (response == ffado_wait_shutdown) {
+            break;
+        } else if (response == ffado_wait_error) {
+            debugError("fatal xrun\n");
+            break;
+        }
+
+        ffado_streaming_transfer_capture_buffers(dev);
+
+        retireClients(clients);
+        distributeCapture(registry, clients, capture_buffers, period);
+        mixPlayback(registry, clients, playback_buffers, period, mix_add);
+
+        ffado_streaming_transfer_playback_buffers(dev);
+    }
+    result = 0;
+
+    ffado_streaming_stop(dev);
+
+out:
+    service_thread.Stop();
+    for (int idx = 0; idx < (int)clients.size(); idx++) {
+        delete clients.at(idx).capture;
+        delete clients.at(idx).playback;
+    }
+    ffado_streaming_finish(dev);
+
+    for (unsigned int i = 0; i < capture_buffers.size(); i++) {
+        free(capture_buffers.at(i));
+    }
+    for (unsigned int i = 0; i < playback_buffers.size(); i++) {
+        free(playback_buffers.at(i));
+    }
+    free(nullbuffer);
+
+    return result;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mixkernels.h"
+
+#include <cstddef>
+
+// same scheme as the AMDTP kernels: function level target attributes,
+// selected at runtime based on the CPU features
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define MIX_KERNELS_X86 1
+#include <immintrin.h>
+#define KERNEL_TARGET_SSE2     __attribute__((target("sse2")))
+#define KERNEL_TARGET_AVX      __attribute__((target("avx")))
+#else
+#define MIX_KERNELS_X86 0
+#endif
+
+namespace Streamd {
+
+static void
+mixAddScalar(float *dst, const float *src, unsigned int nsamples)
+{
+    for (unsigned int i = 0; i < nsamples; i++) {
+        dst[i] += src[i];
+    }
+}
+
+#if MIX_KERNELS_X86
+KERNEL_TARGET_SSE2 static void
+mixAddSSE2(float *dst, const float *src, unsigned int nsamples)
+{
+    unsigned int i = 0;
+    for (; i + 8 <= nsamples; i += 8) {
+        __m128 d0 = _mm_loadu_ps(dst + i);
+        __m128 d1 = _mm_loadu_ps(dst + i + 4);
+        d0 = _mm_add_ps(d0, _mm_loadu_ps(src + i));
+        d1 = _mm_add_ps(d1, _mm_loadu_ps(src + i + 4));
+        _mm_storeu_ps(dst + i, d0);
+        _mm_storeu_ps(dst + i + 4, d1);
+    }
+    mixAddScalar(dst + i, src + i, nsamples - i);
+}
+
+KERNEL_TARGET_AVX static void
+mixAddAVX(float *dst, const float *src, unsigned int nsamples)
+{
+    unsigned int i = 0;
+    for (; i + 16 <= nsamples; i += 16) {
+        __m256 d0 = _mm256_loadu_ps(dst + i);
+        __m256 d1 = _mm256_loadu_ps(dst + i + 8);
+        d0 = _mm256_add_ps(d0, _mm256_loadu_ps(src + i));
+        d1 = _mm256_add_ps(d1, _mm256_loadu_ps(src + i + 8));
+        _mm256_storeu_ps(dst + i, d0);
+        _mm256_storeu_ps(dst + i + 8, d1);
+    }
+    _mm256_zeroupper();
+    mixAddScalar(dst + i, src + i, nsamples - i);
+}
+#endif
+
+mix_add_t
+getMixAddKernel(const char **name)
+{
+    const char *n = "scalar";
+    mix_add_t k = mixAddScalar;
+#if MIX_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        n = "AVX";
+        k = mixAddAVX;
+    } else if (__builtin_cpu_supports("sse2")) {
+        n = "SSE2";
+        k = mixAddSSE2;
+    }
+#endif
+    if (name) *name = n;
+    return k;
+}
+
+} // end of namespace Streamd
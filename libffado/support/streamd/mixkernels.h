@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_STREAMD_MIXKERNELS__
+#define __FFADO_STREAMD_MIXKERNELS__
+
+namespace Streamd {
+
+/**
+ * Adds nsamples float samples of src to dst. The buffers don't need
+ * any particular alignment.
+ */
+typedef void (*mix_add_t)(float *dst, const float *src, unsigned int nsamples);
+
+/**
+ * @brief get the fastest mix kernel supported by the host
+ *
+ * Probes the CPU, call it once at startup.
+ *
+ * @param name if not NULL, set to the name of the kernel set
+ */
+mix_add_t getMixAddKernel(const char **name);
+
+} // end of namespace Streamd
+
+#endif /* __FFADO_STREAMD_MIXKERNELS__ */
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Benchmark for the serializer backends used by the discovery cache.
+ *
+ * A synthetic AV/C plug graph (subunits, plugs, clusters, formats) is
+ * written with the XML and the binary backend, then loaded and every
+ * member is read back. The numbers are the time to write, the time to
+ * load (open + parse/map + version check), the time to look up all
+ * members, the file size and the resident memory held by a loaded
+ * deserializer.
+ */
+
+#include <argp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <string>
+#include <sstream>
+
+#include "debugmodule/debugmodule.h"
+
+#include "libutil/serialize.h"
+#include "libutil/serialize_binary.h"
+#include "libutil/SystemTimeSource.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+// Program documentation.
+static char doc[] = "FFADO -- serializer benchmark\n\n"
+                    "Compares the XML and binary serializer backends on a\n"
+                    "synthetic AV/C plug graph.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int plugs;
+    long int iterations;
+    const char *directory;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",    'v', "level",      0, "Verbose level (0)" },
+    {"plugs",      'p', "count",      0, "Plugs per subunit (32)" },
+    {"iterations", 'n', "count",      0, "Iterations per measurement (10)" },
+    {"directory",  'd', "path",       0, "Directory for the test files (/tmp)" },
+    { 0 }
+};
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+    long int *value = NULL;
+
+    errno = 0;
+    switch (key) {
+        case 'v': value = &arguments->verbose; break;
+        case 'p': value = &arguments->plugs; break;
+        case 'n': value = &arguments->iterations; break;
+        case 'd':
+            arguments->directory = arg;
+            return 0;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    *value = strtol( arg, &tail, 0 );
+    if ( errno || *tail ) {
+        fprintf( stderr, "Could not parse '%s' argument\n", arg );
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+
+struct member {
+    std::string path;
+    bool        is_string;
+    long long   value;
+    std::string str;
+};
+
+static uint64_t
+getNsecs()
+{
+    struct timespec ts;
+    Util::SystemTimeSource::clockGettime(&ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// resident memory in KiB
+static long
+getResidentKiB()
+{
+    long size, resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void
+addInt(std::vector<member> &m, const std::string &path, long long value)
+{
+    member e;
+    e.path = path;
+    e.is_string = false;
+    e.value = value;
+    m.push_back(e);
+}
+
+static void
+addString(std::vector<member> &m, const std::string &path, const std::string &str)
+{
+    member e;
+    e.path = path;
+    e.is_string = true;
+    e.value = 0;
+    e.str = str;
+    m.push_back(e);
+}
+
+// a plug graph shaped like the one written by AVC::Unit::serialize
+static void
+buildPlugGraph(std::vector<member> &m, unsigned int nb_plugs)
+{
+    for (unsigned int s = 0; s < 2; s++) {
+        std::ostringstream sub;
+        sub << "Subunit" << s << "/";
+        addInt(m, sub.str() + "m_sbType", s ? 0x0c : 0x01);
+        addInt(m, sub.str() + "m_sbId", 0);
+        addInt(m, sub.str() + "m_verboseLevel", 0);
+        for (unsigned int p = 0; p < nb_plugs; p++) {
+            std::ostringstream plug;
+            plug << sub.str() << "Plug" << p << "/";
+            const std::string base = plug.str();
+            addInt(m, base + "m_subunitType", s ? 0x0c : 0x01);
+            addInt(m, base + "m_subunitId", 0);
+            addInt(m, base + "m_functionBlockType", 0xff);
+            addInt(m, base + "m_functionBlockId", 0xff);
+            addInt(m, base + "m_addressType", p & 1);
+            addInt(m, base + "m_direction", p & 1);
+            addInt(m, base + "m_id", p);
+            addInt(m, base + "m_infoPlugType", 0);
+            addInt(m, base + "m_nrOfChannels", 8);
+            addString(m, base + "m_name", "Analog Out " + base);
+            addInt(m, base + "m_globalId", s * nb_plugs + p);
+            addInt(m, base + "m_verboseLevel", 0);
+            for (unsigned int c = 0; c < 4; c++) {
+                std::ostringstream cl;
+                cl << base << "m_clusterInfos/ClusterInfo" << c << "/";
+                addInt(m, cl.str() + "m_index", c);
+                addInt(m, cl.str() + "m_portType", 6);
+                addString(m, cl.str() + "m_name", "Line 1/2");
+                addInt(m, cl.str() + "m_nrOfChannels", 2);
+                for (unsigned int ch = 0; ch < 2; ch++) {
+                    std::ostringstream chi;
+                    chi << cl.str() << "ChannelInfo" << ch << "/";
+                    addInt(m, chi.str() + "m_streamPosition", c * 2 + ch);
+                    addInt(m, chi.str() + "m_location", ch + 1);
+                    addString(m, chi.str() + "m_name", ch ? "Right" : "Left");
+                }
+            }
+            for (unsigned int f = 0; f < 6; f++) {
+                std::ostringstream fi;
+                fi << base << "m_formatInfos/FormatInfo" << f << "/";
+                addInt(m, fi.str() + "m_samplingFrequency", f);
+                addInt(m, fi.str() + "m_isSyncStream", 0);
+                addInt(m, fi.str() + "m_audioChannels", 8);
+                addInt(m, fi.str() + "m_midiChannels", 1);
+                addInt(m, fi.str() + "m_index", f);
+            }
+            addInt(m, base + "m_inputConnections0/global_id", s * nb_plugs + p);
+        }
+    }
+}
+
+static bool
+writeMembers(Util::IOSerialize &ser, std::vector<member> &m)
+{
+    bool result = true;
+    for (unsigned int i = 0; i < m.size(); i++) {
+        if (m[i].is_string) {
+            result &= ser.write(m[i].path, m[i].str);
+        } else {
+            result &= ser.write(m[i].path, m[i].value);
+        }
+    }
+    return result;
+}
+
+static bool
+readMembers(Util::IODeserialize &deser, std::vector<member> &m)
+{
+    bool result = true;
+    for (unsigned int i = 0; i < m.size(); i++) {
+        if (m[i].is_string) {
+            std::string str;
+            result &= deser.read(m[i].path, str);
+            result &= (str == m[i].str);
+        } else {
+            long long value;
+            result &= deser.read(m[i].path, value);
+            result &= (value == m[i].value);
+        }
+    }
+    return result;
+}
+
+static long
+getFileSize(const std::string &name)
+{
+    struct stat buf;
+    if (stat(name.c_str(), &buf) != 0) {
+        return -1;
+    }
+    return buf.st_size;
+}
+
+static void
+printResult(const char *backend, long size, double t_write, double t_load,
+            double t_read, long rss, unsigned int nb_members, bool ok)
+{
+    printf("%-7s %9ld %10.3f %10.3f %10.3f %8.2f %8ld %s\n",
+           backend, size, t_write, t_load, t_read,
+           t_read * 1000.0 / nb_members, rss, (ok ? "" : "FAILED"));
+}
+
+static bool
+benchXml(const std::string &name, std::vector<member> &m, unsigned int iterations)
+{
+    bool ok = true;
+    uint64_t t0 = getNsecs();
+    for (unsigned int i = 0; i < iterations; i++) {
+        // the file is written when ser goes out of scope
+        Util::XMLSerialize ser(name);
+        ok &= writeMembers(ser, m);
+    }
+    uint64_t t_write = getNsecs() - t0;
+
+    uint64_t t_load = 0, t_read = 0;
+    long rss = 0;
+    for (unsigned int i = 0; i < iterations; i++) {
+        long rss0 = getResidentKiB();
+        t0 = getNsecs();
+        Util::XMLDeserialize deser(name);
+        ok &= deser.isValid();
+        uint64_t t1 = getNsecs();
+        ok &= readMembers(deser, m);
+        uint64_t t2 = getNsecs();
+        t_load += t1 - t0;
+        t_read += t2 - t1;
+        rss = getResidentKiB() - rss0;
+    }
+    printResult("xml", getFileSize(name), t_write / 1e6 / iterations,
+                t_load / 1e6 / iterations, t_read / 1e6 / iterations,
+                rss, m.size(), ok);
+    unlink(name.c_str());
+    return ok;
+}
+
+static bool
+benchBinary(const std::string &name, std::vector<member> &m, unsigned int iterations)
+{
+    bool ok = true;
+    uint64_t t0 = getNsecs();
+    for (unsigned int i = 0; i < iterations; i++) {
+        Util::BinarySerialize ser(name);
+        ok &= writeMembers(ser, m);
+        ok &= ser.close();
+    }
+    uint64_t t_write = getNsecs() - t0;
+
+    uint64_t t_load = 0, t_read = 0;
+    long rss = 0;
+    for (unsigned int i = 0; i < iterations; i++) {
+        long rss0 = getResidentKiB();
+        t0 = getNsecs();
+        Util::BinaryDeserialize deser(name);
+        ok &= deser.isValid();
+        uint64_t t1 = getNsecs();
+        ok &= readMembers(deser, m);
+        uint64_t t2 = getNsecs();
+        t_load += t1 - t0;
+        t_read += t2 - t1;
+        rss = getResidentKiB() - rss0;
+    }
+    printResult("binary", getFileSize(name), t_write / 1e6 / iterations,
+                t_load / 1e6 / iterations, t_read / 1e6 / iterations,
+                rss, m.size(), ok);
+    unlink(name.c_str());
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct arguments arguments;
+
+    // Default values.
+    arguments.verbose    = 0;
+    arguments.plugs      = 32;
+    arguments.iterations = 10;
+    arguments.directory  = "/tmp";
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        return -1;
+    }
+    if (arguments.plugs <= 0 || arguments.iterations <= 0) {
+        fprintf( stderr, "Invalid arguments\n" );
+        return -1;
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    std::vector<member> members;
+    buildPlugGraph(members, arguments.plugs);
+
+    std::ostringstream base;
+    base << arguments.directory << "/bench-serialize-" << getpid();
+
+    printf("%u members, %ld iterations\n", (unsigned int)members.size(), arguments.iterations);
+    printf("%-7s %9s %10s %10s %10s %8s %8s\n",
+           "backend", "bytes", "write ms", "load ms", "read ms", "us/read", "rss KiB");
+
+    bool all_ok = true;
+    all_ok &= benchXml(base.str() + ".xml", members, arguments.iterations);
+    all_ok &= benchBinary(base.str() + ".bin", members, arguments.iterations);
+
+    return (all_ok ? 0 : -1);
+}
@@ -0,0 +1,911 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Micro-benchmark for the stream processor data paths.
+ *
+ * The stream processors are instantiated on top of a fake device that
+ * has no hardware behind it. They are prepared as usual, after which the
+ * per-period conversion (processReadBlock/processWriteBlock) is driven
+ * with synthetic event data. The Oxford receive processor is fed with
+ * synthetic non-blocking iso packets instead, since its packet
+ * reassembly is part of the data path.
+ *
+ * No timestamp/DLL processing is done, the numbers only cover the
+ * conversion between the iso payload and the client port buffers.
+ */
+
+#include <argp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <vector>
+#include <memory>
+
+#include "debugmodule/debugmodule.h"
+
+#include "devicemanager.h"
+#include "ffadodevice.h"
+#include "libieee1394/configrom.h"
+#include "libieee1394/ieee1394service.h"
+
+#include "libstreaming/StreamProcessorManager.h"
+#include "libstreaming/util/cip.h"
+
+#ifdef ENABLE_GENERICAVC
+#include "libstreaming/amdtp/AmdtpKernels.h"
+#include "libstreaming/amdtp/AmdtpBufferOps.h"
+#include "libstreaming/amdtp/AmdtpPort.h"
+#include "libstreaming/amdtp/AmdtpReceiveStreamProcessor.h"
+#include "libstreaming/amdtp/AmdtpTransmitStreamProcessor.h"
+#endif
+#ifdef ENABLE_OXFORD
+#include <libiec61883/iec61883.h>
+#include "libstreaming/amdtp-oxford/AmdtpOxfordReceiveStreamProcessor.h"
+#endif
+#ifdef ENABLE_MOTU
+#include "motu/motu_avdevice.h"
+#include "libstreaming/motu/MotuPort.h"
+#include "libstreaming/motu/MotuKernels.h"
+#include "libstreaming/motu/MotuReceiveStreamProcessor.h"
+#include "libstreaming/motu/MotuTransmitStreamProcessor.h"
+#endif
+#ifdef ENABLE_RME
+#include "rme/rme_avdevice.h"
+#include "libstreaming/rme/RmePort.h"
+#include "libstreaming/rme/RmeReceiveStreamProcessor.h"
+#include "libstreaming/rme/RmeTransmitStreamProcessor.h"
+#endif
+#ifdef ENABLE_DIGIDESIGN
+#include "libstreaming/digidesign/DigidesignPort.h"
+#include "libstreaming/digidesign/DigidesignReceiveStreamProcessor.h"
+#include "libstreaming/digidesign/DigidesignTransmitStreamProcessor.h"
+#endif
+
+#include "libutil/ByteSwap.h"
+#include "libutil/SystemTimeSource.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+using namespace Streaming;
+
+// Program documentation.
+static char doc[] = "FFADO -- stream processor micro-benchmark\n\n"
+                    "Measures the cost of converting between iso payload and\n"
+                    "client buffers for every stream processor type, without\n"
+                    "requiring any hardware.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int rate;
+    long int frames;
+    long int channels;
+    long int period;
+    long int kernel;
+    const char *processor;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",   'v', "level",     0, "Verbose level (0)" },
+    {"rate",      'r', "rate",      0, "Nominal sample rate (48000)" },
+    {"frames",    'f', "frames",    0, "Frames to process per measurement (1048576)" },
+    {"channels",  'c', "channels",  0, "Channel count, 0 sweeps 2/8/16/32 (0)" },
+    {"period",    'p', "frames",    0, "Period size, 0 sweeps 64/256/1024 (0)" },
+    {"kernel",    'k', "type",      0, "Kernel type (AMDTP: 1=scalar, 2=SSE2, 3=AVX2, 4=AVX-512; MOTU: 1=scalar, 2=SSSE3, 3=AVX2), -1 sweeps all supported (-1)" },
+    {"processor", 's', "name",      0, "Only run the processors whose name starts with this (all)" },
+    { 0 }
+};
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+    long int *value = NULL;
+
+    errno = 0;
+    switch (key) {
+        case 'v': value = &arguments->verbose; break;
+        case 'r': value = &arguments->rate; break;
+        case 'f': value = &arguments->frames; break;
+        case 'c': value = &arguments->channels; break;
+        case 'p': value = &arguments->period; break;
+        case 'k': value = &arguments->kernel; break;
+        case 's':
+            arguments->processor = arg;
+            return 0;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    *value = strtol( arg, &tail, 0 );
+    if ( errno || *tail ) {
+        fprintf( stderr, "Could not parse '%s' argument\n", arg );
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+
+/**
+ * A device without hardware behind it, only used as the parent of
+ * the stream processors.
+ */
+class BenchDevice : public FFADODevice {
+public:
+    BenchDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ) )
+        : FFADODevice( d, configRom )
+    {};
+    virtual ~BenchDevice() {};
+
+    virtual bool discover() {return true;};
+    virtual bool setSamplingFrequency( int samplingFrequency ) {return false;};
+    virtual int getSamplingFrequency( ) {return 0;};
+    virtual std::vector<int> getSupportedSamplingFrequencies( )
+        {return std::vector<int>();};
+    virtual ClockSourceVector getSupportedClockSources()
+        {return ClockSourceVector();};
+    virtual bool setActiveClockSource(ClockSource) {return false;};
+    virtual ClockSource getActiveClockSource() {return ClockSource();};
+    virtual bool lock() {return true;};
+    virtual bool unlock() {return true;};
+    virtual bool prepare() {return true;};
+    virtual int getStreamCount() {return 0;};
+    virtual StreamProcessor *getStreamProcessorByIndex(int i) {return NULL;};
+    virtual bool startStreamByIndex(int i) {return false;};
+    virtual bool stopStreamByIndex(int i) {return false;};
+};
+
+/**
+ * Interface to the stream processor under test
+ */
+class BenchTarget {
+public:
+    virtual ~BenchTarget() {};
+    virtual StreamProcessor &getProcessor() = 0;
+    /// called once after prepare(), with the synthetic event data
+    virtual bool setupData(char *data, unsigned int nevents) {return true;};
+    /// transfer one period between the event data and the port buffers
+    virtual bool transfer(char *data, unsigned int nevents) = 0;
+};
+
+/**
+ * Exposes the (protected) block processing functions of a stream processor
+ */
+template <class SP>
+class BenchSP : public SP, public BenchTarget {
+public:
+    template <typename A>
+    BenchSP( FFADODevice &parent, A a )
+        : SP( parent, a ) {};
+    template <typename A, typename B>
+    BenchSP( FFADODevice &parent, A a, B b )
+        : SP( parent, a, b ) {};
+    virtual ~BenchSP() {};
+
+    virtual StreamProcessor &getProcessor() {return *this;};
+    virtual bool transfer(char *data, unsigned int nevents) {
+        if (this->getType() == StreamProcessor::ePT_Receive) {
+            return SP::processReadBlock(data, nevents, 0);
+        } else {
+            return SP::processWriteBlock(data, nevents, 0);
+        }
+    };
+};
+
+#ifdef ENABLE_GENERICAVC
+/**
+ * The AMDTP receive processor in decode-on-receive mode. A transfer
+ * covers both halves of the data path: the decode done on the ISO
+ * thread when the packets are received, and the demultiplexing done in
+ * the period transfer.
+ */
+class BenchAmdtpDecodedSP : public AmdtpReceiveStreamProcessor, public BenchTarget {
+public:
+    BenchAmdtpDecodedSP( FFADODevice &parent, int dimension )
+        : AmdtpReceiveStreamProcessor( parent, dimension )
+    {
+        setDecodeOnReceive(true);
+    };
+    virtual ~BenchAmdtpDecodedSP() {};
+
+    virtual StreamProcessor &getProcessor() {return *this;};
+
+    virtual bool setupData(char *data, unsigned int nevents) {
+        m_decoded.resize(nevents * m_dimension);
+        return true;
+    };
+
+    virtual bool transfer(char *data, unsigned int nevents) {
+        // the ISO thread decodes packet by packet
+        const quadlet_t *events = (const quadlet_t *)data;
+        unsigned int block = getDecodeBlockEvents();
+        for (unsigned int i = 0; i < nevents; i += block) {
+            unsigned int n = nevents - i;
+            if (n > block) n = block;
+            decodeEventsToHost(events + i * m_dimension, &m_decoded[i * m_dimension], n);
+        }
+        return processReadBlock((char *)&m_decoded[0], nevents, 0);
+    };
+
+private:
+    std::vector<quadlet_t> m_decoded;
+};
+#endif
+
+#ifdef ENABLE_OXFORD
+/**
+ * The Oxford receive processor reassembles non-blocking packets into
+ * SYT_INTERVAL sized blocks. The synthetic event data is cut into
+ * non-blocking packets once, the transfer then feeds them to the packet
+ * header processing and decodes each completed block.
+ */
+class BenchOxfordSP : public AmdtpOxfordReceiveStreamProcessor, public BenchTarget {
+public:
+    BenchOxfordSP( FFADODevice &parent, int dimension )
+        : AmdtpOxfordReceiveStreamProcessor( parent, dimension )
+        , m_cycle( 0 )
+        , m_offset( 0 )
+    {};
+    virtual ~BenchOxfordSP() {};
+
+    virtual StreamProcessor &getProcessor() {return *this;};
+
+    virtual bool setupData(char *data, unsigned int nevents) {
+        unsigned int rate = m_StreamProcessorManager.getNominalRate();
+        unsigned int frame = 0;
+        unsigned int cycle = 0;
+        quadlet_t *events = (quadlet_t *)data;
+
+        m_packets.clear();
+        m_packet_lengths.clear();
+        while (frame < nevents) {
+            // nominal number of frames in this cycle
+            unsigned int n = ((cycle + 1) * rate / 8000) - (cycle * rate / 8000);
+            if (frame + n > nevents) n = nevents - frame;
+
+            unsigned int start = m_packets.size();
+            m_packets.resize(start + 2 + n * m_dimension);
+            struct iec61883_packet *packet = (struct iec61883_packet *)&m_packets[start];
+            memset(packet, 0, 8);
+            packet->dbs = m_dimension;
+            packet->fmt = 0x10;
+            packet->fdf = IEC61883_FDF_SFC_48KHZ;
+            packet->syt = 0xFFFF;
+            memcpy(&m_packets[start + 2], events + frame * m_dimension,
+                   n * m_dimension * sizeof(quadlet_t));
+            m_packet_lengths.push_back((2 + n * m_dimension) * sizeof(quadlet_t));
+
+            frame += n;
+            cycle++;
+        }
+        return true;
+    };
+
+    virtual bool transfer(char *data, unsigned int nevents) {
+        unsigned int period = m_StreamProcessorManager.getPeriodSize();
+        unsigned char *packet = (unsigned char *)&m_packets[0];
+        for (unsigned int i = 0; i < m_packet_lengths.size(); i++) {
+            uint32_t pkt_ctr = (((m_cycle / 8000) & 0x7F) << 25)
+                               | ((m_cycle % 8000) << 12);
+            m_cycle++;
+            enum eChildReturnValue r = processPacketHeader(packet, m_packet_lengths.at(i),
+                                                           IEC61883_TAG_WITH_CIP, 0, pkt_ctr);
+            if (r == eCRV_OK) {
+                if (m_offset + m_syt_interval > period) m_offset = 0;
+                if (!processReadBlock(m_payload_buffer, m_syt_interval, m_offset)) {
+                    return false;
+                }
+                m_offset += m_syt_interval;
+            } else if (r != eCRV_Invalid) {
+                return false;
+            }
+            packet += m_packet_lengths.at(i);
+        }
+        return true;
+    };
+
+private:
+    std::vector<quadlet_t> m_packets;
+    std::vector<unsigned int> m_packet_lengths;
+    unsigned int m_cycle;
+    unsigned int m_offset;
+};
+#endif
+
+///////////////////////////
+
+enum eBenchProcessor {
+    eBP_AmdtpReceive,
+    eBP_AmdtpReceiveDecoded,
+    eBP_AmdtpTransmit,
+    eBP_OxfordReceive,
+    eBP_MotuReceive,
+    eBP_MotuTransmit,
+    eBP_RmeReceive,
+    eBP_RmeTransmit,
+    eBP_DigidesignReceive,
+    eBP_DigidesignTransmit,
+};
+
+// the conversion kernel family used by a processor
+enum eBenchKernels {
+    eBK_None,
+    eBK_Amdtp,
+    eBK_Motu,
+};
+
+struct bench_processor {
+    const char *name;
+    enum eBenchProcessor type;
+    enum eBenchKernels kernels;
+};
+
+static const struct bench_processor processors[] = {
+#ifdef ENABLE_GENERICAVC
+    {"amdtp-rx", eBP_AmdtpReceive, eBK_Amdtp},
+    {"amdtp-rx-dor", eBP_AmdtpReceiveDecoded, eBK_Amdtp},
+    {"amdtp-tx", eBP_AmdtpTransmit, eBK_Amdtp},
+#endif
+#ifdef ENABLE_OXFORD
+    {"oxford-rx", eBP_OxfordReceive, eBK_Amdtp},
+#endif
+#ifdef ENABLE_MOTU
+    {"motu-rx", eBP_MotuReceive, eBK_Motu},
+    {"motu-tx", eBP_MotuTransmit, eBK_Motu},
+#endif
+#ifdef ENABLE_RME
+    {"rme-rx", eBP_RmeReceive, eBK_None},
+    {"rme-tx", eBP_RmeTransmit, eBK_None},
+#endif
+#ifdef ENABLE_DIGIDESIGN
+    {"digidesign-rx", eBP_DigidesignReceive, eBK_None},
+    {"digidesign-tx", eBP_DigidesignTransmit, eBK_None},
+#endif
+};
+#define NB_PROCESSORS (sizeof(processors) / sizeof(processors[0]))
+
+struct bench_setup {
+    unsigned int channels;
+    unsigned int period;
+    enum StreamProcessorManager::eADT_AudioDataType datatype;
+    unsigned int frames;
+};
+
+struct bench_env {
+    DeviceManager *devmgr;
+    FFADODevice *device;
+#ifdef ENABLE_MOTU
+    FFADODevice *motu_device;
+#endif
+};
+
+static uint64_t
+getNsecs()
+{
+    struct timespec ts;
+    Util::SystemTimeSource::clockGettime(&ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// simple deterministic generator for the synthetic data
+static uint32_t
+nextRandom(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+static void
+fillRandom(byte_t *data, size_t nbytes)
+{
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < nbytes; i++) {
+        data[i] = nextRandom(&state) >> 24;
+    }
+}
+
+static void
+fillClientBuffers(std::vector<quadlet_t> &buffers,
+                  enum StreamProcessorManager::eADT_AudioDataType datatype)
+{
+    uint32_t state = 0x87654321;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        uint32_t v = nextRandom(&state);
+        if (datatype == StreamProcessorManager::eADT_Float) {
+            float f = ((int32_t)v) / 2147483648.0f;
+            memcpy(&buffers[i], &f, sizeof(float));
+        } else {
+            buffers[i] = v >> 8;
+        }
+    }
+}
+
+/**
+ * Creates the stream processor and its audio ports. The ports are
+ * enabled and attached to the client buffers, one period per channel.
+ */
+static BenchTarget *
+createTarget(struct bench_env &env, enum eBenchProcessor type,
+             int kernel, unsigned int channels, quadlet_t *client)
+{
+    BenchTarget *t = NULL;
+    Port::E_Direction direction = Port::E_Capture;
+    unsigned int i;
+
+    switch (type) {
+#ifdef ENABLE_GENERICAVC
+        case eBP_AmdtpReceive:
+        {
+            BenchSP<AmdtpReceiveStreamProcessor> *sp =
+                new BenchSP<AmdtpReceiveStreamProcessor>(*env.device, (int)channels);
+            sp->setKernelType((enum AmdtpKernels::eKernelType)kernel);
+            for (i = 0; i < channels; i++) {
+                new AmdtpAudioPort(*sp, "bench_in", Port::E_Capture,
+                                   i, i, AmdtpPortInfo::E_MBLA);
+            }
+            t = sp;
+            break;
+        }
+        case eBP_AmdtpReceiveDecoded:
+        {
+            BenchAmdtpDecodedSP *sp = new BenchAmdtpDecodedSP(*env.device, (int)channels);
+            sp->setKernelType((enum AmdtpKernels::eKernelType)kernel);
+            for (i = 0; i < channels; i++) {
+                new AmdtpAudioPort(*sp, "bench_in", Port::E_Capture,
+                                   i, i, AmdtpPortInfo::E_MBLA);
+            }
+            t = sp;
+            break;
+        }
+        case eBP_AmdtpTransmit:
+        {
+            BenchSP<AmdtpTransmitStreamProcessor> *sp =
+                new BenchSP<AmdtpTransmitStreamProcessor>(*env.device, (int)channels);
+            sp->setKernelType((enum AmdtpKernels::eKernelType)kernel);
+            for (i = 0; i < channels; i++) {
+                new AmdtpAudioPort(*sp, "bench_out", Port::E_Playback,
+                                   i, i, AmdtpPortInfo::E_MBLA);
+            }
+            t = sp;
+            direction = Port::E_Playback;
+            break;
+        }
+#endif
+#ifdef ENABLE_OXFORD
+        case eBP_OxfordReceive:
+        {
+            BenchOxfordSP *sp = new BenchOxfordSP(*env.device, channels);
+            sp->setKernelType((enum AmdtpKernels::eKernelType)kernel);
+            for (i = 0; i < channels; i++) {
+                new AmdtpAudioPort(*sp, "bench_in", Port::E_Capture,
+                                   i, i, AmdtpPortInfo::E_MBLA);
+            }
+            t = sp;
+            break;
+        }
+#endif
+#ifdef ENABLE_MOTU
+        // the MOTU events start with the SPH quadlet and 6 bytes of
+        // control/MIDI data, followed by packed 24 bit audio samples
+        case eBP_MotuReceive:
+        {
+            BenchSP<MotuReceiveStreamProcessor> *sp =
+                new BenchSP<MotuReceiveStreamProcessor>(*env.motu_device,
+                                                        ((10 + 3 * channels + 3) / 4) * 4);
+            sp->setKernelType((enum MotuKernels::eKernelType)kernel);
+            for (i = 0; i < channels; i++) {
+                new MotuAudioPort(*sp, "bench_in", Port::E_Capture, 10 + 3 * i, 3);
+            }
+            t = sp;
+            break;
+        }
+        case eBP_MotuTransmit:
+        {
+            BenchSP<MotuTransmitStreamProcessor> *sp =
+                new BenchSP<MotuTransmitStreamProcessor>(*env.motu_device,
+                                                         ((10 + 3 * channels + 3) / 4) * 4);
+            sp->setKernelType((enum MotuKernels::eKernelType)kernel);
+            for (i = 0; i < channels; i++) {
+                new MotuAudioPort(*sp, "bench_out", Port::E_Playback, 10 + 3 * i, 3);
+            }
+            t = sp;
+            direction = Port::E_Playback;
+            break;
+        }
+#endif
+#ifdef ENABLE_RME
+        // RME devices use one quadlet per channel
+        case eBP_RmeReceive:
+        {
+            BenchSP<RmeReceiveStreamProcessor> *sp =
+                new BenchSP<RmeReceiveStreamProcessor>(*env.device,
+                        (unsigned int)Rme::RME_MODEL_FIREFACE800, 4 * channels);
+            for (i = 0; i < channels; i++) {
+                new RmeAudioPort(*sp, "bench_in", Port::E_Capture, 4 * i, 4);
+            }
+            t = sp;
+            break;
+        }
+        case eBP_RmeTransmit:
+        {
+            BenchSP<RmeTransmitStreamProcessor> *sp =
+                new BenchSP<RmeTransmitStreamProcessor>(*env.device,
+                        (unsigned int)Rme::RME_MODEL_FIREFACE800, 4 * channels);
+            for (i = 0; i < channels; i++) {
+                new RmeAudioPort(*sp, "bench_out", Port::E_Playback, 4 * i, 4);
+            }
+            t = sp;
+            direction = Port::E_Playback;
+            break;
+        }
+#endif
+#ifdef ENABLE_DIGIDESIGN
+        // the Digidesign skeleton assumes packed 24 bit samples
+        case eBP_DigidesignReceive:
+        {
+            BenchSP<DigidesignReceiveStreamProcessor> *sp =
+                new BenchSP<DigidesignReceiveStreamProcessor>(*env.device,
+                                                              ((3 * channels + 3) / 4) * 4);
+            for (i = 0; i < channels; i++) {
+                new DigidesignAudioPort(*sp, "bench_in", Port::E_Capture, 3 * i, 3);
+            }
+            t = sp;
+            break;
+        }
+        case eBP_DigidesignTransmit:
+        {
+            BenchSP<DigidesignTransmitStreamProcessor> *sp =
+                new BenchSP<DigidesignTransmitStreamProcessor>(*env.device,
+                                                               ((3 * channels + 3) / 4) * 4);
+            for (i = 0; i < channels; i++) {
+                new DigidesignAudioPort(*sp, "bench_out", Port::E_Playback, 3 * i, 3);
+            }
+            t = sp;
+            direction = Port::E_Playback;
+            break;
+        }
+#endif
+        default:
+            debugError("Processor type %d not available\n", type);
+            return NULL;
+    }
+
+    StreamProcessor &sp = t->getProcessor();
+    for (i = 0; i < (unsigned int)sp.getPortCount(); i++) {
+        Port *p = sp.getPortAtIdx(i);
+        p->setBufferAddress(client + i * env.devmgr->getStreamProcessorManager().getPeriodSize());
+        p->enable();
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Created %s processor with %u ports\n",
+                (direction == Port::E_Capture ? "receive" : "transmit"),
+                sp.getPortCount());
+    return t;
+}
+
+/**
+ * The kernel types of a family to run, either all supported ones or
+ * only the forced one (if supported).
+ */
+static std::vector<int>
+kernelSweep(enum eBenchKernels family, long int forced)
+{
+    std::vector<int> kernels;
+    switch (family) {
+#ifdef ENABLE_GENERICAVC
+        case eBK_Amdtp:
+            for (int k = AmdtpKernels::eKT_Scalar; k <= AmdtpKernels::eKT_AVX512; k++) {
+                if ((forced < 0 || forced == k) &&
+                    AmdtpKernels::isSupported((enum AmdtpKernels::eKernelType)k)) {
+                    kernels.push_back(k);
+                }
+            }
+            break;
+#endif
+#ifdef ENABLE_MOTU
+        case eBK_Motu:
+            for (int k = MotuKernels::eKT_Scalar; k <= MotuKernels::eKT_AVX2; k++) {
+                if ((forced < 0 || forced == k) &&
+                    MotuKernels::isSupported((enum MotuKernels::eKernelType)k)) {
+                    kernels.push_back(k);
+                }
+            }
+            break;
+#endif
+        default:
+            kernels.push_back(0);
+            break;
+    }
+    return kernels;
+}
+
+static const char *
+kernelName(enum eBenchKernels family, int kernel)
+{
+    switch (family) {
+#ifdef ENABLE_GENERICAVC
+        case eBK_Amdtp:
+            return AmdtpKernels::getKernelTable((enum AmdtpKernels::eKernelType)kernel)->name;
+#endif
+#ifdef ENABLE_MOTU
+        case eBK_Motu:
+            return MotuKernels::getKernelTable((enum MotuKernels::eKernelType)kernel)->name;
+#endif
+        default:
+            return "-";
+    }
+}
+
+static bool
+benchProcessor(struct bench_env &env, const struct bench_processor &bp,
+               int kernel, const struct bench_setup &s)
+{
+    StreamProcessorManager &spm = env.devmgr->getStreamProcessorManager();
+    spm.setPeriodSize(s.period);
+    spm.setAudioDataType(s.datatype);
+
+    std::vector<quadlet_t> client(s.channels * s.period);
+    fillClientBuffers(client, s.datatype);
+
+    BenchTarget *t = createTarget(env, bp.type, kernel, s.channels, &client[0]);
+    if (t == NULL) {
+        return false;
+    }
+    StreamProcessor &sp = t->getProcessor();
+    // the processor is its own sync source, as it would be when it is
+    // the only one of the manager
+    if (!sp.init() || !spm.setSyncSource(&sp) || !sp.prepare()) {
+        debugError("Could not prepare %s\n", bp.name);
+        delete t;
+        return false;
+    }
+
+    size_t block_size = s.period * sp.getEventsPerFrame() * sp.getEventSize();
+    std::vector<quadlet_t> block((block_size + 3) / 4);
+    byte_t *data = (byte_t *)&block[0];
+    if (sp.getType() == StreamProcessor::ePT_Receive) {
+        fillRandom(data, block_size);
+        if (bp.kernels == eBK_Amdtp) {
+            // label every quadlet as multi-bit linear audio
+            for (size_t i = 0; i < block.size(); i++) {
+                block[i] = CondSwapToBus32((CondSwapFromBus32(block[i]) & 0x00FFFFFF) | 0x40000000);
+            }
+        }
+#ifdef ENABLE_MOTU
+        if (bp.type == eBP_MotuReceive) {
+            // no control or MIDI data
+            for (size_t i = 0; i < s.period; i++) {
+                memset(data + i * sp.getEventSize(), 0, 10);
+            }
+        }
+#endif
+    }
+
+    if (!t->setupData((char *)data, s.period)) {
+        debugError("Could not set up data for %s\n", bp.name);
+        delete t;
+        return false;
+    }
+
+    // warm up the caches
+    if (!t->transfer((char *)data, s.period)) {
+        debugError("%s transfer failed\n", bp.name);
+        delete t;
+        return false;
+    }
+
+    unsigned int iterations = s.frames / s.period;
+    if (iterations == 0) iterations = 1;
+
+    uint64_t start = getNsecs();
+    for (unsigned int i = 0; i < iterations; i++) {
+        t->transfer((char *)data, s.period);
+    }
+    uint64_t elapsed = getNsecs() - start;
+
+    double ns_per_frame = (double)elapsed / ((double)iterations * s.period);
+    printf("%-14s %-8s %-5s %3u ch %5u fr: %9.2f ns/frame %7.2f ns/channel\n",
+           bp.name, kernelName(bp.kernels, kernel),
+           s.datatype == StreamProcessorManager::eADT_Float ? "float" : "int24",
+           s.channels, s.period, ns_per_frame, ns_per_frame / s.channels);
+
+    delete t;
+    return true;
+}
+
+#ifdef ENABLE_GENERICAVC
+/**
+ * The AMDTP labeling helpers operate on the interleaved event data
+ * in-place, the channel count only determines the number of quadlets.
+ */
+static void
+benchBufferOps(const struct bench_setup &s)
+{
+    unsigned int nb_quadlets = s.channels * s.period;
+    std::vector<quadlet_t> data(nb_quadlets);
+    std::vector<quadlet_t> ref(nb_quadlets);
+    fillClientBuffers(ref, s.datatype);
+
+    unsigned int iterations = s.frames / s.period;
+    if (iterations == 0) iterations = 1;
+
+    uint64_t elapsed = 0;
+    for (unsigned int i = 0; i < iterations; i++) {
+        // the conversion is in-place, restore the input first
+        memcpy(&data[0], &ref[0], nb_quadlets * sizeof(quadlet_t));
+        uint64_t start = getNsecs();
+        if (s.datatype == StreamProcessorManager::eADT_Float) {
+            convertFromFloatAndLabelAsMBLA(&data[0], nb_quadlets);
+        } else {
+            convertFromInt24AndLabelAsMBLA(&data[0], nb_quadlets);
+        }
+        elapsed += getNsecs() - start;
+    }
+
+    double ns_per_frame = (double)elapsed / ((double)iterations * s.period);
+    printf("%-14s %-8s %-5s %3u ch %5u fr: %9.2f ns/frame %7.2f ns/channel\n",
+           "bufferops", "-",
+           s.datatype == StreamProcessorManager::eADT_Float ? "float" : "int24",
+           s.channels, s.period, ns_per_frame, ns_per_frame / s.channels);
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+    struct arguments arguments;
+    static const unsigned int sweep_channels[] = {2, 8, 16, 32};
+    static const unsigned int sweep_periods[] = {64, 256, 1024};
+    static const enum StreamProcessorManager::eADT_AudioDataType sweep_types[] = {
+        StreamProcessorManager::eADT_Int24,
+        StreamProcessorManager::eADT_Float,
+    };
+
+    // Default values.
+    arguments.verbose   = 0;
+    arguments.rate      = 48000;
+    arguments.frames    = 1024 * 1024;
+    arguments.channels  = 0;
+    arguments.period    = 0;
+    arguments.kernel    = -1;
+    arguments.processor = "";
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        return -1;
+    }
+    if (arguments.rate <= 0 || arguments.frames <= 0
+        || arguments.channels < 0 || arguments.period < 0) {
+        fprintf( stderr, "Invalid arguments\n" );
+        return -1;
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    std::vector<unsigned int> channels;
+    if (arguments.channels) {
+        channels.push_back(arguments.channels);
+    } else {
+        channels.assign(sweep_channels, sweep_channels + sizeof(sweep_channels) / sizeof(sweep_channels[0]));
+    }
+    std::vector<unsigned int> periods;
+    if (arguments.period) {
+        periods.push_back(arguments.period);
+    } else {
+        periods.assign(sweep_periods, sweep_periods + sizeof(sweep_periods) / sizeof(sweep_periods[0]));
+    }
+
+    // the stream processors are registered on the simulated bus, none
+    // of them streams on it
+    setenv("FFADO_LOOPBACK", "1", 1);
+    Ieee1394Service *service = new Ieee1394Service();
+    if (!service->initialize(0)) {
+        fprintf( stderr, "Could not initialize the simulated bus\n" );
+        delete service;
+        return -1;
+    }
+    struct bench_env env;
+    env.devmgr = new DeviceManager();
+    env.device = new BenchDevice(*env.devmgr, std::auto_ptr<ConfigRom>(new ConfigRom(*service, 0)));
+#ifdef ENABLE_MOTU
+    env.motu_device = new Motu::MotuDevice(*env.devmgr, std::auto_ptr<ConfigRom>(new ConfigRom(*service, 0)));
+#endif
+
+    StreamProcessorManager &spm = env.devmgr->getStreamProcessorManager();
+    spm.setNominalRate(arguments.rate);
+    spm.setNbBuffers(2);
+
+    printf("%-14s %-8s %-5s %6s %8s\n", "processor", "kernel", "type", "chans", "period");
+
+    bool all_ok = true;
+    for (unsigned int p = 0; p < NB_PROCESSORS; p++) {
+        const struct bench_processor &bp = processors[p];
+        if (strncmp(bp.name, arguments.processor, strlen(arguments.processor)) != 0) {
+            continue;
+        }
+        std::vector<int> bp_kernels = kernelSweep(bp.kernels, arguments.kernel);
+        if (bp_kernels.empty()) {
+            fprintf( stderr, "Kernel type %ld not supported by %s on this host\n",
+                     arguments.kernel, bp.name );
+            continue;
+        }
+        for (unsigned int t = 0; t < sizeof(sweep_types) / sizeof(sweep_types[0]); t++) {
+            for (unsigned int k = 0; k < bp_kernels.size(); k++) {
+                for (unsigned int c = 0; c < channels.size(); c++) {
+                    for (unsigned int i = 0; i < periods.size(); i++) {
+                        struct bench_setup s;
+                        s.channels = channels.at(c);
+                        s.period = periods.at(i);
+                        s.datatype = sweep_types[t];
+                        s.frames = arguments.frames;
+                        all_ok &= benchProcessor(env, bp, bp_kernels.at(k), s);
+                    }
+                }
+            }
+        }
+    }
+
+#ifdef ENABLE_GENERICAVC
+    if (strncmp("bufferops", arguments.processor, strlen(arguments.processor)) == 0) {
+        for (unsigned int t = 0; t < sizeof(sweep_types) / sizeof(sweep_types[0]); t++) {
+            for (unsigned int c = 0; c < channels.size(); c++) {
+                for (unsigned int i = 0; i < periods.size(); i++) {
+                    struct bench_setup s;
+                    s.channels = channels.at(c);
+                    s.period = periods.at(i);
+                    s.datatype = sweep_types[t];
+                    s.frames = arguments.frames;
+                    benchBufferOps(s);
+                }
+            }
+        }
+    }
+#endif
+
+#ifdef ENABLE_MOTU
+    delete env.motu_device;
+#endif
+    delete env.device;
+    delete env.devmgr;
+    delete service;
+
+    return (all_ok ? 0 : -1);
+}
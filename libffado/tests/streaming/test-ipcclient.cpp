@@ -23,7 +23,7 @@
 
 #include "debugmodule/debugmodule.h"
 
-#include "libutil/IpcRingBuffer.h"
+#include "libutil/ShmRingBuffer.h"
 #include "libutil/SystemTimeSource.h"
 
 #include <argp.h>
@@ -202,13 +202,14 @@ main(int argc, char **argv)
     // prepare the IPC buffers
     unsigned int capture_buffsize = arguments.capture * arguments.period * 4;
     unsigned int playback_buffsize = arguments.playback * arguments.period * 4;
-    IpcRingBuffer* capturebuffer = NULL;
-    IpcRingBuffer* playbackbuffer = NULL;
+    ShmRingBuffer* capturebuffer = NULL;
+    ShmRingBuffer* playbackbuffer = NULL;
+    // the directions are the ones of the streaming process, which owns the buffers
     if(arguments.playback) {
-        playbackbuffer = new IpcRingBuffer("playbackbuffer",
-                              IpcRingBuffer::eBT_Slave,
-                              IpcRingBuffer::eD_Outward,
-                              IpcRingBuffer::eB_Blocking,
+        playbackbuffer = new ShmRingBuffer("playbackbuffer",
+                              ShmRingBuffer::eBT_Slave,
+                              ShmRingBuffer::eD_Inward,
+                              ShmRingBuffer::eB_Blocking,
                               arguments.nb_buffers, playback_buffsize);
         if(playbackbuffer == NULL) {
             debugError("Could not create playbackbuffer\n");
@@ -219,13 +220,19 @@ main(int argc, char **argv)
             delete playbackbuffer;
             exit(-1);
         }
+        if(playbackbuffer->getBlockSize() != playback_buffsize) {
+            debugError("Playback block size mismatch (want: %u, have: %u)\n",
+                       playback_buffsize, playbackbuffer->getBlockSize());
+            delete playbackbuffer;
+            exit(-1);
+        }
         playbackbuffer->setVerboseLevel(arguments.verbose);
     }
     if(arguments.capture) {
-        capturebuffer = new IpcRingBuffer("capturebuffer",
-                              IpcRingBuffer::eBT_Slave,
-                              IpcRingBuffer::eD_Inward,
-                              IpcRingBuffer::eB_Blocking,
+        capturebuffer = new ShmRingBuffer("capturebuffer",
+                              ShmRingBuffer::eBT_Slave,
+                              ShmRingBuffer::eD_Outward,
+                              ShmRingBuffer::eB_Blocking,
                               arguments.nb_buffers, capture_buffsize);
         if(capturebuffer == NULL) {
             debugError("Could not create capturebuffer\n");
@@ -238,14 +245,16 @@ main(int argc, char **argv)
             delete capturebuffer;
             exit(-1);
         }
+        if(capturebuffer->getBlockSize() != capture_buffsize) {
+            debugError("Capture block size mismatch (want: %u, have: %u)\n",
+                       capture_buffsize, capturebuffer->getBlockSize());
+            delete playbackbuffer;
+            delete capturebuffer;
+            exit(-1);
+        }
         capturebuffer->setVerboseLevel(arguments.verbose);
     }
 
-
-    // dummy buffers
-    char capture_buff[capture_buffsize];
-    char playback_buff[playback_buffsize];
-
     int cnt = 0;
     int pbkcnt = 0;
 
@@ -267,24 +276,33 @@ main(int argc, char **argv)
                 tmp = tmp >> 8;
                 memcpy(&sine_buff[i], &tmp, 4);
             }
-            for(int j=0; j<arguments.playback; j++) {
-                uint32_t *target = (uint32_t *)(playback_buff + j*arguments.period*4);
-                memcpy(target, &sine_buff, arguments.period*4);
-            }
         }
         frame_counter += arguments.period;
 
-        // write the data
-        IpcRingBuffer::eResult res;
+        // write the data directly into the shared block
+        ShmRingBuffer::eResult res;
         if(playbackbuffer) {
-            res = playbackbuffer->Write(playback_buff);
-            if(res != IpcRingBuffer::eR_OK && res != IpcRingBuffer::eR_Again) {
-                debugError("Could not write to segment\n");
+            char *playback_buff;
+            res = playbackbuffer->requestBlockForWrite((void**) &playback_buff);
+            if(res != ShmRingBuffer::eR_OK && res != ShmRingBuffer::eR_Timeout) {
+                debugError("Could not get block to write\n");
                 goto out_err;
             }
-            if(res == IpcRingBuffer::eR_Again) {
+            if(res == ShmRingBuffer::eR_Timeout) {
                 printMessage(" Try playback again on %d...\n", cnt);
             } else {
+                for(int j=0; j<arguments.playback; j++) {
+                    uint32_t *target = (uint32_t *)(playback_buff + j*arguments.period*4);
+                    if (arguments.test_tone) {
+                        memcpy(target, &sine_buff, arguments.period*4);
+                    } else {
+                        memset(target, 0, arguments.period*4);
+                    }
+                }
+                if(playbackbuffer->releaseBlockForWrite() != ShmRingBuffer::eR_OK) {
+                    debugError("Could not commit written block\n");
+                    goto out_err;
+                }
                 if(pbkcnt%100==0) {
                     printMessage(" Period %d...\n", pbkcnt);
                 }
@@ -293,12 +311,13 @@ main(int argc, char **argv)
         }
         // read data
         if (capturebuffer) {
-            res = capturebuffer->Read(capture_buff);
-            if(res != IpcRingBuffer::eR_OK && res != IpcRingBuffer::eR_Again) {
-                debugError("Could not receive from queue\n");
+            char *capture_buff;
+            res = capturebuffer->requestBlockForRead((void**) &capture_buff);
+            if(res != ShmRingBuffer::eR_OK && res != ShmRingBuffer::eR_Timeout) {
+                debugError("Could not get block to read\n");
                 goto out_err;
             }
-            if(res == IpcRingBuffer::eR_Again) {
+            if(res == ShmRingBuffer::eR_Timeout) {
                 printMessage(" Try again on %d...\n", cnt);
             } else {
                 if(cnt%10==0) {
@@ -314,6 +333,10 @@ main(int argc, char **argv)
                         printMessageShort("\n");
                     }
                 }
+                if(capturebuffer->releaseBlockForRead() != ShmRingBuffer::eR_OK) {
+                    debugError("Could not release read block\n");
+                    goto out_err;
+                }
                 cnt++;
             }
         }
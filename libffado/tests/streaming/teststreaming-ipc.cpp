@@ -37,7 +37,7 @@
 
 #include "debugmodule/debugmodule.h"
 
-#include "libutil/IpcRingBuffer.h"
+#include "libutil/ShmRingBuffer.h"
 #include "libutil/SystemTimeSource.h"
 
 #include <math.h>
@@ -392,14 +392,14 @@ int main(int argc, char *argv[])
                   nb_out_channels*dev_options.period_size * 4);
 
     // allocate the IPC structures
-    IpcRingBuffer* capturebuffer = NULL;
-    IpcRingBuffer* playbackbuffer = NULL;
+    ShmRingBuffer* capturebuffer = NULL;
+    ShmRingBuffer* playbackbuffer = NULL;
     if(arguments.capture) {
         // 4 bytes per channel per sample
-        capturebuffer = new IpcRingBuffer("capturebuffer",
-                                IpcRingBuffer::eBT_Master,
-                                IpcRingBuffer::eD_Outward,
-                                IpcRingBuffer::eB_NonBlocking,
+        capturebuffer = new ShmRingBuffer("capturebuffer",
+                                ShmRingBuffer::eBT_Master,
+                                ShmRingBuffer::eD_Outward,
+                                ShmRingBuffer::eB_NonBlocking,
                                 arguments.nb_buffers,
                                 dev_options.period_size * arguments.capture * 4);
         if(capturebuffer == NULL) {
@@ -420,10 +420,10 @@ int main(int argc, char *argv[])
 
     if(arguments.playback) {
         // 4 bytes per channel per sample
-        playbackbuffer = new IpcRingBuffer("playbackbuffer",
-                                IpcRingBuffer::eBT_Master,
-                                IpcRingBuffer::eD_Inward,
-                                IpcRingBuffer::eB_NonBlocking,
+        playbackbuffer = new ShmRingBuffer("playbackbuffer",
+                                ShmRingBuffer::eBT_Master,
+                                ShmRingBuffer::eD_Inward,
+                                ShmRingBuffer::eB_NonBlocking,
                                 arguments.nb_buffers,
                                 dev_options.period_size * arguments.playback * 4);
         if(playbackbuffer == NULL) {
@@ -464,7 +464,7 @@ int main(int argc, char *argv[])
 
     while(run && start_flag==0) {
         bool need_silent;
-        enum IpcRingBuffer::eResult msg_res;
+        enum ShmRingBuffer::eResult msg_res;
 
         ffado_wait_response response;
         response = ffado_streaming_wait(dev);
@@ -481,7 +481,7 @@ int main(int argc, char *argv[])
         if(arguments.capture) {
             uint32_t *audiobuffers_raw;
             msg_res = capturebuffer->requestBlockForWrite((void**) &audiobuffers_raw); // pointer voodoo
-            if(msg_res == IpcRingBuffer::eR_OK) {
+            if(msg_res == ShmRingBuffer::eR_OK) {
                 // if we got a valid pointer, setup the stream pointers
                 for (i=0; i < nb_in_channels; i++) {
                     if(i < arguments.capture) {
@@ -534,7 +534,7 @@ int main(int argc, char *argv[])
         // transfer
         ffado_streaming_transfer_capture_buffers(dev);
 
-        if(capturebuffer && !need_silent && msg_res == IpcRingBuffer::eR_OK) {
+        if(capturebuffer && !need_silent && msg_res == ShmRingBuffer::eR_OK) {
             // if we had a good block, release it
             // FIXME: we should check for errors here
             capturebuffer->releaseBlockForWrite();
@@ -544,7 +544,7 @@ int main(int argc, char *argv[])
             uint32_t *audiobuffers_raw;
             // get a block pointer from the IPC buffer to read
             msg_res = playbackbuffer->requestBlockForRead((void**) &audiobuffers_raw); // pointer voodoo
-            if(msg_res == IpcRingBuffer::eR_OK) {
+            if(msg_res == ShmRingBuffer::eR_OK) {
                 // if we got a valid pointer, setup the stream pointers
                 for (i=0; i < nb_out_channels; i++) {
                     if(i < arguments.playback) {
@@ -598,7 +598,7 @@ int main(int argc, char *argv[])
         // transfer playback buffers
         ffado_streaming_transfer_playback_buffers(dev);
 
-        if(playbackbuffer && !need_silent && msg_res == IpcRingBuffer::eR_OK) {
+        if(playbackbuffer && !need_silent && msg_res == ShmRingBuffer::eR_OK) {
             // if we had a good block, release it
             // FIXME: we should check for errors here
             playbackbuffer->releaseBlockForRead();
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Tests the config ROM cache on the simulated bus, without any hardware.
+ *
+ * Nodes with a minimal config ROM are put on the bus, and the ROMs are
+ * looked up in the cache before and after simulated bus resets. The
+ * number of async reads tells whether the cache was used, and how the
+ * node was identified.
+ */
+
+#include <argp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <vector>
+
+#include "debugmodule/debugmodule.h"
+
+#include "libieee1394/configrom.h"
+#include "libieee1394/ConfigRomCache.h"
+#include "libieee1394/ieee1394service.h"
+#include "libieee1394/SimulatedBus.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+// Program documentation.
+static char doc[] = "FFADO -- config ROM cache test\n\n"
+                    "Checks the config ROM cache against ROMs of\n"
+                    "simulated nodes, no hardware is needed.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",   'v', "level",     0, "Verbose level (0)" },
+    { 0 }
+};
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+
+    errno = 0;
+    switch (key) {
+        case 'v':
+            arguments->verbose = strtol( arg, &tail, 0 );
+            if ( errno || *tail ) {
+                fprintf( stderr, "Could not parse '%s' argument\n", arg );
+                return ARGP_ERR_UNKNOWN;
+            }
+            return 0;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+
+#define GUID_HI         0x000a3501
+#define FIRMWARE_KEY    0x17
+
+static int nb_failed = 0;
+
+#define CHECK( cond, what ) \
+    do { \
+        if ( cond ) { \
+            printf( "  ok:     %s\n", what ); \
+        } else { \
+            printf( "  FAILED: %s\n", what ); \
+            nb_failed++; \
+        } \
+    } while ( 0 )
+
+// the CRC-16 of IEEE 1212
+static uint32_t
+crc16( const std::vector<uint32_t>& rom, unsigned int first, unsigned int length )
+{
+    uint32_t crc = 0;
+    for ( unsigned int i = first; i < first + length; i++ ) {
+        for ( int shift = 28; shift >= 0; shift -= 4 ) {
+            uint32_t sum = ( ( crc >> 12 ) ^ ( rom[i] >> shift ) ) & 0xf;
+            crc = ( ( crc << 4 ) ^ ( sum << 12 ) ^ ( sum << 5 ) ^ sum ) & 0xffff;
+        }
+    }
+    return crc;
+}
+
+/**
+ * builds a config ROM with a bus info block, a root directory with the
+ * vendor and a firmware version entry, and a unit directory
+ *
+ * @param good_crc whether the bus info block CRC verifies
+ */
+static std::vector<uint32_t>
+makeRom( uint32_t guid_lo, uint32_t firmware, bool good_crc )
+{
+    std::vector<uint32_t> rom( 18, 0 );
+    // bus info block, max_rec 8 allows 128 quadlet blocks
+    rom[1] = 0x31333934;
+    rom[2] = 0xe0008000 | ( 8 << 12 );
+    rom[3] = GUID_HI;
+    rom[4] = guid_lo;
+    // root directory
+    rom[6] = 0x03000a35;
+    rom[7] = 0x81000003;
+    rom[8] = ( FIRMWARE_KEY << 24 ) | firmware;
+    rom[9] = 0xd1000006;
+    rom[5] = ( 4 << 16 ) | crc16( rom, 6, 4 );
+    // vendor name descriptor leaf
+    rom[13] = 0x41434d45;
+    rom[14] = 0x436f0000;
+    rom[10] = ( 4 << 16 ) | crc16( rom, 11, 4 );
+    // unit directory
+    rom[16] = 0x1200a02d;
+    rom[17] = 0x13010001;
+    rom[15] = ( 2 << 16 ) | crc16( rom, 16, 2 );
+    // the CRC only covers the bus info block
+    rom[0] = ( 4 << 24 ) | ( 4 << 16 ) | ( good_crc ? crc16( rom, 1, 4 ) : 0 );
+    return rom;
+}
+
+static fb_octlet_t
+guidOf( uint32_t guid_lo )
+{
+    return ( (fb_octlet_t)GUID_HI << 32 ) | guid_lo;
+}
+
+/**
+ * reads the ROM of a node from the bus and stores it in the cache
+ */
+static bool
+readRom( Ieee1394Service& service, fb_nodeid_t node )
+{
+    ConfigRom rom( service, node );
+    unsigned int generation = service.getGeneration();
+    if ( !rom.initialize() ) {
+        return false;
+    }
+    service.getConfigRomCache().update( rom, generation );
+    return true;
+}
+
+/**
+ * looks up the ROM of a node in the cache
+ *
+ * @param guid receives the GUID of the cached ROM, if any
+ * @param reads receives the number of async reads the lookup took
+ * @return true on a cache hit
+ */
+static bool
+lookupRom( Ieee1394Service& service, fb_nodeid_t node,
+           fb_octlet_t& guid, unsigned int& reads )
+{
+    SimulatedBus* bus = service.getSimulatedBus();
+    ConfigRom rom( service, node );
+    unsigned int reads_before = bus->getReadCount();
+    bool hit = service.getConfigRomCache().lookup( rom );
+    reads = bus->getReadCount() - reads_before;
+    guid = ( hit ? rom.getGuid() : 0 );
+    return hit;
+}
+
+int
+main( int argc, char **argv )
+{
+    struct arguments arguments;
+
+    // Default values.
+    arguments.verbose = 0;
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        return -1;
+    }
+
+    setDebugLevel( arguments.verbose );
+
+    // no streaming on the bus, only the nodes
+    setenv( "FFADO_LOOPBACK", "1", 1 );
+
+    Ieee1394Service *service = new Ieee1394Service();
+    service->setVerboseLevel( arguments.verbose );
+    if ( !service->initialize( 0 ) ) {
+        fprintf( stderr, "Could not initialize the simulated bus\n" );
+        delete service;
+        return -1;
+    }
+    SimulatedBus* bus = service->getSimulatedBus();
+
+    const uint32_t guid_a = 0x11111111;
+    const uint32_t guid_b = 0x22222222;
+    const uint32_t guid_c = 0x33333333;
+    std::vector<uint32_t> rom_a = makeRom( guid_a, 1, true );
+    std::vector<uint32_t> rom_b = makeRom( guid_b, 1, false );
+    bus->setNode( 1, rom_a, 128 );
+    bus->setNode( 2, rom_b, 128 );
+
+    fb_octlet_t guid;
+    unsigned int reads;
+
+    printf( "Empty cache\n" );
+    CHECK( !lookupRom( *service, 1, guid, reads ), "node 1 misses" );
+    CHECK( readRom( *service, 1 ) && readRom( *service, 2 ), "ROMs read from the nodes" );
+
+    printf( "Same generation\n" );
+    CHECK( lookupRom( *service, 1, guid, reads ) && guid == guidOf( guid_a ),
+           "node 1 hits" );
+    CHECK( reads == 0, "without any read" );
+    CHECK( lookupRom( *service, 2, guid, reads ) && guid == guidOf( guid_b ),
+           "node 2 hits" );
+    CHECK( reads == 0, "without any read" );
+
+    printf( "Bus reset\n" );
+    bus->busReset();
+    CHECK( lookupRom( *service, 1, guid, reads ) && guid == guidOf( guid_a ),
+           "node 1 hits" );
+    // bus info header + root directory
+    CHECK( reads == 2, "identified by the bus info CRC" );
+
+    printf( "Bus reset, nodes swapped\n" );
+    bus->busReset();
+    bus->setNode( 1, rom_b, 128 );
+    bus->setNode( 2, rom_a, 128 );
+    CHECK( lookupRom( *service, 1, guid, reads ) && guid == guidOf( guid_b ),
+           "node 1 hits the ROM of node 2" );
+    // bus info header + GUID + root directory
+    CHECK( reads == 4, "identified by the GUID, the CRC doesn't verify" );
+    CHECK( lookupRom( *service, 2, guid, reads ) && guid == guidOf( guid_a ),
+           "node 2 hits the ROM of node 1" );
+    CHECK( reads == 2, "identified by the bus info CRC" );
+
+    printf( "Bus reset, other device with the same bad CRC\n" );
+    bus->busReset();
+    bus->setNode( 1, makeRom( guid_c, 1, false ), 128 );
+    CHECK( !lookupRom( *service, 1, guid, reads ), "node 1 misses" );
+    CHECK( reads == 3, "after reading the GUID" );
+
+    printf( "Bus reset, other device with a good CRC\n" );
+    bus->busReset();
+    bus->setNode( 2, makeRom( guid_c, 1, true ), 128 );
+    CHECK( !lookupRom( *service, 2, guid, reads ), "node 2 misses" );
+    CHECK( reads == 1, "after reading the bus info header" );
+
+    printf( "Bus reset, other firmware\n" );
+    bus->busReset();
+    std::vector<uint32_t> rom_a2 = makeRom( guid_a, 2, true );
+    bus->setNode( 2, rom_a2, 128 );
+    CHECK( rom_a2[0] == rom_a[0], "bus info block unchanged" );
+    CHECK( !lookupRom( *service, 2, guid, reads ), "node 2 misses" );
+    CHECK( reads == 2, "after reading the root directory" );
+    CHECK( readRom( *service, 2 ), "ROM read from node 2" );
+    CHECK( lookupRom( *service, 2, guid, reads ) && guid == guidOf( guid_a ),
+           "node 2 hits" );
+
+    // a type error means the node doesn't do block reads, the ROM is
+    // then read a quadlet at a time. Blocks that run past the end of the
+    // ROM fail with an address error, and are retried smaller.
+    printf( "Node without block reads\n" );
+    bus->busReset();
+    bus->setNode( 3, makeRom( 0x44444444, 1, true ), 1 );
+    {
+        ConfigRom rom( *service, 3 );
+        CHECK( rom.initialize() && rom.getGuid() == guidOf( 0x44444444 )
+               && rom.getUnitSpecifierId() == 0x00a02d && rom.getUnitVersion() == 0x010001,
+               "ROM read from node 3" );
+    }
+    printf( "Node with block reads\n" );
+    bus->setNode( 4, makeRom( 0x55555555, 1, true ), 128 );
+    {
+        ConfigRom rom( *service, 4 );
+        CHECK( rom.initialize() && rom.getGuid() == guidOf( 0x55555555 )
+               && rom.getUnitSpecifierId() == 0x00a02d && rom.getUnitVersion() == 0x010001,
+               "ROM read from node 4" );
+    }
+
+    delete service;
+
+    if ( nb_failed ) {
+        printf( "%d checks FAILED\n", nb_failed );
+        return -1;
+    }
+    printf( "All checks passed\n" );
+    return 0;
+}
@@ -0,0 +1,672 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Runs the streaming code on the simulated loopback bus, without any
+ * hardware.
+ *
+ * A fake device gets an AMDTP capture and playback stream, which are
+ * prepared and started by the stream processor manager as for a real
+ * device. The device side of the capture stream is emulated by a
+ * transmit processor that sends a frame counter, stamped from the bus
+ * clock. The playback stream goes out on the bus without a listener.
+ *
+ * The bus imperfections (clock drift, wakeup jitter, packet drops) can
+ * be set on the command line. The run reports the xruns, the gaps in
+ * the captured frame counter and the latency statistics, and checks the
+ * port meters of the last period against its samples.
+ *
+ * With --replay the capture stream comes from an ISO capture made with
+ * FFADO_ISO_CAPTURE instead of the emulated device, at the original or
+ * at an accelerated speed. The stream format is taken from the capture,
+ * only AMDTP streams can be decoded.
+ */
+
+#include <argp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+
+#include <vector>
+#include <memory>
+
+#include "debugmodule/debugmodule.h"
+
+#include "devicemanager.h"
+#include "ffadodevice.h"
+#include "libieee1394/configrom.h"
+#include "libieee1394/ieee1394service.h"
+#include "libieee1394/IsoHandlerManager.h"
+#include "libieee1394/IsoCapture.h"
+#include "libieee1394/SimulatedBus.h"
+#include "libieee1394/cycletimer.h"
+
+#include "libstreaming/StreamProcessorManager.h"
+#include "libstreaming/util/cip.h"
+#include "libstreaming/amdtp/AmdtpPort.h"
+#include "libstreaming/amdtp/AmdtpReceiveStreamProcessor.h"
+#include "libstreaming/amdtp/AmdtpTransmitStreamProcessor.h"
+
+#include "libutil/ByteSwap.h"
+#include "libutil/LatencyStatistics.h"
+#include "libutil/PortMeters.h"
+#include "libutil/SystemTimeSource.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+using namespace Streaming;
+
+// how far the time between two periods may be off, in frames
+#define MAX_PERIOD_TIME_ERROR_FRAMES 2.0
+
+// Program documentation.
+static char doc[] = "FFADO -- streaming test on the simulated loopback bus\n\n"
+                    "Streams a fake AMDTP device over a simulated bus, no\n"
+                    "hardware is needed. Can also replay a captured stream.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int rate;
+    long int period;
+    long int nb_buffers;
+    long int channels;
+    long int periods;
+    double   drift;
+    long int jitter;
+    long int drop;
+    long int latency;
+    char    *replay;
+    double   speed;
+    long int channel;
+    long int decode;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",   'v', "level",     0, "Verbose level (0)" },
+    {"rate",      'r', "rate",      0, "Sample rate (48000)" },
+    {"period",    'p', "frames",    0, "Period size (256)" },
+    {"nb_buffers",'n', "nb",        0, "Number of periods to buffer (3)" },
+    {"channels",  'c', "channels",  0, "Channels per stream (8)" },
+    {"countdown", 't', "periods",   0, "Number of periods to run (2000)" },
+    {"drift",     'd', "ppm",       0, "Drift of the bus clock (0)" },
+    {"jitter",    'j', "usecs",     0, "Maximum wakeup jitter (0)" },
+    {"drop",      'x', "ppm",       0, "Packet drop rate (0)" },
+    {"latency",   'l', "cycles",    0, "Bus latency (1)" },
+    {"replay",    'R', "file",      0, "Replay an ISO capture instead of emulating the device" },
+    {"speed",     's', "factor",    0, "Replay speed relative to real time (1.0)" },
+    {"channel",   'C', "channel",   0, "Channel of the replayed stream (0)" },
+    {"decode",    'D', "0|1",       0, "Decode the samples on receive (0)" },
+    { 0 }
+};
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+    long int *value = NULL;
+
+    errno = 0;
+    switch (key) {
+        case 'v': value = &arguments->verbose; break;
+        case 'r': value = &arguments->rate; break;
+        case 'p': value = &arguments->period; break;
+        case 'n': value = &arguments->nb_buffers; break;
+        case 'c': value = &arguments->channels; break;
+        case 't': value = &arguments->periods; break;
+        case 'j': value = &arguments->jitter; break;
+        case 'x': value = &arguments->drop; break;
+        case 'l': value = &arguments->latency; break;
+        case 'C': value = &arguments->channel; break;
+        case 'D': value = &arguments->decode; break;
+        case 'R':
+            arguments->replay = arg;
+            return 0;
+        case 'd':
+        case 's':
+            *(key == 'd' ? &arguments->drift : &arguments->speed) = strtod( arg, &tail );
+            if ( errno || *tail ) {
+                fprintf( stderr, "Could not parse '%s' argument\n", arg );
+                return ARGP_ERR_UNKNOWN;
+            }
+            return 0;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    *value = strtol( arg, &tail, 0 );
+    if ( errno || *tail ) {
+        fprintf( stderr, "Could not parse '%s' argument\n", arg );
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+
+/**
+ * A device without hardware behind it, only used as the parent of
+ * the stream processors.
+ */
+class LoopbackDevice : public FFADODevice {
+public:
+    LoopbackDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ) )
+        : FFADODevice( d, configRom )
+    {};
+    virtual ~LoopbackDevice() {};
+
+    virtual bool discover() {return true;};
+    virtual bool setSamplingFrequency( int samplingFrequency ) {return false;};
+    virtual int getSamplingFrequency( ) {return 0;};
+    virtual std::vector<int> getSupportedSamplingFrequencies( )
+        {return std::vector<int>();};
+    virtual ClockSourceVector getSupportedClockSources()
+        {return ClockSourceVector();};
+    virtual bool setActiveClockSource(ClockSource) {return false;};
+    virtual ClockSource getActiveClockSource() {return ClockSource();};
+    virtual bool lock() {return true;};
+    virtual bool unlock() {return true;};
+    virtual bool prepare() {return true;};
+    virtual int getStreamCount() {return 0;};
+    virtual StreamProcessor *getStreamProcessorByIndex(int i) {return NULL;};
+    virtual bool startStreamByIndex(int i) {return false;};
+    virtual bool stopStreamByIndex(int i) {return false;};
+};
+
+/**
+ * The device side of the capture stream. It belongs to a stream
+ * processor manager of its own that is never started, and it never
+ * leaves the dry-running state, in which
+ * an AMDTP transmit processor would send empty packets. Instead it sends
+ * blocking mode data packets clocked by the bus, like a device that is
+ * its own clock master. Channel 0 carries a frame counter, the others
+ * are silent.
+ */
+class EmulatedDeviceSP : public AmdtpTransmitStreamProcessor {
+public:
+    EmulatedDeviceSP( FFADODevice &parent, int dimension, unsigned int rate )
+        : AmdtpTransmitStreamProcessor( parent, dimension )
+        , m_ticks_per_frame( (double)TICKS_PER_SECOND / rate )
+        , m_next_ts( -1.0 )
+        , m_dbc( 0 )
+        , m_frame( 0 )
+    {
+        switch (rate) {
+            case 32000:  m_fdf = IEC61883_FDF_SFC_32KHZ; break;
+            case 44100:  m_fdf = IEC61883_FDF_SFC_44K1HZ; break;
+            case 88200:  m_fdf = IEC61883_FDF_SFC_88K2HZ; break;
+            case 96000:  m_fdf = IEC61883_FDF_SFC_96KHZ; break;
+            case 176400: m_fdf = IEC61883_FDF_SFC_176K4HZ; break;
+            case 192000: m_fdf = IEC61883_FDF_SFC_192KHZ; break;
+            default:     m_fdf = IEC61883_FDF_SFC_48KHZ; break;
+        }
+    };
+    virtual ~EmulatedDeviceSP() {};
+
+    virtual enum eChildReturnValue generateEmptyPacketHeader(
+            unsigned char *data, unsigned int *length,
+            unsigned char *tag, unsigned char *sy, uint32_t pkt_ctr)
+    {
+        struct iec61883_packet *packet = (struct iec61883_packet *)data;
+        unsigned int syt_interval = getNominalFramesPerPacket();
+        unsigned int dimension = getEventsPerFrame();
+        uint64_t cycle_ticks = CYCLE_TIMER_TO_TICKS(pkt_ctr);
+
+        if (m_next_ts < 0) {
+            m_next_ts = cycle_ticks + getTransferDelay();
+        }
+        uint64_t ts = wrapAtMaxTicks((uint64_t)m_next_ts);
+
+        memset(packet, 0, 8);
+        packet->sid = 0x3F;
+        packet->dbs = dimension;
+        packet->eoh1 = 2;
+        packet->fmt = IEC61883_FMT_AMDTP;
+        packet->dbc = m_dbc;
+        *tag = IEC61883_TAG_WITH_CIP;
+        *sy = 0;
+
+        // a block is sent once its presentation time is within
+        // the transfer delay
+        if (diffTicks(ts, cycle_ticks) > (int64_t)getTransferDelay()) {
+            packet->fdf = IEC61883_FDF_NODATA;
+            packet->syt = 0xFFFF;
+            *length = 8;
+            return eCRV_OK;
+        }
+
+        packet->fdf = m_fdf;
+        packet->syt = CondSwapToBus16(TICKS_TO_SYT(ts));
+        quadlet_t *events = (quadlet_t *)(data + 8);
+        for (unsigned int f = 0; f < syt_interval; f++) {
+            events[f * dimension] = CondSwapToBus32(0x40000000 | (m_frame & 0x00FFFFFF));
+            for (unsigned int c = 1; c < dimension; c++) {
+                events[f * dimension + c] = CondSwapToBus32(0x40000000);
+            }
+            m_frame++;
+        }
+        *length = 8 + syt_interval * dimension * sizeof(quadlet_t);
+        m_dbc += syt_interval;
+        m_next_ts += syt_interval * m_ticks_per_frame;
+        return eCRV_OK;
+    };
+
+    virtual enum eChildReturnValue generateEmptyPacketData(
+            unsigned char *data, unsigned int *length)
+        {return eCRV_OK;};
+
+private:
+    double          m_ticks_per_frame;
+    double          m_next_ts;
+    unsigned int    m_dbc;
+    unsigned int    m_frame;
+    int             m_fdf;
+};
+
+/**
+ * Gets the format of the AMDTP stream on a channel from the first data
+ * packet in a capture.
+ */
+static bool
+probeCapture(const char *filename, unsigned int channel,
+             long int *dimension, long int *rate)
+{
+    IsoCaptureReader reader(filename);
+    if (!reader.open()) {
+        return false;
+    }
+    const struct IsoCaptureRecord *rec;
+    const unsigned char *data;
+    while (reader.next(&rec, &data)) {
+        struct iec61883_packet *packet = (struct iec61883_packet *)data;
+        if (rec->channel != channel || rec->length <= 8
+            || packet->fmt != IEC61883_FMT_AMDTP || packet->dbs == 0
+            || packet->syt == 0xFFFF) {
+            continue;
+        }
+        *dimension = packet->dbs;
+        switch (packet->fdf) {
+            case IEC61883_FDF_SFC_32KHZ:   *rate = 32000; break;
+            case IEC61883_FDF_SFC_44K1HZ:  *rate = 44100; break;
+            case IEC61883_FDF_SFC_88K2HZ:  *rate = 88200; break;
+            case IEC61883_FDF_SFC_96KHZ:   *rate = 96000; break;
+            case IEC61883_FDF_SFC_176K4HZ: *rate = 176400; break;
+            case IEC61883_FDF_SFC_192KHZ:  *rate = 192000; break;
+            default:                       *rate = 48000; break;
+        }
+        return true;
+    }
+    fprintf( stderr, "No AMDTP data on channel %u in %s\n", channel, filename );
+    return false;
+}
+
+/**
+ * The meter values of a period of int24 samples, as the
+ * stream processors compute them.
+ */
+static void
+computeMeter(const quadlet_t *samples, unsigned int nframes, float &peak, float &rms)
+{
+    double sum_sq = 0.0;
+    peak = 0.0f;
+    for (unsigned int i = 0; i < nframes; i++) {
+        // sign-extend the 24 bit sample
+        float v = (float)((int32_t)(samples[i] << 8) / 256) / (float)0x7FFFFF;
+        if (fabsf(v) > peak) peak = fabsf(v);
+        sum_sq += v * v;
+    }
+    rms = (float)sqrt(sum_sq / nframes);
+}
+
+static bool
+meterMatches(const struct Util::PortMeterData &m, const quadlet_t *samples, unsigned int nframes)
+{
+    float peak, rms;
+    computeMeter(samples, nframes, peak, rms);
+    if (fabsf(m.peak - peak) > 1e-6f || fabsf(m.rms - rms) > 1e-4f * (rms + 1e-6f)) {
+        printf("%s meter: peak %f, rms %f, expected peak %f, rms %f\n",
+               (m.direction == Util::PortMeters::eD_Capture ? "capture" : "playback"),
+               m.peak, m.rms, peak, rms);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the port meters back the way a meter client would, and checks
+ * them against the samples of the last period.
+ * @return false if a meter doesn't match its port, or the meters
+ *         are not published
+ */
+static bool
+checkMeters(StreamProcessorManager &spm, const std::vector<quadlet_t> &capture,
+            const std::vector<quadlet_t> &playback, unsigned int channels,
+            unsigned int period)
+{
+    Util::PortMeters meters;
+    if (!spm.getPortMeters().isPublished() || !meters.open()) {
+        printf("Port meters not published\n");
+        return false;
+    }
+    struct Util::PortMeterData data[PORT_METERS_MAX_PORTS];
+    int nb_meters = meters.read(data, PORT_METERS_MAX_PORTS, NULL);
+    // the capture ports come first, in port order
+    unsigned int nb_capture = 0, nb_playback = 0;
+    unsigned int nb_wrong = 0;
+    for (int i = 0; i < nb_meters; i++) {
+        if (data[i].direction == Util::PortMeters::eD_Capture) {
+            if (nb_capture < channels
+                && !meterMatches(data[i], &capture[nb_capture * period], period)) {
+                nb_wrong++;
+            }
+            nb_capture++;
+        } else {
+            if (nb_playback < channels
+                && !meterMatches(data[i], &playback[nb_playback * period], period)) {
+                nb_wrong++;
+            }
+            nb_playback++;
+        }
+    }
+    printf("%d ports metered, %u meters wrong, capture peak %f\n",
+           nb_meters, nb_wrong, (nb_meters ? data[0].peak : 0.0f));
+    return nb_capture == channels && nb_playback == channels && nb_wrong == 0;
+}
+
+static bool run = true;
+
+static void
+sighandler(int sig)
+{
+    run = false;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct arguments arguments;
+
+    // Default values.
+    arguments.verbose       = 0;
+    arguments.rate          = 48000;
+    arguments.period        = 256;
+    arguments.nb_buffers    = 3;
+    arguments.channels      = 8;
+    arguments.periods       = 2000;
+    arguments.drift         = 0.0;
+    arguments.jitter        = 0;
+    arguments.drop          = 0;
+    arguments.latency       = 1;
+    arguments.replay        = NULL;
+    arguments.speed         = 1.0;
+    arguments.channel       = 0;
+    arguments.decode        = 0;
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        return -1;
+    }
+    if (arguments.channels < 1 || arguments.period < 1) {
+        fprintf( stderr, "Invalid channel count or period size\n" );
+        return -1;
+    }
+
+    setDebugLevel(arguments.verbose);
+    signal(SIGINT, sighandler);
+
+    if (arguments.replay
+        && !probeCapture(arguments.replay, arguments.channel,
+                         &arguments.channels, &arguments.rate)) {
+        fprintf( stderr, "Could not use %s for replay\n", arguments.replay );
+        return -1;
+    }
+
+    // the bus parameters are picked up from the environment
+    char spec[1024];
+    int len = snprintf(spec, sizeof(spec), "1,drift=%f,jitter=%ld,drop=%ld,latency=%ld",
+                       arguments.drift, arguments.jitter, arguments.drop, arguments.latency);
+    if (arguments.replay) {
+        snprintf(spec + len, sizeof(spec) - len, ",replay=%s,speed=%f",
+                 arguments.replay, arguments.speed);
+    }
+    setenv("FFADO_LOOPBACK", spec, 1);
+
+    Ieee1394Service *service = new Ieee1394Service();
+    service->setVerboseLevel(arguments.verbose);
+    if (!service->initialize(0)) {
+        fprintf( stderr, "Could not initialize the simulated bus\n" );
+        delete service;
+        return -1;
+    }
+
+    DeviceManager *devmgr = new DeviceManager();
+    devmgr->setVerboseLevel(arguments.verbose);
+    LoopbackDevice *device = new LoopbackDevice(*devmgr, std::auto_ptr<ConfigRom>(new ConfigRom(*service, 0)));
+    // the emulated device side, kept away from the host's manager
+    DeviceManager *emumgr = new DeviceManager();
+    emumgr->setVerboseLevel(arguments.verbose);
+    LoopbackDevice *emudevice = new LoopbackDevice(*emumgr, std::auto_ptr<ConfigRom>(new ConfigRom(*service, 0)));
+
+    StreamProcessorManager &spm = devmgr->getStreamProcessorManager();
+    spm.setNominalRate(arguments.rate);
+    spm.setPeriodSize(arguments.period);
+    spm.setNbBuffers(arguments.nb_buffers);
+    spm.setAudioDataType(StreamProcessorManager::eADT_Int24);
+    StreamProcessorManager &emuspm = emumgr->getStreamProcessorManager();
+    emuspm.setNominalRate(arguments.rate);
+    emuspm.setPeriodSize(arguments.period);
+    emuspm.setNbBuffers(arguments.nb_buffers);
+
+    unsigned int channels = arguments.channels;
+    unsigned int period = arguments.period;
+    std::vector<quadlet_t> capture(channels * period);
+    std::vector<quadlet_t> playback(channels * period);
+    // a different level on every playback port
+    for (unsigned int i = 0; i < channels; i++) {
+        for (unsigned int f = 0; f < period; f++) {
+            playback[i * period + f] = ((i + 1) << 16) & 0x00FFFFFF;
+        }
+    }
+
+    AmdtpReceiveStreamProcessor *rx = new AmdtpReceiveStreamProcessor(*device, channels);
+    AmdtpTransmitStreamProcessor *tx = new AmdtpTransmitStreamProcessor(*device, channels);
+    EmulatedDeviceSP *emu = NULL;
+    if (!arguments.replay) {
+        emu = new EmulatedDeviceSP(*emudevice, channels, arguments.rate);
+        emu->setChannel(arguments.channel);
+    }
+    rx->setDecodeOnReceive(arguments.decode);
+    for (unsigned int i = 0; i < channels; i++) {
+        Port *p = new AmdtpAudioPort(*rx, "loopback_in", Port::E_Capture,
+                                     i, i, AmdtpPortInfo::E_MBLA);
+        p->setBufferAddress(&capture[i * period]);
+        p->enable();
+        p = new AmdtpAudioPort(*tx, "loopback_out", Port::E_Playback,
+                               i, i, AmdtpPortInfo::E_MBLA);
+        p->setBufferAddress(&playback[i * period]);
+        p->enable();
+    }
+    rx->setChannel(arguments.channel);
+    tx->setChannel(arguments.channel + 1);
+
+    int retval = -1;
+    unsigned int xruns = 0;
+    unsigned int gaps = 0;
+    unsigned int silent = 0;
+    long int periods = 0;
+    bool meters_ok = false;
+    ffado_microsecs_t start_time = 0;
+    bool have_frame = false;
+    uint32_t expected = 0;
+    bool have_time = false;
+    uint64_t last_time = 0;
+    double max_time_error = 0.0;
+    SimulatedBus *bus = service->getSimulatedBus();
+
+    if (!rx->init() || !tx->init() || (emu && (!emu->init() || !emu->prepare()))) {
+        fprintf( stderr, "Could not initialize the stream processors\n" );
+        goto cleanup;
+    }
+    spm.setSyncSource(rx);
+    if (!spm.prepare()) {
+        fprintf( stderr, "Could not prepare streaming\n" );
+        goto cleanup;
+    }
+    // the device has to be sending before the host starts listening
+    if (emu && !emu->startDryRunning(-1)) {
+        fprintf( stderr, "Could not start the emulated device\n" );
+        goto cleanup;
+    }
+    start_time = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    if (!spm.start()) {
+        fprintf( stderr, "Could not start streaming\n" );
+        if (emu) emu->stopDryRunning(-1);
+        goto cleanup;
+    }
+    start_time = Util::SystemTimeSource::getCurrentTimeAsUsecs() - start_time;
+
+    printf("Streaming %u channels at %ld Hz, period %u (drift %f ppm, jitter %ld usecs, drop %ld ppm)\n",
+           channels, arguments.rate, period, arguments.drift, arguments.jitter, arguments.drop);
+    printf("Decoding the samples on %s\n", (arguments.decode ? "receive" : "transfer"));
+    printf("Started in %.1f ms\n", start_time / 1000.0);
+    if (arguments.replay) {
+        printf("Replaying channel %ld of %s at %f times real time\n",
+               arguments.channel, arguments.replay, arguments.speed);
+    }
+
+    while (run && periods < arguments.periods) {
+        // stop while the stream still runs
+        if (arguments.replay && bus->getReplayCyclesLeft() < CYCLES_PER_SECOND) {
+            break;
+        }
+        if (!spm.waitForPeriod()) {
+            if (spm.shutdownNeeded()) {
+                fprintf( stderr, "Shutdown requested\n" );
+                break;
+            }
+            xruns++;
+            have_frame = false;
+            have_time = false;
+            if (!spm.handleXrun()) {
+                fprintf( stderr, "Could not handle xrun\n" );
+                break;
+            }
+            continue;
+        }
+        if (!spm.transfer()) {
+            fprintf( stderr, "Transfer failed\n" );
+            break;
+        }
+        periods++;
+        if (arguments.replay) {
+            continue;
+        }
+
+        // the periods have to follow each other without a jump in time,
+        // also across bridged drops
+        uint64_t now = spm.getTimeOfLastTransfer();
+        if (have_time) {
+            double error = fabs(diffTicks(now, last_time)
+                                - period * (double)TICKS_PER_SECOND / arguments.rate);
+            if (error > max_time_error) {
+                max_time_error = error;
+            }
+        }
+        last_time = now;
+        have_time = true;
+
+        // the frame counter sent by the device has to come back in order.
+        // Packets lost on the bus are bridged with silence, exactly as
+        // many frames as the device sent in them.
+        for (unsigned int i = 0; i < period; i++) {
+            uint32_t frame = capture[i] & 0x00FFFFFF;
+            if (have_frame && frame == 0 && expected != 0) {
+                silent++;
+                expected = (expected + 1) & 0x00FFFFFF;
+                continue;
+            }
+            if (have_frame && frame != expected) {
+                gaps++;
+            }
+            expected = (frame + 1) & 0x00FFFFFF;
+            have_frame = true;
+        }
+    }
+
+    spm.stop();
+    if (emu) emu->stopDryRunning(-1);
+
+    printf("%ld periods, %u xruns, %u gaps in the captured frames\n", periods, xruns, gaps);
+    printf("%u drops bridged with %u silent frames, period time error at most %.1f ticks\n",
+           rx->getSoftRecoveryCount(), silent, max_time_error);
+    spm.getLatencyStatistics().setVerboseLevel(DEBUG_LEVEL_NORMAL);
+    spm.getLatencyStatistics().show();
+    service->show();
+
+    // the meters have to show the last period: the frame counter on the
+    // first capture port, and the level of every playback port
+    meters_ok = checkMeters(spm, capture, playback, channels, period);
+
+    // drops are expected to cause xruns when they can't be bridged, but
+    // the captured frames can't have gaps in any case. A replay
+    // reproduces the xruns of the capture, they don't count.
+    if (arguments.replay) {
+        retval = (periods > 0 && meters_ok ? 0 : -1);
+    } else {
+        retval = ((periods == arguments.periods || !run)
+                  && gaps == 0
+                  && (arguments.drop || xruns == 0)
+                  && max_time_error < MAX_PERIOD_TIME_ERROR_FRAMES * TICKS_PER_SECOND / arguments.rate
+                  && (meters_ok || periods == 0)) ? 0 : -1;
+    }
+
+cleanup:
+    // a stream that didn't start or stop properly still has its handler
+    service->getIsoHandlerManager().stopHandlers();
+    delete emu;
+    delete tx;
+    delete rx;
+    delete emudevice;
+    delete emumgr;
+    delete device;
+    delete devmgr;
+    delete service;
+    return retval;
+}
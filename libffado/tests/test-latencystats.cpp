@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Tests the bucketing and the reset of the latency histograms.
+ */
+
+#include <argp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "debugmodule/debugmodule.h"
+
+#include "libutil/LatencyStatistics.h"
+
+using namespace Util;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+// Program documentation.
+static char doc[] = "FFADO -- latency histogram test\n\n"
+                    "Checks the bucketing and the reset of the\n"
+                    "latency statistics histograms.\n";
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",   'v', "level",     0, "Verbose level (0)" },
+    { 0 }
+};
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+
+    errno = 0;
+    switch (key) {
+        case 'v':
+            arguments->verbose = strtol( arg, &tail, 0 );
+            if ( errno || *tail ) {
+                fprintf( stderr, "Could not parse '%s' argument\n", arg );
+                return ARGP_ERR_UNKNOWN;
+            }
+            return 0;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+
+static int nb_failed = 0;
+
+#define CHECK( cond, what ) \
+    do { \
+        if ( cond ) { \
+            printf( "  ok:     %s\n", what ); \
+        } else { \
+            printf( "  FAILED: %s\n", what ); \
+            nb_failed++; \
+        } \
+    } while ( 0 )
+
+/**
+ * checks that every value lands in a bucket that covers it, and that the
+ * buckets are contiguous and not wider than 1/16 of their values
+ */
+static bool
+checkBuckets( uint32_t first, uint32_t last, uint32_t step )
+{
+    for ( uint64_t v = first; v <= last; v += step ) {
+        uint32_t value = (uint32_t)v;
+        unsigned int idx = LatencyHistogram::getBucketIndex( value );
+        if ( idx >= LATENCY_HISTOGRAM_BUCKETS ) {
+            printf( "  value %u: bucket %u out of range\n", value, idx );
+            return false;
+        }
+        uint32_t upper = LatencyHistogram::getBucketUpperBound( idx );
+        uint32_t lower = ( idx ? LatencyHistogram::getBucketUpperBound( idx - 1 ) + 1 : 0 );
+        if ( value < lower || value > upper ) {
+            printf( "  value %u: bucket %u covers %u..%u\n", value, idx, lower, upper );
+            return false;
+        }
+        if ( (uint64_t)( upper - lower ) * LATENCY_HISTOGRAM_SUB_BUCKETS > lower ) {
+            printf( "  value %u: bucket %u is %u wide\n", value, idx, upper - lower + 1 );
+            return false;
+        }
+    }
+    return true;
+}
+
+int
+main( int argc, char **argv )
+{
+    struct arguments arguments;
+
+    // Default values.
+    arguments.verbose = 0;
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        return -1;
+    }
+
+    setDebugLevel( arguments.verbose );
+
+    printf( "Buckets\n" );
+    bool exact = true;
+    for ( uint32_t v = 0; v < LATENCY_HISTOGRAM_SUB_BUCKETS; v++ ) {
+        exact &= ( LatencyHistogram::getBucketIndex( v ) == v
+                   && LatencyHistogram::getBucketUpperBound( v ) == v );
+    }
+    CHECK( exact, "small values have a bucket each" );
+    CHECK( checkBuckets( 0, 1 << 16, 1 ), "values up to 2^16 are bucketed" );
+    CHECK( checkBuckets( 1 << 16, 0xFFFFFFFF, 65521 ), "larger values are bucketed" );
+    CHECK( LatencyHistogram::getBucketIndex( 0xFFFFFFFF ) == LATENCY_HISTOGRAM_BUCKETS - 1
+           && LatencyHistogram::getBucketUpperBound( LATENCY_HISTOGRAM_BUCKETS - 1 ) == 0xFFFFFFFF,
+           "the last bucket ends at 2^32-1" );
+
+    printf( "Empty histogram\n" );
+    LatencyHistogram h;
+    CHECK( h.getCount() == 0 && h.getMin() == 0 && h.getMax() == 0
+           && h.getMean() == 0 && h.getPercentile( 0.5 ) == 0,
+           "everything is zero" );
+
+    printf( "Marked values\n" );
+    // 90 values of 10, 9 of 1000 and one of 100000
+    for ( int i = 0; i < 90; i++ ) h.mark( 10 );
+    for ( int i = 0; i < 9; i++ ) h.mark( 1000 );
+    h.mark( 100000 );
+    CHECK( h.getCount() == 100, "count" );
+    CHECK( h.getMin() == 10 && h.getMax() == 100000, "min and max" );
+    CHECK( h.getMean() == ( 90 * 10 + 9 * 1000 + 100000 ) / 100, "mean" );
+    CHECK( h.getPercentile( 0.5 ) == 10 && h.getPercentile( 0.9 ) == 10,
+           "p50 and p90 in the exact range" );
+    uint32_t p99 = h.getPercentile( 0.99 );
+    CHECK( p99 >= 1000 && p99 < 1000 + 1000 / LATENCY_HISTOGRAM_SUB_BUCKETS,
+           "p99 is the upper bound of the bucket of 1000" );
+    CHECK( h.getPercentile( 1.0 ) == 100000, "p100 is clamped to the max" );
+
+    printf( "Reset\n" );
+    h.reset();
+    CHECK( h.getCount() == 0 && h.getMin() == 0 && h.getMax() == 0
+           && h.getMean() == 0 && h.getPercentile( 0.99 ) == 0,
+           "everything is zero" );
+    h.mark( 5 );
+    CHECK( h.getCount() == 1 && h.getMin() == 5 && h.getMax() == 5
+           && h.getPercentile( 0.99 ) == 5,
+           "no old buckets left over" );
+
+    printf( "Statistics\n" );
+    LatencyStatistics s;
+    s.mark( LatencyStatistics::eS_DecodeTime, 1234 );
+    s.mark( LatencyStatistics::eS_BufferFill, 256 );
+    CHECK( s.get( LatencyStatistics::eS_DecodeTime ).getCount() == 1
+           && s.get( LatencyStatistics::eS_BufferFill ).getCount() == 1
+           && s.get( LatencyStatistics::eS_DllError ).getCount() == 0,
+           "each statistic has its own histogram" );
+    s.reset();
+    bool empty = true;
+    for ( int i = 0; i < LatencyStatistics::eS_Count; i++ ) {
+        empty &= ( s.get( (enum LatencyStatistics::eStatistic)i ).getCount() == 0 );
+    }
+    CHECK( empty, "reset clears all histograms" );
+
+    if ( nb_failed ) {
+        printf( "%d checks FAILED\n", nb_failed );
+        return -1;
+    }
+    printf( "All checks passed\n" );
+    return 0;
+}
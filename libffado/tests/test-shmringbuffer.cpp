@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2015 by the FFADO developers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "debugmodule/debugmodule.h"
+
+#include "libutil/ShmRingBuffer.h"
+
+#include <argp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace Util;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#define MAX_ARGS 2
+
+int run=1;
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+////////////////////////////////////////////////
+// arg parsing
+////////////////////////////////////////////////
+const char *argp_program_version = "test-shmringbuffer 0.1";
+const char *argp_program_bug_address = "<ffado-devel@lists.sf.net>";
+static char doc[] = "test-shmringbuffer -- test program to test the shared memory ringbuffer class.\n\n"
+                    "DIRECTION 0 is outward (master writes), 1 is inward (master reads).\n"
+                    "Start the master first, then one or more slaves with --slave.";
+static char args_doc[] = "DIRECTION";
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Produce verbose output" },
+    {"slave",    's', 0,          0,  "Attach to the buffer instead of creating it" },
+   { 0 }
+};
+
+struct arguments
+{
+    arguments()
+        : nargs ( 0 )
+        , verbose( false )
+        , slave( false )
+        {
+            args[0] = 0;
+        }
+
+    char* args[MAX_ARGS];
+    int   nargs;
+    long int verbose;
+    bool  slave;
+} arguments;
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+
+    char* tail;
+    errno = 0;
+    switch (key) {
+    case 'v':
+        if (arg) {
+            arguments->verbose = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'verbose' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 's':
+        arguments->slave = true;
+        break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num >= MAX_ARGS) {
+            // Too many arguments.
+            argp_usage (state);
+        }
+        arguments->args[state->arg_num] = arg;
+        arguments->nargs++;
+        break;
+    case ARGP_KEY_END:
+        if(arguments->nargs <= 0) {
+            printMessage("not enough arguments\n");
+            return -1;
+        }
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+// main
+//////////////////////////
+int
+main(int argc, char **argv)
+{
+    signal (SIGINT, sighandler);
+    signal (SIGPIPE, sighandler);
+
+    // arg parsing
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        exit(-1);
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    errno = 0;
+    char* tail;
+    long int direction = strtol( arguments.args[0], &tail, 0 );
+    if ( errno ) {
+        fprintf( stderr,  "Could not parse direction argument\n" );
+        exit(-1);
+    }
+
+    printMessage("Testing shared memory ringbuffer direction %ld as %s\n",
+                 direction, (arguments.slave ? "slave" : "master"));
+
+    #define TEST_SAMPLERATE 44100
+    #define BUFF_SIZE 64
+    #define NB_BUFFERS 4
+    ShmRingBuffer* b = new ShmRingBuffer("testshmbuff",
+                              (arguments.slave ? ShmRingBuffer::eBT_Slave : ShmRingBuffer::eBT_Master),
+                              (direction == 0 ? ShmRingBuffer::eD_Outward : ShmRingBuffer::eD_Inward),
+                              ShmRingBuffer::eB_Blocking,
+                              NB_BUFFERS, BUFF_SIZE);
+    b->setVerboseLevel(arguments.verbose);
+
+    int cnt = 0;
+    int expected = -1;
+    long int time_to_sleep = 1000*1000*BUFF_SIZE/TEST_SAMPLERATE;
+
+    if(!b->init()) {
+        debugError("Could not init buffer\n");
+        goto out_err;
+    }
+
+    run=1;
+    while(run) {
+        if(b->isProducer()) {
+            char *block;
+            ShmRingBuffer::eResult res = b->requestBlockForWrite((void **)&block);
+            if(res == ShmRingBuffer::eR_Timeout) {
+                printMessage(" Timeout on %d...\n", cnt);
+                continue;
+            }
+            if(res != ShmRingBuffer::eR_OK) {
+                debugError("Could not get block to write\n");
+                goto out_err;
+            }
+            snprintf(block, BUFF_SIZE, "test %d", cnt);
+            if(cnt%1000==0) {
+                printMessage("writing '%s'...\n", block);
+            }
+            if(b->releaseBlockForWrite() != ShmRingBuffer::eR_OK) {
+                debugError("Could not release written block\n");
+                goto out_err;
+            }
+            cnt++;
+            usleep(time_to_sleep);
+        } else {
+            char *block;
+            ShmRingBuffer::eResult res = b->requestBlockForRead((void **)&block);
+            if(res == ShmRingBuffer::eR_Timeout) {
+                printMessage(" Timeout on %d...\n", cnt);
+                continue;
+            }
+            if(res != ShmRingBuffer::eR_OK) {
+                debugError("Could not get block to read\n");
+                goto out_err;
+            }
+            // the producer numbers the blocks, check that none went missing.
+            // the block belongs to the producer, terminate a copy.
+            char msg[BUFF_SIZE];
+            memcpy(msg, block, BUFF_SIZE);
+            msg[BUFF_SIZE-1] = 0;
+            int seen = -1;
+            if(sscanf(msg, "test %d", &seen) != 1
+               || (expected >= 0 && seen != expected)) {
+                debugError("Unexpected block '%s', expected %d\n", msg, expected);
+            }
+            expected = seen + 1;
+            if(cnt%1000==0) {
+                printMessage(" read: '%s'\n", msg);
+            }
+            if(b->releaseBlockForRead() != ShmRingBuffer::eR_OK) {
+                debugError("Could not release read block\n");
+                goto out_err;
+            }
+            cnt++;
+        }
+    }
+
+    delete b;
+    return 0;
+
+out_err:
+    delete b;
+    return -1;
+}